@@ -0,0 +1,370 @@
+#include "acoustIdClient.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkRequest>
+#include <QUrlQuery>
+
+const char *AcoustIdClient::clientKey = "GngcI3Divj"; // api key ****(limitation note in report!!!!!)**
+const char *AcoustIdClient::userAgent = "lavender(university project) (n1076024@my.ntu.ac.uk)";
+
+// --- reply --- //
+
+AcoustIdReply::AcoustIdReply(const QByteArray &fingerprint, QObject *parent) : QObject(parent), requestFingerprint(fingerprint)
+{
+}
+
+void AcoustIdReply::complete(QNetworkReply::NetworkError error, const QString &errorString, const QJsonArray &results, bool cached)
+{
+    networkError = error;
+    networkErrorString = errorString;
+    resultList = results;
+    fromCache = cached;
+
+    emit finished();
+}
+
+QNetworkReply::NetworkError AcoustIdReply::error() const
+{
+    return networkError;
+}
+
+QString AcoustIdReply::errorString() const
+{
+    return networkErrorString;
+}
+
+QJsonArray AcoustIdReply::results() const
+{
+    return resultList;
+}
+
+bool AcoustIdReply::isFromCache() const
+{
+    return fromCache;
+}
+
+QByteArray AcoustIdReply::fingerprint() const
+{
+    return requestFingerprint;
+}
+
+// --- client --- //
+
+AcoustIdClient &AcoustIdClient::instance()
+{
+    static AcoustIdClient client;
+    return client;
+}
+
+AcoustIdClient::AcoustIdClient() : network(new QNetworkAccessManager(this)), url("https://api.acoustid.org/v2/lookup"), maxBatch(20),
+                                   rate(3.0), tokens(1.0), refilledAt(0), cacheTtlMs(30LL * 24 * 60 * 60 * 1000), sent(0), sentLookups(0)
+{
+    // fingerprints dont change and neither does what acoustid knows about them, so this can live a while
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/acoustid";
+
+    dispatchTimer.setSingleShot(true);
+    connect(&dispatchTimer, &QTimer::timeout, this, &AcoustIdClient::dispatch);
+
+    clock.start();
+}
+
+void AcoustIdClient::setServerUrl(const QUrl &serverUrl)
+{
+    url = serverUrl;
+}
+
+QUrl AcoustIdClient::serverUrl() const
+{
+    return url;
+}
+
+// https://acoustid.org/webservice, no more than 3 requests a second
+void AcoustIdClient::setRateLimit(double requestsPerSecond)
+{
+    rate = qMax(0.01, requestsPerSecond);
+    tokens = 1.0;
+    refilledAt = clock.elapsed();
+}
+
+void AcoustIdClient::setBatchSize(int fingerprints)
+{
+    maxBatch = qMax(1, fingerprints);
+}
+
+int AcoustIdClient::batchSize() const
+{
+    return maxBatch;
+}
+
+void AcoustIdClient::setCacheDirectory(const QString &dir)
+{
+    cacheDir = dir;
+}
+
+QString AcoustIdClient::cacheDirectory() const
+{
+    return cacheDir;
+}
+
+void AcoustIdClient::setCacheTtl(qint64 seconds)
+{
+    cacheTtlMs = seconds * 1000;
+}
+
+int AcoustIdClient::requestsSent() const
+{
+    return sent;
+}
+
+int AcoustIdClient::lookupsSent() const
+{
+    return sentLookups;
+}
+
+AcoustIdReply *AcoustIdClient::lookup(const QByteArray &fingerprint, int duration)
+{
+    const QString key = cacheKey(fingerprint, duration);
+    AcoustIdReply *reply = new AcoustIdReply(fingerprint, this);
+
+    // --- disk cache, still answered on the next loop pass so callers can connect first --- //
+    QJsonArray cached;
+    if (readCache(key, &cached))
+    {
+        QPointer<AcoustIdReply> waiter(reply);
+        QMetaObject::invokeMethod(this, [waiter, cached]()
+        {
+            if (waiter)
+            {
+                waiter->complete(QNetworkReply::NoError, QString(), cached, true);
+            }
+        }, Qt::QueuedConnection);
+        return reply;
+    }
+
+    // --- same fingerprint already queued or on the wire, just listen in --- //
+    auto existing = inFlight.find(key);
+    if (existing != inFlight.end())
+    {
+        existing->waiters.append(reply);
+        return reply;
+    }
+
+    Pending entry;
+    entry.fingerprint = fingerprint;
+    entry.duration = duration;
+    entry.waiters.append(reply);
+    inFlight.insert(key, entry);
+    queue.append(key);
+
+    // next loop pass, so a caller looking up a whole album in one go fills batches instead of sending the first alone
+    if (!dispatchTimer.isActive())
+    {
+        dispatchTimer.start(0);
+    }
+    return reply;
+}
+
+// sends as many batches as the bucket allows right now and rearms the timer for the rest
+void AcoustIdClient::dispatch()
+{
+    while (!queue.isEmpty())
+    {
+        qint64 wait = takeToken();
+        if (wait > 0)
+        {
+            dispatchTimer.start(int(wait)); // whatever queues up meanwhile joins the next batch
+            return;
+        }
+
+        QList<QString> batch = queue.mid(0, maxBatch);
+        queue.remove(0, batch.size());
+        send(batch);
+    }
+}
+
+qint64 AcoustIdClient::takeToken()
+{
+    qint64 now = clock.elapsed();
+    tokens = qMin(1.0, tokens + (now - refilledAt) * rate / 1000.0);
+    refilledAt = now;
+
+    if (tokens >= 1.0)
+    {
+        tokens -= 1.0;
+        return 0;
+    }
+
+    return qMax<qint64>(1, qint64((1.0 - tokens) * 1000.0 / rate) + 1);
+}
+
+void AcoustIdClient::send(const QList<QString> &keys)
+{
+    // --- form body, fingerprint.N / duration.N per lookup --- //
+    QUrlQuery form;
+    form.addQueryItem("client", clientKey);
+    form.addQueryItem("meta", "recordings+releasegroups+compress");
+    form.addQueryItem("format", "json");
+    form.addQueryItem("threshold", "0.35"); // results under this score are just noise, no point sending them back
+
+    for (int i = 0; i < keys.size(); i++)
+    {
+        const Pending &entry = inFlight[keys[i]];
+        form.addQueryItem(QString("duration.%1").arg(i), QString::number(entry.duration > 0 ? entry.duration : 30));
+        form.addQueryItem(QString("fingerprint.%1").arg(i), QString::fromUtf8(entry.fingerprint));
+    }
+
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    request.setHeader(QNetworkRequest::UserAgentHeader, userAgent);
+
+    sent++;
+    sentLookups += keys.size();
+    qDebug() << "acoustid lookup of" << keys.size() << "fingerprints";
+
+    QNetworkReply *reply = network->post(request, form.toString(QUrl::FullyEncoded).toUtf8());
+    connect(reply, &QNetworkReply::finished, this, [this, keys, reply]()
+    {
+        onFinished(keys, reply);
+    });
+}
+
+void AcoustIdClient::onFinished(const QList<QString> &keys, QNetworkReply *reply)
+{
+    reply->deleteLater();
+
+    QByteArray body = reply->readAll();
+    QJsonObject response = QJsonDocument::fromJson(body).object();
+
+    // --- whole request failed, every fingerprint in it gets the same error --- //
+    if (reply->error() != QNetworkReply::NoError || response["status"].toString() != "ok")
+    {
+        QString message = response["error"].toObject()["message"].toString(); // incase api returned json instance with errors
+        if (message.isEmpty())
+        {
+            message = reply->error() != QNetworkReply::NoError ? reply->errorString() : "api error: " + response["status"].toString();
+        }
+
+        qDebug() << "acoustid lookup failed:" << message;
+        QNetworkReply::NetworkError error = reply->error() != QNetworkReply::NoError ? reply->error() : QNetworkReply::UnknownServerError;
+        for (const QString &key : keys)
+        {
+            finish(key, error, message, QJsonArray());
+        }
+        return;
+    }
+
+    // --- batched answers come back as fingerprints[] tagged with the index they were sent under --- //
+    QHash<int, QJsonArray> resultsByIndex;
+    const QJsonArray fingerprints = response["fingerprints"].toArray();
+    for (const QJsonValue &value : fingerprints)
+    {
+        QJsonObject entry = value.toObject();
+        resultsByIndex.insert(entry["index"].toVariant().toInt(), entry["results"].toArray());
+    }
+    if (fingerprints.isEmpty() && keys.size() == 1)
+    {
+        resultsByIndex.insert(0, response["results"].toArray()); // single lookup shape
+    }
+
+    for (int i = 0; i < keys.size(); i++)
+    {
+        QJsonArray results = resultsByIndex.value(i);
+        writeCache(keys[i], results); // no results is an answer too, no point asking again tomorrow
+        finish(keys[i], QNetworkReply::NoError, QString(), results);
+    }
+}
+
+void AcoustIdClient::finish(const QString &key, QNetworkReply::NetworkError error, const QString &errorString, const QJsonArray &results)
+{
+    Pending entry = inFlight.take(key);
+
+    for (const QPointer<AcoustIdReply> &waiter : entry.waiters)
+    {
+        if (waiter) // caller may have gone away while it waited
+        {
+            waiter->complete(error, errorString, results, false);
+        }
+    }
+}
+
+// --- disk cache: qint64 stored at (ms since epoch) then the results array as compact json --- //
+
+QString AcoustIdClient::cacheKey(const QByteArray &fingerprint, int duration)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(fingerprint);
+    hash.addData(QByteArray::number(duration)); // acoustid scores on it, a different length can match differently
+    return hash.result().toHex();
+}
+
+QString AcoustIdClient::cachePath(const QString &key) const
+{
+    return QString("%1/%2/%3").arg(cacheDir, key.left(2), key);
+}
+
+bool AcoustIdClient::readCache(const QString &key, QJsonArray *results) const
+{
+    if (cacheTtlMs <= 0)
+    {
+        return false;
+    }
+
+    QFile file(cachePath(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    qint64 storedAt = 0;
+    QByteArray json;
+    in >> storedAt >> json;
+
+    if (in.status() != QDataStream::Ok || QDateTime::currentMSecsSinceEpoch() - storedAt > cacheTtlMs)
+    {
+        return false; // stale or half written, the next good response replaces it
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(json);
+    if (!doc.isArray())
+    {
+        return false;
+    }
+    *results = doc.array();
+    return true;
+}
+
+void AcoustIdClient::writeCache(const QString &key, const QJsonArray &results) const
+{
+    if (cacheTtlMs <= 0)
+    {
+        return;
+    }
+
+    QString path = cachePath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "acoustid cache not writable:" << path;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << QDateTime::currentMSecsSinceEpoch() << QJsonDocument(results).toJson(QJsonDocument::Compact);
+
+    if (!file.commit())
+    {
+        qWarning() << "acoustid cache write failed:" << path;
+    }
+}
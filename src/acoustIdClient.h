@@ -0,0 +1,109 @@
+#ifndef ACOUSTIDCLIENT_H
+#define ACOUSTIDCLIENT_H
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QPointer>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QUrl>
+
+// one fingerprint's answer from AcoustIdClient::lookup, delete it with deleteLater once finished
+class AcoustIdReply : public QObject
+{
+    Q_OBJECT
+
+    public:
+        QNetworkReply::NetworkError error() const;
+        QString errorString() const; // acoustids own message when it sent one
+        QJsonArray results() const;  // the "results" array a single lookup would have had, can be empty
+        bool isFromCache() const;
+        QByteArray fingerprint() const;
+
+    signals:
+        void finished(); // always queued, never from inside lookup()
+
+    private:
+        friend class AcoustIdClient;
+        AcoustIdReply(const QByteArray &fingerprint, QObject *parent);
+        void complete(QNetworkReply::NetworkError error, const QString &errorString, const QJsonArray &results, bool fromCache);
+
+        QByteArray requestFingerprint;
+        QNetworkReply::NetworkError networkError = QNetworkReply::NoError;
+        QString networkErrorString;
+        QJsonArray resultList;
+        bool fromCache = false;
+    };
+
+// every acoustid lookup goes through here. lookups queue up and go out as one POST carrying up to batchSize
+// fingerprints (fingerprint.N / duration.N), requests are held to acoustids 3 a second by a timer driven
+// token bucket, the same fingerprint asked for twice rides on one entry, and answers are kept on disk
+// under a hash of the fingerprint so a song is only ever looked up once
+class AcoustIdClient : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static AcoustIdClient &instance();
+
+        AcoustIdReply *lookup(const QByteArray &fingerprint, int duration);
+
+        void setServerUrl(const QUrl &url); // tests point this at a local server
+        QUrl serverUrl() const;
+        void setRateLimit(double requestsPerSecond);
+        void setBatchSize(int fingerprints);
+        int batchSize() const;
+        void setCacheDirectory(const QString &dir);
+        QString cacheDirectory() const;
+        void setCacheTtl(qint64 seconds); // 0 turns the disk cache off
+
+        int requestsSent() const;  // POSTs over the wire
+        int lookupsSent() const;   // fingerprints inside them
+
+        static const char *clientKey;
+        static const char *userAgent;
+
+    private:
+        AcoustIdClient();
+
+        struct Pending
+        {
+            QByteArray fingerprint;
+            int duration = 0;
+            QList<QPointer<AcoustIdReply>> waiters;
+        };
+
+        void dispatch();
+        void send(const QList<QString> &keys);
+        void onFinished(const QList<QString> &keys, QNetworkReply *reply);
+        void finish(const QString &key, QNetworkReply::NetworkError error, const QString &errorString, const QJsonArray &results);
+        qint64 takeToken(); // 0 if one was taken, otherwise ms until there is one
+
+        static QString cacheKey(const QByteArray &fingerprint, int duration);
+        QString cachePath(const QString &key) const;
+        bool readCache(const QString &key, QJsonArray *results) const;
+        void writeCache(const QString &key, const QJsonArray &results) const;
+
+        QNetworkAccessManager *network;
+        QHash<QString, Pending> inFlight; // keyed on the fingerprint hash, queued or on the wire
+        QList<QString> queue;             // keys not sent yet, oldest first
+
+        QUrl url;
+        int maxBatch;
+        double rate;         // tokens per second, burst of one
+        double tokens;
+        qint64 refilledAt;   // ms on clock
+
+        QTimer dispatchTimer;
+        QElapsedTimer clock;
+
+        QString cacheDir;
+        qint64 cacheTtlMs;
+        int sent;
+        int sentLookups;
+    };
+#endif // ACOUSTIDCLIENT_H
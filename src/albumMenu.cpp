@@ -4,6 +4,8 @@
 #include <QDebug>
 #include <QListWidgetItem>
 #include <QPixmap>
+#include <QMenu>
+#include "thumbnailCache.h"
 
 AlbumMenu::AlbumMenu(QWidget *parent) : QWidget(parent) 
 {
@@ -16,10 +18,23 @@ AlbumMenu::AlbumMenu(QWidget *parent) : QWidget(parent)
     albumNameLabel = new QLabel(this);
     layout->addWidget(albumNameLabel);
 
+    playAlbumButton = new QPushButton("play album", this);
+    layout->addWidget(playAlbumButton, 0, Qt::AlignLeft);
+
     songListWidget = new QListWidget(this);
+    songListWidget->setContextMenuPolicy(Qt::CustomContextMenu);
     layout->addWidget(songListWidget);
 
     connect(songListWidget, &QListWidget::itemClicked, this, &AlbumMenu::onSongClicked);
+    connect(songListWidget, &QListWidget::customContextMenuRequested, this, &AlbumMenu::showSongContextMenu);
+    connect(playAlbumButton, &QPushButton::clicked, this, [this]()
+    {
+        QStringList paths = songPaths();
+        if (!paths.isEmpty())
+        {
+            emit playAlbum(paths, 0);
+        }
+    });
 }
 
 void AlbumMenu::loadAlbum(const QString &albumName, const QString &albumPath)
@@ -28,29 +43,16 @@ void AlbumMenu::loadAlbum(const QString &albumName, const QString &albumPath)
     songListWidget->clear();
 
     //get album art 
-    QStringList albumArtFiles = {"Folder.jpg", "Front.jpg", "cover.jpg", "cover.png"}; // possible file names
-
-    QPixmap albumArt;
-    bool albumArtFound = false; //flag to prompt use of placeholder
-
-    foreach (const QString &fileName, albumArtFiles)
-    {
-        QString albumArtPath = albumPath + "/" + fileName;
-        albumArt.load(albumArtPath);
-        if (!albumArt.isNull())
-        {
-            albumArtFound = true;
-            break;
-        }
-    }
+    QImage albumArt = ThumbnailCache::instance().thumbnail(albumPath, ThumbnailCache::Album);
 
-    if (!albumArtFound)
+    if (albumArt.isNull())
     {
         qDebug() << "placeholder used: " << albumName;
         albumArt.load(":/resources/placeholder.jpeg"); // placeholder incase no album art is found
+        albumArt = albumArt.scaled(200, 200, Qt::KeepAspectRatio); // scaling
     }
 
-    albumArtLabel->setPixmap(albumArt.scaled(200, 200, Qt::KeepAspectRatio)); // scaling
+    albumArtLabel->setPixmap(QPixmap::fromImage(albumArt));
 
     QDir dir(albumPath);
     QFileInfoList fileList = dir.entryInfoList(QStringList() << "*.mp3" << "*.flac" << "*.wav", QDir::Files);
@@ -68,4 +70,45 @@ void AlbumMenu::onSongClicked(QListWidgetItem *item) //prompt to switch to songd
 {
     QString songPath = item->data(Qt::UserRole).toString();
     emit songSelected(songPath);
-}
\ No newline at end of file
+}
+
+QStringList AlbumMenu::songPaths() const
+{
+    QStringList paths;
+    for (int i = 0; i < songListWidget->count(); i++)
+    {
+        paths.append(songListWidget->item(i)->data(Qt::UserRole).toString());
+    }
+    return paths;
+}
+
+// right click on a song: play the album from it, or push it into the queue
+void AlbumMenu::showSongContextMenu(const QPoint &pos)
+{
+    QListWidgetItem *item = songListWidget->itemAt(pos);
+    if (!item)
+    {
+        return;
+    }
+
+    QString songPath = item->data(Qt::UserRole).toString();
+
+    QMenu menu(this);
+    QAction *playFromHere = menu.addAction("play album from here");
+    QAction *playNextAction = menu.addAction("play next");
+    QAction *addAction = menu.addAction("add to queue");
+
+    QAction *chosen = menu.exec(songListWidget->viewport()->mapToGlobal(pos));
+    if (chosen == playFromHere)
+    {
+        emit playAlbum(songPaths(), songListWidget->row(item));
+    }
+    else if (chosen == playNextAction)
+    {
+        emit playNext(QStringList{songPath});
+    }
+    else if (chosen == addAction)
+    {
+        emit addToQueue(QStringList{songPath});
+    }
+}
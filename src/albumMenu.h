@@ -5,6 +5,7 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QListWidget>
+#include <QPushButton>
 
 class AlbumMenu : public QWidget 
 {
@@ -18,14 +19,23 @@ public:
 signals:
     void songSelected(const QString &songPath);
 
+    // play queue requests, paths in album order
+    void playAlbum(const QStringList &paths, int startIndex);
+    void playNext(const QStringList &paths);
+    void addToQueue(const QStringList &paths);
+
 private slots:
     void onSongClicked(QListWidgetItem *item);
+    void showSongContextMenu(const QPoint &pos);
 
 private:
     QVBoxLayout *layout;
     QLabel *albumArtLabel;
     QLabel *albumNameLabel;
+    QPushButton *playAlbumButton;
     QListWidget *songListWidget;
+
+    QStringList songPaths() const;
 };
 
 #endif // ALBUMMENU_H
\ No newline at end of file
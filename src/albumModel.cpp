@@ -0,0 +1,174 @@
+#include "albumModel.h"
+#include <QDebug>
+#include "thumbnailCache.h"
+#include <QThread>
+
+AlbumModel::AlbumModel(QObject *parent) : QAbstractListModel(parent), covers(400) // about 36MB of 150px tiles
+{
+    placeholder.load(":/resources/placeholder.jpeg"); //get placeholder image
+    placeholder = placeholder.scaled(coverSize, coverSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    coverPool.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 2)); // leave room for the scanner
+}
+
+AlbumModel::~AlbumModel()
+{
+    coverPool.clear();
+    coverPool.waitForDone();
+}
+
+int AlbumModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : albums.size();
+}
+
+QVariant AlbumModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= albums.size())
+    {
+        return QVariant();
+    }
+
+    const AlbumRecord &album = albums[index.row()];
+
+    switch (role)
+    {
+        case Qt::DisplayRole:
+        case Qt::ToolTipRole: // if user hovers over album, show name
+        case AlbumNameRole:
+            return album.name;
+
+        case AlbumPathRole:
+            return album.path;
+
+        case AlbumIdRole:
+            return album.id;
+
+        case Qt::DecorationRole:
+        {
+            if (QPixmap *cover = covers.object(album.path))
+            {
+                return *cover;
+            }
+
+            requestCover(album.path); // placeholder until the pool gets to it
+            return placeholder;
+        }
+    }
+
+    return QVariant();
+}
+
+void AlbumModel::requestCover(const QString &albumPath) const
+{
+    if (pendingCovers.contains(albumPath))
+    {
+        return;
+    }
+    pendingCovers.insert(albumPath);
+
+    AlbumModel *model = const_cast<AlbumModel *>(this);
+    coverPool.start([model, albumPath]()
+    {
+        QImage image = ThumbnailCache::instance().thumbnail(albumPath, ThumbnailCache::Grid); // decoded once, mapped after that
+
+        // pixmaps can only be made on the gui thread
+        QMetaObject::invokeMethod(model, [model, albumPath, image]()
+        {
+            model->coverReady(albumPath, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AlbumModel::coverReady(const QString &albumPath, const QImage &image)
+{
+    pendingCovers.remove(albumPath);
+
+    int row = rowsByPath.value(albumPath, -1);
+    if (row < 0) // album went away while decoding
+    {
+        return;
+    }
+
+    if (image.isNull())
+    {
+        qDebug() << "using placeholder for: " << albumPath;
+        covers.insert(albumPath, new QPixmap(placeholder));
+    }
+    else
+    {
+        covers.insert(albumPath, new QPixmap(QPixmap::fromImage(image)));
+    }
+
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
+
+void AlbumModel::setAlbums(const QList<AlbumRecord> &newAlbums)
+{
+    beginResetModel();
+    albums = newAlbums;
+    rebuildRows();
+    endResetModel();
+
+    coverPool.clear(); // covers queued for the old list are no use now
+    pendingCovers.clear();
+}
+
+void AlbumModel::addAlbum(const QString &albumName, const QString &albumPath)
+{
+    if (rowsByPath.contains(albumPath))
+    {
+        return;
+    }
+
+    AlbumRecord album;
+    album.name = albumName;
+    album.path = albumPath;
+
+    beginInsertRows(QModelIndex(), albums.size(), albums.size());
+    albums.append(album);
+    rowsByPath.insert(albumPath, albums.size() - 1);
+    endInsertRows();
+}
+
+void AlbumModel::removeAlbum(const QString &albumPath)
+{
+    int row = rowsByPath.value(albumPath, -1);
+    if (row < 0)
+    {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    albums.removeAt(row);
+    rebuildRows();
+    endRemoveRows();
+
+    covers.remove(albumPath);
+}
+
+void AlbumModel::refreshAlbum(const QString &albumPath)
+{
+    int row = rowsByPath.value(albumPath, -1);
+    if (row < 0)
+    {
+        return;
+    }
+
+    covers.remove(albumPath); // next paint asks again and the pool re-decodes it
+
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
+
+void AlbumModel::rebuildRows()
+{
+    rowsByPath.clear();
+    rowsByPath.reserve(albums.size());
+
+    for (int i = 0; i < albums.size(); i++)
+    {
+        rowsByPath.insert(albums[i].path, i);
+    }
+}
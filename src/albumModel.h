@@ -0,0 +1,53 @@
+#ifndef ALBUMMODEL_H
+#define ALBUMMODEL_H
+
+#include <QAbstractListModel>
+#include <QPixmap>
+#include <QImage>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include "dbManager.h"
+
+// albums for the main menu grid, covers are only decoded once the view asks for them
+// (so only for tiles on screen) and that happens on a worker pool, not the gui thread
+class AlbumModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    public:
+        enum Roles
+        {
+            AlbumNameRole = Qt::UserRole + 1,
+            AlbumPathRole,
+            AlbumIdRole
+        };
+
+        explicit AlbumModel(QObject *parent = nullptr);
+        ~AlbumModel();
+
+        int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+        void setAlbums(const QList<AlbumRecord> &albums);
+        void addAlbum(const QString &albumName, const QString &albumPath);
+        void removeAlbum(const QString &albumPath);
+        void refreshAlbum(const QString &albumPath); // drops the cached cover so it gets decoded again
+
+        static const int coverSize = 150; // matches ThumbnailCache::Grid
+
+    private:
+        void requestCover(const QString &albumPath) const;
+        void coverReady(const QString &albumPath, const QImage &image);
+        void rebuildRows();
+
+        QList<AlbumRecord> albums;
+        QHash<QString, int> rowsByPath;
+
+        QPixmap placeholder;
+        mutable QCache<QString, QPixmap> covers; // bounded so scrolling through 20k albums doesnt keep them all
+        mutable QSet<QString> pendingCovers;
+        mutable QThreadPool coverPool;
+    };
+#endif // ALBUMMODEL_H
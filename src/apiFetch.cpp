@@ -7,8 +7,6 @@
 
 ApiFetch::ApiFetch(QObject *parent) : QObject(parent) 
 {
-    networkManager = new QNetworkAccessManager(this);
-    connect(networkManager, &QNetworkAccessManager::finished, this, &ApiFetch::onReplyFinished);
 }
 
 void ApiFetch::fetchMetadata(const QString &artist, const QString &album) 
@@ -19,11 +17,14 @@ void ApiFetch::fetchMetadata(const QString &artist, const QString &album)
     query.addQueryItem("fmt", "json");
     url.setQuery(query);
 
-    QNetworkRequest request(url);
-    networkManager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(url); // shared connection, rate limit and cache
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]()
+    {
+        onReplyFinished(reply);
+    });
 }
 
-void ApiFetch::onReplyFinished(QNetworkReply *reply) 
+void ApiFetch::onReplyFinished(MusicBrainzReply *reply) 
 {
     if (reply->error() == QNetworkReply::NoError) {
         QByteArray response = reply->readAll();
@@ -2,8 +2,7 @@
 #define APIFETCH_H
 
 #include <QObject>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
+#include "musicBrainzClient.h"
 
 class ApiFetch : public QObject 
 {
@@ -16,11 +15,8 @@ public:
 signals:
     void metadataRetrieved(const QString &title, const QString &artist, const QString &album, int year, int track, const QString &genre);
 
-private slots:
-    void onReplyFinished(QNetworkReply *reply);
-
 private:
-    QNetworkAccessManager *networkManager;
+    void onReplyFinished(MusicBrainzReply *reply);
 };
 
 #endif // APIFETCH_H
\ No newline at end of file
@@ -0,0 +1,449 @@
+#include "audioDecoder.h"
+#include <QDebug>
+#include <QFile>
+#include <cstdio>
+
+extern "C" //stops the compiler from complaining
+{
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/avutil.h>
+    #include <libavutil/channel_layout.h>
+    #include <libavutil/samplefmt.h>
+    #include <libswresample/swresample.h>
+}
+
+namespace
+{
+    const int ioBufferSize = 64 * 1024; // what libavformat asks the file for at a time
+}
+
+// --- file io, libavformat reads through this so every byte it pulls off disk gets counted --- //
+
+struct AudioDecoder::FileIo
+{
+    QFile file;
+    qint64 bytes = 0;
+
+    static int read(void *opaque, uint8_t *data, int size)
+    {
+        FileIo *io = static_cast<FileIo *>(opaque);
+        qint64 got = io->file.read(reinterpret_cast<char *>(data), size);
+        if (got <= 0)
+        {
+            return got == 0 ? AVERROR_EOF : AVERROR(EIO);
+        }
+        io->bytes += got;
+        return int(got);
+    }
+
+    static int64_t seek(void *opaque, int64_t offset, int whence)
+    {
+        FileIo *io = static_cast<FileIo *>(opaque);
+        switch (whence & ~AVSEEK_FORCE)
+        {
+            case AVSEEK_SIZE:
+                return io->file.size();
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += io->file.pos();
+                break;
+            case SEEK_END:
+                offset += io->file.size();
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+        return io->file.seek(offset) ? offset : AVERROR(EIO);
+    }
+};
+
+AudioDecoder::AudioDecoder() : format(nullptr), io(nullptr), file(nullptr), codec(nullptr), resampler(nullptr), held(nullptr), streamIndex(-1),
+                               outRate(0), outChannels(0), streamDuration(0), delivered(0), seekFrame(-1), skipFrames(0)
+{
+}
+
+AudioDecoder::~AudioDecoder()
+{
+    close();
+}
+
+bool AudioDecoder::fail(const QString &message, int code)
+{
+    lastError = message;
+    if (code < 0)
+    {
+        char text[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(code, text, sizeof(text));
+        lastError += QString(": ") + text;
+    }
+
+    qWarning() << "decoder:" << lastError;
+    return false;
+}
+
+bool AudioDecoder::open(const QString &filePath, int outputRate, int maxChannels)
+{
+    close();
+
+    // --- our io instead of libavformats file protocol, qfile takes care of unicode paths too --- //
+    file = new FileIo;
+    file->file.setFileName(filePath);
+    if (!file->file.open(QIODevice::ReadOnly))
+    {
+        return fail("could not open " + filePath + ": " + file->file.errorString());
+    }
+
+    unsigned char *ioBuffer = static_cast<unsigned char *>(av_malloc(ioBufferSize));
+    io = ioBuffer ? avio_alloc_context(ioBuffer, ioBufferSize, 0, file, &FileIo::read, nullptr, &FileIo::seek) : nullptr;
+    format = io ? avformat_alloc_context() : nullptr;
+    if (!format)
+    {
+        if (!io)
+        {
+            av_free(ioBuffer);
+        }
+        return fail("out of memory");
+    }
+    format->pb = io;
+
+    // --- container and stream --- //
+    int rc = avformat_open_input(&format, filePath.toUtf8().constData(), nullptr, nullptr); // frees format on failure, not io
+    if (rc < 0)
+    {
+        return fail("could not open " + filePath, rc);
+    }
+
+    rc = avformat_find_stream_info(format, nullptr);
+    if (rc < 0)
+    {
+        return fail("could not read stream info", rc);
+    }
+
+    const AVCodec *decoder = nullptr;
+    streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder, 0);
+    if (streamIndex < 0 || !decoder)
+    {
+        return fail("no audio stream in " + filePath, streamIndex);
+    }
+
+    // embedded cover art and the like never get read off disk
+    for (unsigned int i = 0; i < format->nb_streams; i++)
+    {
+        if (int(i) != streamIndex)
+        {
+            format->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    AVStream *stream = format->streams[streamIndex];
+    if (format->duration != AV_NOPTS_VALUE)
+    {
+        streamDuration = format->duration / double(AV_TIME_BASE);
+    }
+    else if (stream->duration != AV_NOPTS_VALUE)
+    {
+        streamDuration = stream->duration * av_q2d(stream->time_base);
+    }
+
+    // --- codec --- //
+    codec = avcodec_alloc_context3(decoder);
+    if (!codec)
+    {
+        return fail("out of memory");
+    }
+
+    rc = avcodec_parameters_to_context(codec, stream->codecpar);
+    if (rc < 0)
+    {
+        return fail("bad codec parameters", rc);
+    }
+
+    rc = avcodec_open2(codec, decoder, nullptr);
+    if (rc < 0)
+    {
+        return fail(QString("could not open %1 decoder").arg(decoder->name), rc);
+    }
+
+    if (codec->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) // some wavs dont say, guess from the count
+    {
+        int count = codec->ch_layout.nb_channels;
+        av_channel_layout_uninit(&codec->ch_layout);
+        av_channel_layout_default(&codec->ch_layout, count);
+    }
+
+    // --- resampler, planar float or whatever the codec likes -> interleaved s16 --- //
+    outRate = outputRate > 0 ? outputRate : codec->sample_rate;
+    outChannels = qBound(1, codec->ch_layout.nb_channels, qMax(1, maxChannels));
+
+    AVChannelLayout outLayout;
+    av_channel_layout_default(&outLayout, outChannels);
+
+    rc = swr_alloc_set_opts2(&resampler, &outLayout, AV_SAMPLE_FMT_S16, outRate,
+                             &codec->ch_layout, codec->sample_fmt, codec->sample_rate, 0, nullptr);
+    av_channel_layout_uninit(&outLayout);
+    if (rc < 0 || (rc = swr_init(resampler)) < 0)
+    {
+        return fail("could not set up resampler", rc);
+    }
+
+    return true;
+}
+
+void AudioDecoder::close()
+{
+    swr_free(&resampler);
+    av_packet_free(&held);
+    avcodec_free_context(&codec);
+    avformat_close_input(&format);
+
+    if (io)
+    {
+        av_freep(&io->buffer); // may not be the one we allocated any more, libavformat can swap it
+        avio_context_free(&io);
+    }
+    delete file;
+    file = nullptr;
+
+    streamIndex = -1;
+    outRate = 0;
+    outChannels = 0;
+    streamDuration = 0;
+    delivered = 0;
+    seekFrame = -1;
+    skipFrames = 0;
+}
+
+// converts one decoded frame (or flushes the resampler when input is null) and passes it on chunkFrames at a
+// time. whatever doesnt fit in the chunk waits inside swr until the next round, so the buffer never grows
+// however big the codec's frames are. endFrame is where read() has to stop, -1 for no limit
+bool AudioDecoder::convert(const quint8 **input, int inputFrames, const Sink &sink, qint64 endFrame, bool *stop)
+{
+    buffer.resize(size_t(chunkFrames) * outChannels);
+    quint8 *output = reinterpret_cast<quint8 *>(buffer.data());
+
+    while (!*stop)
+    {
+        int produced = swr_convert(resampler, &output, chunkFrames, input, inputFrames);
+        if (produced < 0)
+        {
+            return fail("resampling failed", produced);
+        }
+        if (produced == 0)
+        {
+            break;
+        }
+        inputFrames = 0; // all of it is in swr now, later rounds only drain (a null input would flush instead)
+
+        // after a seek the codec restarts at the packet before the target, the extra gets cut here
+        int offset = 0;
+        int frames = produced;
+        if (skipFrames > 0)
+        {
+            offset = int(qMin<qint64>(skipFrames, frames));
+            skipFrames -= offset;
+            frames -= offset;
+        }
+
+        if (endFrame >= 0 && delivered + frames >= endFrame)
+        {
+            frames = int(endFrame - delivered);
+            *stop = true;
+        }
+
+        delivered += frames;
+        if (frames > 0 && !sink(buffer.data() + size_t(offset) * outChannels, frames))
+        {
+            *stop = true;
+        }
+
+        if (produced < chunkFrames)
+        {
+            break; // drained
+        }
+    }
+    return true;
+}
+
+bool AudioDecoder::read(const Sink &sink, double maxSeconds)
+{
+    if (!format || !codec || !resampler)
+    {
+        return fail("nothing open");
+    }
+
+    // counted from here, after a seek delivered already starts at the seek target
+    const qint64 endFrame = maxSeconds > 0 ? delivered + qint64(maxSeconds * outRate) : -1;
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    bool stop = false;
+    bool ok = packet && frame;
+
+    auto drain = [&]()
+    {
+        while (ok && !stop && avcodec_receive_frame(codec, frame) == 0)
+        {
+            if (seekFrame >= 0)
+            {
+                trimToSeek(frame);
+            }
+            ok = convert(const_cast<const quint8 **>(frame->extended_data), frame->nb_samples, sink, endFrame, &stop);
+            av_frame_unref(frame);
+        }
+    };
+
+    // EAGAIN means the codec wants its frames taken before it takes more, the packet isnt used up and goes
+    // again after a drain. false if the sink stopped during that drain and the packet is now held
+    auto send = [&](AVPacket *input)
+    {
+        int rc = avcodec_send_packet(codec, input);
+        if (rc == AVERROR(EAGAIN))
+        {
+            drain();
+            if (ok && stop)
+            {
+                if (input != held)
+                {
+                    held = held ? held : av_packet_alloc();
+                    av_packet_move_ref(held, input);
+                }
+                return false;
+            }
+            rc = avcodec_send_packet(codec, input);
+        }
+        if (rc < 0)
+        {
+            qDebug() << "decoder: skipping a bad packet"; // same as fpcalc, one broken frame shouldnt sink the song
+        }
+        return true;
+    };
+
+    if (ok && held && held->data) // left over from the read() before
+    {
+        if (send(held))
+        {
+            av_packet_unref(held);
+            drain();
+        }
+    }
+
+    while (ok && !stop && av_read_frame(format, packet) >= 0)
+    {
+        if (packet->stream_index == streamIndex && !send(packet))
+        {
+            break;
+        }
+        av_packet_unref(packet);
+        drain();
+    }
+
+    // --- whatever the codec and resampler are still holding on to --- //
+    if (ok && !stop)
+    {
+        avcodec_send_packet(codec, nullptr);
+        drain();
+    }
+    if (ok && !stop)
+    {
+        ok = convert(nullptr, 0, sink, endFrame, &stop);
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+
+    if (ok && delivered == 0 && !stop) // a sink that stops straight away isnt a broken file
+    {
+        return fail("no audio decoded");
+    }
+    return ok;
+}
+
+bool AudioDecoder::seek(qint64 frame)
+{
+    if (!format || !codec || !resampler)
+    {
+        return fail("nothing open");
+    }
+
+    AVStream *stream = format->streams[streamIndex];
+    frame = qMax<qint64>(0, frame);
+
+    int64_t timestamp = av_rescale_q(frame, AVRational{1, outRate}, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE)
+    {
+        timestamp += stream->start_time;
+    }
+
+    // backward lands on the packet at or before the target, the rest gets trimmed once decoded
+    int rc = av_seek_frame(format, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD);
+    if (rc < 0)
+    {
+        return fail("seek failed", rc);
+    }
+
+    avcodec_flush_buffers(codec);
+    if (held)
+    {
+        av_packet_unref(held); // from before the seek
+    }
+    swr_close(resampler); // drops whatever it was still holding from before the seek
+    rc = swr_init(resampler);
+    if (rc < 0)
+    {
+        return fail("could not reset resampler", rc);
+    }
+
+    delivered = frame;
+    seekFrame = frame;
+    skipFrames = 0;
+    return true;
+}
+
+// the first frame decoded after a seek says where the codec actually landed
+void AudioDecoder::trimToSeek(const AVFrame *frame)
+{
+    AVStream *stream = format->streams[streamIndex];
+    if (frame->best_effort_timestamp != AV_NOPTS_VALUE)
+    {
+        int64_t timestamp = frame->best_effort_timestamp;
+        if (stream->start_time != AV_NOPTS_VALUE)
+        {
+            timestamp -= stream->start_time;
+        }
+
+        qint64 landed = av_rescale_q(timestamp, stream->time_base, AVRational{1, outRate});
+        skipFrames = qMax<qint64>(0, seekFrame - landed);
+    }
+    seekFrame = -1; // no timestamp, trust the seek and play from here
+}
+
+int AudioDecoder::sampleRate() const
+{
+    return outRate;
+}
+
+int AudioDecoder::channels() const
+{
+    return outChannels;
+}
+
+double AudioDecoder::duration() const
+{
+    return streamDuration;
+}
+
+qint64 AudioDecoder::framesRead() const
+{
+    return delivered;
+}
+
+qint64 AudioDecoder::bytesRead() const
+{
+    return file ? file->bytes : 0;
+}
+
+QString AudioDecoder::errorString() const
+{
+    return lastError;
+}
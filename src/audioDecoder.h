@@ -0,0 +1,76 @@
+#ifndef AUDIODECODER_H
+#define AUDIODECODER_H
+
+#include <QString>
+#include <functional>
+#include <vector>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVIOContext;
+struct AVFrame;
+struct AVPacket;
+struct SwrContext;
+
+// opens a song with libavformat and hands back interleaved 16 bit pcm in chunks as it decodes,
+// so callers (fingerprinting for now) can stop as soon as they have enough instead of decoding the whole file.
+// the file is read through our own small io buffer and pcm goes out through one fixed size chunk, so what
+// a read() costs in disk reads and memory depends on how much it decodes, not on how long the song is
+class AudioDecoder
+{
+    public:
+        // called once per decoded chunk, frames counts samples per channel. return false to stop early
+        using Sink = std::function<bool(const qint16 *samples, int frames)>;
+
+        AudioDecoder();
+        ~AudioDecoder();
+
+        AudioDecoder(const AudioDecoder &) = delete;
+        AudioDecoder &operator=(const AudioDecoder &) = delete;
+
+        // outputRate 0 keeps the song's own rate, channels are mixed down to at most maxChannels
+        bool open(const QString &filePath, int outputRate = 0, int maxChannels = 2);
+        void close();
+
+        // decodes from the start (or where seek() left it) until eof, the sink says stop, or maxSeconds of audio
+        // went out in this call (0 = no limit). after the sink stops it, a later read() carries on from there
+        bool read(const Sink &sink, double maxSeconds = 0);
+
+        // the next read() starts exactly at this frame, not at the packet or keyframe before it
+        bool seek(qint64 frame);
+
+        int sampleRate() const; // of what read() hands out
+        int channels() const;
+        double duration() const; // seconds, what the container says, 0 if it doesnt know
+        qint64 framesRead() const; // frame the next read() hands out first, seeks included
+        qint64 bytesRead() const; // off disk since open(), probing and tags included
+        QString errorString() const;
+
+        static const int chunkFrames = 4096; // most the sink is ever handed at once
+
+    private:
+        bool fail(const QString &message, int code = 0);
+        bool convert(const quint8 **input, int inputFrames, const Sink &sink, qint64 endFrame, bool *stop);
+        void trimToSeek(const AVFrame *frame);
+
+        struct FileIo;
+
+        AVFormatContext *format;
+        AVIOContext *io;
+        FileIo *file;
+        AVCodecContext *codec;
+        SwrContext *resampler;
+        AVPacket *held; // turned away with EAGAIN when the sink stopped, sent again before the next read() reads on
+        int streamIndex;
+
+        int outRate;
+        int outChannels;
+        double streamDuration;
+        qint64 delivered;
+        qint64 seekFrame; // -1, or where the first frame after a seek has to be trimmed to
+        qint64 skipFrames; // output frames still to drop before that
+        QString lastError;
+
+        std::vector<qint16> buffer; // chunkFrames worth, reused for every chunk
+    };
+#endif // AUDIODECODER_H
@@ -0,0 +1,613 @@
+#include "audioEngine.h"
+#include "audioDecoder.h"
+#include <QDebug>
+#include <QThread>
+#include <QAudioSink>
+#include <QAudioDevice>
+#include <QAudioFormat>
+#include <QMediaDevices>
+#include <QIODevice>
+#include <cstring>
+
+namespace
+{
+    const int refreshIntervalMs = 50; // positionChanged and track / end checks while playing
+
+    // what QAudioSink reads from in pull mode, every read goes straight to AudioEngine::pull
+    class PullDevice : public QIODevice
+    {
+        public:
+            PullDevice(AudioEngine *engine) : QIODevice(engine), engine(engine)
+            {
+            }
+
+            bool isSequential() const override
+            {
+                return true;
+            }
+
+            qint64 bytesAvailable() const override
+            {
+                return QIODevice::bytesAvailable() + (1 << 20); // always something, silence if need be
+            }
+
+        protected:
+            qint64 readData(char *data, qint64 maxSize) override
+            {
+                const qint64 frameBytes = qint64(sizeof(qint16)) * engine->channels();
+                const int frames = int(maxSize / frameBytes);
+                engine->pull(reinterpret_cast<qint16 *>(data), frames);
+                return frames * frameBytes;
+            }
+
+            qint64 writeData(const char *, qint64) override
+            {
+                return -1;
+            }
+
+        private:
+            AudioEngine *engine;
+    };
+
+    AudioEngine::Options resolve(AudioEngine::Options options)
+    {
+        options.channels = qBound(1, options.channels, 2);
+        options.periodMs = qMax(1, options.periodMs);
+        options.bufferMs = qMax(options.bufferMs, options.periodMs * 2);
+
+        if (options.sampleRate <= 0)
+        {
+            int preferred = 0;
+            if (options.output == AudioEngine::Output::Device)
+            {
+                preferred = QMediaDevices::defaultAudioOutput().preferredFormat().sampleRate();
+            }
+            options.sampleRate = preferred > 0 ? preferred : 44100;
+        }
+        return options;
+    }
+
+    void applyGain(qint16 *samples, size_t count, float scale)
+    {
+        if (scale == 1.0f)
+        {
+            return;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            samples[i] = qint16(qBound(-32768.0f, samples[i] * scale, 32767.0f));
+        }
+    }
+}
+
+AudioEngine::AudioEngine(const Options &opts, QObject *parent) : QObject(parent), options(resolve(opts)),
+    ring(size_t(options.bufferMs) * options.sampleRate / 1000 * options.channels), decodeThread(nullptr), sink(nullptr),
+    device(nullptr), openPending(false), openGain(1.0f), seekPending(false), seekTarget(0), requestedFrame(0), pendingNextGain(1.0f),
+    quitting(false), playing(false), requestGen(0), flushGen(0), flushPos(0), endPos(noPosition), underruns(0), silentFrames(0),
+    framesDecoded(0), framesPlayed(0), trackGain(1.0f), nextGain(1.0f), nextStart(noPosition), lastGap(-1), pulledGen(0), silentRun(0),
+    endSignalled(false), lastPosition(-1), lastDuration(-1)
+{
+    if (options.output == Output::Device)
+    {
+        QAudioFormat format;
+        format.setSampleRate(options.sampleRate);
+        format.setChannelCount(options.channels);
+        format.setSampleFormat(QAudioFormat::Int16);
+
+        sink = new QAudioSink(QMediaDevices::defaultAudioOutput(), format, this);
+        sink->setBufferSize(qsizetype(options.sampleRate) * options.periodMs / 1000 * format.bytesPerFrame() * 2); // two periods
+
+        device = new PullDevice(this);
+        device->open(QIODevice::ReadOnly);
+    }
+
+    refreshTimer.setInterval(refreshIntervalMs);
+    connect(&refreshTimer, &QTimer::timeout, this, &AudioEngine::refresh);
+
+    // the decoder keeps ahead of the output, so it shouldnt sit behind the gui or the scanner
+    decodeThread = QThread::create([this]() { decodeLoop(); });
+    decodeThread->start(QThread::HighPriority);
+}
+
+AudioEngine::~AudioEngine()
+{
+    if (sink)
+    {
+        sink->stop();
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        quitting.store(true, std::memory_order_release);
+        wake.wakeAll();
+    }
+    decodeThread->wait();
+    delete decodeThread;
+}
+
+// --- gui side --- //
+
+void AudioEngine::request()
+{
+    requestGen.fetch_add(1, std::memory_order_release);
+    wake.wakeAll();
+    refreshTimer.start(); // until it lands, even when paused, so duration and errors get out
+}
+
+void AudioEngine::open(const QString &path, float gain)
+{
+    QMutexLocker locker(&mutex);
+    openPending = true;
+    openPath = path;
+    openGain = qMax(0.0f, gain);
+    seekPending = false;
+    pendingNext.clear();
+    requestedFrame = 0;
+    request();
+}
+
+void AudioEngine::setNext(const QString &path, float gain)
+{
+    QMutexLocker locker(&mutex);
+    pendingNext = path;
+    pendingNextGain = qMax(0.0f, gain);
+
+    if (!chained.path.isEmpty() && chained.path != path)
+    {
+        // the old next is already in the ring behind the current track, so decode the current one again
+        // from where the output is and let the new next follow it
+        seekPending = true;
+        seekTarget = playedFrames();
+        requestedFrame = seekTarget;
+        request();
+        return;
+    }
+    if (chained.path == path)
+    {
+        pendingNext.clear();
+        chained.gain = pendingNextGain;
+        nextGain.store(chained.gain, std::memory_order_relaxed);
+    }
+    wake.wakeAll();
+}
+
+void AudioEngine::play()
+{
+    playing.store(true, std::memory_order_release);
+    if (sink)
+    {
+        if (sink->state() == QAudio::SuspendedState)
+        {
+            sink->resume();
+        }
+        else if (sink->state() == QAudio::StoppedState)
+        {
+            sink->start(device);
+        }
+    }
+    refreshTimer.start();
+}
+
+void AudioEngine::pause()
+{
+    playing.store(false, std::memory_order_release);
+    if (sink && sink->state() == QAudio::ActiveState)
+    {
+        sink->suspend();
+    }
+    refresh();
+}
+
+void AudioEngine::stop()
+{
+    pause();
+    seekFrame(0);
+}
+
+void AudioEngine::seek(qint64 ms)
+{
+    seekFrame(ms * options.sampleRate / 1000);
+}
+
+void AudioEngine::seekFrame(qint64 frame)
+{
+    QMutexLocker locker(&mutex);
+    seekPending = true;
+    seekTarget = qMax<qint64>(0, frame);
+    requestedFrame = seekTarget;
+    request();
+}
+
+void AudioEngine::setGain(float gain)
+{
+    QMutexLocker locker(&mutex);
+    current.gain = qMax(0.0f, gain);
+    trackGain.store(current.gain, std::memory_order_relaxed);
+}
+
+qint64 AudioEngine::framesAt(size_t readPos) const
+{
+    if (readPos <= current.startPos) // includes a flush the output hasnt got to yet
+    {
+        return current.startFrame;
+    }
+    return qint64((readPos - current.startPos) / options.channels) + current.startFrame;
+}
+
+// under mutex. while an open or seek is on its way the ring still has the old audio, report where it's going
+qint64 AudioEngine::playedFrames() const
+{
+    if (requestGen.load(std::memory_order_acquire) != flushGen.load(std::memory_order_acquire))
+    {
+        return requestedFrame;
+    }
+    return framesAt(ring.readPosition());
+}
+
+qint64 AudioEngine::positionFrames() const
+{
+    QMutexLocker locker(&mutex);
+    return playedFrames();
+}
+
+qint64 AudioEngine::position() const
+{
+    return positionFrames() * 1000 / options.sampleRate;
+}
+
+qint64 AudioEngine::duration() const
+{
+    QMutexLocker locker(&mutex);
+    return current.durationMs;
+}
+
+bool AudioEngine::isPlaying() const
+{
+    return playing.load(std::memory_order_acquire);
+}
+
+bool AudioEngine::atEnd() const
+{
+    QMutexLocker locker(&mutex);
+    const size_t end = endPos.load(std::memory_order_acquire);
+    return !current.path.isEmpty() && requestGen.load(std::memory_order_acquire) == flushGen.load(std::memory_order_acquire) &&
+           end != noPosition && ring.readPosition() >= end;
+}
+
+QString AudioEngine::currentPath() const
+{
+    QMutexLocker locker(&mutex);
+    return openPending ? openPath : current.path;
+}
+
+QString AudioEngine::nextPath() const
+{
+    QMutexLocker locker(&mutex);
+    return chained.path.isEmpty() ? pendingNext : chained.path;
+}
+
+int AudioEngine::sampleRate() const
+{
+    return options.sampleRate;
+}
+
+int AudioEngine::channels() const
+{
+    return options.channels;
+}
+
+AudioEngine::Stats AudioEngine::stats() const
+{
+    Stats stats;
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.silentFrames = silentFrames.load(std::memory_order_relaxed);
+    stats.framesDecoded = framesDecoded.load(std::memory_order_relaxed);
+    stats.framesPlayed = framesPlayed.load(std::memory_order_relaxed);
+    stats.bufferedFrames = int(ring.readable() / options.channels);
+    stats.capacityFrames = int(ring.capacity() / options.channels);
+    stats.endDecoded = endPos.load(std::memory_order_acquire) != noPosition;
+    stats.lastGapFrames = lastGap.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AudioEngine::refresh()
+{
+    QString changedTo;
+    QString error;
+    qint64 positionMs;
+    qint64 durationMs;
+    bool ended = false;
+    bool settled;
+
+    {
+        QMutexLocker locker(&mutex);
+        const size_t readPos = ring.readPosition();
+        settled = requestGen.load(std::memory_order_acquire) == flushGen.load(std::memory_order_acquire);
+
+        if (settled && !chained.path.isEmpty() && readPos >= chained.startPos) // output is into the next track now
+        {
+            current = chained;
+            chained = Segment();
+            trackGain.store(current.gain, std::memory_order_relaxed); // before the boundary goes, pull() already uses it past there
+            nextStart.store(noPosition, std::memory_order_release);
+            changedTo = current.path;
+            wake.wakeAll(); // decoder can line up the one after
+        }
+
+        const size_t end = endPos.load(std::memory_order_acquire);
+        ended = settled && !current.path.isEmpty() && end != noPosition && readPos >= end;
+
+        positionMs = playedFrames() * 1000 / options.sampleRate;
+        durationMs = current.durationMs;
+        error = errorText;
+        errorText.clear();
+    }
+
+    if (!error.isEmpty())
+    {
+        emit errorOccurred(error);
+    }
+    if (!changedTo.isEmpty())
+    {
+        emit trackChanged(changedTo);
+    }
+    if (durationMs != lastDuration)
+    {
+        lastDuration = durationMs;
+        emit durationChanged(durationMs);
+    }
+    if (positionMs != lastPosition)
+    {
+        lastPosition = positionMs;
+        emit positionChanged(positionMs);
+    }
+
+    if (ended && !endSignalled)
+    {
+        endSignalled = true;
+        playing.store(false, std::memory_order_release);
+        if (sink && sink->state() == QAudio::ActiveState)
+        {
+            sink->suspend();
+        }
+        emit finished();
+    }
+    endSignalled = ended;
+
+    if (settled && !playing.load(std::memory_order_acquire))
+    {
+        refreshTimer.stop();
+    }
+}
+
+// --- output side, no locks or allocation from here --- //
+
+int AudioEngine::pull(qint16 *samples, int frames)
+{
+    const size_t channelCount = size_t(options.channels);
+    const size_t wanted = size_t(qMax(0, frames)) * channelCount;
+
+    // the decoder repositioned for an open or seek, everything before where it started writing is stale
+    const quint64 flushed = flushGen.load(std::memory_order_acquire);
+    const size_t flushedAt = flushPos.load(std::memory_order_acquire);
+    if (flushed != pulledGen)
+    {
+        ring.skipTo(flushedAt);
+        pulledGen = flushed;
+        silentRun = 0; // waiting on an open or seek isnt a gap between tracks
+    }
+
+    size_t got = 0;
+    if (playing.load(std::memory_order_acquire) && requestGen.load(std::memory_order_acquire) == flushed) // silent mid seek
+    {
+        // what is readable is taken before the boundary, the decoder sets that before writing the next track's
+        // first sample, so none of it can come out with the old track's gain
+        const size_t before = ring.readPosition();
+        const size_t available = ring.readable();
+        const size_t boundary = nextStart.load(std::memory_order_acquire);
+        got = ring.read(samples, qMin(wanted, available));
+
+        // in place, the current track's gain up to where the chained one starts and its own from there
+        size_t head = got;
+        if (boundary != noPosition)
+        {
+            head = boundary > before ? qMin(got, boundary - before) : 0;
+        }
+        applyGain(samples, head, trackGain.load(std::memory_order_relaxed));
+        applyGain(samples + head, got - head, nextGain.load(std::memory_order_relaxed));
+
+        // the chained track's first sample just went out, straight after the old track's last or after some silence
+        if (boundary != noPosition && boundary >= before && boundary < before + got)
+        {
+            lastGap.store(head > 0 ? 0 : silentRun, std::memory_order_relaxed);
+        }
+        silentRun = got > 0 ? qint64((wanted - got) / channelCount) : silentRun + qint64(wanted / channelCount);
+
+        // short, and not because the track ended or the decoder just started on a seek
+        if (got < wanted && before != flushedAt && ring.readPosition() != endPos.load(std::memory_order_acquire))
+        {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            silentFrames.fetch_add(qint64((wanted - got) / channelCount), std::memory_order_relaxed);
+        }
+    }
+
+    std::memset(samples + got, 0, (wanted - got) * sizeof(qint16));
+    framesPlayed.fetch_add(qint64(got / channelCount), std::memory_order_relaxed);
+    return int(got / channelCount);
+}
+
+// --- decoder thread --- //
+
+void AudioEngine::decodeLoop()
+{
+    AudioDecoder decoder;
+    QString decoderPath;  // what the decoder has open
+    bool decoding = false;
+    bool atEof = false;   // decoded to the end of the last track, the next one can follow
+    bool interrupted = false;
+    quint64 handled = 0;  // the request the ring is being filled for
+    const size_t channelCount = size_t(options.channels);
+    const unsigned long waitMs = qMax(1, options.periodMs / 2);
+
+    // pushes decoded chunks into the ring, waiting on the output when it's full. a new open / seek or
+    // shutting down stops the read, the loop below picks up from there
+    AudioDecoder::Sink toRing = [&](const qint16 *samples, int frames)
+    {
+        size_t left = size_t(frames) * channelCount;
+        while (left > 0)
+        {
+            if (quitting.load(std::memory_order_acquire) || requestGen.load(std::memory_order_acquire) != handled)
+            {
+                interrupted = true;
+                return false;
+            }
+
+            size_t room = ring.writable();
+            room -= room % channelCount; // whole frames only, so the output never splits one
+            const size_t written = ring.write(samples, qMin(left, room));
+            samples += written;
+            left -= written;
+
+            if (left > 0)
+            {
+                QMutexLocker locker(&mutex);
+                if (requestGen.load(std::memory_order_acquire) == handled && !quitting.load(std::memory_order_acquire))
+                {
+                    wake.wait(&mutex, waitMs);
+                }
+            }
+        }
+        framesDecoded.fetch_add(frames, std::memory_order_relaxed);
+        return true;
+    };
+
+    QMutexLocker locker(&mutex);
+    while (!quitting.load(std::memory_order_acquire))
+    {
+        // --- open / seek, the ring starts over from here --- //
+        if (openPending || seekPending)
+        {
+            handled = requestGen.load(std::memory_order_acquire);
+            const QString path = openPending ? openPath : current.path;
+            const qint64 frame = seekPending ? seekTarget : 0;
+            const bool reopen = openPending || path != decoderPath; // a seek back out of a chained track reopens too
+            const bool opened = openPending;
+            openPending = false;
+            seekPending = false;
+
+            locker.unlock();
+            bool ok = !path.isEmpty();
+            if (ok && reopen)
+            {
+                ok = decoder.open(path, options.sampleRate, int(channelCount));
+            }
+            if (ok && (frame > 0 || !reopen))
+            {
+                ok = decoder.seek(frame);
+            }
+            locker.relock();
+
+            decoderPath = ok ? path : QString();
+            if (requestGen.load(std::memory_order_acquire) != handled) // another one came in meanwhile
+            {
+                if (opened && !openPending) // only a seek, which is into the track being opened, not the old one
+                {
+                    openPending = true;
+                    openPath = path;
+                }
+                continue;
+            }
+            if (!ok && !path.isEmpty())
+            {
+                errorText = decoder.errorString();
+            }
+
+            const size_t position = ring.writePosition();
+            const float gain = opened ? openGain : current.gain; // a seek keeps the track's
+            current = Segment();
+            current.path = path;
+            current.durationMs = ok ? qint64(decoder.duration() * 1000) : 0;
+            current.startPos = position;
+            current.startFrame = frame;
+            current.gain = gain;
+            chained = Segment();
+            atEof = false;
+
+            trackGain.store(gain, std::memory_order_relaxed);
+            nextStart.store(noPosition, std::memory_order_release);
+
+            endPos.store(ok ? noPosition : position, std::memory_order_release);
+            flushPos.store(position, std::memory_order_release);
+            flushGen.store(handled, std::memory_order_release);
+            decoding = ok;
+            continue;
+        }
+
+        // --- decode until the ring is full, eof, or a new request --- //
+        if (decoding)
+        {
+            interrupted = false;
+            locker.unlock();
+            decoder.read(toRing); // a broken file just ends early, the decoder already said why
+            locker.relock();
+
+            if (!interrupted)
+            {
+                decoding = false;
+                atEof = true;
+                if (pendingNext.isEmpty() || !chained.path.isEmpty()) // otherwise it goes straight on below, no end in between
+                {
+                    endPos.store(ring.writePosition(), std::memory_order_release);
+                }
+            }
+            continue;
+        }
+
+        // --- eof, carry straight on into the next track once the output is past the last chained one --- //
+        if (atEof && !pendingNext.isEmpty() && chained.path.isEmpty())
+        {
+            const QString path = pendingNext;
+            const float gain = pendingNextGain;
+            pendingNext.clear();
+
+            locker.unlock();
+            const bool ok = decoder.open(path, options.sampleRate, int(channelCount));
+            locker.relock();
+
+            decoderPath = ok ? path : QString();
+            if (requestGen.load(std::memory_order_acquire) != handled)
+            {
+                if (pendingNext.isEmpty())
+                {
+                    pendingNext = path; // still wanted after whatever the request was
+                    pendingNextGain = gain;
+                }
+                continue;
+            }
+            if (!ok)
+            {
+                errorText = decoder.errorString();
+                atEof = false; // nothing more to decode until a new request
+                endPos.store(ring.writePosition(), std::memory_order_release);
+                continue;
+            }
+
+            chained.path = path;
+            chained.durationMs = qint64(decoder.duration() * 1000);
+            chained.startPos = ring.writePosition();
+            chained.startFrame = 0;
+            chained.gain = gain;
+
+            // both before its first sample goes in, pull() switches gain right there
+            nextGain.store(gain, std::memory_order_relaxed);
+            nextStart.store(chained.startPos, std::memory_order_release);
+
+            endPos.store(noPosition, std::memory_order_release);
+            atEof = false;
+            decoding = true;
+            continue;
+        }
+
+        wake.wait(&mutex);
+    }
+}
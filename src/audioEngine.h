@@ -0,0 +1,157 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTimer>
+#include <atomic>
+#include "ringBuffer.h"
+
+class QThread;
+class QAudioSink;
+class QIODevice;
+
+// playback without QMediaPlayer: a decoder thread (AudioDecoder, libavcodec) keeps a lock-free ring of
+// interleaved s16 filled ahead of the output, and the output drains it through pull(). pull() takes no locks
+// and allocates nothing, so it is safe from QAudioSink's callback. a track queued with setNext() is decoded
+// into the same ring right behind the current one, so the switch between them has no gap at all.
+// with Output::Null nothing drains the ring on its own, whoever owns the engine calls pull() (tests, rendering)
+class AudioEngine : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum class Output
+        {
+            Device, // default audio device through QAudioSink
+            Null    // caller drives pull()
+        };
+
+        struct Options
+        {
+            int bufferMs = 500;  // decoded audio kept ahead of the output
+            int periodMs = 20;   // how much the device asks for at a time, about the output latency
+            int sampleRate = 0;  // everything is resampled to this, 0 = the device's preferred rate (44100 for Null)
+            int channels = 2;    // 1 or 2
+            Output output = Output::Device;
+        };
+
+        struct Stats
+        {
+            qint64 underruns = 0;     // pulls that came up short while playing
+            qint64 silentFrames = 0;  // frames those had to fill with silence
+            qint64 framesDecoded = 0;
+            qint64 framesPlayed = 0;  // handed to the output, all tracks
+            int bufferedFrames = 0;
+            int capacityFrames = 0;
+            bool endDecoded = false;  // the decoder has reached the end of the last track
+            qint64 lastGapFrames = -1; // silence the output got between the last two chained tracks, -1 before the first join
+        };
+
+        explicit AudioEngine(const Options &options = Options(), QObject *parent = nullptr);
+        ~AudioEngine();
+
+        // gain is linear, applied as the output pulls and saturating instead of wrapping. each track keeps its own,
+        // the output switches to the next track's on the exact sample it starts at
+        void open(const QString &path, float gain = 1.0f);    // replaces whatever is playing, keeps playing or paused as it was
+        void setNext(const QString &path, float gain = 1.0f); // decoded straight after the current track, empty to drop it.
+                                                              // the same path again only changes its gain
+        void play();
+        void pause();
+        void stop(); // pause and back to the start of the track
+        void seek(qint64 ms);
+        void seekFrame(qint64 frame); // exact to the sample
+        void setGain(float gain);     // the current track's, lands on the next pull
+
+        qint64 position() const; // ms into the current track that the output has been handed
+        qint64 positionFrames() const;
+        qint64 duration() const;
+        bool isPlaying() const;
+        bool atEnd() const; // the output played everything that was decoded and nothing is queued
+        QString currentPath() const;
+        QString nextPath() const;
+        int sampleRate() const;
+        int channels() const;
+        Stats stats() const;
+
+        // output side. fills frames frames of interleaved s16, silence where nothing is decoded yet,
+        // returns how many of them were real audio
+        int pull(qint16 *samples, int frames);
+
+        // publishes what the output got through since the last call, runs off a timer while playing.
+        // headless callers can call it right after pull()
+        void refresh();
+
+    signals:
+        void positionChanged(qint64 ms);
+        void durationChanged(qint64 ms);
+        void trackChanged(const QString &path); // the output went on into the track from setNext()
+        void finished();
+        void errorOccurred(const QString &message);
+
+    private:
+        // a stretch of the ring that belongs to one track
+        struct Segment
+        {
+            QString path;
+            qint64 durationMs = 0;
+            size_t startPos = 0;   // ring position its first sample went in at
+            qint64 startFrame = 0; // which frame of the track that was, non zero after a seek
+            float gain = 1.0f;
+        };
+
+        void decodeLoop();
+        void request(); // under mutex, after setting what the decoder thread should pick up
+        qint64 framesAt(size_t readPos) const;
+        qint64 playedFrames() const;
+
+        Options options;
+        RingBuffer<qint16> ring;
+
+        QThread *decodeThread;
+        QAudioSink *sink;
+        QIODevice *device;
+        QTimer refreshTimer;
+
+        // --- decoder thread <-> gui, under mutex --- //
+        mutable QMutex mutex;
+        QWaitCondition wake;
+        bool openPending;
+        QString openPath;
+        float openGain;
+        bool seekPending;
+        qint64 seekTarget;
+        qint64 requestedFrame; // where the last open / seek goes, for position() until it lands
+        QString pendingNext;
+        float pendingNextGain;
+        Segment current; // what the output is in
+        Segment chained; // queued behind it in the ring, path empty if nothing
+        QString errorText;
+
+        // --- lock-free, pull() reads these --- //
+        static const size_t noPosition = ~size_t(0);
+        std::atomic<bool> quitting;
+        std::atomic<bool> playing;
+        std::atomic<quint64> requestGen; // bumped for every open / seek
+        std::atomic<quint64> flushGen;   // the request the decoder thread has repositioned for
+        std::atomic<size_t> flushPos;    // ring position the audio for that request starts at
+        std::atomic<size_t> endPos;      // ring position the last track ends at, noPosition while decoding
+        std::atomic<qint64> underruns;
+        std::atomic<qint64> silentFrames;
+        std::atomic<qint64> framesDecoded;
+        std::atomic<qint64> framesPlayed;
+        std::atomic<float> trackGain;   // current's
+        std::atomic<float> nextGain;    // chained's
+        std::atomic<size_t> nextStart;  // chained.startPos, noPosition while nothing is chained
+        std::atomic<qint64> lastGap;
+        quint64 pulledGen;  // pull() only
+        qint64 silentRun;   // pull() only, silent frames played since the last real one
+
+        // --- gui side --- //
+        bool endSignalled;
+        qint64 lastPosition;
+        qint64 lastDuration;
+    };
+#endif // AUDIOENGINE_H
@@ -11,127 +11,392 @@
 #include <QNetworkProxy>
 #include <QCryptographicHash>
 #include <QDebug>
-#include <QProcess>
+#include <QMutex>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QtEndian>
+#include <QThreadPool>
+#include <QCoreApplication>
+#include <QPointer>
+#include "dbManager.h"
+#include "audioDecoder.h"
+#include "acoustIdClient.h"
 
-extern "C" //stops the compiler from complaining 
+// fpcalcs default, enough for acoustid to match on
+const int AudioFingerprint::fingerprintSeconds = 120;
+
+namespace
 {
-    #include <libavformat/avformat.h>
-    #include <libavcodec/avcodec.h>
-    #include <libavutil/avutil.h>
-    #include <libavutil/opt.h>
-    #include <libavutil/channel_layout.h>
-    #include <libavutil/samplefmt.h>
-    #include <libavutil/time.h>
-    #include <libswresample/swresample.h>
-}
+    // chromaprint built against fftw plans its fft in new/free, and fftw planning isnt thread safe
+    QMutex chromaprintMutex;
 
+    ChromaprintContext *newContext()
+    {
+        QMutexLocker locker(&chromaprintMutex);
+        return chromaprint_new(CHROMAPRINT_ALGORITHM_DEFAULT);
+    }
+
+    void freeContext(ChromaprintContext *context)
+    {
+        QMutexLocker locker(&chromaprintMutex);
+        chromaprint_free(context);
+    }
+}
 
 AudioFingerprint::AudioFingerprint(QObject *parent) : QObject(parent)
 {
-    m_networkManager = new QNetworkAccessManager(this);
     m_duration = 0;
+    m_fromCache = false;
 }
 
 AudioFingerprint::~AudioFingerprint()
 {
-    // cleanup qprocesses generated
+    cancel(); // a decode still running on the pool stops at its next chunk and its result goes nowhere
 }
 
 bool AudioFingerprint::generateFingerprint(const QString &filePath)
 {
     m_filePath = filePath;
     m_duration = 0; //double work 
+    m_fromCache = false;
 
     m_fingerprint.clear(); //incase user has done a previous fingerprint
-    
-    return decodeAudioFile(filePath, m_duration, m_fingerprint); //run decoder and get bool 
+
+    qDebug() << "fingerprinting begun!" << filePath;
+    FingerprintData data;
+    QString errorMessage;
+    if (!generate(filePath, &data, &m_fromCache, &errorMessage))
+    {
+        emit error(errorMessage);
+        return false;
+    }
+
+    m_fingerprint = data.fingerprint;
+    m_duration = data.duration;
+    return true;
+}
+
+// same as generateFingerprint but on the thread pool, the gui thread only ever sees the queued signals
+void AudioFingerprint::generateFingerprintAsync(const QString &filePath)
+{
+    cancel(); // one at a time, starting another drops the last
+
+    m_filePath = filePath;
+    m_duration = 0;
+    m_fromCache = false;
+    m_fingerprint.clear();
+
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_cancel = cancelled;
+
+    QPointer<AudioFingerprint> self(this); // only looked at back on the gui thread
+    QThreadPool::globalInstance()->start([self, filePath, cancelled]()
+    {
+        // progress hops over to the gui thread, only when the percentage actually moves
+        auto progress = [self, cancelled](int percent)
+        {
+            QMetaObject::invokeMethod(QCoreApplication::instance(), [self, cancelled, percent]()
+            {
+                if (self && !*cancelled)
+                {
+                    emit self->fingerprintProgress(percent);
+                }
+            }, Qt::QueuedConnection);
+        };
+
+        FingerprintData data;
+        bool fromCache = false;
+        QString errorMessage;
+        bool ok = generate(filePath, &data, &fromCache, &errorMessage, cancelled.get(), progress);
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [self, cancelled, ok, data, fromCache, errorMessage]()
+        {
+            if (!self || *cancelled) // page was left or another song was started meanwhile
+            {
+                return;
+            }
+
+            self->m_cancel.reset();
+            if (!ok)
+            {
+                emit self->error(errorMessage);
+                return;
+            }
+
+            self->m_fingerprint = data.fingerprint;
+            self->m_duration = data.duration;
+            self->m_fromCache = fromCache;
+            emit self->fingerprintGenerated();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AudioFingerprint::cancel()
+{
+    if (m_cancel)
+    {
+        *m_cancel = true;
+        m_cancel.reset();
+    }
 }
 
-bool AudioFingerprint::decodeAudioFile(const QString &filePath, int &duration, QByteArray &fingerprint)
+bool AudioFingerprint::isGenerating() const
 {
-    QProcess checkProcess;
+    return m_cancel != nullptr;
+}
 
-    checkProcess.start("which", QStringList() << "fpcalc");
-    checkProcess.waitForFinished();
+// cache first, decode if it misses. statics only, so it runs on any thread
+bool AudioFingerprint::generate(const QString &filePath, FingerprintData *data, bool *fromCache, QString *errorMessage,
+                                const std::atomic<bool> *cancel, const ProgressCallback &progress)
+{
+    // --- cached from an earlier run or the library job, only good while the file is the same --- //
+    qint64 songId = 0;
+    *fromCache = readCache(filePath, &songId, data);
+    if (*fromCache)
+    {
+        qDebug() << "fingerprint from cache:" << filePath;
+        return true;
+    }
 
-    if (checkProcess.exitCode() != 0) //user prob dont have fpcalc
+    if (!fingerprintFile(filePath, data, errorMessage, cancel, progress))
     {
-        emit error("get fpcalc!");
         return false;
     }
-    
+    qDebug() << "fingerprint length:" << data->fingerprint.size() << "duration:" << data->duration << "read:" << data->bytesRead / 1024 << "kb";
+
+    if (songId > 0) // files outside the library have nowhere to go
+    {
+        writeCache(songId, filePath, *data);
+    }
+    return true;
+}
+
+bool AudioFingerprint::isFromCache() const
+{
+    return m_fromCache;
+}
+
+bool AudioFingerprint::readCache(const QString &filePath, qint64 *songId, FingerprintData *data)
+{
+    QFileInfo info(filePath);
+    bool hit = false;
+    bool restamp = false;
+
+    DbManager::instance().select("SELECT s.id, f.fingerprint, f.duration, f.file_size, f.file_mtime, f.content_hash, f.status "
+                                 "FROM songs s LEFT JOIN fingerprints f ON f.song_id = s.id WHERE s.path = ? LIMIT 1",
+                                 {filePath}, [&](const QSqlQuery &query)
+    {
+        *songId = query.value(0).toLongLong();
+        if (query.value(1).isNull() || query.value(6).toInt() != 0)
+        {
+            return;
+        }
+
+        qint64 size = query.value(3).toLongLong();
+        qint64 mtime = query.value(4).toLongLong();
+
+        // same stamp is enough, a new mtime on the same bytes (copied back, touched) is caught by the hash
+        bool sameStamp = size == info.size() && mtime == info.lastModified().toMSecsSinceEpoch();
+        restamp = !sameStamp && size == info.size() && query.value(5).toByteArray() == contentHash(filePath);
+        hit = sameStamp || restamp;
+        if (hit)
+        {
+            data->fingerprint = query.value(1).toByteArray();
+            data->duration = query.value(2).toInt();
+        }
+    });
+
+    if (hit && restamp)
+    {
+        DbManager::instance().exec("UPDATE fingerprints SET file_mtime = ? WHERE song_id = ?",
+                                   {info.lastModified().toMSecsSinceEpoch(), *songId});
+    }
+
+    return hit;
+}
+
+void AudioFingerprint::writeCache(qint64 songId, const QString &filePath, const FingerprintData &data)
+{
+    QFileInfo info(filePath);
+    QVariantList values = {songId, data.fingerprint, packRaw(data.raw), data.duration, info.size(),
+                           info.lastModified().toMSecsSinceEpoch(), contentHash(filePath), QDateTime::currentSecsSinceEpoch()};
+
+    DbManager::instance().post([values](QSqlDatabase &db)
+    {
+        QSqlQuery query(db);
+        query.prepare("INSERT OR REPLACE INTO fingerprints (song_id, fingerprint, raw, duration, file_size, file_mtime, content_hash, status, error, created_at) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, 0, NULL, ?)");
+        for (const QVariant &value : values)
+        {
+            query.addBindValue(value);
+        }
+
+        if (!query.exec())
+        {
+            qWarning() << "fingerprint cache write failed:" << query.lastError().text();
+            return false;
+        }
+        return true;
+    });
+}
+
+// size plus three 64k samples (start, middle, end), cheap next to a decode and enough to
+// tell a touched file from an edited one. tag edits change it too, which just costs one re-fingerprint
+QByteArray AudioFingerprint::contentHash(const QString &filePath)
+{
+    const qint64 sampleSize = 64 * 1024;
 
     QFile file(filePath);
-    if (!file.exists())
+    if (!file.open(QIODevice::ReadOnly))
     {
-        emit error("song does not exist!: " + filePath);
-        return false;
+        return QByteArray();
     }
-    
-    qDebug() << "fingerprinting begun!" << filePath;
-    
-    // make sure fpcalc runs 
-    QProcess testProcess;
-    testProcess.start("fpcalc", QStringList() << "-version");
-    testProcess.waitForFinished();
-    qDebug() << "version:" << testProcess.readAllStandardOutput();
-    
-    // iniatialse process and capture args
-    QProcess process;
-    QStringList args;
 
-    args << "-json";
-    args << filePath;
-    
-    qDebug() << "args:" << args.join(" ");
-    process.start("fpcalc", args);
-    
-    // timeout handle
-    if (!process.waitForFinished(30000))
-    { // 30 sec
-        process.kill();
-        emit error("timeout");
-        return false;
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const qint64 size = file.size();
+    hash.addData(QByteArray::number(size));
+
+    const qint64 offsets[] = {0, qMax<qint64>(0, size / 2 - sampleSize / 2), qMax<qint64>(0, size - sampleSize)};
+    for (qint64 offset : offsets)
+    {
+        if (file.seek(offset))
+        {
+            hash.addData(file.read(sampleSize));
+        }
     }
-    
-    
-    if (process.exitCode() != 0) // we messed up
+    return hash.result().toHex();
+}
+
+// little endian uint32s, what the raw column holds
+QByteArray AudioFingerprint::packRaw(const QVector<quint32> &raw)
+{
+    QByteArray packed(raw.size() * int(sizeof(quint32)), Qt::Uninitialized);
+    for (int i = 0; i < raw.size(); i++)
     {
-        QString errorOutput = process.readAllStandardError();
-        qDebug() << "fpcalc error output:" << errorOutput;
+        qToLittleEndian(raw[i], packed.data() + i * sizeof(quint32));
+    }
+    return packed;
+}
 
-        emit error("fingerprinting failed!: " + errorOutput);
+QVector<quint32> AudioFingerprint::unpackRaw(const QByteArray &packed)
+{
+    QVector<quint32> raw(packed.size() / int(sizeof(quint32)));
+    for (int i = 0; i < raw.size(); i++)
+    {
+        raw[i] = qFromLittleEndian<quint32>(packed.constData() + i * sizeof(quint32));
+    }
+    return raw;
+}
+
+// no signals or members touched, the batch job calls this from its worker threads.
+// only the first fingerprintSeconds get read and decoded, chunks go straight from the decoder into chromaprint
+bool AudioFingerprint::fingerprintFile(const QString &filePath, FingerprintData *data, QString *errorMessage,
+                                       const std::atomic<bool> *cancel, const ProgressCallback &progress)
+{
+    auto fail = [errorMessage](const QString &message)
+    {
+        if (errorMessage)
+        {
+            *errorMessage = message;
+        }
         return false;
+    };
+
+    if (!QFile::exists(filePath))
+    {
+        return fail("song does not exist!: " + filePath);
     }
-    
-    QByteArray output = process.readAllStandardOutput();
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(output, &parseError);
-    
-    if (parseError.error != QJsonParseError::NoError)
+
+    // chromaprint does its own resampling, so feed it the songs rate and at most stereo like fpcalc does
+    AudioDecoder decoder;
+    if (!decoder.open(filePath))
     {
-        qDebug() << parseError.errorString() << "at offset" << parseError.offset;
-        emit error("parsing output failed... " + parseError.errorString());
+        return fail("fingerprinting failed!: " + decoder.errorString());
+    }
 
-        return false;
+    ChromaprintContext *context = newContext();
+    if (!context || !chromaprint_start(context, decoder.sampleRate(), decoder.channels()))
+    {
+        freeContext(context);
+        return fail("could not start chromaprint");
     }
-    
-    if (!doc.isObject()) // this shouldn't happen but good to see where the errors were occuring...
+
+    const int channels = decoder.channels();
+    const double listenSeconds = decoder.duration() > 0 ? qMin<double>(decoder.duration(), fingerprintSeconds) : fingerprintSeconds;
+    const qint64 expectedFrames = qMax<qint64>(1, qint64(listenSeconds * decoder.sampleRate()));
+    int lastPercent = -1;
+
+    bool fed = true;
+    bool decoded = decoder.read([&](const qint16 *samples, int frames)
     {
-        qDebug() << "not valid json";
-        return false;
+        if (cancel && cancel->load())
+        {
+            return false;
+        }
+
+        fed = chromaprint_feed(context, samples, frames * channels) == 1;
+
+        int percent = int(qMin<qint64>(99, decoder.framesRead() * 100 / expectedFrames));
+        if (progress && percent != lastPercent)
+        {
+            lastPercent = percent;
+            progress(percent);
+        }
+        return fed;
+    }, fingerprintSeconds); // rest of the song isnt needed, stop decoding there
+
+    if (cancel && cancel->load())
+    {
+        freeContext(context);
+        return fail("cancelled");
     }
-    
-    QJsonObject obj = doc.object();
-    qDebug() << obj.keys(); // see the keys generated
-    
 
-    qDebug() <<  obj["fingerprint"].toString().toUtf8(); //make sure values are nice
-    qDebug() << qRound(obj["duration"].toDouble());  // duration is a crazy float 
-    
-    fingerprint = obj["fingerprint"].toString().toUtf8();
-    duration = qRound(obj["duration"].toDouble());
-    return true; 
+    char *encoded = nullptr;
+    quint32 *raw = nullptr;
+    int rawSize = 0;
+    bool ok = decoded && fed && chromaprint_finish(context) && chromaprint_get_fingerprint(context, &encoded) &&
+              chromaprint_get_raw_fingerprint(context, &raw, &rawSize);
+    if (ok)
+    {
+        data->fingerprint = QByteArray(encoded); // compressed + base64, same string fpcalc printed
+        data->raw = QVector<quint32>(raw, raw + rawSize);
+    }
+    chromaprint_dealloc(encoded);
+    chromaprint_dealloc(raw);
+    freeContext(context);
+
+    if (!ok)
+    {
+        return fail("fingerprinting failed!: " + (decoder.errorString().isEmpty() ? QString("chromaprint error") : decoder.errorString()));
+    }
+
+    // whole song length for acoustid, not just the bit we listened to
+    double seconds = decoder.duration() > 0 ? decoder.duration() : double(decoder.framesRead()) / decoder.sampleRate();
+    data->duration = qRound(seconds);
+    data->bytesRead = decoder.bytesRead();
+    return true;
+}
+
+QByteArray AudioFingerprint::getFingerprint() const
+{
+    return m_fingerprint;
+}
+
+int AudioFingerprint::getDuration() const
+{
+    return m_duration;
+}
+
+void AudioFingerprint::setFingerprint(const QByteArray &fingerprint)
+{
+    m_fingerprint = fingerprint;
+}
+
+void AudioFingerprint::setDuration(int duration)
+{
+    m_duration = duration;
 }
 
 void AudioFingerprint::lookupMetadata() 
@@ -150,54 +415,21 @@ void AudioFingerprint::lookupMetadata()
         m_duration = m_duration > 0 ? m_duration : 30; 
     }
     
-    QUrl url("https://api.acoustid.org/v2/lookup"); //acousticid base url 
-    QUrlQuery query;
-    
-    //  params 
-    query.addQueryItem("client", "GngcI3Divj"); // api key ****(limitation note in report!!!!!)**
-    query.addQueryItem("fingerprint", QString::fromUtf8(m_fingerprint));
-    query.addQueryItem("duration", QString::number(m_duration));
-    query.addQueryItem("meta", "recordings+releasegroups+compress");
-    query.addQueryItem("threshold", "0.35"); // low threshold, prevent constant api calls
-    
-    url.setQuery(query);
-    QNetworkRequest request(url);
-    request.setRawHeader("User-Agent", "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-    qDebug() << "API request URL: " << url.toString();
+    // shared client batches this with any other lookups going out, keeps to the rate limit and caches the answer
     qDebug() << "Using duration:" << m_duration << "seconds";
-    qDebug() << "Sending API request...";
-    QNetworkReply *reply = m_networkManager->get(request);
-    
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() 
+    AcoustIdReply *reply = AcoustIdClient::instance().lookup(m_fingerprint, m_duration);
+
+    connect(reply, &AcoustIdReply::finished, this, [this, reply]() 
     {
-        qDebug() << "api request succesf1ul!";
-        
         if (reply->error() == QNetworkReply::NoError) // no errors thrown back by the api, parse response to the songdetail class 
         {
-            QByteArray responseData = reply->readAll();
-            processMetadataResponse(responseData);
+            qDebug() << "acoustid answered" << (reply->isFromCache() ? "(cached)" : "");
+            processLookupResults(reply->results());
         } 
         else 
         {
-            QString errorMsg = reply->errorString();
-            qDebug() << errorMsg;
-            QByteArray responseData = reply->readAll();
-            qDebug() << responseData;
-            
-            // incase api returned json instance with errors
-            QJsonDocument errorDoc = QJsonDocument::fromJson(responseData);
-            if (!errorDoc.isNull() && errorDoc.isObject() && errorDoc.object().contains("error"))
-            {
-                QJsonObject errorObj = errorDoc.object()["error"].toObject();
-                QString fullError = errorObj["message"].toString();
-                qDebug() << fullError;
-                emit error(fullError);
-            } 
-            else 
-            {
-                emit error(errorMsg);
-            }
+            qDebug() << reply->errorString();
+            emit error(reply->errorString());
         }
         
         reply->deleteLater(); //cleanup
@@ -223,15 +455,17 @@ void AudioFingerprint::processMetadataResponse(const QByteArray &responseData)
     qDebug() << doc.toJson(QJsonDocument::Compact); //full response
 
 
-    if (!response.contains("results") || response["results"].toArray().isEmpty())
+    processLookupResults(response["results"].toArray());
+}
+
+void AudioFingerprint::processLookupResults(const QJsonArray &fingerprintResults)
+{
+    if (fingerprintResults.isEmpty())
     {
         emit error("no results found");
         return;
     }
 
-    QJsonArray fingerprintResults = response["results"].toArray();
-    QJsonObject bestMatch = fingerprintResults[0].toObject(); //get best match based on threshold
-    
     QJsonObject metadata;
     metadata["results"] = fingerprintResults; 
     
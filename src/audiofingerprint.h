@@ -4,8 +4,13 @@
 #include <QObject>
 #include <QString>
 #include <QByteArray>
+#include <QVector>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QJsonArray>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 class AudioFingerprint : public QObject
 {
@@ -13,26 +18,66 @@ class AudioFingerprint : public QObject
 
 public:
     explicit AudioFingerprint(QObject *parent = nullptr);
-    ~AudioFingerprint(); //cleanup q process
+    ~AudioFingerprint();
     
     void processMetadataResponse(const QByteArray &responseData);
-    void lookupMetadata();
+    void lookupMetadata(); // through AcoustIdClient, so batched with any other lookups and cached on disk
 
+    struct FingerprintData
+    {
+        QByteArray fingerprint; // compressed + base64, what acoustid takes
+        QVector<quint32> raw;   // one sub fingerprint per ~0.12s, for comparing songs locally
+        int duration = 0;       // whole song, seconds
+        qint64 bytesRead = 0;   // off disk for this fingerprint, stays flat however long the song is
+    };
+
+    // decodes in process, only the first fingerprintSeconds. songs in the library are cached in the
+    // fingerprints table and only redone once the file changes
     bool generateFingerprint(const QString &filePath);
- 
+    void generateFingerprintAsync(const QString &filePath); // off the gui thread, answers with fingerprintGenerated or error
+    void cancel();                                         // drops the async one in flight, no signals come from it after
+    bool isGenerating() const;
+    bool isFromCache() const; // last generateFingerprint didnt decode anything
+
+    using ProgressCallback = std::function<void(int percent)>;
+
+    QByteArray getFingerprint() const;
+    int getDuration() const;
+    void setFingerprint(const QByteArray &fingerprint);
+    void setDuration(int duration);
+
+    // no signals, safe to call from any thread
+    // cancel is checked between decoded chunks, progress is called from the decoding thread
+    static bool fingerprintFile(const QString &filePath, FingerprintData *data, QString *errorMessage = nullptr,
+                                const std::atomic<bool> *cancel = nullptr, const ProgressCallback &progress = ProgressCallback());
+    static QByteArray contentHash(const QString &filePath);
+
+    static QByteArray packRaw(const QVector<quint32> &raw);
+    static QVector<quint32> unpackRaw(const QByteArray &packed);
+
+    static const int fingerprintSeconds;
     
 signals:
     void metadataFound(const QJsonObject &metadata);
     void error(const QString &errorMessage); //if fingerprint gen fails
+    void fingerprintProgress(int percent);  // async only, share of the fingerprint window decoded so far
+    void fingerprintGenerated();            // async only, getFingerprint/getDuration are ready
     
 private:
 
     QByteArray m_fingerprint;
     QString m_filePath;
-    QNetworkAccessManager *m_networkManager;
 
     int m_duration;
-    bool decodeAudioFile(const QString &filePath, int &duration, QByteArray &fingerprint);
+    bool m_fromCache;
+    std::shared_ptr<std::atomic<bool>> m_cancel; // set while an async run is in flight
+
+    void processLookupResults(const QJsonArray &fingerprintResults);
+
+    static bool generate(const QString &filePath, FingerprintData *data, bool *fromCache, QString *errorMessage,
+                         const std::atomic<bool> *cancel = nullptr, const ProgressCallback &progress = ProgressCallback());
+    static bool readCache(const QString &filePath, qint64 *songId, FingerprintData *data);
+    static void writeCache(qint64 songId, const QString &filePath, const FingerprintData &data);
 };
 
 #endif // AUDIOFINGERPRINT_H
\ No newline at end of file
@@ -0,0 +1,461 @@
+#include "dbManager.h"
+#include <QDebug>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QScopedPointer>
+#include <QThread>
+#include <QThreadStorage>
+#include <QSemaphore>
+#include <QSqlError>
+#include <QStandardPaths>
+
+namespace
+{
+    // lives in thread local storage, torn down when its thread exits
+    struct ThreadConnection
+    {
+        QString name;
+        int generation = -1;
+        QHash<QString, QSqlQuery *> queries; // keyed by sql text
+        QHash<QString, int> failed;          // sql that didnt prepare -> the schema_version it was tried against
+        QSet<QString> running;               // cached queries a select() is still stepping through
+
+        ~ThreadConnection()
+        {
+            release();
+        }
+
+        void release()
+        {
+            qDeleteAll(queries); // queries have to go before the connection does
+            queries.clear();
+            failed.clear();
+            running.clear();
+
+            if (!name.isEmpty())
+            {
+                QSqlDatabase::database(name, false).close();
+                QSqlDatabase::removeDatabase(name);
+                name.clear();
+            }
+        }
+    };
+
+    QThreadStorage<ThreadConnection *> threadConnections;
+    QAtomicInt connectionCounter;
+
+    const char *songColumns = "id, album_id, name, artist, album, genre, path";
+
+    SongRecord songFromRow(const QSqlQuery &query)
+    {
+        SongRecord song;
+        song.id = query.value(0).toLongLong();
+        song.albumId = query.value(1).toLongLong();
+        song.name = query.value(2).toString();
+        song.artist = query.value(3).toString();
+        song.album = query.value(4).toString();
+        song.genre = query.value(5).toString();
+        song.path = query.value(6).toString();
+        return song;
+    }
+}
+
+struct DbManager::PendingWrite
+{
+    WriteJob job;
+    bool result = false;
+    QSemaphore *done = nullptr; // null for posted jobs, the writer deletes those itself
+};
+
+DbManager &DbManager::instance()
+{
+    static DbManager manager;
+    return manager;
+}
+
+DbManager::DbManager() : QObject(nullptr), writerThread(nullptr), stopping(false)
+{
+    // same default every menu used before the path got passed around
+    dbPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/lavender.db";
+}
+
+DbManager::~DbManager()
+{
+    QThread *thread = writerThread.load();
+    if (thread)
+    {
+        {
+            QMutexLocker locker(&writeMutex);
+            stopping = true;
+        }
+        writeReady.wakeAll();
+
+        thread->wait(); // drains whatever was posted before shutdown
+        delete thread;
+    }
+}
+
+void DbManager::setDatabasePath(const QString &path)
+{
+    QMutexLocker locker(&pathMutex);
+    if (path == dbPath)
+    {
+        return;
+    }
+
+    dbPath = path;
+    generation.fetchAndAddOrdered(1);
+    qDebug() << "db path set to:" << path;
+}
+
+QString DbManager::databasePath() const
+{
+    QMutexLocker locker(&pathMutex);
+    return dbPath;
+}
+
+// --- connections --- //
+
+QSqlDatabase DbManager::threadDatabase()
+{
+    if (!threadConnections.hasLocalData())
+    {
+        threadConnections.setLocalData(new ThreadConnection);
+    }
+
+    ThreadConnection *connection = threadConnections.localData();
+    int currentGeneration = generation.loadAcquire();
+
+    if (connection->generation == currentGeneration && !connection->name.isEmpty())
+    {
+        return QSqlDatabase::database(connection->name, false);
+    }
+
+    connection->release();
+    connection->generation = currentGeneration;
+    connection->name = QString("lavender_%1").arg(connectionCounter.fetchAndAddOrdered(1));
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection->name);
+    db.setDatabaseName(databasePath());
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+
+    if (!db.open())
+    {
+        qWarning() << "db could not be opened:" << db.lastError().text();
+        return db;
+    }
+
+    // sticks to the file once set, but every connection asks so reads dont wait on the rollback journal
+    // until the first write happens to come through the writer
+    QSqlQuery pragma(db);
+    if (!pragma.exec("PRAGMA journal_mode=WAL") || !pragma.next() || pragma.value(0).toString() != "wal")
+    {
+        qWarning() << "db not in wal mode:" << pragma.lastError().text();
+    }
+    pragma.finish();
+
+    if (QThread::currentThread() == writerThread.load())
+    {
+        pragma.exec("PRAGMA synchronous=NORMAL");
+    }
+    else
+    {
+        pragma.exec("PRAGMA query_only=1"); // this app's writes have to go through the writer
+    }
+
+    return db;
+}
+
+QSqlQuery *DbManager::cachedQuery(const QString &sql)
+{
+    QSqlDatabase db = threadDatabase();
+    if (!db.isOpen())
+    {
+        return nullptr;
+    }
+
+    ThreadConnection *connection = threadConnections.localData();
+    QSqlQuery *query = connection->queries.value(sql, nullptr);
+    if (query)
+    {
+        return query;
+    }
+
+    // a table that isnt there yet fails the same way on every call, only tried (and warned about) again
+    // once the schema has changed
+    const int schema = schemaVersion(db);
+    auto failed = connection->failed.constFind(sql);
+    if (failed != connection->failed.constEnd() && failed.value() == schema)
+    {
+        return nullptr;
+    }
+
+    query = new QSqlQuery(db);
+    query->setForwardOnly(true);
+
+    if (!query->prepare(sql))
+    {
+        qWarning() << "prepare failed:" << sql << query->lastError().text();
+        delete query;
+        connection->failed.insert(sql, schema);
+        return nullptr;
+    }
+    connection->failed.remove(sql);
+    connection->queries.insert(sql, query);
+
+    return query;
+}
+
+// bumped by sqlite on every schema change, from any connection
+int DbManager::schemaVersion(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA schema_version") || !query.next())
+    {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+// --- reads --- //
+
+bool DbManager::select(const QString &sql, const QVariantList &values, const RowHandler &row)
+{
+    QSqlQuery *query = cachedQuery(sql);
+    if (!query)
+    {
+        return false;
+    }
+
+    // the same sql from inside one of its own row handlers would reset the cached query under the outer loop,
+    // so the inner one gets a query of its own for the call
+    ThreadConnection *connection = threadConnections.localData();
+    QScopedPointer<QSqlQuery> nested;
+    if (connection->running.contains(sql))
+    {
+        nested.reset(new QSqlQuery(threadDatabase()));
+        nested->setForwardOnly(true);
+        if (!nested->prepare(sql))
+        {
+            qWarning() << "prepare failed:" << sql << nested->lastError().text();
+            return false;
+        }
+        query = nested.data();
+    }
+    else
+    {
+        connection->running.insert(sql);
+    }
+
+    for (int i = 0; i < values.size(); i++)
+    {
+        query->bindValue(i, values[i]);
+    }
+
+    const bool ok = query->exec();
+    if (!ok)
+    {
+        qWarning() << "query failed:" << sql << query->lastError().text();
+    }
+
+    while (ok && query->next())
+    {
+        row(*query);
+    }
+    query->finish(); // lets go of the read snapshot so the wal can checkpoint
+
+    if (!nested)
+    {
+        connection->running.remove(sql);
+    }
+    return ok;
+}
+
+QList<AlbumRecord> DbManager::albums()
+{
+    QList<AlbumRecord> albums;
+    select("SELECT id, name, path FROM albums", {}, [&](const QSqlQuery &query)
+    {
+        AlbumRecord album;
+        album.id = query.value(0).toLongLong();
+        album.name = query.value(1).toString();
+        album.path = query.value(2).toString();
+        albums.append(album);
+    });
+    return albums;
+}
+
+SongRecord DbManager::song(qint64 songId, bool *found)
+{
+    SongRecord song;
+    bool hit = false;
+
+    select(QString("SELECT %1 FROM song_details WHERE id = ?").arg(songColumns), {songId}, [&](const QSqlQuery &query)
+    {
+        song = songFromRow(query);
+        hit = true;
+    });
+
+    if (found)
+    {
+        *found = hit;
+    }
+    return song;
+}
+
+QList<SongRecord> DbManager::songs()
+{
+    QList<SongRecord> songs;
+    select(QString("SELECT %1 FROM song_details").arg(songColumns), {}, [&](const QSqlQuery &query)
+    {
+        songs.append(songFromRow(query));
+    });
+    return songs;
+}
+
+QList<SongRecord> DbManager::songsForAlbum(qint64 albumId)
+{
+    QList<SongRecord> songs;
+    select(QString("SELECT %1 FROM song_details WHERE album_id = ?").arg(songColumns), {albumId}, [&](const QSqlQuery &query)
+    {
+        songs.append(songFromRow(query));
+    });
+    return songs;
+}
+
+// the id subquery is resolved once, then the artist/genre index on songs does the rest
+QList<SongRecord> DbManager::songsForArtist(const QString &artist)
+{
+    QList<SongRecord> songs;
+    select(QString("SELECT %1 FROM song_details WHERE artist_id = (SELECT id FROM artists WHERE name = ?)").arg(songColumns), {artist}, [&](const QSqlQuery &query)
+    {
+        songs.append(songFromRow(query));
+    });
+    return songs;
+}
+
+QList<SongRecord> DbManager::songsForGenre(const QString &genre)
+{
+    QList<SongRecord> songs;
+    select(QString("SELECT %1 FROM song_details WHERE genre_id = (SELECT id FROM genres WHERE name = ?)").arg(songColumns), {genre}, [&](const QSqlQuery &query)
+    {
+        songs.append(songFromRow(query));
+    });
+    return songs;
+}
+
+QString DbManager::songPath(qint64 songId)
+{
+    QString path;
+    select("SELECT path FROM songs WHERE id = ?", {songId}, [&](const QSqlQuery &query)
+    {
+        path = query.value(0).toString();
+    });
+    return path;
+}
+
+// --- writes --- //
+
+void DbManager::enqueue(PendingWrite *pending)
+{
+    QMutexLocker locker(&writeMutex);
+
+    if (!writerThread.load()) // started on first use so nothing spins up before the app needs it
+    {
+        // published before it starts, so the writer sees itself when it opens its connection
+        QThread *thread = QThread::create([this]() { writerLoop(); });
+        thread->setObjectName("lavender db writer");
+        writerThread.store(thread);
+        thread->start();
+    }
+
+    writeQueue.enqueue(pending);
+    writeReady.wakeOne();
+}
+
+void DbManager::writerLoop()
+{
+    forever
+    {
+        PendingWrite *pending;
+        {
+            QMutexLocker locker(&writeMutex);
+            while (writeQueue.isEmpty() && !stopping)
+            {
+                writeReady.wait(&writeMutex);
+            }
+
+            if (writeQueue.isEmpty())
+            {
+                break; // stopping and nothing left
+            }
+            pending = writeQueue.dequeue();
+        }
+
+        QSqlDatabase db = threadDatabase();
+        pending->result = db.isOpen() && pending->job(db);
+
+        if (pending->done)
+        {
+            pending->done->release();
+        }
+        else
+        {
+            delete pending;
+        }
+    }
+
+    threadConnections.setLocalData(nullptr); // close the writer connection on this thread
+}
+
+bool DbManager::write(const WriteJob &job)
+{
+    if (QThread::currentThread() == writerThread.load()) // already on the writer, queuing would deadlock
+    {
+        QSqlDatabase db = threadDatabase();
+        return db.isOpen() && job(db);
+    }
+
+    QSemaphore done;
+    PendingWrite pending;
+    pending.job = job;
+    pending.done = &done;
+
+    enqueue(&pending);
+    done.acquire();
+
+    return pending.result;
+}
+
+void DbManager::post(const WriteJob &job)
+{
+    PendingWrite *pending = new PendingWrite;
+    pending->job = job;
+    enqueue(pending);
+}
+
+bool DbManager::exec(const QString &sql, const QVariantList &values)
+{
+    return write([this, sql, values](QSqlDatabase &)
+    {
+        QSqlQuery *query = cachedQuery(sql);
+        if (!query)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < values.size(); i++)
+        {
+            query->bindValue(i, values[i]);
+        }
+
+        bool ok = query->exec();
+        if (!ok)
+        {
+            qWarning() << "write failed:" << sql << query->lastError().text();
+        }
+        query->finish();
+        return ok;
+    });
+}
@@ -0,0 +1,97 @@
+#ifndef DBMANAGER_H
+#define DBMANAGER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QVariant>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QAtomicInt>
+#include <atomic>
+#include <functional>
+
+class QThread;
+
+struct AlbumRecord
+{
+    qint64 id = 0;
+    QString name;
+    QString path;
+};
+
+struct SongRecord
+{
+    qint64 id = 0;
+    qint64 albumId = 0;
+    QString name;
+    QString artist;
+    QString album;
+    QString genre;
+    QString path;
+};
+
+// one place for everything that talks to lavender.db through QtSql
+// reads: every thread gets its own connection + statement cache, wal lets them run alongside any writer
+// writes: the app's own (tag edits, caches written back from playback, the reco index) are funneled through
+// a single connection on its own thread so they never race each other. the bulk writers, LibScan's scan and
+// watcher sync and the LibraryJob runners, keep their own sqlite3 connections and batched transactions.
+// sqlite's one write lock per file orders all of them, every writer waits on it with a 5 s busy timeout,
+// so a write here can sit behind a scan batch but never interleaves with one
+class DbManager : public QObject
+{
+    Q_OBJECT
+
+    public:
+        using WriteJob = std::function<bool(QSqlDatabase &db)>;
+        using RowHandler = std::function<void(const QSqlQuery &query)>;
+
+        static DbManager &instance();
+
+        void setDatabasePath(const QString &path); // existing connections reopen on their next use
+        QString databasePath() const;
+
+        // --- reads, safe from any thread --- //
+        // prepared once per thread, nullptr if it doesnt prepare (not retried until the schema changes).
+        // one query per sql per thread, so finish with it before the same sql runs again on this thread
+        QSqlQuery *cachedQuery(const QString &sql);
+        bool select(const QString &sql, const QVariantList &values, const RowHandler &row); // row may select again, even the same sql
+
+        QList<AlbumRecord> albums();
+        SongRecord song(qint64 songId, bool *found = nullptr);
+        QList<SongRecord> songs();
+        QList<SongRecord> songsForAlbum(qint64 albumId);
+        QList<SongRecord> songsForArtist(const QString &artist); // exact tag, as the scanner stored it
+        QList<SongRecord> songsForGenre(const QString &genre);
+        QString songPath(qint64 songId);
+
+        // --- writes, run one at a time in the order they came in --- //
+        bool write(const WriteJob &job); // blocks until the job has run and returns its result
+        void post(const WriteJob &job);  // same but doesnt wait
+        bool exec(const QString &sql, const QVariantList &values = QVariantList());
+
+    private:
+        DbManager();
+        ~DbManager();
+
+        struct PendingWrite;
+
+        QSqlDatabase threadDatabase();
+        static int schemaVersion(QSqlDatabase &db);
+        void enqueue(PendingWrite *pending);
+        void writerLoop();
+
+        mutable QMutex pathMutex;
+        QString dbPath;
+        QAtomicInt generation; // bumped when the path changes so thread connections know to reopen
+
+        std::atomic<QThread *> writerThread; // set under writeMutex, read without it by threadDatabase() and write()
+        QMutex writeMutex;
+        QWaitCondition writeReady;
+        QQueue<PendingWrite *> writeQueue;
+        bool stopping;
+    };
+#endif // DBMANAGER_H
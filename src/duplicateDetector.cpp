@@ -0,0 +1,493 @@
+#include "duplicateDetector.h"
+#include "dbManager.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <QHash>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAMMING_RUNTIME_DISPATCH // default builds arent -march=native, pick the kernel on the cpu it runs on
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    const int commonKeyLimit = 256; // postings per key before it counts as silence/noise and gets skipped
+
+    // one index hit: song a's frame lines up with song b's frame + offset
+    struct Vote
+    {
+        int a;
+        int b;
+        int offset;
+
+        bool operator<(const Vote &other) const
+        {
+            if (a != other.a)
+            {
+                return a < other.a;
+            }
+            if (b != other.b)
+            {
+                return b < other.b;
+            }
+            return offset < other.offset;
+        }
+    };
+
+    struct UnionFind
+    {
+        explicit UnionFind(int size) : parent(size)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                parent[i] = i;
+            }
+        }
+
+        int find(int x)
+        {
+            while (parent[x] != x)
+            {
+                parent[x] = parent[parent[x]]; // halve the path as we go
+                x = parent[x];
+            }
+            return x;
+        }
+
+        QVector<int> parent;
+    };
+}
+
+// --- bit error rate kernel --- //
+
+namespace
+{
+#if defined(__AVX2__) || defined(HAMMING_RUNTIME_DISPATCH)
+    // nibble lookup popcount, 8 sub fingerprints a step, byte counts summed with sad into 4 x 64 bit lanes.
+    // returns the bits of the whole steps and how far they got in *done
+#if defined(HAMMING_RUNTIME_DISPATCH)
+    __attribute__((target("avx2")))
+#endif
+    qint64 hammingAvx2(const quint32 *a, const quint32 *b, int count, int *done)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+        __m256i total = _mm256_setzero_si256();
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+            __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowNibble)),
+                                             _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble)));
+            total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+        }
+
+        alignas(32) quint64 lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), total);
+        *done = i;
+        return qint64(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+#endif
+
+#if defined(HAMMING_RUNTIME_DISPATCH)
+    // the scalar loop below, with one popcnt instruction per pair instead of the bit twiddling fallback
+    __attribute__((target("popcnt")))
+    qint64 hammingPopcnt(const quint32 *a, const quint32 *b, int count, int i)
+    {
+        qint64 bits = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            quint64 x;
+            quint64 y;
+            std::memcpy(&x, a + i, sizeof(x));
+            std::memcpy(&y, b + i, sizeof(y));
+            bits += __builtin_popcountll(x ^ y);
+        }
+        for (; i < count; i++)
+        {
+            bits += __builtin_popcount(a[i] ^ b[i]);
+        }
+        return bits;
+    }
+#endif
+
+    // two sub fingerprints per 64 bit popcount, from i on. the tail after any simd, or everything without it
+    qint64 hammingScalar(const quint32 *a, const quint32 *b, int count, int i)
+    {
+        qint64 bits = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            quint64 x;
+            quint64 y;
+            std::memcpy(&x, a + i, sizeof(x));
+            std::memcpy(&y, b + i, sizeof(y));
+            bits += qPopulationCount(x ^ y);
+        }
+        for (; i < count; i++)
+        {
+            bits += qPopulationCount(a[i] ^ b[i]);
+        }
+        return bits;
+    }
+
+#if defined(HAMMING_RUNTIME_DISPATCH)
+    enum class Kernel
+    {
+        Avx2,
+        Popcnt,
+        Scalar
+    };
+
+    Kernel pickKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        {
+            return Kernel::Avx2;
+        }
+        return __builtin_cpu_supports("popcnt") ? Kernel::Popcnt : Kernel::Scalar;
+    }
+#endif
+}
+
+qint64 DuplicateDetector::hammingDistance(const quint32 *a, const quint32 *b, int count)
+{
+#if defined(__AVX2__)
+    int done = 0;
+    const qint64 bits = hammingAvx2(a, b, count, &done);
+    return bits + hammingScalar(a, b, count, done);
+#elif defined(HAMMING_RUNTIME_DISPATCH)
+    static const Kernel kernel = pickKernel(); // once, the cpu doesnt change under us
+    switch (kernel)
+    {
+        case Kernel::Avx2:
+        {
+            int done = 0;
+            const qint64 bits = hammingAvx2(a, b, count, &done);
+            return bits + hammingPopcnt(a, b, count, done);
+        }
+        case Kernel::Popcnt:
+            return hammingPopcnt(a, b, count, 0);
+        case Kernel::Scalar:
+            break;
+    }
+    return hammingScalar(a, b, count, 0);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // per byte popcount, 4 sub fingerprints a step
+    qint64 bits = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t x = veorq_u32(vld1q_u32(a + i), vld1q_u32(b + i));
+        bits += vaddlvq_u8(vcntq_u8(vreinterpretq_u8_u32(x)));
+    }
+    return bits + hammingScalar(a, b, count, i);
+#else
+    return hammingScalar(a, b, count, 0);
+#endif
+}
+
+float DuplicateDetector::bitErrorRate(const quint32 *a, const quint32 *b, int count)
+{
+    if (count <= 0)
+    {
+        return 1.0f;
+    }
+    return float(hammingDistance(a, b, count)) / float(count * 32);
+}
+
+// --- index keys --- //
+
+// the low classifier bits flip most between encodes, the top 24 survive a re-rip most of the time
+quint32 DuplicateDetector::indexKey(quint32 subFingerprint)
+{
+    return subFingerprint >> 8;
+}
+
+// only one key in 8 goes in the index. picked on the value not the position, so two copies keep the
+// same frames whatever their offset, and the index stays an eighth of the size
+bool DuplicateDetector::sampled(quint32 key)
+{
+    return ((key * 2654435761u) >> 29) == 0;
+}
+
+// --- songs --- //
+
+void DuplicateDetector::add(qint64 songId, const QVector<quint32> &raw, int duration)
+{
+    Song song;
+    song.id = songId;
+    song.duration = duration;
+    song.offset = frames.size();
+    song.length = qMin<int>(raw.size(), storedFrames);
+
+    frames.resize(song.offset + song.length);
+    std::copy(raw.constBegin(), raw.constBegin() + song.length, frames.begin() + song.offset);
+    songs.append(song);
+}
+
+bool DuplicateDetector::load()
+{
+    QElapsedTimer timer;
+    timer.start();
+    clear();
+
+    QVector<quint32> raw;
+    bool ok = DbManager::instance().select("SELECT song_id, raw, duration FROM fingerprints WHERE status = 0 AND raw IS NOT NULL ORDER BY song_id", {},
+                                           [&](const QSqlQuery &query)
+    {
+        // little endian uint32s, as AudioFingerprint::packRaw writes them
+        QByteArray packed = query.value(1).toByteArray();
+        int count = qMin<int>(packed.size() / int(sizeof(quint32)), storedFrames);
+
+        raw.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            raw[i] = qFromLittleEndian<quint32>(packed.constData() + i * sizeof(quint32));
+        }
+        add(query.value(0).toLongLong(), raw, query.value(2).toInt());
+    });
+
+    qDebug() << "duplicate detector loaded" << songs.size() << "fingerprints in" << timer.elapsed() << "ms";
+    return ok;
+}
+
+void DuplicateDetector::clear()
+{
+    songs.clear();
+    frames.clear();
+}
+
+int DuplicateDetector::size() const
+{
+    return songs.size();
+}
+
+// --- search --- //
+
+QList<DuplicateDetector::Match> DuplicateDetector::findMatches(const Options &options, Stats *stats) const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Stats local;
+    local.songs = songs.size();
+    const int window = qBound(1, options.window, int(storedFrames));
+
+    // --- inverted index as one sorted run of (key, song, frame), equal keys sit together --- //
+    std::vector<Posting> postings;
+    postings.reserve(size_t(songs.size()) * (window / 8 + 4));
+
+    for (int s = 0; s < songs.size(); s++)
+    {
+        const quint32 *song = frames.constData() + songs[s].offset;
+        const int length = qMin(songs[s].length, window);
+
+        quint32 previous = 0;
+        for (int i = 0; i < length; i++)
+        {
+            quint32 key = indexKey(song[i]);
+            if ((i > 0 && key == previous) || !sampled(key)) // held notes and silence repeat the same value
+            {
+                previous = key;
+                continue;
+            }
+            postings.push_back({key, s, i});
+            previous = key;
+        }
+    }
+
+    std::sort(postings.begin(), postings.end(), [](const Posting &x, const Posting &y)
+    {
+        return x.key != y.key ? x.key < y.key : (x.song != y.song ? x.song < y.song : x.frame < y.frame);
+    });
+    local.postings = qint64(postings.size());
+    local.indexMs = timer.elapsed();
+
+    // --- offset voting, only songs sharing a key ever meet --- //
+    std::vector<Vote> votes;
+    for (size_t start = 0; start < postings.size();)
+    {
+        size_t end = start + 1;
+        while (end < postings.size() && postings[end].key == postings[start].key)
+        {
+            end++;
+        }
+
+        if (end - start > 1 && end - start <= size_t(commonKeyLimit))
+        {
+            for (size_t x = start; x < end; x++)
+            {
+                for (size_t y = x + 1; y < end; y++)
+                {
+                    const Posting &p = postings[x];
+                    const Posting &q = postings[y];
+                    if (p.song == q.song)
+                    {
+                        continue;
+                    }
+
+                    int offset = q.frame - p.frame;
+                    if (qAbs(offset) > options.maxOffset)
+                    {
+                        continue;
+                    }
+
+                    if (options.maxDurationDiff > 0 && songs[p.song].duration > 0 && songs[q.song].duration > 0 &&
+                        qAbs(songs[p.song].duration - songs[q.song].duration) > options.maxDurationDiff)
+                    {
+                        continue;
+                    }
+
+                    votes.push_back({p.song, q.song, offset}); // p.song < q.song, postings are sorted by song within a key
+                }
+            }
+        }
+        start = end;
+    }
+
+    std::sort(votes.begin(), votes.end());
+
+    // --- best offset per pair, then the real check at that offset --- //
+    QList<Match> matches;
+    for (size_t start = 0; start < votes.size();)
+    {
+        const int a = votes[start].a;
+        const int b = votes[start].b;
+
+        int bestOffset = 0;
+        int bestVotes = 0;
+        size_t end = start;
+        while (end < votes.size() && votes[end].a == a && votes[end].b == b)
+        {
+            size_t run = end;
+            while (run < votes.size() && votes[run].a == a && votes[run].b == b && votes[run].offset == votes[end].offset)
+            {
+                run++;
+            }
+            if (int(run - end) > bestVotes)
+            {
+                bestVotes = int(run - end);
+                bestOffset = votes[end].offset;
+            }
+            end = run;
+        }
+        start = end;
+
+        if (bestVotes < options.minVotes)
+        {
+            continue;
+        }
+        local.candidates++;
+
+        const Song &first = songs[a];
+        const Song &second = songs[b];
+        const quint32 *x = frames.constData() + first.offset;
+        const quint32 *y = frames.constData() + second.offset;
+
+        // a frame either side as well, the vote can land one off when the shift is between frames
+        Match best;
+        best.bitErrorRate = 1.0f;
+        for (int offset = bestOffset - 1; offset <= bestOffset + 1; offset++)
+        {
+            int from = qMax(0, -offset);
+            int to = qMin(qMin(first.length, window), qMin(second.length, window) - offset);
+            if (to - from < options.minOverlap)
+            {
+                continue;
+            }
+
+            float ber = bitErrorRate(x + from, y + from + offset, to - from);
+            if (ber < best.bitErrorRate)
+            {
+                best.bitErrorRate = ber;
+                best.offset = offset;
+            }
+        }
+
+        if (best.bitErrorRate <= options.maxBitErrorRate)
+        {
+            best.first = first.id;
+            best.second = second.id;
+            matches.append(best);
+        }
+    }
+
+    local.matches = matches.size();
+    local.searchMs = timer.elapsed() - local.indexMs;
+
+    if (stats)
+    {
+        *stats = local;
+    }
+    return matches;
+}
+
+QList<DuplicateDetector::Cluster> DuplicateDetector::findDuplicates(const Options &options, Stats *stats) const
+{
+    const QList<Match> matches = findMatches(options, stats);
+
+    QHash<qint64, int> indexById;
+    indexById.reserve(songs.size());
+    for (int s = 0; s < songs.size(); s++)
+    {
+        indexById.insert(songs[s].id, s);
+    }
+
+    // --- union find over the matches, each root keeps the worst error rate that joined its group --- //
+    UnionFind groups(songs.size());
+    QHash<int, float> worst;
+    for (const Match &match : matches)
+    {
+        int a = groups.find(indexById.value(match.first));
+        int b = groups.find(indexById.value(match.second));
+
+        float rate = qMax(match.bitErrorRate, qMax(worst.value(a), worst.value(b)));
+        if (a != b)
+        {
+            groups.parent[b] = a;
+            worst.remove(b);
+        }
+        worst.insert(a, rate);
+    }
+
+    QHash<int, Cluster> clustersByRoot;
+    for (auto it = worst.constBegin(); it != worst.constEnd(); ++it)
+    {
+        clustersByRoot[it.key()].worstBitErrorRate = it.value();
+    }
+    for (int s = 0; s < songs.size(); s++)
+    {
+        auto cluster = clustersByRoot.find(groups.find(s));
+        if (cluster != clustersByRoot.end())
+        {
+            cluster->songIds.append(songs[s].id);
+        }
+    }
+
+    QList<Cluster> clusters;
+    clusters.reserve(clustersByRoot.size());
+    for (Cluster &cluster : clustersByRoot)
+    {
+        std::sort(cluster.songIds.begin(), cluster.songIds.end());
+        clusters.append(cluster);
+    }
+
+    std::sort(clusters.begin(), clusters.end(), [](const Cluster &x, const Cluster &y)
+    {
+        return x.songIds.size() != y.songIds.size() ? x.songIds.size() > y.songIds.size() : x.songIds.first() < y.songIds.first();
+    });
+    return clusters;
+}
@@ -0,0 +1,84 @@
+#ifndef DUPLICATEDETECTOR_H
+#define DUPLICATEDETECTOR_H
+
+#include <QList>
+#include <QVector>
+
+// finds the same recording ripped more than once (different bitrate, format, a little lead in) from the raw
+// chromaprint fingerprints the library job stores. candidate pairs come out of an inverted index over
+// sampled sub fingerprints with offset voting, so nothing is compared all against all, then each candidate
+// is checked with a popcount bit error rate at its voted offset and matches are grouped into clusters
+class DuplicateDetector
+{
+    public:
+        struct Options
+        {
+            double maxBitErrorRate = 0.15; // same recording re-encoded sits well under this, different ones near 0.5
+            int window = 256;              // sub fingerprints compared per song, ~32s from the start
+            int maxOffset = 40;            // frames either way the two copies may be shifted by, ~5s
+            int minOverlap = 64;           // frames that have to line up before the error rate means anything
+            int minVotes = 3;              // index hits at one offset before a pair is checked
+            int maxDurationDiff = 5;       // seconds, songs further apart arent the same rip. 0 turns it off
+        };
+
+        struct Match
+        {
+            qint64 first = 0;
+            qint64 second = 0;
+            int offset = 0;        // second's frame = first's frame + offset
+            float bitErrorRate = 0;
+        };
+
+        struct Cluster
+        {
+            QVector<qint64> songIds;   // ascending
+            float worstBitErrorRate = 0; // highest of the matches that joined it
+        };
+
+        struct Stats
+        {
+            int songs = 0;
+            qint64 postings = 0;    // sub fingerprints in the index
+            qint64 candidates = 0;  // pairs that got enough votes to be checked
+            qint64 matches = 0;
+            qint64 indexMs = 0;
+            qint64 searchMs = 0;
+        };
+
+        void add(qint64 songId, const QVector<quint32> &raw, int duration); // only the first storedFrames are kept
+        bool load();  // every good fingerprint in the fingerprints table, false if there isnt one
+        void clear();
+        int size() const;
+
+        QList<Match> findMatches(const Options &options = Options(), Stats *stats = nullptr) const;
+        QList<Cluster> findDuplicates(const Options &options = Options(), Stats *stats = nullptr) const; // biggest first
+
+        // share of differing bits between two equal length runs of sub fingerprints
+        static float bitErrorRate(const quint32 *a, const quint32 *b, int count);
+        static qint64 hammingDistance(const quint32 *a, const quint32 *b, int count);
+
+        static const int storedFrames = 320; // window + maxOffset with room to spare, ~1.3kb a song
+
+    private:
+        struct Song
+        {
+            qint64 id;
+            int duration;
+            int offset; // into frames
+            int length;
+        };
+
+        struct Posting
+        {
+            quint32 key;
+            int song;
+            int frame;
+        };
+
+        static quint32 indexKey(quint32 subFingerprint);
+        static bool sampled(quint32 key);
+
+        QVector<Song> songs;
+        QVector<quint32> frames; // every songs stored frames back to back
+    };
+#endif // DUPLICATEDETECTOR_H
@@ -0,0 +1,66 @@
+#include "fingerprintJob.h"
+#include "audiofingerprint.h"
+#include "libScan.h"
+
+FingerprintJob::FingerprintJob(QObject *parent) : LibraryJob(spec(), parent)
+{
+}
+
+// the table and its migration live with the rest of the library schema
+void FingerprintJob::createTable(sqlite3 *db)
+{
+    LibScan::createCacheTables(db);
+}
+
+int FingerprintJob::pendingCount(sqlite3 *db, bool retryFailed)
+{
+    return LibraryJob::pendingCount(spec(), db, retryFailed);
+}
+
+bool FingerprintJob::run(const QString &dbPath, const JobOptions &options, Progress *result, const std::atomic<bool> *cancel)
+{
+    return LibraryJob::run(spec(), dbPath, options, result, cancel);
+}
+
+LibraryJob::Spec FingerprintJob::spec()
+{
+    Spec spec;
+    spec.name = "fingerprint";
+    spec.table = "fingerprints";
+    spec.columns = QStringList{"fingerprint", "raw", "duration", "content_hash"};
+    spec.extraColumn = "CASE WHEN t.status = 0 THEN t.content_hash END"; // of the last good fingerprint
+    spec.createTables = &FingerprintJob::createTable;
+
+    spec.process = [](const Song &song, const std::atomic<bool> *cancel)
+    {
+        Outcome outcome;
+        const QByteArray hash = AudioFingerprint::contentHash(song.path);
+        const QByteArray previousHash = song.extra.toByteArray();
+
+        if (!previousHash.isEmpty() && hash == previousHash) // touched, not changed
+        {
+            outcome.ok = true;
+            outcome.restamp = true;
+            return outcome;
+        }
+
+        AudioFingerprint::FingerprintData data;
+        outcome.ok = AudioFingerprint::fingerprintFile(song.path, &data, &outcome.error, cancel);
+        outcome.bytesRead = data.bytesRead;
+        if (outcome.ok)
+        {
+            const QByteArray fingerprint = data.fingerprint;
+            const QByteArray raw = AudioFingerprint::packRaw(data.raw);
+            const int duration = data.duration;
+            outcome.bind = [fingerprint, raw, duration, hash](sqlite3_stmt *insert)
+            {
+                sqlite3_bind_text(insert, 2, fingerprint.constData(), fingerprint.size(), SQLITE_TRANSIENT);
+                sqlite3_bind_blob(insert, 3, raw.constData(), raw.size(), SQLITE_TRANSIENT);
+                sqlite3_bind_int(insert, 4, duration);
+                sqlite3_bind_text(insert, 5, hash.constData(), hash.size(), SQLITE_TRANSIENT);
+            };
+        }
+        return outcome;
+    };
+    return spec;
+}
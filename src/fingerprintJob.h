@@ -0,0 +1,22 @@
+#ifndef FINGERPRINTJOB_H
+#define FINGERPRINTJOB_H
+
+#include "libraryJob.h"
+
+// fingerprints every song in the library db in the background and keeps the results in a fingerprints table.
+// a file that was touched but whose contents hash the same keeps its fingerprint, only its stamp is rewritten
+class FingerprintJob : public LibraryJob
+{
+    Q_OBJECT
+
+    public:
+        explicit FingerprintJob(QObject *parent = nullptr);
+
+        // blocks until every pending song is done or cancel goes true
+        static bool run(const QString &dbPath, const JobOptions &options = JobOptions(), Progress *result = nullptr, const std::atomic<bool> *cancel = nullptr);
+
+        static void createTable(sqlite3 *db);
+        static int pendingCount(sqlite3 *db, bool retryFailed = false);
+        static Spec spec();
+    };
+#endif // FINGERPRINTJOB_H
@@ -0,0 +1,371 @@
+#include "gaplessPlayer.h"
+#include "playQueue.h"
+#include "audioEngine.h"
+#include <QDebug>
+#include <QUrl>
+
+GaplessPlayer::GaplessPlayer(PlayQueue *queue, Backend backend, QObject *parent, const AudioEngine::Options &engineOptions) :
+    QObject(parent), queue(queue), engine(nullptr), active(0), state(QMediaPlayer::StoppedState), advancing(false), handoffUs(-1),
+    handoffPending(false)
+{
+    connect(queue, &PlayQueue::currentChanged, this, &GaplessPlayer::onCurrentChanged);
+    connect(queue, &PlayQueue::nextChanged, this, &GaplessPlayer::onNextChanged);
+
+    if (backend == Backend::Native)
+    {
+        engine = new AudioEngine(engineOptions, this);
+        connect(engine, &AudioEngine::positionChanged, this, &GaplessPlayer::positionChanged);
+        connect(engine, &AudioEngine::durationChanged, this, &GaplessPlayer::durationChanged);
+        connect(engine, &AudioEngine::trackChanged, this, &GaplessPlayer::onEngineTrackChanged);
+        connect(engine, &AudioEngine::finished, this, [this]()
+        {
+            setState(QMediaPlayer::StoppedState);
+            emit queueFinished();
+        });
+        connect(engine, &AudioEngine::errorOccurred, this, [this](const QString &message)
+        {
+            qWarning() << "playback error:" << message;
+        });
+        return;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        decks[i].player = new QMediaPlayer(this);
+        decks[i].output = new QAudioOutput(this);
+        decks[i].player->setAudioOutput(decks[i].output);
+
+        // both decks stay connected, only the active one gets forwarded
+        connect(decks[i].player, &QMediaPlayer::positionChanged, this, [this, i](qint64 position)
+        {
+            if (i != active)
+            {
+                return;
+            }
+            if (handoffPending && position > 0) // the deck we switched to is actually playing
+            {
+                handoffPending = false;
+                handoffUs = handoffTimer.nsecsElapsed() / 1000;
+                qDebug() << "handoff to" << decks[i].path << "took" << handoffUs << "us";
+            }
+            emit positionChanged(position);
+        });
+        connect(decks[i].player, &QMediaPlayer::durationChanged, this, [this, i](qint64 duration)
+        {
+            if (i == active)
+            {
+                emit durationChanged(duration);
+            }
+        });
+        connect(decks[i].player, &QMediaPlayer::mediaStatusChanged, this, [this, i](QMediaPlayer::MediaStatus status)
+        {
+            onMediaStatus(i, status);
+        });
+        connect(decks[i].player, &QMediaPlayer::errorOccurred, this, [this, i](QMediaPlayer::Error, const QString &message)
+        {
+            qWarning() << "playback error:" << decks[i].path << message;
+            if (i == active && state == QMediaPlayer::PlayingState)
+            {
+                handoff(); // skip the broken file rather than stop the whole queue
+            }
+        });
+    }
+}
+
+GaplessPlayer::Deck &GaplessPlayer::current()
+{
+    return decks[active];
+}
+
+GaplessPlayer::Deck &GaplessPlayer::standby()
+{
+    return decks[1 - active];
+}
+
+void GaplessPlayer::play()
+{
+    if (engine)
+    {
+        if (!engine->currentPath().isEmpty())
+        {
+            if (engine->atEnd()) // like QMediaPlayer, play after the end starts over
+            {
+                engine->seekFrame(0);
+            }
+            engine->play();
+            setState(QMediaPlayer::PlayingState);
+        }
+        return;
+    }
+
+    if (current().path.isEmpty())
+    {
+        return;
+    }
+
+    current().player->play();
+    setState(QMediaPlayer::PlayingState);
+}
+
+void GaplessPlayer::pause()
+{
+    if (engine)
+    {
+        engine->pause();
+    }
+    else
+    {
+        current().player->pause();
+    }
+    setState(QMediaPlayer::PausedState);
+}
+
+void GaplessPlayer::stop()
+{
+    if (engine)
+    {
+        engine->stop();
+    }
+    else
+    {
+        current().player->stop();
+    }
+    setState(QMediaPlayer::StoppedState);
+}
+
+void GaplessPlayer::setPosition(qint64 position)
+{
+    if (engine)
+    {
+        engine->seek(position);
+    }
+    else
+    {
+        current().player->setPosition(position);
+    }
+}
+
+qint64 GaplessPlayer::position() const
+{
+    return engine ? engine->position() : decks[active].player->position();
+}
+
+qint64 GaplessPlayer::duration() const
+{
+    return engine ? engine->duration() : decks[active].player->duration();
+}
+
+QMediaPlayer::PlaybackState GaplessPlayer::playbackState() const
+{
+    return state;
+}
+
+QString GaplessPlayer::currentPath() const
+{
+    return engine ? engine->currentPath() : decks[active].path;
+}
+
+bool GaplessPlayer::nextReady() const
+{
+    if (engine)
+    {
+        return !queue->next().isEmpty() && engine->nextPath() == queue->next();
+    }
+
+    const Deck &deck = decks[1 - active];
+    return !deck.path.isEmpty() && deck.path == queue->next() &&
+           (deck.player->mediaStatus() == QMediaPlayer::LoadedMedia || deck.player->mediaStatus() == QMediaPlayer::BufferedMedia);
+}
+
+AudioEngine *GaplessPlayer::audioEngine() const
+{
+    return engine;
+}
+
+qint64 GaplessPlayer::lastHandoffUs() const
+{
+    return handoffUs;
+}
+
+void GaplessPlayer::load(Deck &deck, const QString &path)
+{
+    deck.player->stop();
+    deck.path = path;
+    deck.output->setVolume(qMin(1.0f, gainOf(path))); // QAudioOutput only attenuates
+    deck.player->setSource(path.isEmpty() ? QUrl() : QUrl::fromLocalFile(path));
+}
+
+void GaplessPlayer::setGainLookup(std::function<float(const QString &path)> lookup)
+{
+    gainLookup = std::move(lookup);
+    refreshGain();
+}
+
+void GaplessPlayer::refreshGain()
+{
+    if (engine)
+    {
+        engine->setGain(gainOf(engine->currentPath()));
+        if (!engine->nextPath().isEmpty())
+        {
+            engine->setNext(engine->nextPath(), gainOf(engine->nextPath())); // same track, only its gain changes
+        }
+        return;
+    }
+
+    for (Deck &deck : decks)
+    {
+        deck.output->setVolume(qMin(1.0f, gainOf(deck.path)));
+    }
+}
+
+float GaplessPlayer::gainOf(const QString &path) const
+{
+    return gainLookup && !path.isEmpty() ? gainLookup(path) : 1.0f;
+}
+
+// pausing a stopped player with a source is what gets the backend to open it and fill its first buffers
+void GaplessPlayer::warm(const QString &path)
+{
+    if (engine)
+    {
+        engine->setNext(path, gainOf(path)); // switched to on its first sample, with the track
+        return;
+    }
+
+    Deck &deck = standby();
+    if (deck.path == path)
+    {
+        return;
+    }
+
+    load(deck, path);
+    if (!path.isEmpty())
+    {
+        deck.player->pause();
+    }
+}
+
+// the active deck ran out, the warm one takes over and the old one gets the track after
+void GaplessPlayer::handoff()
+{
+    handoffTimer.start();
+
+    const QString next = queue->next();
+    if (next.isEmpty())
+    {
+        current().player->stop();
+        setState(QMediaPlayer::StoppedState);
+        emit queueFinished();
+        return;
+    }
+
+    if (standby().path != next) // queue changed too late to warm it, load it cold
+    {
+        load(standby(), next);
+    }
+
+    active = 1 - active;
+    current().player->play();
+    handoffPending = true; // done when it first reports a position
+
+    advancing = true;
+    queue->advance();
+    advancing = false;
+
+    emit trackChanged(next);
+    emit durationChanged(current().player->duration());
+
+    standby().player->stop();
+    standby().path.clear(); // at its end, even the same file queued twice needs warming again
+    warm(queue->next());
+}
+
+void GaplessPlayer::setState(QMediaPlayer::PlaybackState newState)
+{
+    if (state != newState)
+    {
+        state = newState;
+        emit playbackStateChanged(state);
+    }
+}
+
+// the user picked another track (or a new queue), keep playing if we were
+void GaplessPlayer::onCurrentChanged(const QString &path)
+{
+    if (advancing)
+    {
+        return;
+    }
+
+    if (engine) // keeps playing or paused across the open by itself
+    {
+        engine->open(path, gainOf(path));
+        if (path.isEmpty())
+        {
+            engine->pause();
+            setState(QMediaPlayer::StoppedState);
+        }
+        emit trackChanged(path);
+        warm(queue->next());
+        return;
+    }
+
+    const bool wasPlaying = state == QMediaPlayer::PlayingState;
+    handoffPending = false; // picked, not a handoff
+    current().player->stop();
+
+    if (!path.isEmpty() && standby().path == path) // jumping to the track that was warming up anyway
+    {
+        active = 1 - active;
+        current().player->setPosition(0);
+    }
+    else
+    {
+        load(current(), path);
+    }
+
+    if (path.isEmpty())
+    {
+        setState(QMediaPlayer::StoppedState);
+    }
+    else if (wasPlaying)
+    {
+        current().player->play();
+    }
+
+    emit trackChanged(path);
+    emit durationChanged(current().player->duration());
+    warm(queue->next());
+}
+
+void GaplessPlayer::onNextChanged(const QString &path)
+{
+    if (!advancing)
+    {
+        warm(path);
+    }
+}
+
+void GaplessPlayer::onMediaStatus(int deck, QMediaPlayer::MediaStatus status)
+{
+    if (deck == active && status == QMediaPlayer::EndOfMedia && state == QMediaPlayer::PlayingState)
+    {
+        handoff();
+    }
+}
+
+// the engine ran from one track into the next, the queue just has to catch up.
+// its gain came along with it when it was chained
+void GaplessPlayer::onEngineTrackChanged(const QString &path)
+{
+    const qint64 gapFrames = qMax<qint64>(0, engine->stats().lastGapFrames);
+    handoffUs = gapFrames * 1000000 / engine->sampleRate();
+
+    advancing = true;
+    queue->advance();
+    advancing = false;
+
+    emit trackChanged(path);
+    warm(queue->next());
+}
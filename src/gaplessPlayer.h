@@ -0,0 +1,96 @@
+#ifndef GAPLESSPLAYER_H
+#define GAPLESSPLAYER_H
+
+#include <QObject>
+#include <QString>
+#include <QMediaPlayer>
+#include <QAudioOutput>
+#include <QElapsedTimer>
+#include <functional>
+#include "audioEngine.h"
+
+class PlayQueue;
+
+// plays a PlayQueue. the native backend is AudioEngine, which decodes the next track into the same buffer
+// right behind the current one, so the output goes from one into the other without a single silent sample.
+// the MediaPlayer backend has two QMediaPlayer decks instead: while one plays, the other already has the next
+// track open and paused at 0, so when the playing deck hits the end of its media the switch is play() on a
+// warm deck. that still leaves whatever the backend takes to start the deck between the tracks
+class GaplessPlayer : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum class Backend
+        {
+            MediaPlayer,
+            Native // AudioEngine, own decoder thread and output buffer
+        };
+
+        // engineOptions only matter for Backend::Native, Output::Null there leaves pulling the audio to the caller
+        explicit GaplessPlayer(PlayQueue *queue, Backend backend = Backend::Native, QObject *parent = nullptr,
+                               const AudioEngine::Options &engineOptions = AudioEngine::Options());
+
+        void play();
+        void pause();
+        void stop();
+        void setPosition(qint64 position); // ms into the current track
+
+        // linear gain for a track, asked whenever one is loaded. the media player decks cant go over 1
+        void setGainLookup(std::function<float(const QString &path)> lookup);
+        void refreshGain(); // ask again for what is loaded, after the lookup's answers change
+
+        qint64 position() const;
+        qint64 duration() const;
+        QMediaPlayer::PlaybackState playbackState() const;
+        QString currentPath() const;
+        bool nextReady() const;     // the next track is chained behind the current one, or loaded on the standby deck
+        AudioEngine *audioEngine() const; // null unless Backend::Native
+
+        // silence between the last sample of one queued track and the first of the next at the last automatic
+        // switch, -1 before the first. native counts it in samples at the output, so it is exact. the media
+        // player decks cant say when a sample goes out, that is the time from the end of one deck's media to
+        // the next deck first reporting a position, which overstates it by up to a position report interval
+        qint64 lastHandoffUs() const;
+
+    signals:
+        void positionChanged(qint64 position);
+        void durationChanged(qint64 duration);
+        void playbackStateChanged(QMediaPlayer::PlaybackState state);
+        void trackChanged(const QString &path);
+        void queueFinished();
+
+    private:
+        struct Deck
+        {
+            QMediaPlayer *player = nullptr;
+            QAudioOutput *output = nullptr;
+            QString path; // what the deck has loaded, empty if nothing
+        };
+
+        Deck &current();
+        Deck &standby();
+
+        void load(Deck &deck, const QString &path);
+        void warm(const QString &path);
+        void handoff();
+        void setState(QMediaPlayer::PlaybackState newState);
+        float gainOf(const QString &path) const;
+
+        void onCurrentChanged(const QString &path);
+        void onNextChanged(const QString &path);
+        void onMediaStatus(int deck, QMediaPlayer::MediaStatus status);
+        void onEngineTrackChanged(const QString &path);
+
+        PlayQueue *queue;
+        AudioEngine *engine; // null unless Backend::Native
+        Deck decks[2];
+        int active;
+        QMediaPlayer::PlaybackState state; // ours, decks stop between tracks without the queue stopping
+        bool advancing;                    // queue moves we made ourselves during a handoff
+        qint64 handoffUs;
+        QElapsedTimer handoffTimer;        // media player only, from end of media until the next deck moves
+        bool handoffPending;
+        std::function<float(const QString &path)> gainLookup;
+    };
+#endif // GAPLESSPLAYER_H
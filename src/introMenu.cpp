@@ -22,13 +22,8 @@ void IntroMenu::selectMusicFolder() {
 
         qDebug() << "Database path:" << dbPath;
 
-        // Check if the database already exists
-        if (QFile::exists(dbPath)) {
-            qDebug() << "Database already exists, skipping scan";
-        } else {
-            // Call the scanMusicLibrary function
-            LibScan::scanMusicLibrary(folder, dbPath);
-        }
+        // Incremental scan, an existing database only gets new/changed files re-read
+        LibScan::scanMusicLibrary(folder, dbPath);
 
         emit musicFolderSelected(folder);
     } else {
@@ -0,0 +1,257 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QList>
+#include <cstdio>
+#include "libScan.h"
+#include "libraryJob.h"
+#include "fingerprintJob.h"
+#include "waveformJob.h"
+#include "loudnessJob.h"
+
+// lavender-scan: the library scanner without the gui, for building dbs on a server or from cron.
+// same LibScan / FingerprintJob / WaveformJob / LoudnessJob the app runs, the reco and search indexes are kept up by the scan itself
+
+namespace
+{
+    const qint64 progressEveryMs = 500; // text and json progress are both throttled to this
+
+    bool jsonOutput = false;
+    bool verbose = false;
+    QMutex outputMutex; // progress comes from the writer threads
+
+    // one json object per line on stdout, text goes to stderr so stdout stays clean for pipes
+    void emitLine(const QJsonObject &json, const QString &text)
+    {
+        QMutexLocker locker(&outputMutex);
+        if (jsonOutput)
+        {
+            fprintf(stdout, "%s\n", QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+            fflush(stdout);
+        }
+        else
+        {
+            fprintf(stderr, "%s\n", qPrintable(text));
+        }
+    }
+
+    // the scanner logs every song it writes, only worth seeing with --verbose
+    void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &message)
+    {
+        if (type == QtDebugMsg && !verbose)
+        {
+            return;
+        }
+
+        QMutexLocker locker(&outputMutex);
+        fprintf(stderr, "%s\n", qPrintable(message));
+    }
+
+    double perSecond(qint64 count, qint64 ms)
+    {
+        return ms > 0 ? count * 1000.0 / ms : 0;
+    }
+
+    QString megabytes(qint64 bytes)
+    {
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+    }
+
+    // what one library job is called in the progress and stats lines
+    struct JobNames
+    {
+        QString event;      // progress lines, "fingerprint"
+        QString doing;      // "fingerprinting: 10/200", "fingerprinting failed"
+        QString doneEvent;  // the stats line at the end
+        QString did;        // "fingerprinted 200 songs"
+        QString followUps;  // what Progress::followUps counts, "albums", empty if the job has none
+    };
+
+    // runs one of the jobs after the scan, throttled progress while it goes and one stats line at the end
+    bool runJob(const LibraryJob::Spec &spec, const QString &dbPath, int threads, const QElapsedTimer &timer, const JobNames &names, QJsonObject *stats)
+    {
+        LibraryJob::JobOptions jobOptions;
+        jobOptions.threadCount = threads;
+
+        qint64 lastJobReport = -progressEveryMs;
+        jobOptions.progress = [&](const LibraryJob::Progress &progress)
+        {
+            qint64 now = timer.elapsed();
+            if (now - lastJobReport < progressEveryMs && progress.done < progress.total)
+            {
+                return;
+            }
+            lastJobReport = now;
+
+            QJsonObject json{{"event", names.event}, {"done", progress.done}, {"total", progress.total},
+                             {"filesPerSecond", progress.filesPerSecond}, {"etaSeconds", progress.etaSeconds}};
+            emitLine(json, QString("%1: %2/%3, %4 files/s").arg(names.doing).arg(progress.done).arg(progress.total)
+                               .arg(progress.filesPerSecond, 0, 'f', 1));
+        };
+
+        LibraryJob::Progress job;
+        if (!LibraryJob::run(spec, dbPath, jobOptions, &job))
+        {
+            emitLine(QJsonObject{{"event", "error"}, {"message", names.doing + " failed"}}, names.doing + " failed");
+            return false;
+        }
+
+        // frames/s over the wall clock, how far ahead of real time the workers decode together
+        const double framesPerSecond = perSecond(job.framesDecoded, job.elapsedMs);
+        QJsonObject jobJson{{"songs", job.done}, {"failed", job.failed}, {"reused", job.reused},
+                            {"filesPerSecond", perSecond(job.done, job.elapsedMs)}, {"framesPerSecond", framesPerSecond},
+                            {"bytesRead", job.bytesRead}, {"elapsedMs", job.elapsedMs}};
+
+        QString text = QString("%1 %2 songs (%3 failed").arg(names.did).arg(job.done).arg(job.failed);
+        if (job.reused > 0)
+        {
+            text += QString(", %1 unchanged").arg(job.reused);
+        }
+        text += ")";
+        if (!names.followUps.isEmpty())
+        {
+            jobJson[names.followUps] = job.followUps;
+            text += QString(" and %1 %2").arg(job.followUps).arg(names.followUps);
+        }
+        text += QString(" in %1 ms, %2 read").arg(job.elapsedMs).arg(megabytes(job.bytesRead));
+        if (job.framesDecoded > 0)
+        {
+            text += QString(", %1 frames/s decoded").arg(framesPerSecond, 0, 'f', 0);
+        }
+
+        emitLine(QJsonObject{{"event", names.doneEvent}, {"stats", jobJson}}, text);
+        *stats = jobJson;
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lavender"); // same app data dir as the gui, so the default db is the same file
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("scans a music library into a lavender db without the gui");
+    parser.addHelpOption();
+    parser.addPositionalArgument("library", "music directory to scan");
+
+    QCommandLineOption dbOption("db", "library db to write, defaults to the one the app uses", "file",
+                                QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/lavender.db");
+    QCommandLineOption threadsOption({"j", "threads"}, "tag parsing / decoding workers, 0 = one per core", "count", "0");
+    QCommandLineOption fullOption("full", "ignore what the db already has and re-read every file");
+    QCommandLineOption fingerprintOption("fingerprint", "fingerprint new and changed songs after the scan");
+    QCommandLineOption waveformOption("waveforms", "build seek bar waveforms for new and changed songs after the scan");
+    QCommandLineOption loudnessOption("loudness", "measure R128 loudness of new and changed songs and their albums after the scan");
+    QCommandLineOption jsonOption("json", "progress and stats as one json object per line on stdout");
+    QCommandLineOption verboseOption({"v", "verbose"}, "log every file the scanner touches");
+
+    parser.addOptions({dbOption, threadsOption, fullOption, fingerprintOption, waveformOption, loudnessOption, jsonOption, verboseOption});
+    parser.process(app);
+
+    jsonOutput = parser.isSet(jsonOption);
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    if (parser.positionalArguments().size() != 1)
+    {
+        fprintf(stderr, "%s\n", qPrintable(parser.helpText()));
+        return 2;
+    }
+
+    bool threadsOk = false;
+    const int threads = parser.value(threadsOption).toInt(&threadsOk);
+    if (!threadsOk || threads < 0)
+    {
+        fprintf(stderr, "--threads wants a number, got %s\n", qPrintable(parser.value(threadsOption)));
+        return 2;
+    }
+
+    const QString library = QFileInfo(parser.positionalArguments().first()).absoluteFilePath();
+    const QString dbPath = QFileInfo(parser.value(dbOption)).absoluteFilePath();
+    QDir().mkpath(QFileInfo(dbPath).absolutePath());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // --- scan --- //
+    LibScan::ScanOptions scanOptions;
+    scanOptions.threadCount = threads;
+    scanOptions.incremental = !parser.isSet(fullOption);
+
+    qint64 lastScanReport = -progressEveryMs;
+    scanOptions.progress = [&](int albums, int songs)
+    {
+        qint64 now = timer.elapsed();
+        if (now - lastScanReport < progressEveryMs)
+        {
+            return;
+        }
+        lastScanReport = now;
+
+        QJsonObject json{{"event", "scan"}, {"albums", albums}, {"songs", songs}, {"elapsedMs", now}};
+        emitLine(json, QString("scanning: %1 albums, %2 songs").arg(albums).arg(songs));
+    };
+
+    LibScan::ScanStats scan;
+    if (!LibScan::scanMusicLibrary(library, dbPath, scanOptions, &scan))
+    {
+        emitLine(QJsonObject{{"event", "error"}, {"message", "scan failed"}}, "scan failed: " + library);
+        return 1;
+    }
+
+    const double filesPerSecond = perSecond(scan.files, scan.elapsedMs);
+    QJsonObject scanJson{{"files", scan.files}, {"albums", scan.albums}, {"songsWritten", scan.songsWritten},
+                         {"filesPerSecond", filesPerSecond}, {"bytesParsed", scan.bytesParsed},
+                         {"parseMs", scan.parseMs}, {"writeMs", scan.writeMs}, {"elapsedMs", scan.elapsedMs}};
+
+    // parse time is summed over the workers, so with several threads it can be more than the wall clock
+    emitLine(QJsonObject{{"event", "scanned"}, {"stats", scanJson}},
+             QString("scanned %1 files (%2 albums, %3 written) in %4 ms, %5 files/s, %6 parsed\n"
+                     "  tag parsing %7 ms across workers, db writes %8 ms")
+                 .arg(scan.files).arg(scan.albums).arg(scan.songsWritten).arg(scan.elapsedMs)
+                 .arg(filesPerSecond, 0, 'f', 1).arg(megabytes(scan.bytesParsed)).arg(scan.parseMs).arg(scan.writeMs));
+
+    QJsonObject done{{"event", "done"}, {"scan", scanJson}};
+
+    // --- library jobs, in the order the app runs them --- //
+    struct Job
+    {
+        bool wanted;
+        LibraryJob::Spec spec;
+        QString key; // in the done line
+        JobNames names;
+    };
+    const QList<Job> jobs{
+        {parser.isSet(fingerprintOption), FingerprintJob::spec(), "fingerprint", {"fingerprint", "fingerprinting", "fingerprinted", "fingerprinted", QString()}},
+        {parser.isSet(waveformOption), WaveformJob::spec(), "waveforms", {"waveform", "waveforms", "waveforms", "waveforms for", QString()}},
+        {parser.isSet(loudnessOption), LoudnessJob::spec(), "loudness", {"loudness", "loudness", "loudnessMeasured", "loudness for", "albums"}},
+    };
+
+    for (const Job &job : jobs)
+    {
+        if (!job.wanted)
+        {
+            continue;
+        }
+
+        QJsonObject stats;
+        if (!runJob(job.spec, dbPath, threads, timer, job.names, &stats))
+        {
+            return 1;
+        }
+        done[job.key] = stats;
+    }
+
+    done["elapsedMs"] = timer.elapsed();
+    if (jsonOutput)
+    {
+        emitLine(done, QString());
+    }
+    return 0;
+}
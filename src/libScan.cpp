@@ -3,13 +3,1232 @@
 #include <QFileInfo>
 #include <QDebug>
 #include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QScopedPointer>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include <atomic>
+#include <algorithm>
 #include <taglib/fileref.h>
 #include <taglib/tag.h>
 #include <sqlite3.h>
+#include "recoEngine.h"
+#include "waveform.h"
+#include "loudness.h"
 
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
 
+namespace
+{
+    // identity of a file on disk, if all three match the tags can't have changed
+    struct FileStamp
+    {
+        qint64 size = -1;
+        qint64 mtime = 0;   // ms since epoch
+        quint64 inode = 0;
+
+        bool operator==(const FileStamp &other) const
+        {
+            return size == other.size && mtime == other.mtime && inode == other.inode;
+        }
+    };
+
+    struct ScannedSong
+    {
+        enum Change
+        {
+            New,        // not in the db, tags parsed
+            Changed,    // in the db but the stamp moved, tags parsed
+            Unchanged,  // stamp matches, tags not touched
+            Moved       // same inode/size/mtime showed up under a new path, tags not touched
+        };
+
+        Change change = New;
+        qint64 existingId = 0;
+
+        QString name;
+        QString artist;
+        QString album;
+        QString genre;
+        QString path;
+        FileStamp stamp;
+    };
+
+    struct ScannedAlbum
+    {
+        QString name;
+        QString path;
+        QVector<ScannedSong> songs;
+    };
+
+    struct KnownSong
+    {
+        qint64 id = 0;
+        qint64 albumId = 0;
+        FileStamp stamp;
+    };
+
+    // what the db looked like before the scan, read only once the workers start
+    struct LibrarySnapshot
+    {
+        QHash<QString, KnownSong> songsByPath;
+        QHash<quint64, QString> pathsByInode;
+        QHash<QString, qint64> albumsByPath;
+
+        QVector<qint64> songIds;   // every row, older scans could leave duplicate paths behind
+        QVector<qint64> albumIds;
+    };
+
+    // shared by every worker, only ever added to
+    struct ParseCounters
+    {
+        std::atomic<int> files{0};
+        std::atomic<qint64> parseNs{0};
+        std::atomic<qint64> bytes{0};
+    };
+
+    // bounded hand-off between the tag parsing workers and the single db writer,
+    // workers block once the writer falls behind so memory stays flat on huge libraries
+    class AlbumQueue
+    {
+    public:
+        explicit AlbumQueue(int capacity) : capacity(qMax(1, capacity)) {}
+
+        void push(ScannedAlbum album)
+        {
+            QMutexLocker locker(&mutex);
+            while (albums.size() >= capacity)
+            {
+                notFull.wait(&mutex);
+            }
+            albums.enqueue(std::move(album));
+            notEmpty.wakeOne();
+        }
+
+        bool pop(ScannedAlbum &album) // false once closed and drained
+        {
+            QMutexLocker locker(&mutex);
+            while (albums.isEmpty() && !closed)
+            {
+                notEmpty.wait(&mutex);
+            }
+            if (albums.isEmpty())
+            {
+                return false;
+            }
+            album = albums.dequeue();
+            notFull.wakeOne();
+            return true;
+        }
+
+        void close()
+        {
+            QMutexLocker locker(&mutex);
+            closed = true;
+            notEmpty.wakeAll();
+        }
+
+    private:
+        QMutex mutex;
+        QWaitCondition notEmpty;
+        QWaitCondition notFull;
+        QQueue<ScannedAlbum> albums;
+        int capacity;
+        bool closed = false;
+    };
+
+    bool columnExists(sqlite3 *db, const char *table, const char *column)
+    {
+        QString query = QString("PRAGMA table_info(%1)").arg(table);
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(db, query.toUtf8().constData(), -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            return false;
+        }
+
+        bool exists = false;
+        while (!exists && sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            exists = qstrcmp(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)), column) == 0;
+        }
+        sqlite3_finalize(stmt);
+        return exists;
+    }
+
+    bool runSql(sqlite3 *db, const char *sql, const char *what)
+    {
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            qWarning() << what << "failed:" << errMsg;
+            sqlite3_free(errMsg);
+            return false;
+        }
+        return true;
+    }
+
+    // 1: artist/album/genre as text on every song row (no schema_version table)
+    // 2: tags interned into artists/genres/album_titles, songs keep integer ids
+    const int currentSchemaVersion = 2;
+
+    // tags only live in the dimension tables, songs point at them. song_details puts the text back for readers
+    const char *songsColumns = "(id INTEGER PRIMARY KEY, album_id INTEGER REFERENCES albums(id), name TEXT, "
+                               "artist_id INTEGER REFERENCES artists(id), album_title_id INTEGER REFERENCES album_titles(id), "
+                               "genre_id INTEGER REFERENCES genres(id), path TEXT, file_size INTEGER, file_mtime INTEGER, file_inode INTEGER)";
+
+    int schemaVersion(sqlite3 *db)
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT MAX(version) FROM schema_version", -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            return 1;
+        }
+
+        int version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        return qMax(1, version);
+    }
+
+    bool setSchemaVersion(sqlite3 *db, int version)
+    {
+        QString sql = QString("DELETE FROM schema_version; INSERT INTO schema_version (version) VALUES (%1);").arg(version);
+        return runSql(db, sql.toUtf8().constData(), "schema version");
+    }
+
+    // rebuilds songs around the dimension tables in one transaction, ids stay put so fingerprints
+    // and the reco index still line up. the old search index was over the text columns, it gets rebuilt after
+    bool migrateToVersion2(sqlite3 *db)
+    {
+        qDebug() << "migrating songs to the normalised schema";
+
+        QString sql = QString("BEGIN;"
+                              "DROP TRIGGER IF EXISTS songs_fts_insert; DROP TRIGGER IF EXISTS songs_fts_delete; DROP TRIGGER IF EXISTS songs_fts_update;"
+                              "DROP TABLE IF EXISTS songs_fts;"
+                              "INSERT OR IGNORE INTO artists (name) SELECT DISTINCT artist FROM songs WHERE artist IS NOT NULL;"
+                              "INSERT OR IGNORE INTO album_titles (name) SELECT DISTINCT album FROM songs WHERE album IS NOT NULL;"
+                              "INSERT OR IGNORE INTO genres (name) SELECT DISTINCT genre FROM songs WHERE genre IS NOT NULL;"
+                              "CREATE TABLE songs_normalised %1;"
+                              "INSERT INTO songs_normalised (id, album_id, name, artist_id, album_title_id, genre_id, path, file_size, file_mtime, file_inode) "
+                              "SELECT s.id, s.album_id, s.name, ar.id, t.id, g.id, s.path, s.file_size, s.file_mtime, s.file_inode FROM songs s "
+                              "LEFT JOIN artists ar ON ar.name = s.artist LEFT JOIN album_titles t ON t.name = s.album LEFT JOIN genres g ON g.name = s.genre;"
+                              "DROP TABLE songs;"
+                              "ALTER TABLE songs_normalised RENAME TO songs;"
+                              "DELETE FROM schema_version; INSERT INTO schema_version (version) VALUES (2);"
+                              "COMMIT;").arg(songsColumns);
+
+        if (!runSql(db, sql.toUtf8().constData(), "schema migration"))
+        {
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr); // old layout stays as it was, next open tries again
+            return false;
+        }
+        return true;
+    }
+
+    void createRecoTables(sqlite3 *db);
+    void createSearchIndex(sqlite3 *db);
+
+    void createTables(sqlite3 *db)
+    {
+        // check if tbls exist
+        if (!LibScan::tableExists(db, "albums"))
+        {
+            const char *createAlbumsTable = "CREATE TABLE albums (id INTEGER PRIMARY KEY, name TEXT, path TEXT)";
+            char *errMsg = nullptr;
+
+            int rc = sqlite3_exec(db, createAlbumsTable, nullptr, nullptr, &errMsg);
+
+            if (rc != SQLITE_OK)
+            {
+                qWarning() << "album table:" << errMsg;
+                sqlite3_free(errMsg);
+            }
+            else
+            {
+                qDebug() << "album table success";
+            }
+        }
+        else
+        {
+            qDebug() << "albums table exists.";
+        }
+
+        // every distinct tag string once, songs only carry the id
+        runSql(db, "CREATE TABLE IF NOT EXISTS artists (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+                   "CREATE TABLE IF NOT EXISTS album_titles (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+                   "CREATE TABLE IF NOT EXISTS genres (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+                   "CREATE TABLE IF NOT EXISTS schema_version (version INTEGER NOT NULL);", "dimension tables");
+
+        if (!LibScan::tableExists(db, "songs"))
+        {
+            QString createSongsTable = QString("CREATE TABLE songs %1").arg(songsColumns);
+            char *errMsg = nullptr;
+
+            int rc = sqlite3_exec(db, createSongsTable.toUtf8().constData(), nullptr, nullptr, &errMsg);
+            if (rc != SQLITE_OK)
+            {
+                qWarning() << "song table failed!:" << errMsg;
+                sqlite3_free(errMsg);
+            }
+            else
+            {
+                qDebug() << "songs table created.";
+                setSchemaVersion(db, currentSchemaVersion);
+            }
+        }
+        else
+        {
+            qDebug() << "song table exists.";
+
+            // dbs from before incremental scans have no stamp columns, rows without a stamp just get re-read once
+            const char *stampColumns[] = {"file_size", "file_mtime", "file_inode"};
+            for (const char *column : stampColumns)
+            {
+                if (!columnExists(db, "songs", column))
+                {
+                    QString alter = QString("ALTER TABLE songs ADD COLUMN %1 INTEGER").arg(column);
+                    char *errMsg = nullptr;
+                    if (sqlite3_exec(db, alter.toUtf8().constData(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+                    {
+                        qWarning() << "adding" << column << "failed:" << errMsg;
+                        sqlite3_free(errMsg);
+                    }
+                }
+            }
+
+            if (schemaVersion(db) < 2)
+            {
+                migrateToVersion2(db);
+            }
+        }
+
+        // path lookups drive every rescan. the album index covers the scoped snapshot outright,
+        // artist/genre ones answer "songs by x" and "artists/albums in genre x" without touching the table
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS idx_songs_path ON songs(path);"
+                             "CREATE INDEX IF NOT EXISTS idx_albums_path ON albums(path);"
+                             "CREATE INDEX IF NOT EXISTS idx_songs_album ON songs(album_id, path, file_size, file_mtime, file_inode);"
+                             "CREATE INDEX IF NOT EXISTS idx_songs_artist ON songs(artist_id, album_id);"
+                             "CREATE INDEX IF NOT EXISTS idx_songs_genre ON songs(genre_id, artist_id, album_id);", nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            qWarning() << "path index failed:" << errMsg;
+            sqlite3_free(errMsg);
+        }
+
+        // what every reader selects from, same shape songs had before the ids
+        runSql(db, "CREATE VIEW IF NOT EXISTS song_details AS "
+                   "SELECT s.id, s.album_id, s.name, ar.name AS artist, t.name AS album, g.name AS genre, s.path, s.artist_id, s.genre_id "
+                   "FROM songs s LEFT JOIN artists ar ON ar.id = s.artist_id LEFT JOIN album_titles t ON t.id = s.album_title_id "
+                   "LEFT JOIN genres g ON g.id = s.genre_id;", "song view");
+
+        createRecoTables(db);
+        createSearchIndex(db);
+        LibScan::createCacheTables(db);
+    }
+
+    // persisted recommendation index: raw term counts per song plus document frequencies,
+    // idf and norms are left to RecoEngine since they move every time a song is added
+    void createRecoTables(sqlite3 *db)
+    {
+        const char *recoTables = "CREATE TABLE IF NOT EXISTS reco_terms (id INTEGER PRIMARY KEY, term TEXT NOT NULL UNIQUE, df INTEGER NOT NULL DEFAULT 0);"
+                                 "CREATE TABLE IF NOT EXISTS reco_vectors (song_id INTEGER NOT NULL, term_id INTEGER NOT NULL, tf INTEGER NOT NULL, "
+                                 "PRIMARY KEY (song_id, term_id)) WITHOUT ROWID;"
+                                 "CREATE TABLE IF NOT EXISTS reco_meta (key TEXT PRIMARY KEY, value INTEGER);";
+
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, recoTables, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            qWarning() << "reco tables failed:" << errMsg;
+            sqlite3_free(errMsg);
+        }
+    }
+
+    // full text index over the song tags for SearchIndex. external content, so the text itself only lives in
+    // song_details (and through it the dimension tables), and triggers keep it in step with every write
+    // (scanner, watcher, tag edits) without anyone having to remember. deletes look the old tags up by id,
+    // dimension rows are only pruned after the songs pointing at them are gone.
+    // moves only touch album_id/path, so they dont fire the update trigger
+    void createSearchIndex(sqlite3 *db)
+    {
+        const bool existed = LibScan::tableExists(db, "songs_fts");
+
+        const char *searchIndex = "CREATE VIRTUAL TABLE IF NOT EXISTS songs_fts USING fts5(name, artist, album, genre, "
+                                  "content='song_details', content_rowid='id', tokenize='unicode61 remove_diacritics 2', prefix='2 3');"
+                                  "CREATE TRIGGER IF NOT EXISTS songs_fts_insert AFTER INSERT ON songs BEGIN "
+                                  "INSERT INTO songs_fts (rowid, name, artist, album, genre) SELECT id, name, artist, album, genre FROM song_details WHERE id = new.id; END;"
+                                  "CREATE TRIGGER IF NOT EXISTS songs_fts_delete AFTER DELETE ON songs BEGIN "
+                                  "INSERT INTO songs_fts (songs_fts, rowid, name, artist, album, genre) VALUES ('delete', old.id, old.name, "
+                                  "(SELECT name FROM artists WHERE id = old.artist_id), (SELECT name FROM album_titles WHERE id = old.album_title_id), "
+                                  "(SELECT name FROM genres WHERE id = old.genre_id)); END;"
+                                  "CREATE TRIGGER IF NOT EXISTS songs_fts_update AFTER UPDATE OF name, artist_id, album_title_id, genre_id ON songs BEGIN "
+                                  "INSERT INTO songs_fts (songs_fts, rowid, name, artist, album, genre) VALUES ('delete', old.id, old.name, "
+                                  "(SELECT name FROM artists WHERE id = old.artist_id), (SELECT name FROM album_titles WHERE id = old.album_title_id), "
+                                  "(SELECT name FROM genres WHERE id = old.genre_id)); "
+                                  "INSERT INTO songs_fts (rowid, name, artist, album, genre) SELECT id, name, artist, album, genre FROM song_details WHERE id = new.id; END;";
+
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, searchIndex, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            qWarning() << "search index failed (sqlite without fts5?):" << errMsg;
+            sqlite3_free(errMsg);
+            return;
+        }
+
+        if (!existed)
+        {
+            // title matches count most, then artist, album, genre. stored so ORDER BY rank uses it
+            // songs from before the index existed get indexed once here
+            if (sqlite3_exec(db, "INSERT INTO songs_fts (songs_fts, rank) VALUES ('rank', 'bm25(10.0, 5.0, 3.0, 1.0)');"
+                                 "INSERT INTO songs_fts (songs_fts) VALUES ('rebuild');", nullptr, nullptr, &errMsg) != SQLITE_OK)
+            {
+                qWarning() << "search index backfill failed:" << errMsg;
+                sqlite3_free(errMsg);
+            }
+        }
+    }
+
+    // the generation row only goes in once every song has been indexed, so no row means backfill
+    bool recoIndexBuilt(sqlite3 *db)
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT 1 FROM reco_meta WHERE key = 'generation'", -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            return false;
+        }
+
+        bool built = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return built;
+    }
+
+    // song rows are always selected as id, album_id, path, file_size, file_mtime, file_inode
+    void addSongRow(LibrarySnapshot &snapshot, sqlite3_stmt *stmt)
+    {
+        KnownSong song;
+        song.id = sqlite3_column_int64(stmt, 0);
+        song.albumId = sqlite3_column_int64(stmt, 1);
+        song.stamp.size = sqlite3_column_type(stmt, 3) == SQLITE_NULL ? -1 : sqlite3_column_int64(stmt, 3);
+        song.stamp.mtime = sqlite3_column_int64(stmt, 4);
+        song.stamp.inode = static_cast<quint64>(sqlite3_column_int64(stmt, 5));
+
+        QString path = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)));
+        snapshot.songsByPath.insert(path, song);
+        snapshot.songIds.append(song.id);
+
+        if (song.stamp.inode != 0)
+        {
+            snapshot.pathsByInode.insert(song.stamp.inode, path);
+        }
+    }
+
+    // album rows are always selected as id, path
+    void addAlbumRow(LibrarySnapshot &snapshot, sqlite3_stmt *stmt)
+    {
+        QString path = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)));
+        snapshot.albumsByPath.insert(path, sqlite3_column_int64(stmt, 0));
+        snapshot.albumIds.append(sqlite3_column_int64(stmt, 0));
+    }
+
+    LibrarySnapshot loadSnapshot(sqlite3 *db)
+    {
+        LibrarySnapshot snapshot;
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(db, "SELECT id, album_id, path, file_size, file_mtime, file_inode FROM songs", -1, &stmt, nullptr) == SQLITE_OK)
+        {
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                addSongRow(snapshot, stmt);
+            }
+        }
+        else
+        {
+            qWarning() << "song snapshot failed:" << sqlite3_errmsg(db);
+        }
+        sqlite3_finalize(stmt);
+
+        if (sqlite3_prepare_v2(db, "SELECT id, path FROM albums", -1, &stmt, nullptr) == SQLITE_OK)
+        {
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                addAlbumRow(snapshot, stmt);
+            }
+        }
+        else
+        {
+            qWarning() << "album snapshot failed:" << sqlite3_errmsg(db);
+        }
+        sqlite3_finalize(stmt);
+
+        qDebug() << "snapshot:" << snapshot.songsByPath.size() << "songs," << snapshot.albumsByPath.size() << "albums";
+        return snapshot;
+    }
+
+    // same as above but only for the given album dirs, used when syncing a handful of changed dirs
+    LibrarySnapshot loadSnapshot(sqlite3 *db, const QStringList &albumPaths)
+    {
+        LibrarySnapshot snapshot;
+        sqlite3_stmt *albumStmt;
+        sqlite3_stmt *songStmt;
+
+        if (sqlite3_prepare_v2(db, "SELECT id, path FROM albums WHERE path = ?", -1, &albumStmt, nullptr) != SQLITE_OK ||
+            sqlite3_prepare_v2(db, "SELECT id, album_id, path, file_size, file_mtime, file_inode FROM songs WHERE album_id = ?", -1, &songStmt, nullptr) != SQLITE_OK)
+        {
+            qWarning() << "scoped snapshot failed:" << sqlite3_errmsg(db);
+            sqlite3_finalize(albumStmt);
+            return snapshot;
+        }
+
+        for (const QString &albumPath : albumPaths)
+        {
+            sqlite3_bind_text(albumStmt, 1, albumPath.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(albumStmt) == SQLITE_ROW)
+            {
+                addAlbumRow(snapshot, albumStmt);
+
+                sqlite3_bind_int64(songStmt, 1, sqlite3_column_int64(albumStmt, 0));
+                while (sqlite3_step(songStmt) == SQLITE_ROW)
+                {
+                    addSongRow(snapshot, songStmt);
+                }
+                sqlite3_reset(songStmt);
+            }
+            sqlite3_reset(albumStmt);
+        }
+
+        sqlite3_finalize(albumStmt);
+        sqlite3_finalize(songStmt);
+        return snapshot;
+    }
+
+    // every album path at or below dir, sorted. a range on the path index instead of substr() so it
+    // doesnt walk the whole albums table, '0' is the character right after '/'
+    QStringList albumPathsUnder(sqlite3 *db, const QString &dir)
+    {
+        QStringList paths;
+        sqlite3_stmt *stmt;
+        const QByteArray path = dir.toUtf8();
+        const QByteArray from = path + '/';
+        const QByteArray to = path + '0';
+
+        if (sqlite3_prepare_v2(db, "SELECT path FROM albums WHERE path = ?1 OR (path >= ?2 AND path < ?3)", -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            qWarning() << "album lookup failed:" << sqlite3_errmsg(db);
+            return paths;
+        }
+
+        sqlite3_bind_text(stmt, 1, path.constData(), path.size(), SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, from.constData(), from.size(), SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, to.constData(), to.size(), SQLITE_TRANSIENT);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            paths.append(QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))));
+        }
+        sqlite3_finalize(stmt);
+
+        std::sort(paths.begin(), paths.end()); // sqlite orders by utf8 bytes, the lookups below by QString
+        return paths;
+    }
+
+    // whether a sorted albumPathsUnder() result has dir or anything below it, so a parent's sub dirs
+    // are checked against one query instead of one each
+    bool hasPathUnder(const QStringList &sortedPaths, const QString &dir)
+    {
+        auto it = std::lower_bound(sortedPaths.begin(), sortedPaths.end(), dir);
+        if (it != sortedPaths.end() && *it == dir)
+        {
+            return true;
+        }
+
+        const QString prefix = dir + "/"; // "dir 2" sorts between dir and dir/..., so look again from the slash
+        it = std::lower_bound(sortedPaths.begin(), sortedPaths.end(), prefix);
+        return it != sortedPaths.end() && it->startsWith(prefix);
+    }
+
+    FileStamp stampFor(const QFileInfo &entry)
+    {
+        FileStamp stamp;
+        stamp.size = entry.size();
+        stamp.mtime = entry.lastModified().toMSecsSinceEpoch();
+
+#ifdef Q_OS_UNIX
+        struct stat st;
+        if (::stat(QFile::encodeName(entry.absoluteFilePath()).constData(), &st) == 0)
+        {
+            stamp.inode = static_cast<quint64>(st.st_ino);
+        }
+#endif
+        return stamp;
+    }
+
+    // suffixes taglib can open, anything else is skipped without touching the file
+    const QSet<QString> &audioExtensions()
+    {
+        static const QSet<QString> extensions = []()
+        {
+            QSet<QString> result;
+            const TagLib::StringList supported = TagLib::FileRef::defaultFileExtensions();
+            for (const TagLib::String &extension : supported)
+            {
+                result.insert(QString::fromStdString(extension.to8Bit(true)).toLower());
+            }
+            return result;
+        }();
+        return extensions;
+    }
+
+    bool readTags(ScannedSong &song)
+    {
+        TagLib::FileRef f(song.path.toUtf8().constData());
+
+        if (f.isNull() || !f.tag())
+        {
+            return false;
+        }
+
+        //get metadata from song in question
+        TagLib::Tag *tag = f.tag();
+        song.name = QString::fromStdString(tag->title().to8Bit(true));
+        song.artist = QString::fromStdString(tag->artist().to8Bit(true));
+        song.album = QString::fromStdString(tag->album().to8Bit(true));
+        song.genre = QString::fromStdString(tag->genre().to8Bit(true));
+
+        if (song.genre.isEmpty()) // keep musicbrainz api happy
+        {
+            song.genre = "Unknown";
+        }
+        return true;
+    }
+
+    // list one album dir: files become songs, sub dirs are handed back for their own pass.
+    // only touches the filesystem and taglib so it is safe to run on any worker thread
+    ScannedAlbum readAlbum(const QFileInfo &albumEntry, const LibrarySnapshot &snapshot, ParseCounters &counters, QStringList &subDirs)
+    {
+        ScannedAlbum album;
+        album.name = albumEntry.fileName();
+        album.path = albumEntry.absoluteFilePath();
+
+        QDir albumDir(album.path);
+        QFileInfoList entries = albumDir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+
+        for (const QFileInfo &songEntry : entries)
+        {
+            if (songEntry.isDir())
+            {
+                subDirs.append(songEntry.absoluteFilePath());
+                continue;
+            }
+
+            if (!audioExtensions().contains(songEntry.suffix().toLower()))
+            {
+                continue;
+            }
+
+            counters.files++;
+
+            ScannedSong song;
+            song.path = songEntry.absoluteFilePath();
+            song.stamp = stampFor(songEntry);
+
+            auto known = snapshot.songsByPath.constFind(song.path);
+            if (known != snapshot.songsByPath.constEnd())
+            {
+                song.existingId = known->id;
+
+                if (known->stamp == song.stamp)
+                {
+                    song.change = ScannedSong::Unchanged;
+                    album.songs.append(song);
+                    continue;
+                }
+                song.change = ScannedSong::Changed;
+            }
+            else if (song.stamp.inode != 0 && snapshot.pathsByInode.contains(song.stamp.inode))
+            {
+                // renamed/moved inside the library, keep the row (and its id) instead of re-reading tags
+                QString oldPath = snapshot.pathsByInode.value(song.stamp.inode);
+                KnownSong moved = snapshot.songsByPath.value(oldPath);
+
+                if (moved.stamp == song.stamp && !QFileInfo::exists(oldPath))
+                {
+                    song.change = ScannedSong::Moved;
+                    song.existingId = moved.id;
+                    album.songs.append(song);
+                    continue;
+                }
+            }
+
+            QElapsedTimer parseTimer;
+            parseTimer.start();
+            bool readable = readTags(song);
+            counters.parseNs += parseTimer.nsecsElapsed();
+            counters.bytes += song.stamp.size;
+
+            if (readable) // new or changed, unreadable files fall out and get cleaned up
+            {
+                album.songs.append(song);
+            }
+        }
+
+        return album;
+    }
+
+    // applies parsed albums on top of the snapshot, single thread only.
+    // statements are compiled once per scan and rows are grouped into transactions
+    // so sqlite syncs once per batch instead of once per row
+    class LibraryWriter
+    {
+    public:
+        LibraryWriter(sqlite3 *db, const LibrarySnapshot &snapshot, int batchSize)
+            : db(db), snapshot(snapshot), batchSize(batchSize), pendingRows(0), inTransaction(false)
+        {
+        }
+
+        ~LibraryWriter()
+        {
+            commit();
+
+            for (sqlite3_stmt *stmt : statements)
+            {
+                sqlite3_finalize(stmt);
+            }
+        }
+
+        void commit()
+        {
+            if (inTransaction)
+            {
+                run("COMMIT");
+                inTransaction = false;
+            }
+            pendingRows = 0;
+        }
+
+        // returns the number of songs inserted or updated
+        int writeAlbum(const ScannedAlbum &album, bool *albumInserted = nullptr)
+        {
+            //--- find or insert album instance
+            qint64 albumId = snapshot.albumsByPath.value(album.path, 0);
+
+            if (albumId == 0)
+            {
+                bool ok = exec("INSERT INTO albums (name, path) VALUES (?, ?)", [&](sqlite3_stmt *stmt)
+                {
+                    sqlite3_bind_text(stmt, 1, album.name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                    sqlite3_bind_text(stmt, 2, album.path.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                });
+
+                if (!ok)
+                {
+                    qWarning() << "failed to insert album:" << sqlite3_errmsg(db);
+                    return 0;
+                }
+
+                albumId = sqlite3_last_insert_rowid(db);
+                qDebug() << "album inserted:" << album.name;
+
+                if (albumInserted)
+                {
+                    *albumInserted = true;
+                }
+            }
+            seenAlbums.insert(albumId);
+
+            //---- songs from the album ---- //
+            int songsWritten = 0;
+
+            for (const ScannedSong &song : album.songs)
+            {
+                bool ok = true;
+                TagIds tags;
+
+                switch (song.change)
+                {
+                    case ScannedSong::Unchanged:
+                        seenSongs.insert(song.existingId);
+                        continue;
+
+                    case ScannedSong::Moved:
+                        ok = exec("UPDATE songs SET album_id = ?, path = ? WHERE id = ?", [&](sqlite3_stmt *stmt)
+                        {
+                            sqlite3_bind_int64(stmt, 1, albumId);
+                            sqlite3_bind_text(stmt, 2, song.path.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                            sqlite3_bind_int64(stmt, 3, song.existingId);
+                        });
+                        seenSongs.insert(song.existingId);
+                        break;
+
+                    case ScannedSong::Changed:
+                        tags = tagIds(song);
+                        ok = exec("UPDATE songs SET album_id = ?, name = ?, artist_id = ?, album_title_id = ?, genre_id = ?, "
+                                  "file_size = ?, file_mtime = ?, file_inode = ? WHERE id = ?", [&](sqlite3_stmt *stmt)
+                        {
+                            bindSong(stmt, albumId, song, tags);
+                            sqlite3_bind_int64(stmt, 9, song.existingId);
+                        });
+                        seenSongs.insert(song.existingId);
+                        tagsDropped = true; // the old tag may have been its last user
+
+                        if (ok) // tags moved, so do its terms
+                        {
+                            unindexSong(song.existingId);
+                            indexSong(song.existingId, song.name, song.artist, song.genre, song.album);
+                        }
+                        break;
+
+                    case ScannedSong::New:
+                        // if insertion ok, bind taglib values to song db instance
+                        tags = tagIds(song);
+                        ok = exec("INSERT INTO songs (album_id, name, artist_id, album_title_id, genre_id, file_size, file_mtime, file_inode, path) "
+                                  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", [&](sqlite3_stmt *stmt)
+                        {
+                            bindSong(stmt, albumId, song, tags);
+                            sqlite3_bind_text(stmt, 9, song.path.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                        });
+                        if (ok)
+                        {
+                            qint64 songId = sqlite3_last_insert_rowid(db);
+                            seenSongs.insert(songId);
+                            indexSong(songId, song.name, song.artist, song.genre, song.album);
+                        }
+                        break;
+                }
+
+                if (!ok)
+                {
+                    qWarning() << "song write failed:" << song.path << sqlite3_errmsg(db);
+                    continue;
+                }
+
+                songsWritten++; // no line per song, a 100k library would log 100k of them
+            }
+
+            return songsWritten;
+        }
+
+        // drops an album row and its songs, songs already moved to another album are left alone
+        void removeAlbum(const QString &albumPath)
+        {
+            for (qint64 songId : idsFor("SELECT id FROM songs WHERE album_id IN (SELECT id FROM albums WHERE path = ?)", albumPath))
+            {
+                unindexSong(songId);
+            }
+
+            exec("DELETE FROM songs WHERE album_id IN (SELECT id FROM albums WHERE path = ?)", [&](sqlite3_stmt *stmt)
+            {
+                sqlite3_bind_text(stmt, 1, albumPath.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            });
+            tagsDropped = true;
+            exec("DELETE FROM albums WHERE path = ?", [&](sqlite3_stmt *stmt)
+            {
+                sqlite3_bind_text(stmt, 1, albumPath.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            });
+        }
+
+        // anything in the snapshot the scan never came across is gone from disk
+        void removeUnseen()
+        {
+            int songsRemoved = 0;
+            for (qint64 songId : snapshot.songIds)
+            {
+                if (seenSongs.contains(songId))
+                {
+                    continue;
+                }
+
+                unindexSong(songId);
+                if (execForId("DELETE FROM songs WHERE id = ?", songId))
+                {
+                    songsRemoved++;
+                    tagsDropped = true;
+                }
+            }
+
+            int albumsRemoved = 0;
+            for (qint64 albumId : snapshot.albumIds)
+            {
+                if (!seenAlbums.contains(albumId) && execForId("DELETE FROM albums WHERE id = ?", albumId))
+                {
+                    albumsRemoved++;
+                }
+            }
+
+            pruneTags();
+            finishRecoIndex();
+            commit();
+            qDebug() << "removed" << songsRemoved << "songs and" << albumsRemoved << "albums no longer on disk";
+        }
+
+        // dbs from before the reco index, every song already there gets its terms written once
+        void backfillRecoIndex()
+        {
+            QList<SongRecord> songs;
+            sqlite3_stmt *stmt;
+
+            if (sqlite3_prepare_v2(db, "SELECT id, name, artist, genre, album FROM song_details", -1, &stmt, nullptr) != SQLITE_OK)
+            {
+                qWarning() << "reco backfill failed:" << sqlite3_errmsg(db);
+                return;
+            }
+
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                SongRecord song;
+                song.id = sqlite3_column_int64(stmt, 0);
+                song.name = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)));
+                song.artist = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)));
+                song.genre = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3)));
+                song.album = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4)));
+                songs.append(song);
+            }
+            sqlite3_finalize(stmt);
+
+            for (const SongRecord &song : songs)
+            {
+                unindexSong(song.id); // a backfill cut short last time may have got to some of them
+                indexSong(song.id, song.name, song.artist, song.genre, song.album);
+            }
+
+            recoChanged = true;
+            qDebug() << "reco index backfilled for" << songs.size() << "songs";
+        }
+
+        void markRecoChanged()
+        {
+            recoChanged = true;
+        }
+
+    private:
+        struct TagIds
+        {
+            qint64 artist = 0;
+            qint64 albumTitle = 0;
+            qint64 genre = 0;
+        };
+
+        // one dimension table, the two statements are literals so they land in the statement cache
+        struct Dimension
+        {
+            const char *select;
+            const char *insert;
+            QHash<QString, qint64> ids; // looked up so far this scan
+        };
+
+        sqlite3_stmt *prepared(const char *sql)
+        {
+            sqlite3_stmt *stmt = statements.value(sql, nullptr);
+
+            if (!stmt)
+            {
+                if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+                {
+                    qWarning() << "prepare failed:" << sql << sqlite3_errmsg(db);
+                    return nullptr;
+                }
+                statements.insert(sql, stmt);
+            }
+            return stmt;
+        }
+
+        bool exec(const char *sql, const std::function<void(sqlite3_stmt *)> &bind)
+        {
+            sqlite3_stmt *stmt = prepared(sql);
+            if (!stmt)
+            {
+                return false;
+            }
+
+            if (batchSize > 1 && !inTransaction)
+            {
+                inTransaction = run("BEGIN");
+            }
+
+            bind(stmt);
+            int rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+
+            if (inTransaction && ++pendingRows >= batchSize)
+            {
+                commit();
+            }
+            return rc == SQLITE_DONE;
+        }
 
-bool LibScan::tableExists(sqlite3 *db, const QString &tableName) 
+        bool run(const char *sql)
+        {
+            char *errMsg = nullptr;
+            if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+            {
+                qWarning() << sql << "failed:" << errMsg;
+                sqlite3_free(errMsg);
+                return false;
+            }
+            return true;
+        }
+
+        bool execForId(const char *sql, qint64 id)
+        {
+            return exec(sql, [id](sqlite3_stmt *stmt) { sqlite3_bind_int64(stmt, 1, id); });
+        }
+
+        QVector<qint64> idsFor(const char *sql, const QString &value)
+        {
+            QVector<qint64> ids;
+            sqlite3_stmt *stmt = prepared(sql);
+            if (!stmt)
+            {
+                return ids;
+            }
+
+            sqlite3_bind_text(stmt, 1, value.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                ids.append(sqlite3_column_int64(stmt, 0));
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            return ids;
+        }
+
+        // --- reco index, kept in step with the songs table inside the same transactions --- //
+        qint64 termId(const QString &term)
+        {
+            auto cached = termIds.constFind(term);
+            if (cached != termIds.constEnd())
+            {
+                return cached.value();
+            }
+
+            qint64 id = 0;
+            sqlite3_stmt *stmt = prepared("SELECT id FROM reco_terms WHERE term = ?");
+            if (stmt)
+            {
+                sqlite3_bind_text(stmt, 1, term.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt) == SQLITE_ROW)
+                {
+                    id = sqlite3_column_int64(stmt, 0);
+                }
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+            }
+
+            if (id == 0)
+            {
+                bool ok = exec("INSERT INTO reco_terms (term, df) VALUES (?, 0)", [&](sqlite3_stmt *stmt)
+                {
+                    sqlite3_bind_text(stmt, 1, term.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                });
+                if (!ok)
+                {
+                    qWarning() << "reco term insert failed:" << term << sqlite3_errmsg(db);
+                    return 0;
+                }
+                id = sqlite3_last_insert_rowid(db);
+            }
+
+            termIds.insert(term, id);
+            return id;
+        }
+
+        // --- artists/album titles/genres, each distinct tag string gets one row --- //
+        qint64 internId(Dimension &dimension, const QString &name)
+        {
+            auto cached = dimension.ids.constFind(name);
+            if (cached != dimension.ids.constEnd())
+            {
+                return cached.value();
+            }
+
+            qint64 id = 0;
+            sqlite3_stmt *stmt = prepared(dimension.select);
+            if (stmt)
+            {
+                sqlite3_bind_text(stmt, 1, name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt) == SQLITE_ROW)
+                {
+                    id = sqlite3_column_int64(stmt, 0);
+                }
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+            }
+
+            if (id == 0)
+            {
+                bool ok = exec(dimension.insert, [&](sqlite3_stmt *stmt)
+                {
+                    sqlite3_bind_text(stmt, 1, name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+                });
+                if (!ok)
+                {
+                    qWarning() << "tag insert failed:" << name << sqlite3_errmsg(db);
+                    return 0;
+                }
+                id = sqlite3_last_insert_rowid(db);
+            }
+
+            dimension.ids.insert(name, id);
+            return id;
+        }
+
+        TagIds tagIds(const ScannedSong &song)
+        {
+            TagIds tags;
+            tags.artist = internId(artists, song.artist);
+            tags.albumTitle = internId(albumTitles, song.album);
+            tags.genre = internId(genres, song.genre);
+            return tags;
+        }
+
+        // tags no song uses any more, only after the songs are gone so the fts delete trigger could still read them
+        void pruneTags()
+        {
+            if (!tagsDropped)
+            {
+                return;
+            }
+
+            run("DELETE FROM artists WHERE id NOT IN (SELECT artist_id FROM songs WHERE artist_id IS NOT NULL);"
+                "DELETE FROM album_titles WHERE id NOT IN (SELECT album_title_id FROM songs WHERE album_title_id IS NOT NULL);"
+                "DELETE FROM genres WHERE id NOT IN (SELECT genre_id FROM songs WHERE genre_id IS NOT NULL);");
+            artists.ids.clear();
+            albumTitles.ids.clear();
+            genres.ids.clear();
+            tagsDropped = false;
+        }
+
+        void indexSong(qint64 songId, const QString &name, const QString &artist, const QString &genre, const QString &album)
+        {
+            QHash<QString, int> counts;
+            for (const QString &token : RecoEngine::tokenize(RecoEngine::featureText(name, artist, genre, album)))
+            {
+                counts[token]++;
+            }
+
+            for (auto it = counts.constBegin(); it != counts.constEnd(); ++it)
+            {
+                qint64 term = termId(it.key());
+                if (term == 0)
+                {
+                    continue;
+                }
+
+                exec("INSERT OR REPLACE INTO reco_vectors (song_id, term_id, tf) VALUES (?, ?, ?)", [&](sqlite3_stmt *stmt)
+                {
+                    sqlite3_bind_int64(stmt, 1, songId);
+                    sqlite3_bind_int64(stmt, 2, term);
+                    sqlite3_bind_int(stmt, 3, it.value());
+                });
+                execForId("UPDATE reco_terms SET df = df + 1 WHERE id = ?", term);
+            }
+            recoChanged = true;
+        }
+
+        void unindexSong(qint64 songId)
+        {
+            execForId("UPDATE reco_terms SET df = df - 1 WHERE id IN (SELECT term_id FROM reco_vectors WHERE song_id = ?)", songId);
+            execForId("DELETE FROM reco_vectors WHERE song_id = ?", songId);
+            recoChanged = true;
+        }
+
+        // drops terms nobody uses any more and bumps the generation so open engines reload
+        void finishRecoIndex()
+        {
+            if (!recoChanged)
+            {
+                return;
+            }
+
+            run("DELETE FROM reco_terms WHERE df <= 0;"
+                "INSERT OR IGNORE INTO reco_meta (key, value) VALUES ('generation', 0);"
+                "UPDATE reco_meta SET value = value + 1 WHERE key = 'generation';");
+            termIds.clear();
+            recoChanged = false;
+        }
+
+        static void bindId(sqlite3_stmt *stmt, int index, qint64 id)
+        {
+            if (id == 0)
+            {
+                sqlite3_bind_null(stmt, index); // intern failed, better no tag than one pointing nowhere
+            }
+            else
+            {
+                sqlite3_bind_int64(stmt, index, id);
+            }
+        }
+
+        static void bindSong(sqlite3_stmt *stmt, qint64 albumId, const ScannedSong &song, const TagIds &tags)
+        {
+            sqlite3_bind_int64(stmt, 1, albumId);
+            sqlite3_bind_text(stmt, 2, song.name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            bindId(stmt, 3, tags.artist);
+            bindId(stmt, 4, tags.albumTitle);
+            bindId(stmt, 5, tags.genre);
+            sqlite3_bind_int64(stmt, 6, song.stamp.size);
+            sqlite3_bind_int64(stmt, 7, song.stamp.mtime);
+            sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(song.stamp.inode));
+        }
+
+        sqlite3 *db;
+        const LibrarySnapshot &snapshot;
+        QSet<qint64> seenSongs;
+        QSet<qint64> seenAlbums;
+
+        QHash<const char *, sqlite3_stmt *> statements; // keyed on the sql literal, one compile per scan
+        QHash<QString, qint64> termIds;                  // reco_terms ids looked up so far
+        bool recoChanged = false;
+
+        Dimension artists{"SELECT id FROM artists WHERE name = ?", "INSERT INTO artists (name) VALUES (?)", {}};
+        Dimension albumTitles{"SELECT id FROM album_titles WHERE name = ?", "INSERT INTO album_titles (name) VALUES (?)", {}};
+        Dimension genres{"SELECT id FROM genres WHERE name = ?", "INSERT INTO genres (name) VALUES (?)", {}};
+        bool tagsDropped = false;
+
+        int batchSize;
+        int pendingRows;
+        bool inTransaction;
+    };
+
+    void applyPragmas(sqlite3 *db)
+    {
+        // wal lets the gui keep reading while the scan writes, normal sync only fsyncs at checkpoints
+        const char *pragmas = "PRAGMA journal_mode=WAL;"
+                              "PRAGMA synchronous=NORMAL;"
+                              "PRAGMA cache_size=-65536;" // 64MB
+                              "PRAGMA temp_store=MEMORY;";
+
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, pragmas, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            qWarning() << "pragmas failed:" << errMsg;
+            sqlite3_free(errMsg);
+        }
+    }
+}
+
+LibScan::LibScan(QObject *parent) : QObject(parent), scanThread(nullptr), lastScanResult(false)
+{
+}
+
+LibScan::~LibScan()
+{
+    if (scanThread) // cant cancel a scan half way through, let it land
+    {
+        scanThread->wait();
+        delete scanThread;
+    }
+}
+
+bool LibScan::tableExists(sqlite3 *db, const QString &tableName)
 {
     const QString query = QString("SELECT name FROM sqlite_master WHERE type='table' AND name='%1';").arg(tableName);
     sqlite3_stmt *stmt;
@@ -27,175 +1246,361 @@ bool LibScan::tableExists(sqlite3 *db, const QString &tableName)
     return exists;
 }
 
+// per song caches the library jobs fill. made with the library so playback can read them, and find the song id
+// it writes a miss back under, before any job has run. the jobs call it too, for dbs last scanned before this.
+// fingerprints: status 0 = fingerprinted, 1 = failed (error says why). size/mtime are the files stamp when it
+// was done and content_hash is AudioFingerprint::contentHash, so a touched but unchanged file keeps its fingerprint.
+// raw is the uncompressed fingerprint as little endian uint32s
+void LibScan::createCacheTables(sqlite3 *db)
+{
+    runSql(db, "CREATE TABLE IF NOT EXISTS fingerprints (song_id INTEGER PRIMARY KEY, fingerprint TEXT, raw BLOB, duration INTEGER, "
+               "file_size INTEGER, file_mtime INTEGER, content_hash TEXT, status INTEGER NOT NULL DEFAULT 0, error TEXT, created_at INTEGER)", "fingerprint table");
+
+    // tables from before the cache columns, old rows have no hash and get redone once their file changes
+    const char *cacheColumns[][2] = {{"raw", "BLOB"}, {"content_hash", "TEXT"}};
+    for (const auto &column : cacheColumns)
+    {
+        if (!columnExists(db, "fingerprints", column[0]))
+        {
+            runSql(db, QString("ALTER TABLE fingerprints ADD COLUMN %1 %2").arg(column[0], column[1]).toUtf8().constData(), "fingerprint migration");
+        }
+    }
+
+    runSql(db, Waveform::tableSql, "waveform table");
+    runSql(db, Loudness::tableSql, "loudness table");
+    runSql(db, Loudness::albumTableSql, "album loudness table");
+}
 
-void LibScan::scanMusicLibrary(const QString &directoryPath, const QString &dbPath) 
+bool LibScan::scanMusicLibrary(const QString &directoryPath, const QString &dbPath, const ScanOptions &options, ScanStats *stats)
 {
     qDebug() << "seleted dir: " << directoryPath << "& " << dbPath;
 
+    QElapsedTimer scanTimer;
+    scanTimer.start();
+
     QDir dir(directoryPath);
 
-    if (!dir.exists()) 
+    if (!dir.exists())
     {
         qWarning() << "dir does not exist:" << directoryPath;
-        return;
+        return false;
     }
 
-    // db intialisation 
+    // db intialisation
     sqlite3 *db;
     int rc = sqlite3_open(dbPath.toUtf8().constData(), &db);
-    if (rc) 
+    if (rc)
     {
         qWarning() << "db cant be opened:" << sqlite3_errmsg(db);
-        return;
+        sqlite3_close(db);
+        return false;
     }
     qDebug() << "db opended";
 
-    // check if tbls exist 
-    if (!tableExists(db, "albums"))
+    sqlite3_busy_timeout(db, 5000); // the watcher may be syncing on its own connection
+
+    if (options.tunePragmas)
     {
-        const char *createAlbumsTable = "CREATE TABLE albums (id INTEGER PRIMARY KEY, name TEXT, path TEXT)";
-        char *errMsg = nullptr;
+        applyPragmas(db);
+    }
 
-        rc = sqlite3_exec(db, createAlbumsTable, nullptr, nullptr, &errMsg);
+    createTables(db);
 
-        if (rc != SQLITE_OK) 
+    if (!options.incremental) // full rebuild, start from empty tables
+    {
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, "DELETE FROM songs; DELETE FROM albums; DELETE FROM artists; DELETE FROM album_titles; DELETE FROM genres; "
+                                 "DELETE FROM reco_vectors; DELETE FROM reco_terms;", nullptr, nullptr, &errMsg) != SQLITE_OK)
         {
-            qWarning() << "album table:" << errMsg;
+            qWarning() << "clearing library failed:" << errMsg;
             sqlite3_free(errMsg);
-        } 
-        else 
+        }
+    }
+
+    const LibrarySnapshot snapshot = loadSnapshot(db);
+    QScopedPointer<LibraryWriter> libraryWriter(new LibraryWriter(db, snapshot, options.batchSize));
+
+    if (!options.incremental)
+    {
+        libraryWriter->markRecoChanged(); // even an empty library is a new index
+    }
+    else if (!recoIndexBuilt(db))
+    {
+        libraryWriter->backfillRecoIndex();
+    }
+    ParseCounters counters;
+
+    int albumsWritten = 0;
+    int songsSeen = 0;
+    int songsWritten = 0;
+    qint64 writeNs = 0;
+
+    // --- single writer, the only thread touching the db handle while the scan runs --- //
+    AlbumQueue queue(options.queueCapacity);
+
+    QScopedPointer<QThread> writer(QThread::create([&]()
+    {
+        QElapsedTimer writeTimer;
+
+        ScannedAlbum album;
+        while (queue.pop(album))
         {
-            qDebug() << "album table success";
+            writeTimer.start();
+            songsWritten += libraryWriter->writeAlbum(album);
+            writeNs += writeTimer.nsecsElapsed();
+
+            songsSeen += album.songs.size();
+            albumsWritten++;
+
+            if (options.progress)
+            {
+                options.progress(albumsWritten, songsSeen);
+            }
+        }
+    }));
+    writer->start();
+
+    // --- bounded pool for directory listing + taglib parsing --- //
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.threadCount > 0 ? options.threadCount : QThread::idealThreadCount());
+
+    // every album dir is its own task, sub dirs get queued back onto the pool as they are found
+    std::function<void(const QFileInfo &)> scanAlbum = [&](const QFileInfo &albumEntry)
+    {
+        QStringList subDirs;
+        queue.push(readAlbum(albumEntry, snapshot, counters, subDirs));
+
+        for (const QString &subDir : subDirs) // recusrive scan on album sub dirs
+        {
+            QFileInfo subEntry(subDir);
+            pool.start([&scanAlbum, subEntry]() { scanAlbum(subEntry); });
         }
-    } 
-    else 
+    };
+
+    // check root dir, loose files in the root are not part of an album
+    QFileInfoList rootEntries = dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QFileInfo &entry : rootEntries)
     {
-        qDebug() << "albums table exists.";
+        pool.start([&scanAlbum, entry]() { scanAlbum(entry); });
     }
 
-    if (!tableExists(db, "songs"))
+    pool.waitForDone(); // tasks only queue children before they return, so this covers the whole tree
+    queue.close();
+    writer->wait();
+
+    QElapsedTimer cleanupTimer;
+    cleanupTimer.start();
+    libraryWriter->removeUnseen();
+    libraryWriter.reset(); // commits the tail batch and finalizes statements before the handle goes
+
+    if (songsWritten >= 1000) // big scans leave the search index in lots of small segments, one merge keeps lookups fast
     {
-        const char *createSongsTable = "CREATE TABLE songs (id INTEGER PRIMARY KEY, album_id INTEGER, name TEXT, artist TEXT, album TEXT, genre TEXT, path TEXT)";
         char *errMsg = nullptr;
-
-        rc = sqlite3_exec(db, createSongsTable, nullptr, nullptr, &errMsg);
-        if (rc != SQLITE_OK)
+        if (sqlite3_exec(db, "INSERT INTO songs_fts (songs_fts) VALUES ('optimize')", nullptr, nullptr, &errMsg) != SQLITE_OK)
         {
-            qWarning() << "song table failed!:" << errMsg;
+            qWarning() << "search index optimize failed:" << errMsg;
             sqlite3_free(errMsg);
-        } 
-        else 
+        }
+    }
+    writeNs += cleanupTimer.nsecsElapsed();
+
+    sqlite3_close(db);
+    qDebug() << "db closed";
+
+    if (stats)
+    {
+        stats->files = counters.files;
+        stats->albums = albumsWritten;
+        stats->songsWritten = songsWritten;
+        stats->bytesParsed = counters.bytes;
+        stats->parseMs = counters.parseNs / 1000000;
+        stats->writeMs = writeNs / 1000000;
+        stats->elapsedMs = scanTimer.elapsed();
+    }
+
+    return true;
+}
+
+// only touches the given dirs, anything else in the library is left as it is
+bool LibScan::syncDirectories(const QString &rootPath, const QString &dbPath, const QStringList &dirs, LibraryChanges *changes)
+{
+    sqlite3 *db;
+    if (sqlite3_open(dbPath.toUtf8().constData(), &db))
+    {
+        qWarning() << "db cant be opened:" << sqlite3_errmsg(db);
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_busy_timeout(db, 5000);
+    applyPragmas(db);
+    createTables(db);
+
+    const QString root = QDir::cleanPath(rootPath);
+
+    // dirs that still exist get rescanned, the rest get their album rows dropped
+    QStringList existing;
+    QStringList vanished;
+    for (const QString &dir : dirs)
+    {
+        QString path = QDir::cleanPath(dir);
+        if (path != root && !path.startsWith(root + "/"))
+        {
+            continue;
+        }
+
+        if (QFileInfo(path).isDir())
+        {
+            existing.append(path);
+        }
+        else
         {
-            qDebug() << "songs table created.";
+            vanished.append(path);
         }
-    } 
-    else 
+    }
+
+    // vanished dirs are in the snapshot so songs moved out of them keep their ids
+    const LibrarySnapshot snapshot = loadSnapshot(db, existing + vanished);
+    QScopedPointer<LibraryWriter> libraryWriter(new LibraryWriter(db, snapshot, 1000));
+
+    if (!recoIndexBuilt(db))
     {
-        qDebug() << "song table exists.";
+        libraryWriter->backfillRecoIndex();
     }
+    ParseCounters counters;
 
-    // recursively scan the dir
-    std::function<void(const QDir&)> scanDir = [&](const QDir &dir) 
+    QSet<QString> synced; // a new dir usually shows up both on its own and through its parent
+
+    std::function<void(const QFileInfo &)> syncAlbum = [&](const QFileInfo &albumEntry)
     {
-        QFileInfoList entries = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot); //get list of entries 
+        if (synced.contains(albumEntry.absoluteFilePath()))
+        {
+            return;
+        }
+        synced.insert(albumEntry.absoluteFilePath());
+
+        QStringList subDirs;
+        ScannedAlbum album = readAlbum(albumEntry, snapshot, counters, subDirs);
 
-        for (const QFileInfo &entry : entries) // iterate through each entry
+        qint64 albumId = snapshot.albumsByPath.value(album.path, 0);
+        int knownSongs = 0;
+        for (const KnownSong &song : snapshot.songsByPath)
         {
-            if (entry.isDir()) 
+            if (albumId != 0 && song.albumId == albumId)
             {
-                QString albumName = entry.fileName();
-                QString albumPath = entry.absoluteFilePath();
-                
+                knownSongs++;
+            }
+        }
 
-                //--- insert album instance 
-                sqlite3_stmt *stmt;
-                const char *insertAlbumSQL = "INSERT INTO albums (name, path) VALUES (?, ?)";
+        bool inserted = false;
+        int written = libraryWriter->writeAlbum(album, &inserted);
 
-                rc = sqlite3_prepare_v2(db, insertAlbumSQL, -1, &stmt, nullptr);
-                if (rc != SQLITE_OK) 
-                {
-                    qWarning() << "album insert failed:" << sqlite3_errmsg(db);
-                    continue;
-                }
+        if (changes && inserted)
+        {
+            changes->addedAlbums.append(qMakePair(album.name, album.path));
+        }
+        else if (changes && (written > 0 || album.songs.size() != knownSongs))
+        {
+            changes->updatedAlbums.append(album.path);
+        }
 
-                sqlite3_bind_text(stmt, 1, albumName.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 2, albumPath.toUtf8().constData(), -1, SQLITE_TRANSIENT);
+        const QStringList known = subDirs.isEmpty() ? QStringList() : albumPathsUnder(db, album.path);
+        for (const QString &subDir : subDirs)
+        {
+            if (!hasPathUnder(known, subDir)) // known sub albums only change if they are dirty themselves
+            {
+                syncAlbum(QFileInfo(subDir));
+            }
+        }
+    };
 
-                rc = sqlite3_step(stmt);
+    for (const QString &path : existing)
+    {
+        QDir dir(path);
 
-                if (rc != SQLITE_DONE)
-                {
-                    qWarning() << "failed to insert album:" << sqlite3_errmsg(db);
-                } 
-                else 
+        if (path == root) // the root is not an album, only look for new album dirs in it
+        {
+            const QStringList known = albumPathsUnder(db, root);
+            for (const QFileInfo &entry : dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+            {
+                if (!hasPathUnder(known, entry.absoluteFilePath()))
                 {
-                    qDebug() << "album inserted:" << albumName;
+                    syncAlbum(entry);
                 }
+            }
+        }
+        else if (snapshot.albumsByPath.contains(path) || albumPathsUnder(db, path).isEmpty())
+        {
+            syncAlbum(QFileInfo(path));
+        }
 
-                sqlite3_finalize(stmt);
-                int albumId = sqlite3_last_insert_rowid(db);
-
-                //---- insert songs from the album ---- //
+        // child dirs deleted without their own event (non linux watchers mostly)
+        for (const QString &albumPath : albumPathsUnder(db, path))
+        {
+            if (albumPath != path && !QFileInfo(albumPath).isDir())
+            {
+                vanished.append(albumPath);
+            }
+        }
+    }
 
-                QDir albumDir(albumPath);
-                QFileInfoList songEntries = albumDir.entryInfoList(QDir::Files);
-                for (const QFileInfo &songEntry : songEntries)
-                {
-                    QString songPath = songEntry.absoluteFilePath();
-                    TagLib::FileRef f(songPath.toUtf8().constData());
+    // after the rescans so songs that moved into a new dir are already repointed
+    for (const QString &path : vanished)
+    {
+        for (const QString &albumPath : albumPathsUnder(db, path))
+        {
+            libraryWriter->removeAlbum(albumPath);
 
-                    if (!f.isNull() && f.tag())  //get metadata from song in question 
-                    {
-                        TagLib::Tag *tag = f.tag();
-                        QString songName = QString::fromStdString(tag->title().to8Bit(true));
-                        QString artist = QString::fromStdString(tag->artist().to8Bit(true));
-                        QString album = QString::fromStdString(tag->album().to8Bit(true));
-                        QString genre = QString::fromStdString(tag->genre().to8Bit(true));
+            if (changes && !changes->removedAlbums.contains(albumPath))
+            {
+                changes->removedAlbums.append(albumPath);
+            }
+        }
+    }
 
-                        if (genre.isEmpty()) // keep musicbrainz api happy
-                        {
-                            genre = "Unknown";
-                        }
+    libraryWriter->removeUnseen(); // songs deleted from dirs that are still there
+    libraryWriter.reset();
 
-                        const char *insertSongSQL = "INSERT INTO songs (album_id, name, artist, album, genre, path) VALUES (?, ?, ?, ?, ?, ?)";
+    sqlite3_close(db);
+    qDebug() << "synced" << dirs.size() << "dirs," << counters.files << "files looked at";
+    return true;
+}
 
-                        rc = sqlite3_prepare_v2(db, insertSongSQL, -1, &stmt, nullptr);
-                        if (rc != SQLITE_OK)
-                        {
-                            qWarning() << "song insertion failed" << sqlite3_errmsg(db);
-                            continue;
-                        }
-                        // if insertion ok, bind taglib values to song db instance 
-                        sqlite3_bind_int(stmt, 1, albumId);
-                        sqlite3_bind_text(stmt, 2, songName.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-                        sqlite3_bind_text(stmt, 3, artist.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-                        sqlite3_bind_text(stmt, 4, album.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-                        sqlite3_bind_text(stmt, 5, genre.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-                        sqlite3_bind_text(stmt, 6, songPath.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-
-                        rc = sqlite3_step(stmt);
-                        if (rc != SQLITE_DONE) 
-                        {
-                            qWarning() << "song insert failed:" << sqlite3_errmsg(db);
-                        } 
-                        else 
-                        {
-                            qDebug() << "song insert success:" << songName;
-                        }
-                        sqlite3_finalize(stmt);
-                    }
-                }
+void LibScan::startScan(const QString &directoryPath, const QString &dbPath, const ScanOptions &options)
+{
+    if (isScanning())
+    {
+        qWarning() << "scan already running, ignoring:" << directoryPath;
+        return;
+    }
 
-                // recusrive scan on album sub dirs
-                scanDir(albumDir);
-            }
+    ScanOptions threadOptions = options;
+    threadOptions.progress = [this, options](int albums, int songs)
+    {
+        if (options.progress)
+        {
+            options.progress(albums, songs);
         }
+        emit scanProgress(albums, songs); // queued over to the gui thread
     };
 
-    // check root dir 
-    scanDir(dir);
+    scanThread = QThread::create([this, directoryPath, dbPath, threadOptions]()
+    {
+        lastScanResult = scanMusicLibrary(directoryPath, dbPath, threadOptions);
+    });
 
-    sqlite3_close(db);
-    qDebug() << "db closed";
+    connect(scanThread, &QThread::finished, this, [this]()
+    {
+        scanThread->deleteLater();
+        scanThread = nullptr;
+
+        emit scanFinished(lastScanResult);
+    });
+
+    scanThread->start();
 }
 
+bool LibScan::isScanning() const
+{
+    return scanThread != nullptr;
+}
@@ -1,14 +1,69 @@
 #ifndef LIBSCAN_H
 #define LIBSCAN_H
 
+#include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <functional>
 #include <sqlite3.h>
 
-class LibScan 
+class QThread;
+
+class LibScan : public QObject
 {
+    Q_OBJECT
+
     public:
-        static void scanMusicLibrary(const QString &directoryPath, const QString &dbPath); //called after filedialog prompt
-        
+        struct ScanOptions
+        {
+            int threadCount = 0;      // tag parsing workers, 0 = QThread::idealThreadCount()
+            int queueCapacity = 256;  // parsed albums waiting on the writer before workers block
+            bool incremental = true;  // only re-read tags for new/changed files, false wipes and rebuilds
+            int batchSize = 1000;     // rows per transaction, 1 or less leaves sqlite in autocommit
+            bool tunePragmas = true;  // wal journal, synchronous=normal and a bigger page cache
+
+            std::function<void(int albums, int songs)> progress; // called from the writer thread
+        };
+
+        struct ScanStats
+        {
+            int files = 0;          // audio files looked at
+            int albums = 0;
+            int songsWritten = 0;   // rows inserted or updated, unchanged files dont count
+            qint64 bytesParsed = 0; // size of every file handed to taglib, unchanged files are never opened
+            qint64 parseMs = 0;     // taglib time summed over every worker
+            qint64 writeMs = 0;     // writer time spent in sqlite, queue waits excluded
+            qint64 elapsedMs = 0;
+        };
+
+        struct LibraryChanges
+        {
+            QList<QPair<QString, QString>> addedAlbums; // name, path
+            QStringList updatedAlbums;                  // paths with songs added, changed or removed
+            QStringList removedAlbums;
+        };
+
+        explicit LibScan(QObject *parent = nullptr);
+        ~LibScan();
+
+        static bool scanMusicLibrary(const QString &directoryPath, const QString &dbPath, const ScanOptions &options = ScanOptions(), ScanStats *stats = nullptr); //called after filedialog prompt
+
+        static bool syncDirectories(const QString &rootPath, const QString &dbPath, const QStringList &dirs, LibraryChanges *changes = nullptr); // watcher path, rescans just these dirs
+
         static bool tableExists(sqlite3 *db, const QString &tableName);  //compiler having a fit because this wasn't static
+        static void createCacheTables(sqlite3 *db); // fingerprints, waveforms, loudness: what the library jobs fill and playback reads
+
+        void startScan(const QString &directoryPath, const QString &dbPath, const ScanOptions &options = ScanOptions()); // same as above but off the gui thread
+        bool isScanning() const;
+
+    signals:
+        void scanProgress(int albums, int songs);
+        void scanFinished(bool success);
+
+    private:
+        QThread *scanThread;
+        bool lastScanResult; // written by the scan thread before it finishes
     };
-#endif // LIBSCAN_H
\ No newline at end of file
+#endif // LIBSCAN_H
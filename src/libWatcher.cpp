@@ -0,0 +1,251 @@
+#include "libWatcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QFileSystemWatcher>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+LibWatcher::LibWatcher(QObject *parent) : QObject(parent), syncThread(nullptr), inotifyFd(-1), notifier(nullptr), fsWatcher(nullptr)
+{
+    debounceTimer = new QTimer(this);
+    debounceTimer->setSingleShot(true);
+    connect(debounceTimer, &QTimer::timeout, this, &LibWatcher::flushPending);
+}
+
+LibWatcher::~LibWatcher()
+{
+    stop();
+
+    if (syncThread) // same as libscan, let a running sync finish
+    {
+        syncThread->wait();
+        delete syncThread;
+    }
+}
+
+bool LibWatcher::start(const QString &root, const QString &db)
+{
+    stop();
+
+    rootPath = QDir::cleanPath(root);
+    dbPath = db;
+
+#ifdef Q_OS_LINUX
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+    {
+        qWarning() << "inotify_init failed, library changes wont be picked up";
+        return false;
+    }
+
+    notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &LibWatcher::readInotifyEvents);
+#else
+    fsWatcher = new QFileSystemWatcher(this);
+    connect(fsWatcher, &QFileSystemWatcher::directoryChanged, this, &LibWatcher::onDirectoryChanged);
+#endif
+
+    watchTree(rootPath);
+    qDebug() << "watching library:" << rootPath;
+    return true;
+}
+
+void LibWatcher::stop()
+{
+    debounceTimer->stop();
+    pendingDirs.clear();
+
+#ifdef Q_OS_LINUX
+    delete notifier;
+    notifier = nullptr;
+
+    if (inotifyFd >= 0)
+    {
+        close(inotifyFd); // drops every watch with it
+        inotifyFd = -1;
+    }
+    watchPaths.clear();
+#else
+    delete fsWatcher;
+    fsWatcher = nullptr;
+#endif
+}
+
+bool LibWatcher::isWatching() const
+{
+    return inotifyFd >= 0 || fsWatcher != nullptr;
+}
+
+// one watch per dir, inotify isnt recursive
+void LibWatcher::watchTree(const QString &path)
+{
+#ifdef Q_OS_LINUX
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                          IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+    int wd = inotify_add_watch(inotifyFd, path.toUtf8().constData(), mask);
+    if (wd < 0)
+    {
+        qWarning() << "cant watch:" << path << "(fs.inotify.max_user_watches may be too low)";
+        return;
+    }
+    watchPaths.insert(wd, path);
+#else
+    if (!fsWatcher->directories().contains(path))
+    {
+        fsWatcher->addPath(path);
+    }
+#endif
+
+    QDir dir(path);
+    for (const QFileInfo &entry : dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        watchTree(entry.absoluteFilePath());
+    }
+}
+
+void LibWatcher::readInotifyEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[16384];
+
+    ssize_t length;
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *ptr = buffer; ptr < buffer + length; )
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) // events were dropped, resync everything we watch
+            {
+                qWarning() << "inotify queue overflowed, resyncing library";
+                for (const QString &dir : watchPaths)
+                {
+                    markDirty(dir);
+                }
+                watchTree(rootPath); // dirs made while events were dropped, re-adding a watch just hands back the same wd
+                continue;
+            }
+
+            QString dir = watchPaths.value(event->wd);
+            if (dir.isEmpty())
+            {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) // dir is gone and the kernel dropped its watch
+            {
+                watchPaths.remove(event->wd);
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                markDirty(dir);
+                continue;
+            }
+
+            QString path = dir + "/" + QString::fromUtf8(event->name);
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    watchTree(path); // watch before syncing so nothing copied in meanwhile gets missed
+                }
+                markDirty(path);
+            }
+
+            markDirty(dir);
+        }
+    }
+#endif
+}
+
+void LibWatcher::onDirectoryChanged(const QString &path)
+{
+    markDirty(path);
+
+    if (fsWatcher && QFileInfo(path).isDir()) // pick up new sub dirs, removed ones drop out on their own
+    {
+        watchTree(path);
+    }
+}
+
+void LibWatcher::markDirty(const QString &path)
+{
+    if (pendingDirs.isEmpty())
+    {
+        pendingSince.start();
+    }
+    pendingDirs.insert(path);
+
+    if (pendingSince.elapsed() >= maxWaitMs)
+    {
+        debounceTimer->start(0);
+    }
+    else
+    {
+        debounceTimer->start(debounceMs); // restarts the quiet period
+    }
+}
+
+void LibWatcher::flushPending()
+{
+    if (pendingDirs.isEmpty())
+    {
+        return;
+    }
+
+    if (syncThread) // one sync at a time, whatever piles up goes in the next one
+    {
+        return;
+    }
+
+    QStringList dirs = pendingDirs.values();
+    pendingDirs.clear();
+
+    syncChanges = LibScan::LibraryChanges();
+    QString root = rootPath;
+    QString db = dbPath;
+
+    syncThread = QThread::create([this, root, db, dirs]()
+    {
+        LibScan::syncDirectories(root, db, dirs, &syncChanges);
+    });
+
+    connect(syncThread, &QThread::finished, this, [this]()
+    {
+        syncThread->deleteLater();
+        syncThread = nullptr;
+
+        for (const QString &path : syncChanges.removedAlbums)
+        {
+            emit albumRemoved(path);
+        }
+        for (const auto &album : syncChanges.addedAlbums)
+        {
+            emit albumAdded(album.first, album.second);
+        }
+        for (const QString &path : syncChanges.updatedAlbums)
+        {
+            emit albumUpdated(path);
+        }
+
+        if (!pendingDirs.isEmpty())
+        {
+            debounceTimer->start(debounceMs);
+        }
+    });
+
+    syncThread->start();
+}
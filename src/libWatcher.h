@@ -0,0 +1,64 @@
+#ifndef LIBWATCHER_H
+#define LIBWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QSet>
+#include <QHash>
+#include <QElapsedTimer>
+#include "libScan.h"
+
+class QThread;
+class QTimer;
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+// keeps the db in step with the music folder after the first scan,
+// changes are batched up per directory and synced off the gui thread
+class LibWatcher : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit LibWatcher(QObject *parent = nullptr);
+        ~LibWatcher();
+
+        bool start(const QString &rootPath, const QString &dbPath);
+        void stop();
+        bool isWatching() const;
+
+        int debounceMs = 750;  // quiet time after the last event before syncing
+        int maxWaitMs = 5000;  // sync anyway if events never stop (big copies)
+
+    signals:
+        void albumAdded(const QString &albumName, const QString &albumPath);
+        void albumRemoved(const QString &albumPath);
+        void albumUpdated(const QString &albumPath);
+
+    private slots:
+        void readInotifyEvents();
+        void onDirectoryChanged(const QString &path);
+        void flushPending();
+
+    private:
+        void watchTree(const QString &path);
+        void markDirty(const QString &path);
+
+        QString rootPath;
+        QString dbPath;
+
+        QSet<QString> pendingDirs;
+        QTimer *debounceTimer;
+        QElapsedTimer pendingSince;
+
+        QThread *syncThread;
+        LibScan::LibraryChanges syncChanges; // written by the sync thread before it finishes
+
+        // linux gets inotify directly, everywhere else falls back to QFileSystemWatcher
+        int inotifyFd;
+        QSocketNotifier *notifier;
+        QHash<int, QString> watchPaths; // inotify watch descriptor -> dir
+
+        QFileSystemWatcher *fsWatcher;
+    };
+#endif // LIBWATCHER_H
@@ -0,0 +1,484 @@
+#include "libraryJob.h"
+#include "libScan.h"
+#include <QDebug>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QDateTime>
+
+namespace
+{
+    const int pageSize = 500;           // songs read from the db at a time, the rest stay on disk
+    const qint64 progressEveryMs = 500; // progress callbacks are throttled to this
+    const double rateSmoothing = 0.3;   // weight of the newest sample in the files/s average
+
+    struct Done
+    {
+        LibraryJob::Song song;
+        LibraryJob::Outcome outcome;
+    };
+
+    // workers -> writer, never holds more than maxInFlight since a slot is taken before a song goes out
+    class ResultQueue
+    {
+    public:
+        void push(Done result)
+        {
+            QMutexLocker locker(&mutex);
+            results.enqueue(std::move(result));
+            notEmpty.wakeOne();
+        }
+
+        bool pop(Done &result) // false once closed and drained
+        {
+            QMutexLocker locker(&mutex);
+            while (results.isEmpty() && !closed)
+            {
+                notEmpty.wait(&mutex);
+            }
+            if (results.isEmpty())
+            {
+                return false;
+            }
+            result = results.dequeue();
+            return true;
+        }
+
+        void close()
+        {
+            QMutexLocker locker(&mutex);
+            closed = true;
+            notEmpty.wakeAll();
+        }
+
+    private:
+        QMutex mutex;
+        QWaitCondition notEmpty;
+        QQueue<Done> results;
+        bool closed = false;
+    };
+
+    // a song needs doing if it has no row yet or the file changed since its row was written
+    const char *pendingWhere = "(t.song_id IS NULL OR t.file_size IS NOT s.file_size OR t.file_mtime IS NOT s.file_mtime OR (?1 AND t.status != 0))";
+
+    QVariant columnValue(sqlite3_stmt *stmt, int column)
+    {
+        switch (sqlite3_column_type(stmt, column))
+        {
+            case SQLITE_INTEGER:
+                return sqlite3_column_int64(stmt, column);
+            case SQLITE_FLOAT:
+                return sqlite3_column_double(stmt, column);
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return QByteArray(reinterpret_cast<const char *>(sqlite3_column_blob(stmt, column)), sqlite3_column_bytes(stmt, column));
+            default:
+                return QVariant();
+        }
+    }
+
+    // next page of songs after afterId, read in one go so no read transaction is held while workers run
+    QVector<LibraryJob::Song> nextPage(const LibraryJob::Spec &spec, sqlite3 *db, qint64 afterId, bool retryFailed)
+    {
+        QVector<LibraryJob::Song> page;
+
+        QString sql = QString("SELECT s.id, s.path, s.file_size, s.file_mtime, %1 FROM songs s LEFT JOIN %2 t ON t.song_id = s.id "
+                              "WHERE s.id > ?2 AND %3 ORDER BY s.id LIMIT ?3")
+                          .arg(spec.extraColumn.isEmpty() ? QString("NULL") : spec.extraColumn, spec.table, pendingWhere);
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql.toUtf8().constData(), -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            qWarning() << "pending songs query failed:" << sqlite3_errmsg(db);
+            return page;
+        }
+
+        sqlite3_bind_int(stmt, 1, retryFailed ? 1 : 0);
+        sqlite3_bind_int64(stmt, 2, afterId);
+        sqlite3_bind_int(stmt, 3, pageSize);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            LibraryJob::Song song;
+            song.id = sqlite3_column_int64(stmt, 0);
+            song.path = QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)));
+            song.size = sqlite3_column_int64(stmt, 2);
+            song.mtime = sqlite3_column_int64(stmt, 3);
+            song.extra = columnValue(stmt, 4);
+            page.append(song);
+        }
+        sqlite3_finalize(stmt);
+        return page;
+    }
+}
+
+LibraryJob::LibraryJob(const Spec &spec, QObject *parent) : QObject(parent), jobSpec(spec), jobThread(nullptr), cancelled(false), lastResult(false)
+{
+}
+
+LibraryJob::~LibraryJob()
+{
+    if (jobThread)
+    {
+        cancel(); // whatever is committed stays, the next start picks up the rest
+        jobThread->wait();
+        delete jobThread;
+    }
+}
+
+bool LibraryJob::openDb(const QString &dbPath, sqlite3 **db)
+{
+    if (sqlite3_open(dbPath.toUtf8().constData(), db) != SQLITE_OK)
+    {
+        qWarning() << "db cant be opened:" << sqlite3_errmsg(*db);
+        sqlite3_close(*db);
+        *db = nullptr;
+        return false;
+    }
+
+    sqlite3_busy_timeout(*db, 5000); // the scanner, watcher and other jobs write on their own connections
+
+    char *errMsg = nullptr;
+    if (sqlite3_exec(*db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        qWarning() << "pragmas failed:" << errMsg;
+        sqlite3_free(errMsg);
+    }
+    return true;
+}
+
+bool LibraryJob::exec(sqlite3 *db, const QString &sql)
+{
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql.toUtf8().constData(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        qWarning() << "library job:" << sql << errMsg;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+int LibraryJob::pendingCount(const Spec &spec, sqlite3 *db, bool retryFailed)
+{
+    QString sql = QString("SELECT COUNT(*) FROM songs s LEFT JOIN %1 t ON t.song_id = s.id WHERE %2").arg(spec.table, pendingWhere);
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql.toUtf8().constData(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        qWarning() << "pending count failed:" << sqlite3_errmsg(db);
+        return 0;
+    }
+
+    sqlite3_bind_int(stmt, 1, retryFailed ? 1 : 0);
+    int count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+bool LibraryJob::run(const Spec &spec, const QString &dbPath, const JobOptions &options, Progress *result, const std::atomic<bool> *cancel)
+{
+    QElapsedTimer jobTimer;
+    jobTimer.start();
+
+    auto stopped = [cancel]()
+    {
+        return cancel && cancel->load();
+    };
+
+    // --- reader connection: pending songs, a page at a time --- //
+    sqlite3 *readDb;
+    if (!openDb(dbPath, &readDb))
+    {
+        return false;
+    }
+
+    if (!LibScan::tableExists(readDb, "songs"))
+    {
+        qWarning() << "no songs table, scan the library first";
+        sqlite3_close(readDb);
+        return false;
+    }
+
+    spec.createTables(readDb);
+    exec(readDb, QString("DELETE FROM %1 WHERE song_id NOT IN (SELECT id FROM songs)").arg(spec.table)); // songs removed since last time
+
+    Progress progress;
+    progress.total = pendingCount(spec, readDb, options.retryFailed);
+    qDebug() << progress.total << "songs pending for the" << spec.name << "job";
+
+    if (progress.total == 0)
+    {
+        if (spec.finish && !stopped())
+        {
+            spec.finish(readDb, QVector<QVariant>(), &progress); // a song may still have gone since last time
+        }
+        sqlite3_close(readDb);
+        if (result)
+        {
+            *result = progress;
+        }
+        return true;
+    }
+
+    // --- writer connection, the only thing writing the table while the job runs --- //
+    sqlite3 *writeDb;
+    if (!openDb(dbPath, &writeDb))
+    {
+        sqlite3_close(readDb);
+        return false;
+    }
+
+    // song_id, the spec's columns, then the stamp / status columns every job table has
+    const int stampColumn = spec.columns.size() + 2;
+    QStringList placeholders;
+    for (int i = 1; i < stampColumn + 5; i++)
+    {
+        placeholders << QString("?%1").arg(i);
+    }
+    const QString insertSql = QString("INSERT OR REPLACE INTO %1 (song_id, %2file_size, file_mtime, status, error, created_at) VALUES (%3)")
+                                  .arg(spec.table, spec.columns.isEmpty() ? QString() : spec.columns.join(", ") + ", ", placeholders.join(", "));
+    const QString restampSql = QString("UPDATE %1 SET file_size = ?2, file_mtime = ?3 WHERE song_id = ?1").arg(spec.table);
+
+    sqlite3_stmt *insert = nullptr;
+    sqlite3_stmt *restamp = nullptr;
+    if (sqlite3_prepare_v2(writeDb, insertSql.toUtf8().constData(), -1, &insert, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(writeDb, restampSql.toUtf8().constData(), -1, &restamp, nullptr) != SQLITE_OK)
+    {
+        qWarning() << spec.name << "statements failed to prepare:" << sqlite3_errmsg(writeDb);
+        sqlite3_finalize(insert);
+        sqlite3_finalize(restamp);
+        sqlite3_close(writeDb);
+        sqlite3_close(readDb);
+        return false;
+    }
+
+    const int threads = options.threadCount > 0 ? options.threadCount : QThread::idealThreadCount();
+    QSemaphore slots(options.maxInFlight > 0 ? options.maxInFlight : threads * 2);
+    ResultQueue queue;
+    QVector<QVariant> written; // writer thread only until it is joined
+
+    QScopedPointer<QThread> writer(QThread::create([&]()
+    {
+        const int batchSize = qMax(1, options.batchSize);
+        int inBatch = 0;
+        int lastDone = 0;
+        qint64 lastReportMs = 0;
+
+        auto report = [&](bool force)
+        {
+            qint64 now = jobTimer.elapsed();
+            if (!force && now - lastReportMs < progressEveryMs)
+            {
+                return;
+            }
+
+            if (now > lastReportMs)
+            {
+                double rate = (progress.done - lastDone) * 1000.0 / (now - lastReportMs);
+                progress.filesPerSecond = lastDone == 0 ? rate : rateSmoothing * rate + (1 - rateSmoothing) * progress.filesPerSecond;
+            }
+            progress.etaSeconds = progress.filesPerSecond > 0 ? qint64((progress.total - progress.done) / progress.filesPerSecond) : -1;
+            progress.elapsedMs = now;
+
+            lastDone = progress.done;
+            lastReportMs = now;
+
+            if (options.progress)
+            {
+                options.progress(progress);
+            }
+        };
+
+        exec(writeDb, "BEGIN");
+
+        Done done;
+        while (queue.pop(done))
+        {
+            const Outcome &outcome = done.outcome;
+            sqlite3_stmt *stmt = outcome.restamp ? restamp : insert;
+            sqlite3_bind_int64(stmt, 1, done.song.id);
+
+            if (outcome.restamp)
+            {
+                sqlite3_bind_int64(restamp, 2, done.song.size);
+                sqlite3_bind_int64(restamp, 3, done.song.mtime);
+            }
+            else
+            {
+                QByteArray error = outcome.error.toUtf8();
+
+                if (outcome.ok && outcome.bind)
+                {
+                    outcome.bind(insert);
+                    sqlite3_bind_null(insert, stampColumn + 3);
+                }
+                else
+                {
+                    for (int column = 2; column < stampColumn; column++)
+                    {
+                        sqlite3_bind_null(insert, column);
+                    }
+                    sqlite3_bind_text(insert, stampColumn + 3, error.constData(), error.size(), SQLITE_TRANSIENT);
+                }
+                sqlite3_bind_int64(insert, stampColumn, done.song.size);
+                sqlite3_bind_int64(insert, stampColumn + 1, done.song.mtime);
+                sqlite3_bind_int(insert, stampColumn + 2, outcome.ok ? 0 : 1);
+                sqlite3_bind_int64(insert, stampColumn + 4, QDateTime::currentSecsSinceEpoch());
+            }
+
+            if (sqlite3_step(stmt) != SQLITE_DONE)
+            {
+                qWarning() << spec.name << "write failed:" << sqlite3_errmsg(writeDb);
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+
+            slots.release(); // row is written, another song can go out
+
+            progress.done++;
+            progress.failed += outcome.ok ? 0 : 1;
+            progress.reused += outcome.restamp ? 1 : 0;
+            progress.bytesRead += outcome.bytesRead;
+            progress.framesDecoded += outcome.frames;
+            if (spec.finish)
+            {
+                written.append(done.song.extra);
+            }
+
+            if (++inBatch >= batchSize) // committed work survives a crash or quit
+            {
+                exec(writeDb, "COMMIT");
+                exec(writeDb, "BEGIN");
+                inBatch = 0;
+            }
+
+            report(false);
+        }
+
+        exec(writeDb, "COMMIT");
+        report(true);
+    }));
+    writer->start();
+
+    // --- bounded decoder pool, one open file per worker --- //
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    qint64 lastId = 0;
+    while (!stopped())
+    {
+        const QVector<Song> page = nextPage(spec, readDb, lastId, options.retryFailed);
+
+        for (const Song &song : page)
+        {
+            slots.acquire(); // blocks once maxInFlight songs are out, so memory stays flat however big the library
+            if (stopped())
+            {
+                slots.release();
+                break;
+            }
+
+            pool.start([&spec, &queue, &slots, &stopped, cancel, song]()
+            {
+                if (stopped()) // cancelled while it was queued, leave it for next time
+                {
+                    slots.release();
+                    return;
+                }
+
+                Done done;
+                done.song = song;
+                done.outcome = spec.process(song, cancel);
+
+                if (!done.outcome.ok && stopped()) // cut off mid decode, not a broken file
+                {
+                    slots.release();
+                    return;
+                }
+                queue.push(std::move(done));
+            });
+
+            lastId = song.id;
+        }
+
+        if (page.size() < pageSize)
+        {
+            break;
+        }
+    }
+
+    pool.waitForDone();
+    queue.close();
+    writer->wait();
+
+    sqlite3_finalize(insert);
+    sqlite3_finalize(restamp);
+
+    // a cancelled run leaves it for next time, finish steps have to work out what is stale from the tables anyway
+    if (spec.finish && !stopped())
+    {
+        spec.finish(writeDb, written, &progress);
+    }
+
+    sqlite3_close(writeDb);
+    sqlite3_close(readDb);
+
+    qDebug() << spec.name << "job did" << progress.done << "songs," << progress.failed << "failed, in" << jobTimer.elapsed() << "ms"
+             << (stopped() ? "(cancelled)" : "");
+
+    if (result)
+    {
+        *result = progress;
+    }
+    return true;
+}
+
+void LibraryJob::start(const QString &dbPath, const JobOptions &options)
+{
+    if (isRunning())
+    {
+        qWarning() << jobSpec.name << "job already running";
+        return;
+    }
+
+    cancelled = false;
+
+    JobOptions threadOptions = options;
+    threadOptions.progress = [this, options](const Progress &progress)
+    {
+        if (options.progress)
+        {
+            options.progress(progress);
+        }
+        emit jobProgress(progress.done, progress.total, progress.filesPerSecond, progress.etaSeconds); // queued over to the gui thread
+    };
+
+    jobThread = QThread::create([this, dbPath, threadOptions]()
+    {
+        lastResult = run(jobSpec, dbPath, threadOptions, nullptr, &cancelled);
+    });
+
+    connect(jobThread, &QThread::finished, this, [this]()
+    {
+        jobThread->deleteLater();
+        jobThread = nullptr;
+
+        emit jobFinished(lastResult, cancelled);
+    });
+
+    jobThread->start();
+}
+
+void LibraryJob::cancel()
+{
+    cancelled = true;
+}
+
+bool LibraryJob::isRunning() const
+{
+    return jobThread != nullptr;
+}
@@ -0,0 +1,109 @@
+#ifndef LIBRARYJOB_H
+#define LIBRARYJOB_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <sqlite3.h>
+
+class QThread;
+
+// runs one piece of analysis over every song in the library db in the background and keeps one row per song in
+// the job's own table. results are committed in batches as they come in and songs that already have a row for
+// their current size/mtime are skipped, so a job that was quit or crashed just carries on from where it got to.
+// FingerprintJob, WaveformJob and LoudnessJob are a Spec each: the table, how to do one song and what it writes
+class LibraryJob : public QObject
+{
+    Q_OBJECT
+
+    public:
+        struct Progress
+        {
+            int total = 0;              // songs that needed doing when the job started
+            int done = 0;               // done or given up on, committed or about to be
+            int failed = 0;
+            int reused = 0;             // file was touched but its row still holds, nothing decoded
+            int followUps = 0;          // rows the job's finish step wrote, e.g. albums for loudness
+            qint64 bytesRead = 0;       // by the decoder
+            qint64 framesDecoded = 0;   // audio frames decoded, all songs, for jobs that count them
+            double filesPerSecond = 0;  // recent rate, not the average since the start
+            qint64 etaSeconds = -1;     // -1 until there is a rate to go on
+            qint64 elapsedMs = 0;
+        };
+
+        struct JobOptions
+        {
+            int threadCount = 0;      // decoder workers, 0 = QThread::idealThreadCount()
+            int maxInFlight = 0;      // songs handed to workers but not written yet, 0 = 2 per worker
+            int batchSize = 200;      // rows per transaction, also the most a crash can lose
+            bool retryFailed = false; // files that failed before are normally left alone until they change
+
+            std::function<void(const Progress &progress)> progress; // called from the writer thread
+        };
+
+        struct Song
+        {
+            qint64 id = 0;
+            QString path;
+            qint64 size = 0;
+            qint64 mtime = 0;
+            QVariant extra; // the spec's extraColumn, null if it has none
+        };
+
+        // what a worker made of one song
+        struct Outcome
+        {
+            bool ok = false;
+            bool restamp = false; // the row there still holds, only the file stamp is rewritten
+            QString error;
+            qint64 bytesRead = 0;
+            qint64 frames = 0;
+            std::function<void(sqlite3_stmt *insert)> bind; // the spec's columns from ?2 on, only called when ok
+        };
+
+        struct Spec
+        {
+            QString name;        // log lines, "fingerprint"
+            QString table;       // has song_id, file_size, file_mtime, status, error, created_at besides columns
+            QStringList columns; // the job's own, in the order bind() fills them
+            QString extraColumn; // optional sql over s (songs) and t (the table) read into Song::extra
+
+            std::function<void(sqlite3 *db)> createTables;
+            std::function<Outcome(const Song &song, const std::atomic<bool> *cancel)> process; // on a worker thread
+
+            // after the songs, unless cancelled, even when there were none. written has Song::extra of every row written
+            std::function<void(sqlite3 *db, const QVector<QVariant> &written, Progress *progress)> finish;
+        };
+
+        // blocks until every pending song is done or cancel goes true
+        static bool run(const Spec &spec, const QString &dbPath, const JobOptions &options = JobOptions(), Progress *result = nullptr,
+                        const std::atomic<bool> *cancel = nullptr);
+        static int pendingCount(const Spec &spec, sqlite3 *db, bool retryFailed = false);
+
+        static bool openDb(const QString &dbPath, sqlite3 **db); // wal, busy timeout
+        static bool exec(sqlite3 *db, const QString &sql);
+
+        ~LibraryJob();
+
+        void start(const QString &dbPath, const JobOptions &options = JobOptions()); // same as run() but off the gui thread
+        void cancel(); // workers drop the file they are on, everything done so far is kept
+        bool isRunning() const;
+
+    signals:
+        void jobProgress(int done, int total, double filesPerSecond, qint64 etaSeconds);
+        void jobFinished(bool success, bool cancelled);
+
+    protected:
+        LibraryJob(const Spec &spec, QObject *parent = nullptr);
+
+    private:
+        Spec jobSpec;
+        QThread *jobThread;
+        std::atomic<bool> cancelled;
+        bool lastResult; // written by the job thread before it finishes
+    };
+#endif // LIBRARYJOB_H
@@ -0,0 +1,405 @@
+#include "loudness.h"
+#include "audioDecoder.h"
+#include "dbManager.h"
+#include <QDebug>
+#include <QFile>
+#include <QSqlQuery>
+#include <QtEndian>
+#include <cmath>
+
+namespace
+{
+    const double pi = 3.14159265358979323846;
+
+    double lufs(double energy)
+    {
+        return -0.691 + 10 * std::log10(energy);
+    }
+
+    double binLufs(int bin)
+    {
+        return Loudness::silenceLufs + (bin + 0.5) / 10;
+    }
+
+    double binEnergy(int bin)
+    {
+        return std::pow(10.0, (binLufs(bin) + 0.691) / 10);
+    }
+
+    // below the absolute gate counts for nothing
+    void addToHistogram(QVector<quint32> &histogram, double energy)
+    {
+        if (energy <= 0)
+        {
+            return;
+        }
+
+        const double loudness = lufs(energy);
+        if (loudness < Loudness::silenceLufs)
+        {
+            return;
+        }
+        histogram[qMin(Loudness::histogramBins - 1, int((loudness - Loudness::silenceLufs) * 10))]++;
+    }
+
+    // value of the index'th (0 based, ascending) entry that is at or above firstBin
+    double histogramValue(const QVector<quint32> &histogram, int firstBin, qint64 index)
+    {
+        qint64 seen = 0;
+        for (int bin = firstBin; bin < histogram.size(); bin++)
+        {
+            seen += histogram[bin];
+            if (seen > index)
+            {
+                return binLufs(bin);
+            }
+        }
+        return binLufs(histogram.size() - 1);
+    }
+
+    // first bin whose loudness is at or over the gate
+    int gateBin(double gate)
+    {
+        return qBound(0, int(std::ceil((gate - Loudness::silenceLufs) * 10 - 0.5)), Loudness::histogramBins);
+    }
+}
+
+// --- analyzer --- //
+
+// K weighting is the BS.1770 high shelf then high pass, worked out for whatever rate the song has
+// (the spec only lists 48kHz coefficients), same formulas as libebur128
+Loudness::Analyzer::Analyzer(int channelCount, int sampleRate) : channels(qBound(1, channelCount, 2)), historyPos(0),
+                                                                 subBlockFrames(qMax(1, sampleRate / 10)), inSubBlock(0), subBlockSum(0),
+                                                                 recent(), subBlocks(0), peak(0), frames(0),
+                                                                 blocks(histogramBins, 0), shortTerm(histogramBins, 0)
+{
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(pi * f0 / sampleRate);
+    double vh = std::pow(10.0, gain / 20);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1 + k / q + k * k;
+    shelf = {(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+             2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(pi * f0 / sampleRate);
+    a0 = 1 + k / q + k * k;
+    highPass = {1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+
+    // true peak: windowed sinc interpolator, each phase normalised so a flat signal comes out at the same level
+    factor = sampleRate >= 192000 ? 1 : sampleRate >= 96000 ? 2 : maxFactor;
+    const int count = factor * phaseTaps;
+    const double centre = (count - 1) / 2.0;
+    for (int n = 0; n < count; n++)
+    {
+        const double x = (n - centre) / factor;
+        const double sinc = x == 0 ? 1 : std::sin(pi * x) / (pi * x);
+        const double window = 0.5 * (1 - std::cos(2 * pi * (n + 1) / (count + 1)));
+        taps[n] = sinc * window;
+    }
+    for (int phase = 0; phase < factor; phase++)
+    {
+        double sum = 0;
+        for (int j = 0; j < phaseTaps; j++)
+        {
+            sum += taps[j * factor + phase];
+        }
+        for (int j = 0; j < phaseTaps; j++)
+        {
+            taps[j * factor + phase] /= sum;
+        }
+    }
+}
+
+// window holds the newest phaseTaps input samples, oldest first
+double Loudness::Analyzer::interpolatedPeak(const double *window) const
+{
+    double highest = 0;
+    for (int phase = 0; phase < factor; phase++)
+    {
+        double value = 0;
+        for (int j = 0; j < phaseTaps; j++)
+        {
+            value += taps[j * factor + phase] * window[phaseTaps - 1 - j];
+        }
+        highest = qMax(highest, std::fabs(value));
+    }
+    return highest;
+}
+
+void Loudness::Analyzer::add(const qint16 *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            Channel &channel = state[c];
+            const double x = samples[c] / 32768.0;
+
+            // two biquads, transposed direct form ii
+            double y = shelf.b0 * x + channel.shelf[0];
+            channel.shelf[0] = shelf.b1 * x - shelf.a1 * y + channel.shelf[1];
+            channel.shelf[1] = shelf.b2 * x - shelf.a2 * y;
+
+            const double z = highPass.b0 * y + channel.highPass[0];
+            channel.highPass[0] = highPass.b1 * y - highPass.a1 * z + channel.highPass[1];
+            channel.highPass[1] = highPass.b2 * y - highPass.a2 * z;
+
+            subBlockSum += z * z; // channels are weighted 1, there are only ever left and right here
+
+            channel.history[historyPos] = x;
+            channel.history[historyPos + phaseTaps] = x;
+            peak = qMax(peak, factor > 1 ? qMax(std::fabs(x), interpolatedPeak(channel.history + historyPos + 1)) : std::fabs(x));
+        }
+
+        historyPos = (historyPos + 1) % phaseTaps;
+        samples += channels;
+        frames++;
+
+        if (++inSubBlock == subBlockFrames)
+        {
+            endSubBlock();
+        }
+    }
+}
+
+// every 100ms: a 400ms momentary block (75% overlap), and every 10th time a 3s short term window
+void Loudness::Analyzer::endSubBlock()
+{
+    recent[subBlocks % 30] = subBlockSum / subBlockFrames;
+    subBlocks++;
+    subBlockSum = 0;
+    inSubBlock = 0;
+
+    if (subBlocks >= 4)
+    {
+        double energy = 0;
+        for (int i = 1; i <= 4; i++)
+        {
+            energy += recent[(subBlocks - i) % 30];
+        }
+        addToHistogram(blocks, energy / 4);
+    }
+
+    if (subBlocks >= 30 && (subBlocks - 30) % 10 == 0)
+    {
+        double energy = 0;
+        for (double sub : recent)
+        {
+            energy += sub;
+        }
+        addToHistogram(shortTerm, energy / 30);
+    }
+}
+
+// the last partial block is dropped, as the spec has it
+Loudness::Result Loudness::Analyzer::finish()
+{
+    Result result;
+    result.frames = frames;
+    result.integrated = integratedFrom(blocks);
+    result.range = rangeFrom(shortTerm);
+    result.truePeak = peak > 0 ? qMax(silencePeak, 20 * std::log10(peak)) : silencePeak;
+    result.blocks = blocks;
+    result.shortTerm = shortTerm;
+    return result;
+}
+
+// --- gating --- //
+
+// absolute gate is already applied going into the histogram, then the relative gate 10 LU under the mean
+double Loudness::integratedFrom(const QVector<quint32> &blocks)
+{
+    double energy = 0;
+    qint64 count = 0;
+    for (int bin = 0; bin < blocks.size(); bin++)
+    {
+        energy += blocks[bin] * binEnergy(bin);
+        count += blocks[bin];
+    }
+    if (count == 0)
+    {
+        return silenceLufs;
+    }
+
+    const int first = gateBin(lufs(energy / count) - 10);
+    energy = 0;
+    count = 0;
+    for (int bin = first; bin < blocks.size(); bin++)
+    {
+        energy += blocks[bin] * binEnergy(bin);
+        count += blocks[bin];
+    }
+    return count > 0 ? lufs(energy / count) : silenceLufs;
+}
+
+// EBU tech 3342: relative gate 20 LU under the mean, then the spread between the 10th and 95th percentile
+double Loudness::rangeFrom(const QVector<quint32> &shortTerm)
+{
+    double energy = 0;
+    qint64 count = 0;
+    for (int bin = 0; bin < shortTerm.size(); bin++)
+    {
+        energy += shortTerm[bin] * binEnergy(bin);
+        count += shortTerm[bin];
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    const int first = gateBin(lufs(energy / count) - 20);
+    count = 0;
+    for (int bin = first; bin < shortTerm.size(); bin++)
+    {
+        count += shortTerm[bin];
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    const double low = histogramValue(shortTerm, first, qRound64((count - 1) * 0.10));
+    const double high = histogramValue(shortTerm, first, qRound64((count - 1) * 0.95));
+    return high - low;
+}
+
+Loudness::Result Loudness::combine(const QList<Result> &tracks)
+{
+    Result album;
+    album.blocks.fill(0, histogramBins);
+    album.shortTerm.fill(0, histogramBins);
+
+    for (const Result &track : tracks)
+    {
+        for (int bin = 0; bin < histogramBins && bin < track.blocks.size(); bin++)
+        {
+            album.blocks[bin] += track.blocks[bin];
+        }
+        for (int bin = 0; bin < histogramBins && bin < track.shortTerm.size(); bin++)
+        {
+            album.shortTerm[bin] += track.shortTerm[bin];
+        }
+        album.truePeak = qMax(album.truePeak, track.truePeak);
+        album.frames += track.frames;
+    }
+
+    album.integrated = integratedFrom(album.blocks);
+    album.range = rangeFrom(album.shortTerm);
+    return album;
+}
+
+// --- playback gain --- //
+
+double Loudness::gainDb(double integrated, double truePeak)
+{
+    if (integrated <= silenceLufs)
+    {
+        return 0;
+    }
+    return qMin(referenceLufs - integrated, maxTruePeak - truePeak);
+}
+
+// only rows made from the file as the scanner last saw it count, an album falls back to the track if it has none
+float Loudness::gainFor(const QString &filePath, GainMode mode)
+{
+    if (mode == GainMode::Off)
+    {
+        return 1.0f;
+    }
+
+    double gain = 0;
+    DbManager::instance().select("SELECT l.integrated, l.true_peak, a.integrated, a.true_peak FROM songs s "
+                                 "JOIN loudness l ON l.song_id = s.id AND l.status = 0 AND l.file_size IS s.file_size AND l.file_mtime IS s.file_mtime "
+                                 "LEFT JOIN album_loudness a ON a.album_id = s.album_id WHERE s.path = ? LIMIT 1",
+                                 {filePath}, [&](const QSqlQuery &query)
+    {
+        const bool album = mode == GainMode::Album && !query.value(2).isNull();
+        gain = album ? gainDb(query.value(2).toDouble(), query.value(3).toDouble())
+                     : gainDb(query.value(0).toDouble(), query.value(1).toDouble());
+    });
+
+    return float(std::pow(10.0, gain / 20));
+}
+
+// --- storage --- //
+
+// little endian uint32s, compressed since most of the thousand bins are empty
+QByteArray Loudness::packHistogram(const QVector<quint32> &histogram)
+{
+    QByteArray packed(histogram.size() * int(sizeof(quint32)), Qt::Uninitialized);
+    for (int i = 0; i < histogram.size(); i++)
+    {
+        qToLittleEndian(histogram[i], packed.data() + i * sizeof(quint32));
+    }
+    return qCompress(packed);
+}
+
+QVector<quint32> Loudness::unpackHistogram(const QByteArray &packed)
+{
+    const QByteArray raw = qUncompress(packed);
+    QVector<quint32> histogram(raw.size() / int(sizeof(quint32)));
+    for (int i = 0; i < histogram.size(); i++)
+    {
+        histogram[i] = qFromLittleEndian<quint32>(raw.constData() + i * sizeof(quint32));
+    }
+    return histogram;
+}
+
+// --- files --- //
+
+// every chunk goes straight from the decoder into the analyzer, nothing bigger than a chunk is ever held
+bool Loudness::analyseFile(const QString &filePath, Result *result, QString *errorMessage, const std::atomic<bool> *cancel, qint64 *bytesRead)
+{
+    auto fail = [errorMessage](const QString &message)
+    {
+        if (errorMessage)
+        {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    if (!QFile::exists(filePath))
+    {
+        return fail("song does not exist!: " + filePath);
+    }
+
+    // the songs own rate, resampling would smear the true peak
+    AudioDecoder decoder;
+    if (!decoder.open(filePath))
+    {
+        return fail("loudness failed!: " + decoder.errorString());
+    }
+
+    Analyzer analyzer(decoder.channels(), decoder.sampleRate());
+    bool decoded = decoder.read([&](const qint16 *samples, int frames)
+    {
+        if (cancel && cancel->load())
+        {
+            return false;
+        }
+        analyzer.add(samples, frames);
+        return true;
+    });
+
+    if (bytesRead)
+    {
+        *bytesRead = decoder.bytesRead();
+    }
+
+    if (cancel && cancel->load())
+    {
+        return fail("cancelled");
+    }
+    if (!decoded)
+    {
+        return fail("loudness failed!: " + decoder.errorString());
+    }
+
+    *result = analyzer.finish();
+    return true;
+}
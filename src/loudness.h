@@ -0,0 +1,116 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <atomic>
+
+// EBU R128 / ITU-R BS.1770 loudness of a song: integrated loudness (gated), loudness range and true peak.
+// block loudness is kept as histograms (0.1 LU bins) instead of one value per block, the way libebur128's
+// histogram mode does it, so an album is just its songs' histograms added up and nothing has to be decoded again.
+// playback turns the stored values into a replaygain style gain towards referenceLufs
+class Loudness
+{
+    public:
+        static constexpr double referenceLufs = -18.0; // replaygain 2.0
+        static constexpr double maxTruePeak = -1.0;    // dBTP
+        static constexpr double silenceLufs = -70.0;   // the absolute gate
+        static constexpr double silencePeak = -120.0;
+        static constexpr int histogramBins = 1000;     // -70 to +30 LUFS in 0.1 LU steps
+        static constexpr int phaseTaps = 12;           // true peak interpolator taps per output phase
+        static constexpr int maxFactor = 4;
+
+        struct Result
+        {
+            double integrated = silenceLufs; // LUFS, silenceLufs if no block got past the gates
+            double range = 0;                // LU, 10th to 95th percentile of the gated short term loudness
+            double truePeak = silencePeak;   // dBTP, 4x oversampled below 96kHz
+            qint64 frames = 0;
+            QVector<quint32> blocks;    // 400ms momentary blocks, for integrated loudness
+            QVector<quint32> shortTerm; // 3s short term windows every second, for the range
+        };
+
+        // K weighting, block gating and true peak on decoded pcm as it comes, nothing allocated after construction
+        class Analyzer
+        {
+            public:
+                Analyzer(int channels, int sampleRate);
+
+                void add(const qint16 *samples, int count); // count frames of interleaved pcm
+                Result finish();
+
+            private:
+                struct Biquad
+                {
+                    double b0, b1, b2, a1, a2;
+                };
+
+                struct Channel
+                {
+                    double shelf[2] = {0, 0}; // transposed direct form ii state of each stage
+                    double highPass[2] = {0, 0};
+                    double history[2 * phaseTaps] = {}; // written twice so the newest phaseTaps are always in one run
+                };
+
+                void endSubBlock();
+                double interpolatedPeak(const double *window) const;
+
+                int channels;
+                Biquad shelf;
+                Biquad highPass;
+                Channel state[2];
+
+                int factor;     // true peak oversampling, 1 at 192kHz and up
+                int historyPos;
+                double taps[maxFactor * phaseTaps];
+
+                int subBlockFrames; // 100ms, blocks and windows are built out of these
+                int inSubBlock;
+                double subBlockSum;
+                double recent[30]; // last 3s of sub block energies
+                qint64 subBlocks;
+
+                double peak; // linear, of the oversampled signal
+                qint64 frames;
+                QVector<quint32> blocks;
+                QVector<quint32> shortTerm;
+            };
+
+        enum class GainMode
+        {
+            Off,
+            Track,
+            Album
+        };
+
+        // whole file at its own rate, no signals, safe from any thread. cancel is checked between decoded chunks
+        static bool analyseFile(const QString &filePath, Result *result, QString *errorMessage = nullptr,
+                                const std::atomic<bool> *cancel = nullptr, qint64 *bytesRead = nullptr);
+
+        // album values out of its songs' results, same as analysing the album as one long file
+        static Result combine(const QList<Result> &tracks);
+        static double integratedFrom(const QVector<quint32> &blocks);
+        static double rangeFrom(const QVector<quint32> &shortTerm);
+
+        // dB towards referenceLufs, held back so the true peak stays under maxTruePeak. 0 for silence
+        static double gainDb(double integrated, double truePeak);
+
+        // linear gain for a library song from the loudness tables, 1 if it hasnt been analysed yet
+        static float gainFor(const QString &filePath, GainMode mode);
+
+        static QByteArray packHistogram(const QVector<quint32> &histogram);
+        static QVector<quint32> unpackHistogram(const QByteArray &packed);
+
+        // status 0 = analysed, 1 = failed (error says why). blocks / short_term are the packed histograms an album is
+        // combined from, size/mtime are the files stamp when it was analysed. in the header for the scanner's schema
+        static constexpr const char *tableSql = "CREATE TABLE IF NOT EXISTS loudness (song_id INTEGER PRIMARY KEY, integrated REAL, loudness_range REAL, "
+                                                "true_peak REAL, blocks BLOB, short_term BLOB, file_size INTEGER, file_mtime INTEGER, "
+                                                "status INTEGER NOT NULL DEFAULT 0, error TEXT, created_at INTEGER)";
+
+        // songs is how many analysed songs went into it, so one added or removed since shows up as a mismatch
+        static constexpr const char *albumTableSql = "CREATE TABLE IF NOT EXISTS album_loudness (album_id INTEGER PRIMARY KEY, integrated REAL, "
+                                                     "loudness_range REAL, true_peak REAL, songs INTEGER, updated_at INTEGER)";
+    };
+#endif // LOUDNESS_H
@@ -0,0 +1,145 @@
+#include "loudnessJob.h"
+#include "loudness.h"
+#include <QDebug>
+#include <QDateTime>
+#include <QList>
+
+LoudnessJob::LoudnessJob(QObject *parent) : LibraryJob(spec(), parent)
+{
+}
+
+void LoudnessJob::createTable(sqlite3 *db)
+{
+    exec(db, Loudness::tableSql);
+    exec(db, Loudness::albumTableSql);
+}
+
+int LoudnessJob::pendingCount(sqlite3 *db, bool retryFailed)
+{
+    return LibraryJob::pendingCount(spec(), db, retryFailed);
+}
+
+// recombines every touched album, plus any whose stored song count no longer matches its analysed songs
+// (one added, removed or failed since). albums left with no analysed songs lose their row
+int LoudnessJob::updateAlbums(sqlite3 *db, const QSet<qint64> &touched)
+{
+    QSet<qint64> albums = touched;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT s.album_id FROM songs s JOIN loudness l ON l.song_id = s.id AND l.status = 0 GROUP BY s.album_id "
+                               "HAVING COUNT(*) IS NOT (SELECT a.songs FROM album_loudness a WHERE a.album_id = s.album_id)", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            albums.insert(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    sqlite3_stmt *songs = nullptr;
+    sqlite3_stmt *upsert = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT l.integrated, l.true_peak, l.blocks, l.short_term FROM loudness l JOIN songs s ON s.id = l.song_id "
+                               "WHERE s.album_id = ?1 AND l.status = 0", -1, &songs, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO album_loudness (album_id, integrated, loudness_range, true_peak, songs, updated_at) "
+                               "VALUES (?1, ?2, ?3, ?4, ?5, ?6)", -1, &upsert, nullptr) != SQLITE_OK)
+    {
+        qWarning() << "album loudness statements failed to prepare:" << sqlite3_errmsg(db);
+        sqlite3_finalize(songs);
+        sqlite3_finalize(upsert);
+        return 0;
+    }
+
+    exec(db, "BEGIN");
+    int updated = 0;
+    for (qint64 albumId : albums)
+    {
+        QList<Loudness::Result> tracks;
+        sqlite3_bind_int64(songs, 1, albumId);
+        while (sqlite3_step(songs) == SQLITE_ROW)
+        {
+            Loudness::Result track;
+            track.integrated = sqlite3_column_double(songs, 0);
+            track.truePeak = sqlite3_column_double(songs, 1);
+            track.blocks = Loudness::unpackHistogram(QByteArray(reinterpret_cast<const char *>(sqlite3_column_blob(songs, 2)), sqlite3_column_bytes(songs, 2)));
+            track.shortTerm = Loudness::unpackHistogram(QByteArray(reinterpret_cast<const char *>(sqlite3_column_blob(songs, 3)), sqlite3_column_bytes(songs, 3)));
+            tracks.append(track);
+        }
+        sqlite3_reset(songs);
+
+        if (tracks.isEmpty())
+        {
+            continue; // the delete below takes its row
+        }
+
+        const Loudness::Result album = Loudness::combine(tracks);
+        sqlite3_bind_int64(upsert, 1, albumId);
+        sqlite3_bind_double(upsert, 2, album.integrated);
+        sqlite3_bind_double(upsert, 3, album.range);
+        sqlite3_bind_double(upsert, 4, album.truePeak);
+        sqlite3_bind_int(upsert, 5, tracks.size());
+        sqlite3_bind_int64(upsert, 6, QDateTime::currentSecsSinceEpoch());
+        if (sqlite3_step(upsert) != SQLITE_DONE)
+        {
+            qWarning() << "album loudness write failed:" << sqlite3_errmsg(db);
+        }
+        sqlite3_reset(upsert);
+        updated++;
+    }
+
+    exec(db, "DELETE FROM album_loudness WHERE album_id NOT IN (SELECT s.album_id FROM songs s JOIN loudness l ON l.song_id = s.id AND l.status = 0)");
+    exec(db, "COMMIT");
+
+    sqlite3_finalize(songs);
+    sqlite3_finalize(upsert);
+    return updated;
+}
+
+bool LoudnessJob::run(const QString &dbPath, const JobOptions &options, Progress *result, const std::atomic<bool> *cancel)
+{
+    return LibraryJob::run(spec(), dbPath, options, result, cancel);
+}
+
+LibraryJob::Spec LoudnessJob::spec()
+{
+    Spec spec;
+    spec.name = "loudness";
+    spec.table = "loudness";
+    spec.columns = QStringList{"integrated", "loudness_range", "true_peak", "blocks", "short_term"};
+    spec.extraColumn = "s.album_id";
+    spec.createTables = &LoudnessJob::createTable;
+
+    spec.process = [](const Song &song, const std::atomic<bool> *cancel)
+    {
+        Outcome outcome;
+        Loudness::Result loudness;
+        outcome.ok = Loudness::analyseFile(song.path, &loudness, &outcome.error, cancel, &outcome.bytesRead);
+        outcome.frames = loudness.frames;
+        if (outcome.ok)
+        {
+            const QByteArray blocks = Loudness::packHistogram(loudness.blocks);
+            const QByteArray shortTerm = Loudness::packHistogram(loudness.shortTerm);
+            outcome.bind = [loudness, blocks, shortTerm](sqlite3_stmt *insert)
+            {
+                sqlite3_bind_double(insert, 2, loudness.integrated);
+                sqlite3_bind_double(insert, 3, loudness.range);
+                sqlite3_bind_double(insert, 4, loudness.truePeak);
+                sqlite3_bind_blob(insert, 5, blocks.constData(), blocks.size(), SQLITE_TRANSIENT);
+                sqlite3_bind_blob(insert, 6, shortTerm.constData(), shortTerm.size(), SQLITE_TRANSIENT);
+            };
+        }
+        return outcome;
+    };
+
+    // a failed song can still have been in an album before. a cancelled run never gets here and leaves its albums
+    // short, the song count mismatch gets them next time
+    spec.finish = [](sqlite3 *db, const QVector<QVariant> &written, Progress *progress)
+    {
+        QSet<qint64> touched;
+        for (const QVariant &albumId : written)
+        {
+            touched.insert(albumId.toLongLong());
+        }
+        progress->followUps = updateAlbums(db, touched);
+    };
+    return spec;
+}
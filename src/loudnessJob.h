@@ -0,0 +1,25 @@
+#ifndef LOUDNESSJOB_H
+#define LOUDNESSJOB_H
+
+#include "libraryJob.h"
+#include <QSet>
+
+// R128 loudness for every song in the library db, in the background, kept in the loudness table for playback's
+// track gain. once the songs are done every album that gained, lost or changed one is recombined into
+// album_loudness from its songs' stored histograms, no decoding. Progress::followUps is how many albums that was
+class LoudnessJob : public LibraryJob
+{
+    Q_OBJECT
+
+    public:
+        explicit LoudnessJob(QObject *parent = nullptr);
+
+        // blocks until every pending song is done or cancel goes true
+        static bool run(const QString &dbPath, const JobOptions &options = JobOptions(), Progress *result = nullptr, const std::atomic<bool> *cancel = nullptr);
+
+        static void createTable(sqlite3 *db); // both tables
+        static int updateAlbums(sqlite3 *db, const QSet<qint64> &touched); // returns how many were recombined
+        static int pendingCount(sqlite3 *db, bool retryFailed = false);
+        static Spec spec();
+    };
+#endif // LOUDNESSJOB_H
@@ -1,7 +1,5 @@
 #include "mainMenu.h"
-#include <QSqlDatabase>
-#include <QSqlQuery>
-#include <QSqlError>
+#include "dbManager.h"
 #include <QDebug>
 #include <QMouseEvent>
 #include <QPixmap>
@@ -18,12 +16,38 @@ MainMenu::MainMenu(QWidget *parent) : QWidget(parent)
   
     recommendationButton = new QPushButton("Recommendations", this);
     playbackButton = new QPushButton("Playback", this);
+    searchButton = new QPushButton("Search", this);
+    searchButton->setShortcut(QKeySequence::Find);
 
+    layout->addWidget(searchButton, 0, 0);
     layout->addWidget(recommendationButton, 0, 1);
     layout->addWidget(playbackButton, 0, 2);
 
     connect(recommendationButton, &QPushButton::clicked, this, &MainMenu::onRecommendationButtonClicked);
     connect(playbackButton, &QPushButton::clicked, this, &MainMenu::onPlaybackButtonClicked);
+    connect(searchButton, &QPushButton::clicked, this, &MainMenu::showSearchMenu);
+
+    // ---- album grid ------- //
+    albumModel = new AlbumModel(this);
+
+    albumView = new QListView(this);
+    albumView->setViewMode(QListView::IconMode);
+    albumView->setResizeMode(QListView::Adjust); // reflow columns with the window
+    albumView->setMovement(QListView::Static);
+    albumView->setUniformItemSizes(true);        // lets the view skip measuring every tile
+    albumView->setLayoutMode(QListView::Batched);
+    albumView->setBatchSize(256);
+    albumView->setIconSize(QSize(AlbumModel::coverSize, AlbumModel::coverSize));
+    albumView->setGridSize(QSize(AlbumModel::coverSize + 20, AlbumModel::coverSize + 30));
+    albumView->setWordWrap(true);
+    albumView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    albumView->setModel(albumModel);
+
+    layout->addWidget(albumView, 1, 0, 1, 4); // under the buttons
+
+    connect(albumView, &QListView::clicked, this, &MainMenu::onAlbumClicked);
+
+    // ---- album grid ------- //
 
     // ---- playback bar stuff ------- //
 
@@ -58,80 +82,29 @@ MainMenu::MainMenu(QWidget *parent) : QWidget(parent)
     qDebug() << "mainmenu initialized";
 }
 
-void MainMenu::loadAlbums(const QString &dbPath)
+void MainMenu::loadAlbums()
 {
-    qDebug() << "loadAlbums func called" << dbPath;
+    qDebug() << "loadAlbums func called" << DbManager::instance().databasePath();
 
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(dbPath);
-    if (!db.open()) 
-    {
-        qWarning() << "db could not be opened:";
-        return;
-    }
+    albumModel->setAlbums(DbManager::instance().albums()); // covers come in as the view asks for them
 
-    QSqlQuery query(db);
+    qDebug() << "albums loaded:" << albumModel->rowCount();
+}
 
-    if (!query.exec("SELECT name, path FROM albums")) 
-    {
-        qWarning() << "Failed to execute query:" << query.lastError().text();
-        return;
-    }
+// --- live updates from the library watcher --- //
+void MainMenu::addAlbum(const QString &albumName, const QString &albumPath)
+{
+    albumModel->addAlbum(albumName, albumPath);
+}
 
-    int row = 1; // prevent overlapping
-    int col = 0;
+void MainMenu::removeAlbum(const QString &albumPath)
+{
+    albumModel->removeAlbum(albumPath);
+}
 
-    while (query.next())
-    {
-        QString albumName = query.value(0).toString();
-        QString albumPath = query.value(1).toString();
-        qDebug() << albumName << " path: " << albumPath;
-
-
-        QStringList albumArtFiles = {"Folder.jpg", "Front.jpg", "cover.jpg", "cover.png"};
-        QPixmap albumArt;
-        bool albumArtFound = false; //prompt to use placeholder 
-
-        foreach (const QString &fileName, albumArtFiles) //check if an instance of album art exists 
-        {
-            QString albumArtPath = albumPath + "/" + fileName;
-            albumArt.load(albumArtPath);
-            if (!albumArt.isNull()) 
-            {
-                albumArtFound = true;
-                break;
-            }
-        }
-
-        if (!albumArtFound)
-        {
-            qDebug() << "using placeholder for: " << albumName;
-            albumArt.load(":/resources/placeholder.jpeg"); //get placeholder image
-        }
-
-        //------ cusotmised label for album art -------//
-        ClickableLabel *albumLabel = new ClickableLabel(this);
-        albumLabel->setPixmap(albumArt.scaled(150, 150, Qt::KeepAspectRatio)); // scaling to fit grid 
-        albumLabel->setAlignment(Qt::AlignCenter);
-        albumLabel->setToolTip(albumName); // if user hovers over album, show name 
-        albumLabel->setProperty("albumName", albumName);
-        albumLabel->setProperty("albumPath", albumPath);
-        connect(albumLabel, &ClickableLabel::clicked, this, &MainMenu::onAlbumClicked);
-
-        layout->addWidget(albumLabel, row, col);
-        //------ cusotmised label for album art -------//
-
-
-        col++; // increment column for next album
-        if (col >= 4) 
-        { 
-            col = 0;
-            row++;
-        }
-    }
-    db.close();
-    qDebug() << "albums loaded";
-    this->update(); //update layout to show laoded albums
+void MainMenu::refreshAlbum(const QString &albumPath)
+{
+    albumModel->refreshAlbum(albumPath);
 }
 
 //----------- connections / signals ---------------//
@@ -146,26 +119,35 @@ void MainMenu::onPlaybackButtonClicked()
     emit showPlayback();
 }
 
-void MainMenu::onAlbumClicked() 
+void MainMenu::onAlbumClicked(const QModelIndex &index) 
 {
-    ClickableLabel *albumLabel = qobject_cast<ClickableLabel *>(sender());
-    if (albumLabel) {
-        QString albumName = albumLabel->property("albumName").toString();
-        QString albumPath = albumLabel->property("albumPath").toString();
-        emit showAlbumMenu(albumName, albumPath);
-    }
+    QString albumName = index.data(AlbumModel::AlbumNameRole).toString();
+    QString albumPath = index.data(AlbumModel::AlbumPathRole).toString();
+    emit showAlbumMenu(albumName, albumPath);
 }
 
-void MainMenu::updatePlaybackBar(const QString &songTitle, int duration) 
+// slider is in seconds, the bus only calls with a new position once it has moved on a second
+void MainMenu::showPlaybackState(const PlaybackBus::State &state, PlaybackBus::Changes changes)
 {
-    currentSongLabel->setText(songTitle);
-    playbackSlider->setRange(0, duration); // update slider
-    playbackSlider->setValue(0);           // reset 
-}
+    if (changes & PlaybackBus::Track)
+    {
+        currentSongLabel->setText(state.path.isEmpty() ? QString("No song playing") : state.title);
+    }
 
-void MainMenu::updatePlaybackProgress(int position) 
-{
-    playbackSlider->setValue(position); // get current position
+    if (changes & PlaybackBus::Duration)
+    {
+        playbackSlider->setRange(0, int(state.duration / 1000));
+    }
+
+    if ((changes & PlaybackBus::Position) && !playbackSlider->isSliderDown())
+    {
+        playbackSlider->setValue(int(state.position / 1000));
+    }
+
+    if (changes & PlaybackBus::PlayState)
+    {
+        playPauseButton->setText(state.playbackState == QMediaPlayer::PlayingState ? "Pause" : "Play");
+    }
 }
 
 //----------- connections / signals ---------------//
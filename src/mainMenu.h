@@ -6,23 +6,9 @@
 #include <QGridLayout>
 #include <QLabel>
 #include <QSlider>
-
-class ClickableLabel : public QLabel 
-{
-    Q_OBJECT
-
-public:
-    explicit ClickableLabel(QWidget *parent = nullptr) : QLabel(parent) {}
-
-signals:
-    void clicked();
-
-protected:
-    void mousePressEvent(QMouseEvent *event) override 
-    {
-        emit clicked();
-    }
-};
+#include <QListView>
+#include "albumModel.h"
+#include "playbackBus.h"
 
 class MainMenu : public QWidget 
 {
@@ -31,14 +17,18 @@ class MainMenu : public QWidget
 public:
     explicit MainMenu(QWidget *parent = nullptr);
 
-    void loadAlbums(const QString &dbPath);
-    void updatePlaybackBar(const QString &songTitle, int duration); // update playback bar if user plays song
-    void updatePlaybackProgress(int position); //update progress when switching to mainemenu
+    void loadAlbums(); // reads through DbManager, path is set by mainwindow
+    void showPlaybackState(const PlaybackBus::State &state, PlaybackBus::Changes changes); // from the playback bus, once a second at most
+
+    void addAlbum(const QString &albumName, const QString &albumPath); // library watcher updates
+    void removeAlbum(const QString &albumPath);
+    void refreshAlbum(const QString &albumPath);
     
 
 signals:
     void showRecommendationMenu();
     void showPlayback();
+    void showSearchMenu();
     void showAlbumMenu(const QString &albumName, const QString &albumPath);
 
     //signal to playback menu functinalities 
@@ -49,7 +39,7 @@ signals:
 
 private slots:
     void onRecommendationButtonClicked();
-    void onAlbumClicked();
+    void onAlbumClicked(const QModelIndex &index);
 
     void onPlaybackButtonClicked();
 
@@ -58,12 +48,16 @@ private:
 
     QPushButton *recommendationButton;
     QPushButton *playbackButton;
+    QPushButton *searchButton;
     QPushButton *playPauseButton;
     QPushButton *stopButton;
 
     QLabel *currentSongLabel;
     QSlider *playbackSlider;
 
+    QListView *albumView; // only lays out and paints the tiles on screen
+    AlbumModel *albumModel;
+
 
 
 };
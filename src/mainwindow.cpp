@@ -5,6 +5,8 @@
 #include <QDir>
 #include <QGuiApplication>
 #include <QScreen>
+#include <QStatusBar>
+#include "dbManager.h"
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) 
 {
@@ -22,14 +24,22 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     songDetail = new SongDetail(this);
     playback = new Playback(this);
     recommendationMenu = new RecommendationMenu(this);
+    searchMenu = new SearchMenu(this);
     // --- call constructors for each menu ---//
 
+    libScan = new LibScan(this);
+    libWatcher = new LibWatcher(this);
+    fingerprintJob = new FingerprintJob(this);
+    waveformJob = new WaveformJob(this);
+    loudnessJob = new LoudnessJob(this);
+
     // --- add objects to the stacked widget ---//
     stackedWidget->addWidget(mainMenu);
     stackedWidget->addWidget(albumMenu);
     stackedWidget->addWidget(songDetail);
     stackedWidget->addWidget(recommendationMenu);
     stackedWidget->addWidget(playback);
+    stackedWidget->addWidget(searchMenu);
     // --- add objects to the stacked widget ---//
 
     setCentralWidget(stackedWidget);
@@ -54,24 +64,45 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     });
 
     connect(mainMenu, &MainMenu::showAlbumMenu, this, &MainWindow::showAlbumMenu);
+
+    // -- play queue, the menus push songs in and playback works through them gaplessly -- //
+    connect(albumMenu, &AlbumMenu::playAlbum, this, [this](const QStringList &paths, int startIndex)
+    {
+        playback->playTracks(paths, startIndex);
+        stackedWidget->setCurrentWidget(playback);
+    });
+    connect(albumMenu, &AlbumMenu::playNext, playback, &Playback::enqueueNext);
+    connect(albumMenu, &AlbumMenu::addToQueue, playback, &Playback::enqueue);
+    connect(recommendationMenu, &RecommendationMenu::addToQueue, playback, &Playback::enqueue);
+
     connect(albumMenu, &AlbumMenu::songSelected, this, &MainWindow::showSongMenu);
     connect(songDetail, &SongDetail::backToMainMenu, this, &MainWindow::returnMainMenu);
     connect(playback, &Playback::backToMainMenu, this, &MainWindow::returnMainMenu);
     connect(recommendationMenu, &RecommendationMenu::backToMainMenu, this, &MainWindow::returnMainMenu);
 
+    // -- search, results open the same pages the album grid does -- //
+    connect(mainMenu, &MainMenu::showSearchMenu, this, &MainWindow::showSearchMenu);
+    connect(searchMenu, &SearchMenu::albumSelected, this, &MainWindow::showAlbumMenu);
+    connect(searchMenu, &SearchMenu::songSelected, this, &MainWindow::showSongMenu);
+    connect(searchMenu, &SearchMenu::backToMainMenu, this, &MainWindow::returnMainMenu);
+
     // -- playback signals -- //
-    connect(playback, &Playback::playbackStarted, mainMenu, &MainMenu::updatePlaybackBar);
-    connect(playback, &Playback::playbackProgress, mainMenu, &MainMenu::updatePlaybackProgress);
-    connect(playback, &Playback::playbackStopped, mainMenu, [this]()
+    // the bar only shows whole seconds, so it only hears about position once a second
+    playback->stateBus()->subscribe(mainMenu, [this](const PlaybackBus::State &state, PlaybackBus::Changes changes)
     {
-        mainMenu->updatePlaybackBar("No song playing", 0);
-    });
+        mainMenu->showPlaybackState(state, changes);
+    }, 1000);
 
     connect(mainMenu, &MainMenu::playPauseClicked, playback, &Playback::togglePlayPause);
     connect(mainMenu, &MainMenu::stopClicked, playback, &Playback::stopPlayback);
     connect(mainMenu, &MainMenu::seekPosition, playback, &Playback::seekPosition);
     // -- playback signals -- //
 
+    // -- library watcher, only the affected tiles change -- //
+    connect(libWatcher, &LibWatcher::albumAdded, mainMenu, &MainMenu::addAlbum);
+    connect(libWatcher, &LibWatcher::albumRemoved, mainMenu, &MainMenu::removeAlbum);
+    connect(libWatcher, &LibWatcher::albumUpdated, mainMenu, &MainMenu::refreshAlbum);
+
 
 
     // --- CONNCECTIONS AND SIGNALS --- //
@@ -88,19 +119,40 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
         dbPath += "/lavender.db"; // db file 
 
         qDebug() << dbPath;
+        DbManager::instance().setDatabasePath(dbPath); // every menu reads through this from here on
 
-        // // incase db exists, skip scan 
+        stackedWidget->setCurrentWidget(mainMenu);
+
+        // show whatever the last scan left behind straight away
         if (QFile::exists(dbPath))
         {
-            qDebug() << "db already exists, skip scan";
-        } 
-        else 
-        {
-            LibScan::scanMusicLibrary(folder, dbPath); // scan provided dir 
+            mainMenu->loadAlbums();
         }
 
-        mainMenu->loadAlbums(dbPath);
-        stackedWidget->setCurrentWidget(mainMenu);
+        // incremental rescan in the background, only new/changed files get their tags read
+        connect(libScan, &LibScan::scanProgress, this, [this](int albums, int songs)
+        {
+            statusBar()->showMessage(QString("scanning library... %1 albums, %2 songs").arg(albums).arg(songs));
+        });
+        connect(libScan, &LibScan::scanFinished, this, [this, folder, dbPath](bool success)
+        {
+            statusBar()->showMessage(success ? "scan complete" : "scan failed", 5000);
+            mainMenu->loadAlbums();
+
+            libWatcher->start(folder, dbPath); // from here on changes on disk are synced as they happen
+
+            if (success) // only songs without a fingerprint yet, picks up where the last run stopped
+            {
+                fingerprintJob->start(dbPath);
+            }
+        });
+
+        // one after another, not alongside, all three decode the whole library
+        followLibraryJob(fingerprintJob, "fingerprinting library", "fingerprinting", waveformJob, dbPath);
+        followLibraryJob(waveformJob, "building waveforms", "waveforms", loudnessJob, dbPath);
+        followLibraryJob(loudnessJob, "measuring loudness", "loudness", nullptr, dbPath);
+
+        libScan->startScan(folder, dbPath);
 
     } 
     else 
@@ -109,6 +161,30 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     }
 }
 
+// status bar progress for one of the library jobs, then the next one started once it stops. a failed job
+// (say the db was locked) still hands on, the next one has nothing to do with it, only cancelling ends the chain
+void MainWindow::followLibraryJob(LibraryJob *job, const QString &doing, const QString &name, LibraryJob *next, const QString &dbPath)
+{
+    connect(job, &LibraryJob::jobProgress, this, [this, doing](int done, int total, double filesPerSecond, qint64 etaSeconds)
+    {
+        QString eta = etaSeconds < 0 ? QString("--") : QString("%1:%2").arg(etaSeconds / 60).arg(etaSeconds % 60, 2, 10, QChar('0'));
+        statusBar()->showMessage(QString("%1... %2/%3 (%4 songs/s, %5 left)").arg(doing).arg(done).arg(total).arg(filesPerSecond, 0, 'f', 1).arg(eta));
+    });
+    connect(job, &LibraryJob::jobFinished, this, [this, name, next, dbPath](bool success, bool cancelled)
+    {
+        if (cancelled)
+        {
+            return;
+        }
+
+        statusBar()->showMessage(QString("%1 %2").arg(name, success ? "complete" : "failed"), 5000);
+        if (next)
+        {
+            next->start(dbPath);
+        }
+    });
+}
+
 // --- CONNCECTIONS AND SIGNALS --- //
 void MainWindow::returnMainMenu() 
 {
@@ -118,8 +194,7 @@ stackedWidget->setCurrentWidget(mainMenu);
 
 void MainWindow::showMainMenu(const QString &folder) 
 {
-    QString dbPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/lavender.db";
-    mainMenu->loadAlbums(dbPath);
+    mainMenu->loadAlbums();
     stackedWidget->setCurrentWidget(mainMenu);
 
     qDebug() << "mainmenu loaded";
@@ -149,6 +224,12 @@ void MainWindow::showAlbumMenu(const QString &albumName, const QString &albumPat
     stackedWidget->setCurrentWidget(albumMenu);
 }
 
+void MainWindow::showSearchMenu()
+{
+    stackedWidget->setCurrentWidget(searchMenu);
+    searchMenu->focusSearch();
+}
+
 void MainWindow::showSongMenu(const QString &songPath)
 {
     songDetail->loadSong(songPath);
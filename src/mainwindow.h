@@ -8,7 +8,12 @@
 #include "songMenu.h"
 #include "playback.h"
 #include "recoMenu.h"
+#include "searchMenu.h"
 #include "libScan.h"
+#include "libWatcher.h"
+#include "fingerprintJob.h"
+#include "waveformJob.h"
+#include "loudnessJob.h"
 
 class MainWindow : public QMainWindow 
 {
@@ -24,20 +29,30 @@ private slots:
     void showRecommendationMenu(int songId);
     void showAlbumMenu(const QString &albumName, const QString &albumPath);
     void showSongMenu(const QString &songPath);
+    void showSearchMenu();
 
     void showPlayback(const QString &songPath);
     void showPlayback();
 
 
 private:
+    void followLibraryJob(LibraryJob *job, const QString &doing, const QString &name, LibraryJob *next, const QString &dbPath);
+
     QStackedWidget *stackedWidget;
 
     MainMenu *mainMenu;
     AlbumMenu *albumMenu;
     SongDetail *songDetail;
     RecommendationMenu *recommendationMenu;
+    SearchMenu *searchMenu;
 
     Playback *playback;
+
+    LibScan *libScan;
+    LibWatcher *libWatcher;
+    FingerprintJob *fingerprintJob;
+    WaveformJob *waveformJob;
+    LoudnessJob *loudnessJob;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
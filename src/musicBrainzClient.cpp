@@ -0,0 +1,338 @@
+#include "musicBrainzClient.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+
+const char *MusicBrainzClient::userAgent = "lavender(university project) (n1076024@my.ntu.ac.uk)";
+
+namespace
+{
+    const int maxAttempts = 3;          // 503s from musicbrainz mean slow down, not give up
+    const qint64 retryDelayMs = 2000;   // when the server doesnt say how long
+}
+
+// --- reply --- //
+
+MusicBrainzReply::MusicBrainzReply(const QUrl &url, QObject *parent) : QObject(parent), requestUrl(url)
+{
+}
+
+void MusicBrainzReply::complete(QNetworkReply::NetworkError error, const QString &errorString, const QByteArray &data, int httpStatus, bool cached)
+{
+    networkError = error;
+    networkErrorString = errorString;
+    body = data;
+    status = httpStatus;
+    fromCache = cached;
+
+    emit finished();
+}
+
+QNetworkReply::NetworkError MusicBrainzReply::error() const
+{
+    return networkError;
+}
+
+QString MusicBrainzReply::errorString() const
+{
+    return networkErrorString;
+}
+
+QByteArray MusicBrainzReply::readAll() const
+{
+    return body;
+}
+
+int MusicBrainzReply::httpStatus() const
+{
+    return status;
+}
+
+bool MusicBrainzReply::isFromCache() const
+{
+    return fromCache;
+}
+
+QUrl MusicBrainzReply::url() const
+{
+    return requestUrl;
+}
+
+// --- client --- //
+
+MusicBrainzClient &MusicBrainzClient::instance()
+{
+    static MusicBrainzClient client;
+    return client;
+}
+
+MusicBrainzClient::MusicBrainzClient() : network(new QNetworkAccessManager(this)), cacheTtlMs(7LL * 24 * 60 * 60 * 1000), sent(0)
+{
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/musicbrainz";
+
+    setRateLimit("musicbrainz.org", 1.0); // https://musicbrainz.org/doc/MusicBrainz_API/Rate_Limiting
+    setRateLimit("coverartarchive.org", 5.0, 5);
+
+    dispatchTimer.setSingleShot(true);
+    connect(&dispatchTimer, &QTimer::timeout, this, &MusicBrainzClient::dispatch);
+
+    clock.start();
+}
+
+void MusicBrainzClient::setRateLimit(const QString &host, double requestsPerSecond, int burst)
+{
+    Bucket bucket;
+    bucket.rate = qMax(0.01, requestsPerSecond);
+    bucket.capacity = qMax(1, burst);
+    bucket.tokens = bucket.capacity;
+    bucket.refilledAt = clock.isValid() ? clock.elapsed() : 0;
+    buckets.insert(host, bucket);
+}
+
+void MusicBrainzClient::setCacheDirectory(const QString &dir)
+{
+    cacheDir = dir;
+}
+
+QString MusicBrainzClient::cacheDirectory() const
+{
+    return cacheDir;
+}
+
+void MusicBrainzClient::setCacheTtl(qint64 seconds)
+{
+    cacheTtlMs = seconds * 1000;
+}
+
+int MusicBrainzClient::requestsSent() const
+{
+    return sent;
+}
+
+MusicBrainzReply *MusicBrainzClient::get(const QUrl &url)
+{
+    return get(QNetworkRequest(url));
+}
+
+MusicBrainzReply *MusicBrainzClient::get(const QNetworkRequest &request)
+{
+    const QString key = request.url().toString(QUrl::FullyEncoded);
+    MusicBrainzReply *reply = new MusicBrainzReply(request.url(), this);
+
+    // --- disk cache, still answered on the next loop pass so callers can connect first --- //
+    QByteArray cached;
+    if (readCache(key, &cached))
+    {
+        QPointer<MusicBrainzReply> waiter(reply);
+        QMetaObject::invokeMethod(this, [waiter, cached]()
+        {
+            if (waiter)
+            {
+                waiter->complete(QNetworkReply::NoError, QString(), cached, 0, true);
+            }
+        }, Qt::QueuedConnection);
+        return reply;
+    }
+
+    // --- same url already waiting or on the wire, just listen in --- //
+    auto existing = inFlight.find(key);
+    if (existing != inFlight.end())
+    {
+        existing->waiters.append(reply);
+        return reply;
+    }
+
+    InFlight entry;
+    entry.request = request;
+    entry.request.setHeader(QNetworkRequest::UserAgentHeader, userAgent);
+    entry.waiters.append(reply);
+    inFlight.insert(key, entry);
+
+    pending.append(key);
+    dispatch();
+
+    return reply;
+}
+
+// sends everything the buckets allow right now and rearms the timer for the rest
+void MusicBrainzClient::dispatch()
+{
+    qint64 nextWait = -1;
+
+    for (int i = 0; i < pending.size();)
+    {
+        const QString key = pending[i];
+        qint64 wait = takeToken(inFlight.value(key).request.url().host());
+
+        if (wait > 0)
+        {
+            nextWait = nextWait < 0 ? wait : qMin(nextWait, wait);
+            i++; // other hosts can still go ahead of it
+            continue;
+        }
+
+        pending.removeAt(i);
+        send(key);
+    }
+
+    if (nextWait >= 0 && (!dispatchTimer.isActive() || dispatchTimer.remainingTime() > nextWait))
+    {
+        dispatchTimer.start(int(nextWait));
+    }
+}
+
+qint64 MusicBrainzClient::takeToken(const QString &host)
+{
+    auto it = buckets.find(host);
+    if (it == buckets.end())
+    {
+        return 0;
+    }
+
+    Bucket &bucket = it.value();
+    qint64 now = clock.elapsed();
+
+    bucket.tokens = qMin(bucket.capacity, bucket.tokens + (now - bucket.refilledAt) * bucket.rate / 1000.0);
+    bucket.refilledAt = now;
+
+    if (bucket.tokens >= 1.0)
+    {
+        bucket.tokens -= 1.0;
+        return 0;
+    }
+
+    return qMax<qint64>(1, qint64((1.0 - bucket.tokens) * 1000.0 / bucket.rate) + 1);
+}
+
+void MusicBrainzClient::send(const QString &key)
+{
+    auto it = inFlight.find(key);
+    if (it == inFlight.end())
+    {
+        return;
+    }
+
+    it->attempts++;
+    sent++;
+
+    QNetworkReply *reply = network->get(it->request);
+    connect(reply, &QNetworkReply::finished, this, [this, key, reply]()
+    {
+        onFinished(key, reply);
+    });
+}
+
+void MusicBrainzClient::onFinished(const QString &key, QNetworkReply *reply)
+{
+    reply->deleteLater();
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    auto it = inFlight.find(key);
+    if (it == inFlight.end())
+    {
+        return;
+    }
+
+    // throttled, back off and queue it again instead of handing the error out
+    if (status == 503 && it->attempts < maxAttempts)
+    {
+        qint64 delay = retryDelayMs;
+        if (reply->hasRawHeader("Retry-After"))
+        {
+            delay = qMax<qint64>(1000, reply->rawHeader("Retry-After").toLongLong() * 1000);
+        }
+
+        qDebug() << "musicbrainz throttled, retrying in" << delay << "ms:" << key;
+        QTimer::singleShot(int(delay), this, [this, key]()
+        {
+            pending.prepend(key);
+            dispatch();
+        });
+        return;
+    }
+
+    QByteArray body = reply->readAll();
+    if (reply->error() == QNetworkReply::NoError && status == 200)
+    {
+        writeCache(key, body);
+    }
+
+    finish(key, reply->error(), reply->errorString(), body, status);
+}
+
+void MusicBrainzClient::finish(const QString &key, QNetworkReply::NetworkError error, const QString &errorString, const QByteArray &body, int status)
+{
+    InFlight entry = inFlight.take(key);
+
+    for (const QPointer<MusicBrainzReply> &waiter : entry.waiters)
+    {
+        if (waiter) // caller may have gone away while it waited
+        {
+            waiter->complete(error, errorString, body, status, false);
+        }
+    }
+}
+
+// --- disk cache: qint64 stored at (ms since epoch) then the body --- //
+
+QString MusicBrainzClient::cachePath(const QString &key) const
+{
+    QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QString("%1/%2/%3").arg(cacheDir, hash.left(2), hash);
+}
+
+bool MusicBrainzClient::readCache(const QString &key, QByteArray *body) const
+{
+    if (cacheTtlMs <= 0)
+    {
+        return false;
+    }
+
+    QFile file(cachePath(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    qint64 storedAt = 0;
+    in >> storedAt >> *body;
+
+    if (in.status() != QDataStream::Ok || QDateTime::currentMSecsSinceEpoch() - storedAt > cacheTtlMs)
+    {
+        return false; // stale or half written, the next good response replaces it
+    }
+    return true;
+}
+
+void MusicBrainzClient::writeCache(const QString &key, const QByteArray &body) const
+{
+    if (cacheTtlMs <= 0)
+    {
+        return;
+    }
+
+    QString path = cachePath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "musicbrainz cache not writable:" << path;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << QDateTime::currentMSecsSinceEpoch() << body;
+
+    if (!file.commit())
+    {
+        qWarning() << "musicbrainz cache write failed:" << path;
+    }
+}
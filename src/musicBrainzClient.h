@@ -0,0 +1,107 @@
+#ifndef MUSICBRAINZCLIENT_H
+#define MUSICBRAINZCLIENT_H
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QUrl>
+
+// what a caller gets back from MusicBrainzClient::get, reads like the QNetworkReply it stands in for.
+// one per get() call even when several share the request underneath, delete it with deleteLater once finished
+class MusicBrainzReply : public QObject
+{
+    Q_OBJECT
+
+    public:
+        QNetworkReply::NetworkError error() const;
+        QString errorString() const;
+        QByteArray readAll() const; // whole body, can be read more than once
+        int httpStatus() const;     // 0 when it came out of the cache
+        bool isFromCache() const;
+        QUrl url() const;
+
+    signals:
+        void finished(); // always queued, never from inside get()
+
+    private:
+        friend class MusicBrainzClient;
+        MusicBrainzReply(const QUrl &url, QObject *parent);
+        void complete(QNetworkReply::NetworkError error, const QString &errorString, const QByteArray &body, int status, bool fromCache);
+
+        QUrl requestUrl;
+        QNetworkReply::NetworkError networkError = QNetworkReply::NoError;
+        QString networkErrorString;
+        QByteArray body;
+        int status = 0;
+        bool fromCache = false;
+    };
+
+// one network manager for every musicbrainz / cover art archive call so connections stay alive between them,
+// requests wait on a per host token bucket (timer driven, the event loop never sleeps), identical urls
+// already on the wire are shared, and good responses are kept on disk for a while
+class MusicBrainzClient : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static MusicBrainzClient &instance();
+
+        MusicBrainzReply *get(const QNetworkRequest &request);
+        MusicBrainzReply *get(const QUrl &url);
+
+        void setRateLimit(const QString &host, double requestsPerSecond, int burst = 1); // hosts without one go straight out
+        void setCacheDirectory(const QString &dir);
+        QString cacheDirectory() const;
+        void setCacheTtl(qint64 seconds); // 0 turns the disk cache off
+
+        int requestsSent() const; // over the wire, cache hits and shared requests dont count
+
+        static const char *userAgent;
+
+    private:
+        MusicBrainzClient();
+
+        struct Bucket
+        {
+            double rate = 1;      // tokens per second
+            double capacity = 1;
+            double tokens = 1;
+            qint64 refilledAt = 0; // ms on clock
+        };
+
+        struct InFlight
+        {
+            QNetworkRequest request;
+            QList<QPointer<MusicBrainzReply>> waiters;
+            int attempts = 0;
+        };
+
+        void dispatch();
+        void send(const QString &key);
+        void onFinished(const QString &key, QNetworkReply *reply);
+        void finish(const QString &key, QNetworkReply::NetworkError error, const QString &errorString, const QByteArray &body, int status);
+        qint64 takeToken(const QString &host); // 0 if one was taken, otherwise ms until there is one
+
+        QString cachePath(const QString &key) const;
+        bool readCache(const QString &key, QByteArray *body) const;
+        void writeCache(const QString &key, const QByteArray &body) const;
+
+        QNetworkAccessManager *network;
+        QHash<QString, InFlight> inFlight; // keyed on the full url, waiting or on the wire
+        QList<QString> pending;            // keys waiting on a token, oldest first
+        QHash<QString, Bucket> buckets;
+
+        QTimer dispatchTimer;
+        QElapsedTimer clock;
+
+        QString cacheDir;
+        qint64 cacheTtlMs;
+        int sent;
+    };
+#endif // MUSICBRAINZCLIENT_H
@@ -0,0 +1,174 @@
+#include "playQueue.h"
+
+namespace
+{
+    const int forceChange = -2; // passed as the old index when currentChanged has to go out even for the same path
+}
+
+PlayQueue::PlayQueue(QObject *parent) : QObject(parent), index(-1)
+{
+}
+
+QStringList PlayQueue::tracks() const
+{
+    return paths;
+}
+
+int PlayQueue::currentIndex() const
+{
+    return index;
+}
+
+QString PlayQueue::current() const
+{
+    return index >= 0 ? paths[index] : QString();
+}
+
+QString PlayQueue::next() const
+{
+    return index >= 0 && index + 1 < paths.size() ? paths[index + 1] : QString();
+}
+
+int PlayQueue::size() const
+{
+    return paths.size();
+}
+
+bool PlayQueue::isEmpty() const
+{
+    return paths.isEmpty();
+}
+
+void PlayQueue::setTracks(const QStringList &tracks, int startIndex)
+{
+    const int oldIndex = index;
+    const QString oldCurrent = current();
+    const QString oldNext = next();
+
+    paths = tracks;
+    index = paths.isEmpty() ? -1 : qBound(0, startIndex, int(paths.size()) - 1);
+
+    // same track picked again still counts, the player restarts it
+    notify(paths.isEmpty() ? oldIndex : forceChange, oldCurrent, oldNext);
+}
+
+void PlayQueue::append(const QStringList &tracks)
+{
+    if (tracks.isEmpty())
+    {
+        return;
+    }
+
+    const int oldIndex = index;
+    const QString oldCurrent = current();
+    const QString oldNext = next();
+
+    paths.append(tracks);
+    if (index < 0) // appending to an empty queue starts it
+    {
+        index = 0;
+    }
+    notify(oldIndex, oldCurrent, oldNext);
+}
+
+void PlayQueue::playNext(const QStringList &tracks)
+{
+    if (tracks.isEmpty())
+    {
+        return;
+    }
+
+    const int oldIndex = index;
+    const QString oldCurrent = current();
+    const QString oldNext = next();
+
+    for (int i = 0; i < tracks.size(); i++)
+    {
+        paths.insert(index + 1 + i, tracks[i]);
+    }
+    if (index < 0)
+    {
+        index = 0;
+    }
+    notify(oldIndex, oldCurrent, oldNext);
+}
+
+void PlayQueue::remove(int position)
+{
+    if (position < 0 || position >= paths.size())
+    {
+        return;
+    }
+
+    const int oldIndex = index;
+    const QString oldCurrent = current();
+    const QString oldNext = next();
+
+    paths.removeAt(position);
+    if (position < index || index >= paths.size()) // removing the current track moves on to the one after it
+    {
+        index--;
+    }
+    if (index < 0 && !paths.isEmpty())
+    {
+        index = 0;
+    }
+    notify(position == oldIndex ? forceChange : oldIndex, oldCurrent, oldNext);
+}
+
+void PlayQueue::clear()
+{
+    setTracks(QStringList());
+}
+
+bool PlayQueue::advance()
+{
+    if (index < 0 || index + 1 >= paths.size())
+    {
+        return false;
+    }
+
+    jumpTo(index + 1);
+    return true;
+}
+
+bool PlayQueue::previous()
+{
+    if (index <= 0)
+    {
+        return false;
+    }
+
+    jumpTo(index - 1);
+    return true;
+}
+
+void PlayQueue::jumpTo(int position)
+{
+    if (position < 0 || position >= paths.size())
+    {
+        return;
+    }
+
+    const int oldIndex = index;
+    const QString oldCurrent = current();
+    const QString oldNext = next();
+
+    index = position;
+    notify(position != oldIndex ? forceChange : oldIndex, oldCurrent, oldNext); // the same file queued twice still restarts
+}
+
+// signals only for what actually moved, so the player doesnt reload or re-warm tracks it already has
+void PlayQueue::notify(int oldIndex, const QString &oldCurrent, const QString &oldNext)
+{
+    emit queueChanged();
+
+    if (oldIndex == forceChange || current() != oldCurrent) // an index shifted by edits around it isnt a new track
+    {
+        emit currentChanged(current());
+    }
+    if (next() != oldNext)
+    {
+        emit nextChanged(next());
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef PLAYQUEUE_H
+#define PLAYQUEUE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+// what plays now and what comes after it, just paths. menus push into it through the slots,
+// the player follows currentChanged and keeps whatever nextChanged says warmed up for a gapless switch
+class PlayQueue : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit PlayQueue(QObject *parent = nullptr);
+
+        QStringList tracks() const;
+        int currentIndex() const; // -1 when empty
+        QString current() const;
+        QString next() const;     // empty on the last track
+        int size() const;
+        bool isEmpty() const;
+
+    public slots:
+        void setTracks(const QStringList &paths, int startIndex = 0); // replaces the queue, e.g. a whole album
+        void append(const QStringList &paths);                        // after everything already queued
+        void playNext(const QStringList &paths);                      // straight after the current track
+        void remove(int index);
+        void clear();
+
+        bool advance();  // false on the last track, current stays where it is
+        bool previous();
+        void jumpTo(int index);
+
+    signals:
+        void currentChanged(const QString &path); // empty once the queue is cleared
+        void nextChanged(const QString &path);
+        void queueChanged();
+
+    private:
+        void notify(int oldIndex, const QString &oldCurrent, const QString &oldNext);
+
+        QStringList paths;
+        int index;
+    };
+#endif // PLAYQUEUE_H
@@ -1,13 +1,18 @@
 #include "playback.h"
 #include <QPixmap>
+#include "thumbnailCache.h"
 #include <QTime>
+#include <QThreadPool>
+#include <QPointer>
+#include <QCoreApplication>
+#include <QDebug>
 
 #include <taglib/fileref.h>
 #include <taglib/tag.h>
 #include <qfileinfo.h>
 
 
-Playback::Playback(QWidget *parent) : QWidget(parent) 
+Playback::Playback(QWidget *parent) : QWidget(parent), gainMode(Loudness::GainMode::Track)
 {
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
 
@@ -36,10 +41,19 @@ Playback::Playback(QWidget *parent) : QWidget(parent)
     // --- playback controls --- //
     QHBoxLayout *controlsLayout = new QHBoxLayout();
 
+    previousButton = new QPushButton("prev", this);
+    controlsLayout->addWidget(previousButton);
+
     playPauseButton = new QPushButton("Play", this);
     controlsLayout->addWidget(playPauseButton);
 
-    positionSlider = new QSlider(Qt::Horizontal, this);
+    nextButton = new QPushButton("next", this);
+    controlsLayout->addWidget(nextButton);
+
+    gainButton = new QPushButton("gain: track", this);
+    controlsLayout->addWidget(gainButton);
+
+    positionSlider = new WaveformSlider(this); // draws the song's peaks once they are loaded
     controlsLayout->addWidget(positionSlider);
 
     currentTimeLabel = new QLabel("0:00", this);
@@ -57,33 +71,101 @@ Playback::Playback(QWidget *parent) : QWidget(parent)
 
 
   
-    mediaPlayer = new QMediaPlayer(this);
-    audioOutput = new QAudioOutput(this);
-    mediaPlayer->setAudioOutput(audioOutput); // initalise audio output
+    // the player follows the queue, the next track is decoded straight on behind the current one for gapless switches
+    queue = new PlayQueue(this);
+    // LAVENDER_AUDIO=qt goes back to QMediaPlayer decks, e.g. for a format only the system backend plays
+    GaplessPlayer::Backend backend = qgetenv("LAVENDER_AUDIO") == "qt" ? GaplessPlayer::Backend::MediaPlayer : GaplessPlayer::Backend::Native;
+    player = new GaplessPlayer(queue, backend, this);
+    // from the loudness job's tables, songs it hasnt got to play as they are
+    player->setGainLookup([this](const QString &path)
+    {
+        return Loudness::gainFor(path, gainMode);
+    });
+
+    // the player reports position far more often than anything is drawn, the bus cuts it down to one snapshot a frame
+    bus = new PlaybackBus(this);
 
     // --- coneections --- //
     connect(backButton, &QPushButton::clicked, this, &Playback::backToMainMenu);
     connect(playPauseButton, &QPushButton::clicked, this, &Playback::playPause);
-
-    connect(mediaPlayer, &QMediaPlayer::positionChanged, this, [this](qint64 position)
+    connect(previousButton, &QPushButton::clicked, queue, &PlayQueue::previous);
+    connect(nextButton, &QPushButton::clicked, queue, &PlayQueue::advance);
+    connect(gainButton, &QPushButton::clicked, this, &Playback::cycleGainMode);
+
+    connect(player, &GaplessPlayer::positionChanged, bus, &PlaybackBus::setPosition);
+    connect(player, &GaplessPlayer::durationChanged, bus, &PlaybackBus::setDuration);
+    connect(player, &GaplessPlayer::playbackStateChanged, bus, &PlaybackBus::setPlaybackState);
+    connect(player, &GaplessPlayer::trackChanged, this, &Playback::showTrack);
+    connect(player, &GaplessPlayer::queueFinished, this, [this]()
     {
-        emit playbackProgress(position / 1000); //seconds
+        bus->setTrack(QString(), QString());
+        bus->setDuration(0);
+        bus->setPosition(0);
     });
 
-    connect(mediaPlayer, &QMediaPlayer::durationChanged, this, &Playback::updateDuration);
     connect(positionSlider, &QSlider::sliderMoved, this, &Playback::setPosition);
 
+    // this page's own controls are just another subscriber, at full frame rate for the seek bar
+    bus->subscribe(this, [this](const PlaybackBus::State &state, PlaybackBus::Changes changes)
+    {
+        showState(state, changes);
+    });
+
     setLayout(mainLayout);
 }
 
 void Playback::loadSong(const QString &songPath) 
 {
-    mediaPlayer->setSource(QUrl::fromLocalFile(songPath));
+    player->stop();
+    queue->setTracks(QStringList{songPath});
+}
 
-    playPauseButton->setText("play");
-    mediaPlayer->stop();
+PlayQueue *Playback::playQueue() const
+{
+    return queue;
+}
 
-    QString songTitle = QFileInfo(songPath).baseName();
+PlaybackBus *Playback::stateBus() const
+{
+    return bus;
+}
+
+void Playback::playTracks(const QStringList &paths, int startIndex)
+{
+    queue->setTracks(paths, startIndex);
+    player->play();
+}
+
+void Playback::enqueue(const QStringList &paths)
+{
+    const bool wasEmpty = queue->isEmpty();
+    queue->append(paths);
+    if (wasEmpty) // nothing was playing, the queue starts with these
+    {
+        player->play();
+    }
+}
+
+void Playback::enqueueNext(const QStringList &paths)
+{
+    const bool wasEmpty = queue->isEmpty();
+    queue->playNext(paths);
+    if (wasEmpty)
+    {
+        player->play();
+    }
+}
+
+// whenever the queue moves on, by itself or from the buttons
+void Playback::showTrack(const QString &songPath)
+{
+    bus->setTrack(songPath, songPath.isEmpty() ? QString() : QFileInfo(songPath).baseName());
+    if (songPath.isEmpty())
+    {
+        return;
+    }
+
+    loadWaveform(songPath);
 
     // --- using taglib to extract & populating song info --- //
     TagLib::FileRef file(songPath.toUtf8().constData());
@@ -103,85 +185,138 @@ void Playback::loadSong(const QString &songPath)
 
 
     // get album art 
-    QString albumDir = QFileInfo(songPath).absolutePath();
-    QStringList possibleCoverNames = {"cover.jpg", "folder.jpg", "album.jpg", "artwork.jpg"};
-    QString coverArtPath;
+    QImage albumArt = ThumbnailCache::instance().thumbnail(QFileInfo(songPath).absolutePath(), ThumbnailCache::Player);
 
-    for (const QString &coverName : possibleCoverNames) // iterate through possible names
+    if (!albumArt.isNull())
     {
-        QString potentialPath = albumDir + "/" + coverName;
-        if (QFileInfo::exists(potentialPath)) 
-        {
-            coverArtPath = potentialPath;
-            break;
-        }
-    }
-
-    if (!coverArtPath.isEmpty())
-    {
-        QPixmap pixmap(coverArtPath);
-        albumArtLabel->setPixmap(pixmap.scaled(albumArtLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        albumArtLabel->setPixmap(QPixmap::fromImage(albumArt)); // already sized for the 400px label
     } 
     else 
     {
         // use placeholder 
-        albumArtLabel->setPixmap(QPixmap(":/placeholder.jpg").scaled(albumArtLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        albumArtLabel->setPixmap(QPixmap(":/resources/placeholder.jpeg").scaled(albumArtLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+}
+
+// peaks from the library job if it has got to this song, otherwise decoded off the gui thread once and cached
+void Playback::loadWaveform(const QString &songPath)
+{
+    Waveform waveform;
+    qint64 songId = 0;
+    if (Waveform::readCache(songPath, &waveform, &songId))
+    {
+        positionSlider->setWaveform(waveform);
+        return;
+    }
+
+    positionSlider->clearWaveform(); // plain slider until it is ready
+    if (waveformPending.contains(songPath))
+    {
+        return;
     }
+    waveformPending.insert(songPath);
 
-    connect(mediaPlayer, &QMediaPlayer::durationChanged, this, [this, songTitle](qint64 duration)
+    QPointer<Playback> self(this);
+    QThreadPool::globalInstance()->start([self, songPath, songId]()
     {
-        emit playbackStarted(songTitle, duration / 1000); // format to seconds
+        Waveform waveform;
+        QString error;
+        if (!Waveform::fromFile(songPath, &waveform, &error))
+        {
+            qWarning() << error;
+        }
+        else if (songId > 0) // files outside the library have nowhere to go
+        {
+            Waveform::writeCache(songId, songPath, waveform);
+        }
+
+        QMetaObject::invokeMethod(qApp, [self, songPath, waveform]()
+        {
+            if (!self)
+            {
+                return;
+            }
+
+            self->waveformPending.remove(songPath);
+            if (!waveform.isNull() && self->player->currentPath() == songPath) // still the song on screen
+            {
+                self->positionSlider->setWaveform(waveform);
+            }
+        }, Qt::QueuedConnection);
     });
 }
 
-void Playback::playPause() 
+void Playback::cycleGainMode()
 {
-    if (mediaPlayer->playbackState() == QMediaPlayer::PlayingState) 
-    {
-        mediaPlayer->pause();
-        playPauseButton->setText("play");
-    } 
-    else 
+    switch (gainMode)
     {
-        mediaPlayer->play();
-        playPauseButton->setText("pause");
+        case Loudness::GainMode::Track:
+            gainMode = Loudness::GainMode::Album;
+            gainButton->setText("gain: album");
+            break;
+        case Loudness::GainMode::Album:
+            gainMode = Loudness::GainMode::Off;
+            gainButton->setText("gain: off");
+            break;
+        case Loudness::GainMode::Off:
+            gainMode = Loudness::GainMode::Track;
+            gainButton->setText("gain: track");
+            break;
     }
+    player->refreshGain();
 }
 
-void Playback::updatePosition(qint64 position) 
+void Playback::playPause() 
 {
-    positionSlider->setValue(position);
-    currentTimeLabel->setText(QTime(0, 0).addMSecs(position).toString("m:ss"));
+    togglePlayPause(); // button text follows the player state
 }
 
-void Playback::setPosition(int position) 
+// only what changed since the last frame gets touched
+void Playback::showState(const PlaybackBus::State &state, PlaybackBus::Changes changes)
 {
-    mediaPlayer->setPosition(position);
+    if (changes & PlaybackBus::Duration)
+    {
+        positionSlider->setMaximum(state.duration);
+        totalTimeLabel->setText(QTime(0, 0).addMSecs(state.duration).toString("m:ss"));
+    }
+
+    if (changes & PlaybackBus::Position)
+    {
+        if (!positionSlider->isSliderDown()) // dont pull it out from under a drag
+        {
+            positionSlider->setValue(state.position);
+        }
+        currentTimeLabel->setText(QTime(0, 0).addMSecs(state.position).toString("m:ss"));
+    }
+
+    if (changes & PlaybackBus::PlayState)
+    {
+        playPauseButton->setText(state.playbackState == QMediaPlayer::PlayingState ? "pause" : "play");
+    }
 }
 
-void Playback::updateDuration(qint64 duration) 
+void Playback::setPosition(int position) 
 {
-    positionSlider->setMaximum(duration);
-    totalTimeLabel->setText(QTime(0, 0).addMSecs(duration).toString("m:ss"));
+    player->setPosition(position);
 }
 
 void Playback::togglePlayPause() 
 {
-    if (mediaPlayer->playbackState() == QMediaPlayer::PlayingState) 
+    if (player->playbackState() == QMediaPlayer::PlayingState) 
     {
-        mediaPlayer->pause();
+        player->pause();
     } 
     else 
     {
-        mediaPlayer->play();
+        player->play();
     }
 }
 
 void Playback::stopPlayback() 
 {
-    mediaPlayer->stop();
+    player->stop();
 }
 
 void Playback::seekPosition(int position) {
-    mediaPlayer->setPosition(position * 1000); // miliseconds
+    player->setPosition(position * 1000); // miliseconds
 }
\ No newline at end of file
@@ -3,19 +3,25 @@
 
 #include <QWidget>
 #include <QMediaPlayer>
-#include <QAudioOutput>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QPushButton>
-#include <QSlider>
+#include <QSet>
+#include "playQueue.h"
+#include "gaplessPlayer.h"
+#include "waveformSlider.h"
+#include "loudness.h"
+#include "playbackBus.h"
 
 class Playback : public QWidget {
     Q_OBJECT
 
 public:
     explicit Playback(QWidget *parent = nullptr);
-    void loadSong(const QString &songPath);
+    void loadSong(const QString &songPath); // single song queue, stopped until play is pressed
+    PlayQueue *playQueue() const;
+    PlaybackBus *stateBus() const; // position / duration / track / state for anything outside this page
 
     QSize sizeHint() const override // dont work :(
     {
@@ -26,27 +32,31 @@ public:
 signals:
     void backToMainMenu(); 
 
-    //signaling to mainmenu
-    void playbackStarted(const QString &songTitle, int duration); 
-    void playbackProgress(int position); 
-    void playbackStopped(); 
-
 public slots:
     void togglePlayPause();
     void stopPlayback();
     void seekPosition(int position);
 
+    // queue entry points for the menus
+    void playTracks(const QStringList &paths, int startIndex = 0);
+    void enqueue(const QStringList &paths);
+    void enqueueNext(const QStringList &paths);
+
 
 private slots:
     void playPause();
     void setPosition(int position);
 
-    void updatePosition(qint64 position);
-    void updateDuration(qint64 duration);
+    void showTrack(const QString &songPath);
+    void cycleGainMode(); // track -> album -> off
 
 private:
-    QMediaPlayer *mediaPlayer;
-    QAudioOutput *audioOutput;
+    void loadWaveform(const QString &songPath);
+    void showState(const PlaybackBus::State &state, PlaybackBus::Changes changes);
+
+    PlayQueue *queue;
+    GaplessPlayer *player;
+    PlaybackBus *bus;
 
     QLabel *albumArtLabel;
     QLabel *songTitleLabel;
@@ -55,9 +65,14 @@ private:
     QLabel *totalTimeLabel;
 
     QPushButton *playPauseButton;
+    QPushButton *previousButton;
+    QPushButton *nextButton;
     QPushButton *backButton;
+    QPushButton *gainButton;
+    Loudness::GainMode gainMode;
 
-    QSlider *positionSlider;
+    WaveformSlider *positionSlider;
+    QSet<QString> waveformPending; // being decoded off the gui thread
   
 };
 
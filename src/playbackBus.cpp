@@ -0,0 +1,159 @@
+#include "playbackBus.h"
+#include <QDebug>
+
+PlaybackBus::PlaybackBus(QObject *parent, int maxFps) : QObject(parent), frameMs(1000 / qMax(1, maxFps)), published(0)
+{
+    frameTimer.setSingleShot(true);
+    frameTimer.setTimerType(Qt::PreciseTimer); // coarse timers can be 5% late, a frame is short enough for that to show
+    connect(&frameTimer, &QTimer::timeout, this, &PlaybackBus::publish);
+}
+
+// --- publisher side --- //
+
+void PlaybackBus::setPosition(qint64 position)
+{
+    if (current.position != position)
+    {
+        current.position = position;
+        schedule(Position);
+    }
+}
+
+void PlaybackBus::setDuration(qint64 duration)
+{
+    if (current.duration != duration)
+    {
+        current.duration = duration;
+        schedule(Duration);
+    }
+}
+
+void PlaybackBus::setTrack(const QString &path, const QString &title)
+{
+    if (current.path != path || current.title != title)
+    {
+        current.path = path;
+        current.title = title;
+        schedule(Track);
+    }
+}
+
+void PlaybackBus::setPlaybackState(QMediaPlayer::PlaybackState playbackState)
+{
+    if (current.playbackState != playbackState)
+    {
+        current.playbackState = playbackState;
+        schedule(PlayState);
+    }
+}
+
+// a frame after the last snapshot, or straight away (next event loop pass) if it has been longer than that
+void PlaybackBus::schedule(Changes changes)
+{
+    pending |= changes;
+    if (frameTimer.isActive())
+    {
+        return;
+    }
+
+    const qint64 since = sincePublish.isValid() ? sincePublish.elapsed() : frameMs;
+    frameTimer.start(int(qMax<qint64>(0, frameMs - since)));
+}
+
+qint64 PlaybackBus::stepOf(const Subscriber &subscriber, qint64 position) const
+{
+    return subscriber.positionStepMs > 0 ? position / subscriber.positionStepMs : position;
+}
+
+void PlaybackBus::publish()
+{
+    const Changes changes = pending;
+    pending = Changes();
+    if (!changes)
+    {
+        return;
+    }
+
+    sincePublish.start();
+    published++;
+
+    // a callback can subscribe or unsubscribe, go over who was there when the frame started
+    const QList<QObject *> listeners = subscribers.keys();
+    for (QObject *listener : listeners)
+    {
+        auto it = subscribers.find(listener);
+        if (it == subscribers.end())
+        {
+            continue;
+        }
+
+        Changes theirs = changes & ~Changes(Position);
+        const qint64 step = stepOf(*it, current.position);
+        if (step != it->lastStep)
+        {
+            theirs |= Position;
+            it->lastStep = step;
+        }
+
+        if (theirs)
+        {
+            const Callback callback = it->callback; // the entry can go while it runs
+            callback(current, theirs);
+        }
+    }
+}
+
+// --- subscriber side --- //
+
+void PlaybackBus::subscribe(QObject *listener, Callback callback, int positionStepMs)
+{
+    if (!listener || !callback)
+    {
+        qWarning() << "playback bus: subscribe needs a listener and a callback";
+        return;
+    }
+
+    if (!subscribers.contains(listener)) // only the first time, a second connection would just be a duplicate
+    {
+        connect(listener, &QObject::destroyed, this, [this, listener]()
+        {
+            subscribers.remove(listener);
+        });
+    }
+
+    Subscriber &subscriber = subscribers[listener];
+    subscriber.callback = std::move(callback);
+    subscriber.positionStepMs = qMax(0, positionStepMs);
+    subscriber.lastStep = stepOf(subscriber, current.position);
+
+    const Callback initial = subscriber.callback;
+    initial(current, Everything);
+}
+
+void PlaybackBus::unsubscribe(QObject *listener)
+{
+    if (subscribers.remove(listener) > 0)
+    {
+        disconnect(listener, &QObject::destroyed, this, nullptr);
+    }
+}
+
+bool PlaybackBus::isSubscribed(QObject *listener) const
+{
+    return subscribers.contains(listener);
+}
+
+int PlaybackBus::subscriberCount() const
+{
+    return subscribers.size();
+}
+
+PlaybackBus::State PlaybackBus::state() const
+{
+    return current;
+}
+
+qint64 PlaybackBus::publishCount() const
+{
+    return published;
+}
@@ -0,0 +1,87 @@
+#ifndef PLAYBACKBUS_H
+#define PLAYBACKBUS_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMediaPlayer>
+#include <functional>
+
+// one place the player's state goes through on its way to the widgets. the player can report position as often as
+// it likes, the bus keeps only the latest and hands subscribers one snapshot at most every frame, and nothing at all
+// while paused or stopped. gui thread only
+class PlaybackBus : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum Change
+        {
+            Position = 0x1,
+            Duration = 0x2,
+            Track = 0x4,
+            PlayState = 0x8,
+            Everything = Position | Duration | Track | PlayState
+        };
+        Q_DECLARE_FLAGS(Changes, Change)
+
+        struct State
+        {
+            QString path;  // empty when nothing is loaded
+            QString title;
+            qint64 position = 0; // ms
+            qint64 duration = 0; // ms, 0 until the backend knows
+            QMediaPlayer::PlaybackState playbackState = QMediaPlayer::StoppedState;
+        };
+
+        using Callback = std::function<void(const State &state, Changes changes)>;
+
+        static const int defaultFps = 30;
+
+        explicit PlaybackBus(QObject *parent = nullptr, int maxFps = defaultFps);
+
+        // --- publisher side, cheap, nothing goes out until the next frame --- //
+        void setPosition(qint64 position);
+        void setDuration(qint64 duration);
+        void setTrack(const QString &path, const QString &title);
+        void setPlaybackState(QMediaPlayer::PlaybackState playbackState);
+
+        // --- subscriber side --- //
+        // one subscription per listener, subscribing again replaces its callback, and it goes away with the listener.
+        // positionStepMs > 0 only passes on position changes that cross a step, e.g. 1000 for a seconds slider.
+        // the callback gets the current state straight away
+        void subscribe(QObject *listener, Callback callback, int positionStepMs = 0);
+        void unsubscribe(QObject *listener);
+        bool isSubscribed(QObject *listener) const;
+        int subscriberCount() const;
+
+        State state() const;
+        qint64 publishCount() const; // snapshots sent out, for tests and profiling
+
+    private:
+        struct Subscriber
+        {
+            Callback callback;
+            int positionStepMs = 0;
+            qint64 lastStep = -1; // position / step it was last told about
+        };
+
+        void schedule(Changes changes);
+        void publish();
+        qint64 stepOf(const Subscriber &subscriber, qint64 position) const;
+
+        State current;
+        Changes pending;
+        QHash<QObject *, Subscriber> subscribers;
+
+        int frameMs;
+        QTimer frameTimer;         // single shot, only running while something is pending
+        QElapsedTimer sincePublish;
+        qint64 published;
+    };
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(PlaybackBus::Changes)
+
+#endif // PLAYBACKBUS_H
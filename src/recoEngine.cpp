@@ -0,0 +1,448 @@
+#include "recoEngine.h"
+#include <QDebug>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <cmath>
+#include <queue>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // sklearn's ENGLISH_STOP_WORDS, so the scores line up with what the python script gave
+    const QSet<QString> &stopWords()
+    {
+        static const QSet<QString> words = {
+            "a", "about", "above", "across", "after", "afterwards", "again", "against", "all", "almost",
+            "alone", "along", "already", "also", "although", "always", "am", "among", "amongst", "amoungst",
+            "amount", "an", "and", "another", "any", "anyhow", "anyone", "anything", "anyway", "anywhere",
+            "are", "around", "as", "at", "back", "be", "became", "because", "become", "becomes",
+            "becoming", "been", "before", "beforehand", "behind", "being", "below", "beside", "besides", "between",
+            "beyond", "bill", "both", "bottom", "but", "by", "call", "can", "cannot", "cant",
+            "co", "con", "could", "couldnt", "cry", "de", "describe", "detail", "do", "done",
+            "down", "due", "during", "each", "eg", "eight", "either", "eleven", "else", "elsewhere",
+            "empty", "enough", "etc", "even", "ever", "every", "everyone", "everything", "everywhere", "except",
+            "few", "fifteen", "fifty", "fill", "find", "fire", "first", "five", "for", "former",
+            "formerly", "forty", "found", "four", "from", "front", "full", "further", "get", "give",
+            "go", "had", "has", "hasnt", "have", "he", "hence", "her", "here", "hereafter",
+            "hereby", "herein", "hereupon", "hers", "herself", "him", "himself", "his", "how", "however",
+            "hundred", "i", "ie", "if", "in", "inc", "indeed", "interest", "into", "is",
+            "it", "its", "itself", "keep", "last", "latter", "latterly", "least", "less", "ltd",
+            "made", "many", "may", "me", "meanwhile", "might", "mill", "mine", "more", "moreover",
+            "most", "mostly", "move", "much", "must", "my", "myself", "name", "namely", "neither",
+            "never", "nevertheless", "next", "nine", "no", "nobody", "none", "noone", "nor", "not",
+            "nothing", "now", "nowhere", "of", "off", "often", "on", "once", "one", "only",
+            "onto", "or", "other", "others", "otherwise", "our", "ours", "ourselves", "out", "over",
+            "own", "part", "per", "perhaps", "please", "put", "rather", "re", "same", "see",
+            "seem", "seemed", "seeming", "seems", "serious", "several", "she", "should", "show", "side",
+            "since", "sincere", "six", "sixty", "so", "some", "somehow", "someone", "something", "sometime",
+            "sometimes", "somewhere", "still", "such", "system", "take", "ten", "than", "that", "the",
+            "their", "them", "themselves", "then", "thence", "there", "thereafter", "thereby", "therefore", "therein",
+            "thereupon", "these", "they", "thick", "thin", "third", "this", "those", "though", "three",
+            "through", "throughout", "thru", "thus", "to", "together", "too", "top", "toward", "towards",
+            "twelve", "twenty", "two", "un", "under", "until", "up", "upon", "us", "very",
+            "via", "was", "we", "well", "were", "what", "whatever", "when", "whence", "whenever",
+            "where", "whereafter", "whereas", "whereby", "wherein", "whereupon", "wherever", "whether", "which", "while",
+            "whither", "who", "whoever", "whole", "whom", "whose", "why", "will", "with", "within",
+            "without", "would", "yet", "you", "your", "yours", "yourself", "yourselves"
+        };
+        return words;
+    }
+
+    bool isWordChar(QChar c)
+    {
+        return c.isLetterOrNumber() || c.isMark() || c == '_'; // what \w matches in the old regex
+    }
+
+    struct Candidate
+    {
+        float score;
+        int doc;
+    };
+
+    // "better" means higher score, then lower doc index (same order python's stable sort gave)
+    bool better(const Candidate &a, const Candidate &b)
+    {
+        return a.score > b.score || (a.score == b.score && a.doc < b.doc);
+    }
+
+    struct WorseOnTop
+    {
+        bool operator()(const Candidate &a, const Candidate &b) const
+        {
+            return better(a, b); // priority_queue keeps the "largest" on top, so the worst kept candidate sits there
+        }
+    };
+}
+
+QStringList RecoEngine::tokenize(const QString &text)
+{
+    QStringList tokens;
+    QString lower = text.toLower();
+
+    int start = -1;
+    for (int i = 0; i <= lower.size(); i++)
+    {
+        bool word = i < lower.size() && isWordChar(lower[i]);
+        if (word && start < 0)
+        {
+            start = i;
+        }
+        else if (!word && start >= 0)
+        {
+            if (i - start >= 2)
+            {
+                QString token = lower.mid(start, i - start);
+                if (!stopWords().contains(token))
+                {
+                    tokens.append(token);
+                }
+            }
+            start = -1;
+        }
+    }
+
+    return tokens;
+}
+
+void RecoEngine::clear()
+{
+    songs.clear();
+    docsById.clear();
+    termIds.clear();
+    idfs.clear();
+    postings.clear();
+    documents.clear();
+    artistDocs.clear();
+    artistDocsByGenre.clear();
+    loadedGeneration = -1;
+}
+
+bool RecoEngine::isEmpty() const
+{
+    return songs.isEmpty();
+}
+
+int RecoEngine::songCount() const
+{
+    return songs.size();
+}
+
+float RecoEngine::idf(const QString &term) const
+{
+    int id = termIds.value(term, -1);
+    return id < 0 ? 0.0f : idfs[id];
+}
+
+void RecoEngine::build(const QList<SongRecord> &library)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    clear();
+    songs = library;
+
+    int n = songs.size();
+    docsById.reserve(n);
+    documents.resize(n);
+
+    // --- raw term counts per doc, and doc frequency per term --- //
+    QVector<int> docFreq;
+
+    for (int doc = 0; doc < n; doc++)
+    {
+        const SongRecord &song = songs[doc];
+        docsById.insert(song.id, doc);
+
+        QHash<int, int> counts;
+        for (const QString &token : tokenize(featureText(song.name, song.artist, song.genre, song.album)))
+        {
+            auto it = termIds.constFind(token);
+            int term;
+            if (it == termIds.constEnd())
+            {
+                term = termIds.size();
+                termIds.insert(token, term);
+                docFreq.append(0);
+            }
+            else
+            {
+                term = it.value();
+            }
+
+            if (counts[term]++ == 0)
+            {
+                docFreq[term]++;
+            }
+        }
+
+        QVector<TermWeight> &vector = documents[doc];
+        vector.reserve(counts.size());
+        for (auto it = counts.constBegin(); it != counts.constEnd(); ++it)
+        {
+            vector.append({it.key(), float(it.value())});
+        }
+    }
+
+    finish(docFreq);
+    loadedGeneration = -1; // not tied to whatever is persisted
+
+    qDebug() << "reco index built:" << n << "songs," << idfs.size() << "terms in" << timer.elapsed() << "ms";
+}
+
+// loads the vectors libscan keeps in lavender.db, no tokenising and no vocabulary to build.
+// idf and norms still get worked out here since they shift with every song added
+bool RecoEngine::load()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 generation = storedGeneration(); // read first, a scan landing mid load just means a reload next time
+    if (generation < 0)
+    {
+        return false;
+    }
+
+    clear();
+    songs = DbManager::instance().songs();
+
+    int n = songs.size();
+    docsById.reserve(n);
+    documents.resize(n);
+    for (int doc = 0; doc < n; doc++)
+    {
+        docsById.insert(songs[doc].id, doc);
+    }
+
+    // --- vocabulary, db term ids get packed down to 0..terms-1 --- //
+    QVector<int> docFreq;
+    QHash<qint64, int> localTerms;
+
+    bool ok = DbManager::instance().select("SELECT id, term, df FROM reco_terms WHERE df > 0", {}, [&](const QSqlQuery &query)
+    {
+        int term = docFreq.size();
+        localTerms.insert(query.value(0).toLongLong(), term);
+        termIds.insert(query.value(1).toString(), term);
+        docFreq.append(query.value(2).toInt());
+    });
+
+    // --- raw term counts per song --- //
+    ok = ok && DbManager::instance().select("SELECT song_id, term_id, tf FROM reco_vectors", {}, [&](const QSqlQuery &query)
+    {
+        int doc = docsById.value(query.value(0).toLongLong(), -1);
+        int term = localTerms.value(query.value(1).toLongLong(), -1);
+        if (doc >= 0 && term >= 0) // rows written after the songs were read wait for the next load
+        {
+            documents[doc].append({term, query.value(2).toFloat()});
+        }
+    });
+
+    if (!ok)
+    {
+        clear();
+        return false;
+    }
+
+    finish(docFreq);
+    loadedGeneration = generation;
+
+    qDebug() << "reco index loaded:" << n << "songs," << idfs.size() << "terms in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool RecoEngine::refresh()
+{
+    qint64 generation = storedGeneration();
+    if (!isEmpty() && generation == loadedGeneration)
+    {
+        return false;
+    }
+
+    if (!load()) // db from before the persisted index, scanner fills it in on its next pass
+    {
+        build(DbManager::instance().songs());
+        loadedGeneration = generation;
+    }
+    return true;
+}
+
+qint64 RecoEngine::generation() const
+{
+    return loadedGeneration;
+}
+
+qint64 RecoEngine::storedGeneration()
+{
+    qint64 generation = -1;
+    DbManager::instance().select("SELECT value FROM reco_meta WHERE key = 'generation'", {}, [&](const QSqlQuery &query)
+    {
+        generation = query.value(0).toLongLong();
+    });
+    return generation;
+}
+
+QString RecoEngine::featureText(const QString &name, const QString &artist, const QString &genre, const QString &album)
+{
+    return name + " " + artist + " " + genre + " " + album;
+}
+
+// documents hold raw term counts going in, weighted and normalised coming out
+void RecoEngine::finish(const QVector<int> &docFreq)
+{
+    int n = songs.size();
+
+    // --- smooth idf, same as sklearn: ln((1 + n) / (1 + df)) + 1 --- //
+    idfs.resize(docFreq.size());
+    for (int term = 0; term < docFreq.size(); term++)
+    {
+        idfs[term] = float(std::log((1.0 + n) / (1.0 + docFreq[term])) + 1.0);
+    }
+
+    // --- weight, l2 normalise and fill the inverted index --- //
+    postings.resize(idfs.size());
+    for (int term = 0; term < docFreq.size(); term++)
+    {
+        postings[term].reserve(docFreq[term]);
+    }
+
+    for (int doc = 0; doc < n; doc++)
+    {
+        QVector<TermWeight> &vector = documents[doc];
+
+        double norm = 0;
+        for (TermWeight &entry : vector)
+        {
+            entry.weight *= idfs[entry.term];
+            norm += double(entry.weight) * entry.weight;
+        }
+
+        norm = std::sqrt(norm);
+        for (TermWeight &entry : vector)
+        {
+            if (norm > 0)
+            {
+                entry.weight = float(entry.weight / norm);
+            }
+            postings[entry.term].append({doc, entry.weight}); // docs go in ascending, so lists stay sorted
+        }
+    }
+
+    indexArtists();
+}
+
+// first song of each artist in library order, and the same list split by that song's genre
+void RecoEngine::indexArtists()
+{
+    QSet<QString> seenArtists;
+    for (int doc = 0; doc < songs.size(); doc++)
+    {
+        if (!seenArtists.contains(songs[doc].artist))
+        {
+            seenArtists.insert(songs[doc].artist);
+            artistDocs.append(doc);
+            artistDocsByGenre[songs[doc].genre].append(doc);
+        }
+    }
+}
+
+bool RecoEngine::recommend(qint64 songId, Results *results, int artistCount, int songCount) const
+{
+    results->artists.clear();
+    results->songs.clear();
+
+    int query = docsById.value(songId, -1);
+    if (query < 0)
+    {
+        qDebug() << "song not in reco index:" << songId;
+        return false;
+    }
+
+    const SongRecord &current = songs[query];
+
+    // --- artists: same genre first, everyone else if that's empty --- //
+    auto addArtists = [&](const QVector<int> &docs)
+    {
+        for (int doc : docs)
+        {
+            if (results->artists.size() >= artistCount)
+            {
+                break;
+            }
+            if (songs[doc].artist != current.artist)
+            {
+                results->artists.append({songs[doc].artist, songs[doc].genre});
+            }
+        }
+    };
+
+    addArtists(artistDocsByGenre.value(current.genre));
+    if (results->artists.isEmpty())
+    {
+        addArtists(artistDocs);
+    }
+
+    // --- songs: cosine is just the dot product of normalised vectors, only walk docs sharing a term --- //
+    QHash<int, float> scores;
+    for (const TermWeight &entry : documents[query])
+    {
+        for (const Posting &posting : postings[entry.term])
+        {
+            if (posting.doc != query)
+            {
+                scores[posting.doc] += entry.weight * posting.weight;
+            }
+        }
+    }
+
+    int k = qMin(songCount, int(songs.size()) - 1);
+    std::priority_queue<Candidate, std::vector<Candidate>, WorseOnTop> heap;
+
+    for (auto it = scores.constBegin(); it != scores.constEnd(); ++it)
+    {
+        Candidate candidate = {it.value(), it.key()};
+        if (int(heap.size()) < k)
+        {
+            heap.push(candidate);
+        }
+        else if (k > 0 && better(candidate, heap.top()))
+        {
+            heap.pop();
+            heap.push(candidate);
+        }
+    }
+
+    std::vector<Candidate> picked;
+    picked.reserve(k);
+    while (!heap.empty())
+    {
+        picked.push_back(heap.top());
+        heap.pop();
+    }
+    std::reverse(picked.begin(), picked.end()); // best first
+
+    // not enough overlapping songs, python would have filled up with zero scores in library order
+    for (int doc = 0; int(picked.size()) < k && doc < songs.size(); doc++)
+    {
+        if (doc != query && !scores.contains(doc))
+        {
+            picked.push_back({0.0f, doc});
+        }
+    }
+
+    for (const Candidate &candidate : picked)
+    {
+        const SongRecord &song = songs[candidate.doc];
+
+        SongRecommendation recommendation;
+        recommendation.id = song.id;
+        recommendation.title = song.name;
+        recommendation.artist = song.artist;
+        recommendation.genre = song.genre;
+        recommendation.album = song.album;
+        recommendation.score = candidate.score;
+        results->songs.append(recommendation);
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef RECOENGINE_H
+#define RECOENGINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QVector>
+#include "dbManager.h"
+
+// tf-idf + cosine recommender, same maths as the old recoEngine.py (sklearn TfidfVectorizer defaults)
+// but kept as a sparse inverted index so a query only touches songs sharing a term with it
+class RecoEngine
+{
+    public:
+        struct ArtistRecommendation
+        {
+            QString artist;
+            QString genre;
+        };
+
+        struct SongRecommendation
+        {
+            qint64 id = 0;
+            QString title;
+            QString artist;
+            QString genre;
+            QString album;
+            float score = 0;
+        };
+
+        struct Results
+        {
+            QList<ArtistRecommendation> artists;
+            QList<SongRecommendation> songs;
+        };
+
+        void build(const QList<SongRecord> &songs); // replaces whatever was indexed before
+        bool load();                                // from the reco_* tables libscan keeps up to date, false if they arent there
+        bool refresh();                             // reloads if the scanner has changed the index since, true if it did
+        qint64 generation() const;                  // of the persisted index this was loaded from, -1 if built by hand
+        void clear();
+        bool isEmpty() const;
+        int songCount() const;
+
+        bool recommend(qint64 songId, Results *results, int artistCount = 5, int songCount = 10) const; // false if the song isnt indexed
+
+        static QStringList tokenize(const QString &text); // lowercase, 2+ word chars, english stop words dropped
+        float idf(const QString &term) const;             // 0 for unknown terms
+
+        static QString featureText(const QString &name, const QString &artist, const QString &genre, const QString &album); // what gets tokenised per song
+        static qint64 storedGeneration();                 // bumped by libscan whenever it touches the index, -1 without one
+
+    private:
+        struct Posting
+        {
+            int doc;
+            float weight;
+        };
+
+        struct TermWeight
+        {
+            int term;
+            float weight;
+        };
+
+        void finish(const QVector<int> &docFreq);
+        void indexArtists();
+
+        QList<SongRecord> songs;                 // doc index -> song
+        QHash<qint64, int> docsById;
+        QHash<QString, int> termIds;
+        QVector<float> idfs;                     // by term id
+        QVector<QVector<Posting>> postings;      // by term id, docs in index order
+        QVector<QVector<TermWeight>> documents;  // by doc, l2 normalised
+        QVector<int> artistDocs;                 // first doc of each artist, library order
+        QHash<QString, QVector<int>> artistDocsByGenre;
+        qint64 loadedGeneration = -1;
+    };
+#endif // RECOENGINE_H
@@ -5,9 +5,7 @@
 #include <QJsonObject>
 #include <QStandardPaths>
 #include <QDir>
-#include <QSqlDatabase>
-#include <QSqlError>
-#include <QSqlQuery>
+#include "dbManager.h"
 #include <QDebug>
 #include <QCoreApplication>
 #include <QTabWidget>
@@ -15,14 +13,17 @@
 #include <QListWidget>
 #include <QPushButton>
 #include <QFont>
-#include <QNetworkAccessManager>
+#include "musicBrainzClient.h"
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QThread>
 #include <QDialog>
 #include <QMessageBox>
 #include <QRandomGenerator>
 #include <QRegularExpression>  
+#include <QElapsedTimer>
+#include <QMenu>
+#include <QPointer>
+#include <QThreadPool>
 
 #include <taglib/fileref.h>
 #include <taglib/tag.h>
@@ -82,6 +83,29 @@ RecommendationMenu::RecommendationMenu(QWidget *parent) : QWidget(parent)
     connect(backButton, &QPushButton::clicked, this, &RecommendationMenu::backToMainMenu);
     connect(albumRecommendationsList, &QListWidget::itemClicked, this, &RecommendationMenu::onRecommendationClicked);
     connect(artistRecommendationsList, &QListWidget::itemClicked, this, &RecommendationMenu::onRecommendationClicked);
+
+    // library picks can go straight into the play queue
+    albumRecommendationsList->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(albumRecommendationsList, &QListWidget::customContextMenuRequested, this, [this](const QPoint &pos)
+    {
+        QListWidgetItem *item = albumRecommendationsList->itemAt(pos);
+        int songId = item ? item->data(Qt::UserRole).toInt() : 0;
+        if (songId <= 0) // headers and musicbrainz results arent in the library
+        {
+            return;
+        }
+
+        QMenu menu(this);
+        QAction *addAction = menu.addAction("add to queue");
+        if (menu.exec(albumRecommendationsList->viewport()->mapToGlobal(pos)) == addAction)
+        {
+            QString filePath = DbManager::instance().songPath(songId);
+            if (!filePath.isEmpty())
+            {
+                emit addToQueue(QStringList{filePath});
+            }
+        }
+    });
     // -- connections -- //
     
     setLayout(mainLayout);
@@ -92,7 +116,6 @@ RecommendationMenu::RecommendationMenu(QWidget *parent) : QWidget(parent)
 
     currentGenre = "";
     currentAlbum = "";
-    pythonProcess = nullptr;
 }
 
 
@@ -100,208 +123,110 @@ void RecommendationMenu::fetchRecommendations(int songId)
 {
     qDebug() << "fetchRecommendations for: " << songId;
     
-    // init db connection if one doesn't exist
-    if (!QSqlDatabase::database("lavender_connection").isValid()) 
-    {
-        QString dbPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/lavender.db";
-        qDebug() << dbPath;
-        setupDatabase(dbPath);
-    }
-    
-    QSqlDatabase db = QSqlDatabase::database("lavender_connection");
-    if (!db.isOpen()) 
-    {
-        qDebug() << "db not opened";
-        return;
-    }
-    
     // get song in question 
-    QSqlQuery songQuery(db);
-    songQuery.prepare("SELECT name, artist, genre, album, album_id FROM songs WHERE id = :id");
-    songQuery.bindValue(":id", songId);
+    bool found = false;
+    SongRecord song = DbManager::instance().song(songId, &found);
     
-    if (!songQuery.exec() || !songQuery.next())
+    if (!found)
     {
-        qDebug() << "db query failed:" << songQuery.lastError().text();
+        qDebug() << "song not in db:" << songId;
         return;
     }
     
     //get song details from query
-    QString songName = songQuery.value(0).toString();
-    QString artistName = songQuery.value(1).toString();
-    currentGenre = songQuery.value(2).toString();
-    currentAlbum = songQuery.value(3).toString();
-    int albumId = songQuery.value(4).toInt();
+    QString songName = song.name;
+    QString artistName = song.artist;
+    currentGenre = song.genre;
+    currentAlbum = song.album;
     
     qDebug() << songName << artistName << currentGenre << currentAlbum;
     
     
-    if (!pythonProcess) 
-    {
-        pythonProcess = new QProcess(this);
-
-        connect(pythonProcess, &QProcess::readyReadStandardOutput, this, &RecommendationMenu::handlePythonOutput);
-        connect(pythonProcess, &QProcess::readyReadStandardError, this, [this]() 
-        {
-            QByteArray output = pythonProcess->readAllStandardError();
-            qDebug() << "stderr:" << output;
-        });
-    } 
-    else if (pythonProcess->state() == QProcess::Running) // if process exists get rid of it ...
-    {
-        pythonProcess->terminate();
-        pythonProcess->waitForFinished(1000);
-    }
-    
     // incase user has checked the reccomendations before
     albumRecommendationsList->clear();
     artistRecommendationsList->clear();
-    
-    // prompt user that we are processing
-    albumRecommendationsList->addItem("processing...");
-    artistRecommendationsList->addItem("processing...");
-    
-    // prepare data
-    QSqlQuery allSongsQuery(db);
-    if (!allSongsQuery.exec("SELECT id, name, artist, genre, album, album_id, path FROM songs")) 
-    {
-        qDebug() << allSongsQuery.lastError().text();
 
-        return;
-    }
-    
-    QStringList pythonData;
+    QListWidgetItem *item = new QListWidgetItem("loading recommendations...");
+    item->setForeground(Qt::gray);
+    albumRecommendationsList->addItem(item);
+    artistRecommendationsList->addItem(item->clone());
 
-    while (allSongsQuery.next()) //iterate through all songs 
+    pendingSongId = songId;
+    if (!indexLoading) // one already out answers for the latest song when it gets back
     {
-        int id = allSongsQuery.value(0).toInt();
-        int albumId = allSongsQuery.value(5).toInt();
+        refreshIndex();
+    }
+}
 
-        QString name = allSongsQuery.value(1).toString();
-        QString artist = allSongsQuery.value(2).toString();
+// checking the index against the db and reloading it (the whole library on a big one) both hit the db, so off the
+// gui thread. the reload goes into a fresh engine that gets swapped in, recoEngine is only ever touched here
+void RecommendationMenu::refreshIndex()
+{
+    indexLoading = true;
 
-        QString genre = allSongsQuery.value(3).toString();
-        QString album = allSongsQuery.value(4).toString();
+    const bool empty = recoEngine.isEmpty();
+    const qint64 loaded = recoEngine.generation();
+    QPointer<RecommendationMenu> self(this);
+    QThreadPool::globalInstance()->start([self, empty, loaded]()
+    {
+        QSharedPointer<RecoEngine> engine;
+        if (empty || RecoEngine::storedGeneration() != loaded) // only reloads when the scanner has touched the persisted index since last time
+        {
+            engine.reset(new RecoEngine);
+            engine->refresh();
+        }
 
-        QString filePath = allSongsQuery.value(6).toString();
-        
-        // genre fallback
-        if (genre.isEmpty() && !filePath.isEmpty() && QFile::exists(filePath)) 
+        QMetaObject::invokeMethod(qApp, [self, engine]()
         {
-            TagLib::FileRef fileRef(filePath.toUtf8().constData());
-            if (!fileRef.isNull() && fileRef.tag()) 
+            if (self)
             {
-                genre = QString::fromUtf8(fileRef.tag()->genre().toCString(true)).trimmed();
+                self->indexRefreshed(engine);
             }
-        }
-        
-        // formatting 
-        pythonData.append(QString("%1|%2|%3|%4|%5|%6|%7")
-                          .arg(id)
-                          .arg(name.replace("|", " "))
-                          .arg(artist.replace("|", " "))
-                          .arg(genre.replace("|", " "))
-                          .arg(album.replace("|", " "))
-                          .arg(albumId)
-                          .arg(filePath.replace("|", " ")));
-    }
-    
-    // py script
-    QString pythonScript = QCoreApplication::applicationDirPath() + "/scripts/recoEngine.py";
-    QStringList arguments;
-    arguments << pythonScript << QString::number(songId) << QString::number(albumId);
-    
-    qDebug() << pythonScript << arguments; //check arguments are correct
-    pythonProcess->start("python3", arguments);
-    
-    if (!pythonProcess->waitForStarted(3000)) // 30 seconds i beleive 
+        }, Qt::QueuedConnection);
+    });
+}
+
+void RecommendationMenu::indexRefreshed(QSharedPointer<RecoEngine> engine)
+{
+    indexLoading = false;
+    if (engine) // null when the one here is still current
     {
-        qDebug() << pythonProcess->errorString();
-        return;
+        recoEngine = std::move(*engine);
     }
-    
-    QByteArray inputData = pythonData.join("\n").toUtf8();
-
-    pythonProcess->write(inputData);
-    pythonProcess->closeWriteChannel(); 
+    recommendFor(pendingSongId);
 }
 
-void RecommendationMenu::handlePythonOutput() 
+void RecommendationMenu::recommendFor(int songId)
 {
-    QByteArray output = pythonProcess->readAllStandardOutput();
-    QString outputStr = QString::fromUtf8(output).trimmed();
-    
-    //incase user has previously used reccomendation menu 
-    albumRecommendationsList->clear();  
-    artistRecommendationsList->clear(); 
+    albumRecommendationsList->clear(); // the loading line
+    artistRecommendationsList->clear();
 
-    // process python output 
-    QStringList lines = outputStr.split("\n");
-    bool readingRecommendations = false;
+    QElapsedTimer timer;
+    timer.start();
 
-    QString jsonData;
-    
-    foreach (const QString &line, lines) {
-        if (line == "RECOMMENDATIONS_BEGIN") // macros allow us to see where the python process is at
-        {
-            readingRecommendations = true;
-            continue;
-        }
-        else if (line == "RECOMMENDATIONS_END") 
-        {
-            readingRecommendations = false;
-            continue;
-        }
-        
-        if (readingRecommendations) 
-        {
-            jsonData += line + "\n";
-        }
-    }
-    
-    if (jsonData.isEmpty()) // if python process does not return anything
+    RecoEngine::Results results;
+    if (!recoEngine.recommend(songId, &results))
     {
         QListWidgetItem *item = new QListWidgetItem("no valid reccomendations found");
         item->setForeground(Qt::gray);
 
         albumRecommendationsList->addItem(item);
-        artistRecommendationsList->addItem(item);
+        artistRecommendationsList->addItem(item->clone());
 
         return;
     }
-    
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData.toUtf8());
-    if (jsonDoc.isNull()) 
-    {
-        QListWidgetItem *errorItem = new QListWidgetItem("error processing recommendations");
-        errorItem->setForeground(Qt::red);
 
-        albumRecommendationsList->addItem(errorItem);
-        return;
-    }
+    qDebug() << "recommendations took" << timer.elapsed() << "ms";
+    showRecommendations(results);
+}
 
+void RecommendationMenu::showRecommendations(const RecoEngine::Results &results)
+{
     // -- ARTIST RECOMMENDATIONS -- //
-    QJsonObject resultObj = jsonDoc.object();
-    
     QSet<QString> processedArtists; // for tracking artists to prevent duplicates
-    
-   
-    if (resultObj.contains("artist_recommendations")) 
-    {
-        QJsonArray artistRecs = resultObj["artist_recommendations"].toArray();
-        qDebug() << artistRecs.size();
-
 
-        //int debugCount = qMin(3, artistRecs.size()); //for debugging to check json 
-        //for (int i = 0; i < debugCount; i++) 
-        //{
-        //QJsonObject artist = artistRecs[i].toObject();
-        //QString artistName = artist["artist"].toString();
-        //QString genre = artist["genre"].toString();
-        //qDebug() << "  Artist recommendation" << artistName << genre << ")";
-        //}
-
-        
+    if (!results.artists.isEmpty())
+    {
         QListWidgetItem *header = new QListWidgetItem("artists based on your library");
 
         header->setForeground(Qt::blue);
@@ -309,10 +234,9 @@ void RecommendationMenu::handlePythonOutput()
 
         artistRecommendationsList->addItem(header);
         
-        for (const QJsonValue &value : artistRecs) 
+        for (const RecoEngine::ArtistRecommendation &artist : results.artists)
         {
-            QJsonObject artist = value.toObject();
-            QString artistName = artist["artist"].toString();
+            QString artistName = artist.artist;
             
       
             if (processedArtists.contains(artistName)) //if artist already processed
@@ -321,7 +245,7 @@ void RecommendationMenu::handlePythonOutput()
             }
             
             processedArtists.insert(artistName);
-            QString genre = artist["genre"].toString();
+            QString genre = artist.genre;
             
             QString displayText = QString("%1 (Genre: %2)").arg(artistName, genre);
             QListWidgetItem *item = new QListWidgetItem(displayText);
@@ -330,21 +254,15 @@ void RecommendationMenu::handlePythonOutput()
         }
         
         
-        if (!artistRecs.isEmpty())
+        // get random artist rather than first one in index
+        int randomIndex = 0;
+        if (results.artists.size() > 1) 
         {
-            // get random artist rather than first one in index
-
-            int randomIndex = 0;
-            if (artistRecs.size() > 1) 
-            {
-                randomIndex = QRandomGenerator::global()->bounded(artistRecs.size());
-            }
-
-            QJsonObject randomArtist = artistRecs[randomIndex].toObject();
-            QString artistName = randomArtist["artist"].toString();
-
-            fetchAlbumRecommendationsFromAPI(artistName); //get reccomendations based on artist
+            randomIndex = QRandomGenerator::global()->bounded(results.artists.size());
         }
+
+        QString artistName = results.artists[randomIndex].artist;
+        fetchAlbumRecommendationsFromAPI(artistName); //get reccomendations based on artist
     }
     // -- ARTIST RECOMMENDATIONS -- //
 
@@ -352,22 +270,8 @@ void RecommendationMenu::handlePythonOutput()
     QSet<QString> processedAlbums;
     
     
-    if (resultObj.contains("genre_recommendations")) {
-        QJsonArray genreRecs = resultObj["genre_recommendations"].toArray();
-        qDebug() << genreRecs.size();
-        
-        int debugCount = qMin(3, genreRecs.size());
-        for (int i = 0; i < debugCount; i++) // get each genre reccomendatiom 
-        {
-            QJsonObject song = genreRecs[i].toObject();
-            QString title = song["title"].toString();
-            QString artist = song["artist"].toString();
-            QString album = song["album"].toString();
-            QString genre = song["genre"].toString();
-            qDebug() << album << artist << genre;
-        }
-        // ...exist
-
+    if (!results.songs.isEmpty())
+    {
         QListWidgetItem *header = new QListWidgetItem("albums you might like based on your library"); 
         
         header->setForeground(Qt::blue);
@@ -377,16 +281,13 @@ void RecommendationMenu::handlePythonOutput()
   
         QStringList validGenres; // store valid genres for api use 
         
-        for (const QJsonValue &value : genreRecs) 
+        for (const RecoEngine::SongRecommendation &song : results.songs)
         {
-            QJsonObject song = value.toObject();
+            qint64 songId = song.id;
 
-            int songId = song["id"].toInt();
-
-            QString title = song["title"].toString();
-            QString artist = song["artist"].toString();
-            QString album = song["album"].toString();
-            QString genre = song["genre"].toString();
+            QString artist = song.artist;
+            QString album = song.album;
+            QString genre = song.genre;
             
             // unique key for album
             QString albumKey = artist + " - " + album;
@@ -437,7 +338,6 @@ void RecommendationMenu::fetchAlbumRecommendationsFromAPI(const QString &artist)
 {
     apiCallsMade++;
 
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     
     QString encodedArtist = QUrl::toPercentEncoding(artist);
     
@@ -456,17 +356,10 @@ void RecommendationMenu::fetchAlbumRecommendationsFromAPI(const QString &artist)
     qDebug() << apiUrl;
 
     QNetworkRequest request{QUrl(apiUrl)};
-    request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-   
-    if (apiCallsMade > 1) //if api called already made, gen a thread and chill for abit
-    {
-        QThread::msleep(2000);
-    }
 
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply, artist, manager]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply, artist]() 
     {
         qDebug() << "request finished for " << artist;
 
@@ -544,7 +437,6 @@ void RecommendationMenu::fetchAlbumRecommendationsFromAPI(const QString &artist)
         }
         
         reply->deleteLater();
-        manager->deleteLater();
     });
 }
 
@@ -621,7 +513,6 @@ void RecommendationMenu::fetchGenreRecommendationsFromAPI(const QString &genre,
         cleanGenre = "pop";
     }
 
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     QString encodedGenre = QUrl::toPercentEncoding(cleanGenre);
     
     QString apiUrl = QString("https://musicbrainz.org/ws/2/genre/%1?fmt=json").arg(encodedGenre);
@@ -629,17 +520,10 @@ void RecommendationMenu::fetchGenreRecommendationsFromAPI(const QString &genre,
     qDebug() << apiUrl;
 
     QNetworkRequest request{QUrl(apiUrl)};
-    request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-   
-    if (apiCallsMade > 1) // get thread goin if api called already made
-    {
-        QThread::msleep(2000);
-    }
 
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply, genre, cleanGenre, manager, isRetry]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply, genre, cleanGenre, isRetry]() 
     {
         if (reply->error() == QNetworkReply::NoError)
         {
@@ -674,14 +558,12 @@ void RecommendationMenu::fetchGenreRecommendationsFromAPI(const QString &genre,
         }
         
         reply->deleteLater();
-        manager->deleteLater();
     });
 }
 
 void RecommendationMenu::fetchReleasesByBrowseMethod(const QString &genre, bool isRetry)
 {
     
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     
     QString mbUrl = QString("https://musicbrainz.org/ws/2/artist?query=tag:%1 AND type:group AND country:US&limit=30&fmt=json")
     .arg(QUrl::toPercentEncoding(genre));
@@ -691,13 +573,10 @@ void RecommendationMenu::fetchReleasesByBrowseMethod(const QString &genre, bool
     qDebug() << "Artist lookup URL:" << apiUrl;
 
     QNetworkRequest request{QUrl(apiUrl)};
-    request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-    QThread::msleep(2000); // respect api call limits 
-    
-    QNetworkReply *reply = manager->get(request);
+
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
     
-    connect(reply, &QNetworkReply::finished, this, [this, reply, genre, manager, isRetry]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply, genre, isRetry]() 
     {
         albumRecommendationsList->clear();
         
@@ -728,7 +607,6 @@ void RecommendationMenu::fetchReleasesByBrowseMethod(const QString &genre, bool
             {
                 displayFallbackOrRetry(genre, isRetry);
                 reply->deleteLater();
-                manager->deleteLater();
                 return;
             }
             
@@ -741,7 +619,6 @@ void RecommendationMenu::fetchReleasesByBrowseMethod(const QString &genre, bool
         }
         
         reply->deleteLater();
-        manager->deleteLater();
     });
 }
 
@@ -756,9 +633,6 @@ void RecommendationMenu::fetchAlbumsForGenreArtists(const QList<QPair<QString, Q
     int artistsToUse = qMin(5, artists.size());
     QList<QPair<QString, QString>> selectedArtists = artists.mid(0, artistsToUse);
     
-    // for handling requests
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-    
     int *completedRequests = new int(0);  // for tracking completed requests
 
     QList<QJsonObject> *albumResults = new QList<QJsonObject>();
@@ -772,14 +646,11 @@ void RecommendationMenu::fetchAlbumsForGenreArtists(const QList<QPair<QString, Q
         
         qDebug() << artistName << " " << artistId << " ";
         
-        QNetworkRequest request{QUrl(apiUrl)}; 
-        request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-        
-        QThread::msleep(2000);// delay between requests
-        
-        QNetworkReply *reply = manager->get(request);
+        QNetworkRequest request{QUrl(apiUrl)};
+
+        MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
         
-        connect(reply, &QNetworkReply::finished, this, [this, reply, manager, artistName, genre,completedRequests, albumResults, artistsToUse,selectedArtists]() 
+        connect(reply, &MusicBrainzReply::finished, this, [this, reply, artistName, genre,completedRequests, albumResults, artistsToUse,selectedArtists]() 
         {
             (*completedRequests)++; //increment inside reply to prevent false positive calls
             
@@ -817,7 +688,6 @@ void RecommendationMenu::fetchAlbumsForGenreArtists(const QList<QPair<QString, Q
                 
                 delete completedRequests;
                 delete albumResults;
-                manager->deleteLater();
             }
         });
     }
@@ -1070,28 +940,6 @@ void RecommendationMenu::displayFallbackOrRetry(const QString &genre, bool isRet
     }
 }
 
-void RecommendationMenu::setupDatabase(const QString &dbPath) 
-{ 
-    // check if db connection already exists 
-    if (QSqlDatabase::contains("lavender_connection")) 
-    {
-        qDebug() << "db connection already exists.";
-        return;
-    }
-
-    // init new connection 
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "lavender_connection");
-    db.setDatabaseName(dbPath);
-
-    if (!db.open())
-     {
-        qDebug() << db.lastError().text();
-        return;
-    }
-
-    qDebug() << "db  opened at:" << dbPath;
-}
-
 void RecommendationMenu::initUI() 
 {
     // connect signals and slots
@@ -1129,32 +977,22 @@ void RecommendationMenu::onRecommendationClicked(QListWidgetItem *item) {
         if (songId > 0) 
         {
             // fetch from db 
-            QSqlDatabase db = QSqlDatabase::database("lavender_connection");
-            if (db.isOpen())
+            QString filePath = DbManager::instance().songPath(songId);
+            
+            if (!filePath.isEmpty() && QFile::exists(filePath)) 
             {
-                QSqlQuery query(db);
-                query.prepare("SELECT path FROM songs WHERE id = :id"); // Changed from filePath to path
-                query.bindValue(":id", songId);
-                
-                if (query.exec() && query.next()) 
-                {
-                    QString filePath = query.value(0).toString();
-                    if (!filePath.isEmpty() && QFile::exists(filePath)) 
-                    {
-                        // Show song details using TagLib
-                        showSongDetails(filePath);
-                    } 
-                    else 
-                    {
-                        QMessageBox::information(this, "song details", 
-                            "song: " + item->text() + "\nfile not found: " + filePath);
-                    }
-                } 
-                else 
-                {
-                    QMessageBox::information(this, "song Details", 
-                        "selected song: " + item->text() + "\ncouldn't retrieve file path from db");
-                }
+                // Show song details using TagLib
+                showSongDetails(filePath);
+            } 
+            else if (!filePath.isEmpty())
+            {
+                QMessageBox::information(this, "song details", 
+                    "song: " + item->text() + "\nfile not found: " + filePath);
+            }
+            else 
+            {
+                QMessageBox::information(this, "song Details", 
+                    "selected song: " + item->text() + "\ncouldn't retrieve file path from db");
             }
         } else {
             QMessageBox::information(this, "song Details", "selected song: " + item->text()); // limited info, this wasnt implemented fully :(
@@ -1164,20 +1002,16 @@ void RecommendationMenu::onRecommendationClicked(QListWidgetItem *item) {
 
 void RecommendationMenu::fetchAlbumDetails(const QString &mbid) 
 {
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     
     QString apiUrl = QString("https://musicbrainz.org/ws/2/release/%1?inc=recordings+artist-credits&fmt=json").arg(mbid);
 
     qDebug() << apiUrl;
 
     QNetworkRequest request{QUrl(apiUrl)};
-    request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-    QThread::msleep(1000); //thread for rate limits
 
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply,manager]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]() 
     {
 
         if (reply->error() == QNetworkReply::NoError) 
@@ -1283,7 +1117,6 @@ void RecommendationMenu::fetchAlbumDetails(const QString &mbid)
         }
         
         reply->deleteLater();
-        manager->deleteLater();
     });
 }
 
@@ -1387,7 +1220,6 @@ void RecommendationMenu::showSongDetails(const QString &filePath)
 
 void RecommendationMenu::fetchReleasesByGenreId(const QString &genreId, const QString &genreName)
 {
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     
     QString apiUrl = QString("https://musicbrainz.org/ws/2/release-group?genre=%1&type=album&limit=30&fmt=json").arg(genreId);
 
@@ -1395,13 +1227,10 @@ void RecommendationMenu::fetchReleasesByGenreId(const QString &genreId, const QS
     qDebug() << apiUrl;
 
     QNetworkRequest request{QUrl(apiUrl)};
-    request.setHeader(QNetworkRequest::UserAgentHeader, "lavender(university project) (n1076024@my.ntu.ac.uk)");
-    
-    QThread::msleep(2000); //delay for api limits
-    
-    QNetworkReply *reply = manager->get(request);
+
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
     
-    connect(reply, &QNetworkReply::finished, this, [this, reply, manager, genreId, genreName]()
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply, genreId, genreName]()
     {
         albumRecommendationsList->clear();
         
@@ -1434,36 +1263,18 @@ void RecommendationMenu::fetchReleasesByGenreId(const QString &genreId, const QS
         }
         
         reply->deleteLater();
-        manager->deleteLater();
     });
 }
 
 QString RecommendationMenu::analyzeAlbumGenre(const QString &albumId) 
 {
 
-    QSqlDatabase db = QSqlDatabase::database("lavender_connection");
-    if (!db.isOpen())
-    {
-        qDebug() << "db is not open!";
-        return QString();
-    }
-    
-    QSqlQuery query(db);
-    query.prepare("SELECT path FROM songs WHERE album_id = :albumId");
-    query.bindValue(":albumId", albumId);
-    
-    if (!query.exec())
-    {
-        qDebug() << query.lastError().text();
-        return QString();
-    }
-    
     QMap<QString, int> genreCounts;
     int totalSongs = 0;
     
-    while (query.next()) 
+    for (const SongRecord &song : DbManager::instance().songsForAlbum(albumId.toLongLong())) 
     {
-        QString filePath = query.value(0).toString();
+        QString filePath = song.path;
         if (filePath.isEmpty() || !QFile::exists(filePath)) 
         {
             continue;
@@ -4,7 +4,6 @@
 #include <QWidget>
 #include <QListWidget>
 #include <QPushButton>
-#include <QProcess>
 
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -17,6 +16,8 @@
 #include <QNetworkAccessManager> 
 #include <QNetworkRequest>       
 #include <QNetworkReply>
+#include <QSharedPointer>
+#include "recoEngine.h"
 
 
 class RecommendationMenu : public QWidget 
@@ -34,7 +35,9 @@ private:
 
     QPushButton *backButton; 
 
-    QProcess *pythonProcess; //recoengine.py process 
+    RecoEngine recoEngine; // tf-idf index over the library, loaded from the db and kept until the scanner changes it
+    bool indexLoading = false; // a refresh is out on the thread pool
+    int pendingSongId = 0;     // latest song asked for, answered once the refresh is back
 
     // for limiiting API calls 
     int apiCallLimit;
@@ -43,7 +46,6 @@ private:
     QString currentGenre;  
     QString currentAlbum;  
 
-    void setupDatabase(const QString &dbPath); // redundant
     void initUI();
 
     void onRecommendationClicked(QListWidgetItem *item);
@@ -64,13 +66,16 @@ private:
 
 
     void showSongDetails(const QString &filePath);
+    void refreshIndex();
+    void indexRefreshed(QSharedPointer<RecoEngine> engine);
+    void recommendFor(int songId);
+    void showRecommendations(const RecoEngine::Results &results);
 
 signals:
     void backToMainMenu();
     void songSelected(int songId, const QString &filePath);
+    void addToQueue(const QStringList &paths);
 
-private slots:
-    void handlePythonOutput(); 
 };
 
 #endif // RECOMMENDATIONMENU_H
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// single producer / single consumer ring of trivially copyable values, no locks and no allocation after
+// construction, so the audio callback can read from it while the decoder thread writes.
+// the positions only ever count up (64 bit, they dont wrap in practice) and get masked on access,
+// which keeps full and empty apart without a spare slot and lets the consumer skip to a position
+// the producer handed it
+template <typename T>
+class RingBuffer
+{
+    public:
+        explicit RingBuffer(size_t minCapacity)
+        {
+            size_t capacity = 1;
+            while (capacity < minCapacity)
+            {
+                capacity <<= 1;
+            }
+            slots.resize(capacity);
+            mask = capacity - 1;
+        }
+
+        RingBuffer(const RingBuffer &) = delete;
+        RingBuffer &operator=(const RingBuffer &) = delete;
+
+        size_t capacity() const
+        {
+            return slots.size();
+        }
+
+        // either side, only a snapshot while the other one is running
+        size_t readable() const
+        {
+            return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+        }
+
+        // --- producer --- //
+
+        size_t writable() const
+        {
+            return capacity() - (writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+        }
+
+        size_t writePosition() const
+        {
+            return writePos.load(std::memory_order_relaxed);
+        }
+
+        // copies as much of values as fits, returns how many that was
+        size_t write(const T *values, size_t count)
+        {
+            const size_t position = writePos.load(std::memory_order_relaxed);
+            count = std::min(count, capacity() - (position - readPos.load(std::memory_order_acquire)));
+            copyIn(position, values, count);
+            writePos.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        // --- consumer --- //
+
+        size_t read(T *values, size_t count)
+        {
+            const size_t position = readPos.load(std::memory_order_relaxed);
+            count = std::min(count, writePos.load(std::memory_order_acquire) - position);
+            copyOut(position, values, count);
+            readPos.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        size_t readPosition() const
+        {
+            return readPos.load(std::memory_order_relaxed);
+        }
+
+        // drops everything before a writePosition() the producer passed over, e.g. stale audio before a seek
+        void skipTo(size_t position)
+        {
+            const size_t current = readPos.load(std::memory_order_relaxed);
+            if (position - current <= writePos.load(std::memory_order_acquire) - current) // not past what was written
+            {
+                readPos.store(position, std::memory_order_release);
+            }
+        }
+
+    private:
+        void copyIn(size_t position, const T *values, size_t count)
+        {
+            const size_t start = position & mask;
+            const size_t first = std::min(count, capacity() - start);
+            std::memcpy(slots.data() + start, values, first * sizeof(T));
+            std::memcpy(slots.data(), values + first, (count - first) * sizeof(T));
+        }
+
+        void copyOut(size_t position, T *values, size_t count) const
+        {
+            const size_t start = position & mask;
+            const size_t first = std::min(count, capacity() - start);
+            std::memcpy(values, slots.data() + start, first * sizeof(T));
+            std::memcpy(values + first, slots.data(), (count - first) * sizeof(T));
+        }
+
+        std::vector<T> slots;
+        size_t mask;
+
+        // own cache lines, the two threads each hammer one of them
+        alignas(64) std::atomic<size_t> writePos{0};
+        alignas(64) std::atomic<size_t> readPos{0};
+    };
+#endif // RINGBUFFER_H
@@ -0,0 +1,120 @@
+#include "searchIndex.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QStringList>
+
+namespace
+{
+    // best songs first, limited before the join so only the rows that get shown are looked up in songs
+    const char *songSearch = "SELECT s.id, s.album_id, s.name, s.artist, s.album, s.genre, s.path "
+                             "FROM (SELECT rowid, rank FROM songs_fts WHERE songs_fts MATCH ? ORDER BY rank LIMIT ?) hit "
+                             "JOIN song_details s ON s.id = hit.rowid ORDER BY hit.rank";
+
+    // rank is negative bm25, so the smallest is the best hit in the group
+    const char *albumSearch = "SELECT a.id, a.name, a.path "
+                              "FROM (SELECT rowid, rank FROM songs_fts WHERE songs_fts MATCH ? ORDER BY rank LIMIT ?) hit "
+                              "JOIN songs s ON s.id = hit.rowid JOIN albums a ON a.id = s.album_id "
+                              "GROUP BY a.id ORDER BY MIN(hit.rank) LIMIT ?";
+
+    const char *artistSearch = "SELECT ar.name, COUNT(*) "
+                               "FROM (SELECT rowid, rank FROM songs_fts WHERE songs_fts MATCH ? ORDER BY rank LIMIT ?) hit "
+                               "JOIN songs s ON s.id = hit.rowid JOIN artists ar ON ar.id = s.artist_id WHERE ar.name <> '' "
+                               "GROUP BY ar.name COLLATE NOCASE ORDER BY MIN(hit.rank) LIMIT ?";
+}
+
+// words are whatever the unicode61 tokenizer would index, so punctuation the user types never reaches fts5 syntax
+QString SearchIndex::matchExpression(const QString &text, const QString &column)
+{
+    static const QRegularExpression separators("[^\\p{L}\\p{N}]+", QRegularExpression::UseUnicodePropertiesOption);
+    const QStringList words = text.split(separators, Qt::SkipEmptyParts);
+
+    QStringList terms;
+    for (int i = 0; i < words.size(); i++)
+    {
+        QString term = "\"" + words[i] + "\"";
+        if (i == words.size() - 1 && words[i].size() >= 2) // one letter prefixes match half the library, wait for the second
+        {
+            term += "*";
+        }
+        terms.append(column.isEmpty() ? term : column + " : " + term);
+    }
+    return terms.join(' ');
+}
+
+QList<SongRecord> SearchIndex::searchSongs(const QString &text, int limit)
+{
+    QList<SongRecord> songs;
+    const QString match = matchExpression(text);
+    if (match.isEmpty())
+    {
+        return songs;
+    }
+
+    DbManager::instance().select(songSearch, {match, limit}, [&](const QSqlQuery &query)
+    {
+        SongRecord song;
+        song.id = query.value(0).toLongLong();
+        song.albumId = query.value(1).toLongLong();
+        song.name = query.value(2).toString();
+        song.artist = query.value(3).toString();
+        song.album = query.value(4).toString();
+        song.genre = query.value(5).toString();
+        song.path = query.value(6).toString();
+        songs.append(song);
+    });
+    return songs;
+}
+
+QList<AlbumRecord> SearchIndex::searchAlbums(const QString &text, int limit)
+{
+    QList<AlbumRecord> albums;
+    const QString match = matchExpression(text, "album");
+    if (match.isEmpty())
+    {
+        return albums;
+    }
+
+    DbManager::instance().select(albumSearch, {match, groupPool, limit}, [&](const QSqlQuery &query)
+    {
+        AlbumRecord album;
+        album.id = query.value(0).toLongLong();
+        album.name = query.value(1).toString();
+        album.path = query.value(2).toString();
+        albums.append(album);
+    });
+    return albums;
+}
+
+QList<SearchIndex::ArtistHit> SearchIndex::searchArtists(const QString &text, int limit)
+{
+    QList<ArtistHit> artists;
+    const QString match = matchExpression(text, "artist");
+    if (match.isEmpty())
+    {
+        return artists;
+    }
+
+    DbManager::instance().select(artistSearch, {match, groupPool, limit}, [&](const QSqlQuery &query)
+    {
+        ArtistHit artist;
+        artist.name = query.value(0).toString();
+        artist.songs = query.value(1).toInt();
+        artists.append(artist);
+    });
+    return artists;
+}
+
+SearchIndex::Results SearchIndex::search(const QString &text, int songLimit, int groupLimit)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Results results;
+    results.songs = searchSongs(text, songLimit);
+    results.albums = searchAlbums(text, groupLimit);
+    results.artists = searchArtists(text, groupLimit);
+    results.elapsedUs = timer.nsecsElapsed() / 1000;
+
+    return results;
+}
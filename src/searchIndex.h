@@ -0,0 +1,40 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QList>
+#include "dbManager.h"
+
+// search as you type over the songs_fts table the scanner keeps (fts5 over title, artist, album, genre).
+// every word has to match, the last one as a prefix since it is probably still being typed, and hits come
+// back best first by bm25 with titles weighted over artists over albums over genres.
+// reads go through DbManager, so it works from any thread
+class SearchIndex
+{
+    public:
+        struct ArtistHit
+        {
+            QString name;
+            int songs = 0; // among the top hits, not the whole library
+        };
+
+        struct Results
+        {
+            QList<SongRecord> songs;
+            QList<AlbumRecord> albums;
+            QList<ArtistHit> artists;
+            qint64 elapsedUs = 0;
+        };
+
+        static Results search(const QString &text, int songLimit = 50, int groupLimit = 8);
+
+        static QList<SongRecord> searchSongs(const QString &text, int limit = 50);
+        static QList<AlbumRecord> searchAlbums(const QString &text, int limit = 8);  // by album tag, best song decides the order
+        static QList<ArtistHit> searchArtists(const QString &text, int limit = 8);
+
+        // user text -> fts5 query, column limits every word to that column. empty if there is nothing to search for
+        static QString matchExpression(const QString &text, const QString &column = QString());
+
+        static const int groupPool = 500; // top song hits that albums/artists are grouped from, keeps short prefixes cheap
+    };
+#endif // SEARCHINDEX_H
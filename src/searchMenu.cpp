@@ -0,0 +1,131 @@
+#include "searchMenu.h"
+#include "searchIndex.h"
+#include <QDebug>
+#include <QFont>
+
+namespace
+{
+    const int typingPauseMs = 120; // queries are a few ms, this is just so every keystroke doesnt repaint the list
+    const int typeRole = Qt::UserRole;
+    const int nameRole = Qt::UserRole + 1;
+    const int pathRole = Qt::UserRole + 2;
+}
+
+SearchMenu::SearchMenu(QWidget *parent) : QWidget(parent)
+{
+    layout = new QVBoxLayout(this);
+
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText("search songs, albums and artists");
+    searchEdit->setClearButtonEnabled(true);
+    layout->addWidget(searchEdit);
+
+    statusLabel = new QLabel(this);
+    layout->addWidget(statusLabel);
+
+    resultListWidget = new QListWidget(this);
+    layout->addWidget(resultListWidget);
+
+    backButton = new QPushButton("back", this);
+    layout->addWidget(backButton);
+
+    setLayout(layout);
+
+    searchTimer.setSingleShot(true);
+    searchTimer.setInterval(typingPauseMs);
+
+    // -- connections -- //
+    connect(searchEdit, &QLineEdit::textChanged, this, [this]() { searchTimer.start(); });
+    connect(searchEdit, &QLineEdit::returnPressed, this, &SearchMenu::runSearch); // enter doesnt wait
+    connect(&searchTimer, &QTimer::timeout, this, &SearchMenu::runSearch);
+    connect(resultListWidget, &QListWidget::itemClicked, this, &SearchMenu::onResultClicked);
+    connect(backButton, &QPushButton::clicked, this, &SearchMenu::backToMainMenu);
+    // -- connections -- //
+}
+
+void SearchMenu::focusSearch()
+{
+    searchEdit->setFocus();
+    searchEdit->selectAll();
+}
+
+void SearchMenu::addHeader(const QString &title)
+{
+    QListWidgetItem *header = new QListWidgetItem(title, resultListWidget);
+    QFont font = header->font();
+    font.setBold(true);
+    header->setFont(font);
+    header->setFlags(Qt::NoItemFlags); // not clickable
+}
+
+void SearchMenu::runSearch()
+{
+    searchTimer.stop();
+    resultListWidget->clear();
+
+    const QString text = searchEdit->text();
+    if (text.trimmed().isEmpty())
+    {
+        statusLabel->clear();
+        return;
+    }
+
+    SearchIndex::Results results = SearchIndex::search(text);
+
+    if (!results.artists.isEmpty())
+    {
+        addHeader("artists");
+        for (const SearchIndex::ArtistHit &artist : results.artists)
+        {
+            QListWidgetItem *item = new QListWidgetItem(artist.name, resultListWidget);
+            item->setData(typeRole, ArtistResult);
+            item->setData(nameRole, artist.name);
+        }
+    }
+
+    if (!results.albums.isEmpty())
+    {
+        addHeader("albums");
+        for (const AlbumRecord &album : results.albums)
+        {
+            QListWidgetItem *item = new QListWidgetItem(album.name, resultListWidget);
+            item->setData(typeRole, AlbumResult);
+            item->setData(nameRole, album.name);
+            item->setData(pathRole, album.path);
+        }
+    }
+
+    if (!results.songs.isEmpty())
+    {
+        addHeader("songs");
+        for (const SongRecord &song : results.songs)
+        {
+            QString title = song.name.isEmpty() ? song.path.section('/', -1) : song.name;
+            QListWidgetItem *item = new QListWidgetItem(song.artist.isEmpty() ? title : title + " - " + song.artist, resultListWidget);
+            item->setData(typeRole, SongResult);
+            item->setData(pathRole, song.path);
+            item->setToolTip(song.album);
+        }
+    }
+
+    statusLabel->setText(results.songs.isEmpty() ? QString("no matches")
+                                                 : QString("%1 songs (%2 ms)").arg(results.songs.size()).arg(results.elapsedUs / 1000.0, 0, 'f', 1));
+}
+
+void SearchMenu::onResultClicked(QListWidgetItem *item)
+{
+    switch (item->data(typeRole).toInt())
+    {
+        case ArtistResult:
+            searchEdit->setText(item->data(nameRole).toString()); // searches again through textChanged
+            break;
+        case AlbumResult:
+            emit albumSelected(item->data(nameRole).toString(), item->data(pathRole).toString());
+            break;
+        case SongResult:
+            emit songSelected(item->data(pathRole).toString());
+            break;
+        default:
+            break; // section header
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef SEARCHMENU_H
+#define SEARCHMENU_H
+
+#include <QWidget>
+#include <QVBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QPushButton>
+#include <QTimer>
+
+// search box plus one list of results split into artists, albums and songs.
+// albums open in AlbumMenu, songs in SongDetail, an artist narrows the search down to them
+class SearchMenu : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SearchMenu(QWidget *parent = nullptr);
+
+    void focusSearch(); // called when the page is shown
+
+signals:
+    void albumSelected(const QString &albumName, const QString &albumPath);
+    void songSelected(const QString &songPath);
+    void backToMainMenu();
+
+private slots:
+    void runSearch();
+    void onResultClicked(QListWidgetItem *item);
+
+private:
+    enum ResultType
+    {
+        ArtistResult = 1,
+        AlbumResult,
+        SongResult
+    };
+
+    void addHeader(const QString &title);
+
+    QVBoxLayout *layout;
+    QLineEdit *searchEdit;
+    QLabel *statusLabel;
+    QListWidget *resultListWidget;
+    QPushButton *backButton;
+
+    QTimer searchTimer; // restarted on every keystroke, searches once typing pauses
+};
+
+#endif // SEARCHMENU_H
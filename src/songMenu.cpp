@@ -7,14 +7,13 @@
 #include <QFileDialog>
 #include <QBuffer>
 
-#include <QNetworkAccessManager>
+#include "musicBrainzClient.h"
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QApplication>
-#include <QTimer>
 
 SongDetail::SongDetail(QWidget *parent) : QWidget(parent) 
 {
@@ -333,6 +332,17 @@ SongDetail::SongDetail(QWidget *parent) : QWidget(parent)
     connect(fingerprintGenerator, &AudioFingerprint::error, this, [this](const QString &error) 
     {
         songInfo->setText("Fingerprinting error: " + error);
+        setFingerprintControlsEnabled(true);
+    });
+    connect(fingerprintGenerator, &AudioFingerprint::fingerprintProgress, this, [this](int percent)
+    {
+        songInfo->setText(QString("Generating audio fingerprint... %1%").arg(percent));
+    });
+    connect(fingerprintGenerator, &AudioFingerprint::fingerprintGenerated, this, [this]()
+    {
+        qDebug() << "fingerprint generated successfully, starting metadata lookup" << (fingerprintGenerator->isFromCache() ? "(cached)" : "");
+        songInfo->setText("looking up song by audio fingerprint...");
+        fingerprintGenerator->lookupMetadata();
     });
     // -- connections -- //
 
@@ -341,16 +351,42 @@ SongDetail::SongDetail(QWidget *parent) : QWidget(parent)
 
 void SongDetail::onBackButtonClicked() 
 {
+    cancelFingerprinting();
     emit backToMainMenu(); // emit signal to return to main menu
 }
 
+// page left by any route (back, another view in the stack), a fingerprint nobody will see isnt worth finishing
+void SongDetail::hideEvent(QHideEvent *event)
+{
+    if (!event->spontaneous()) // minimising the window doesnt count
+    {
+        cancelFingerprinting();
+    }
+    QWidget::hideEvent(event);
+}
+
+void SongDetail::cancelFingerprinting()
+{
+    if (fingerprintGenerator->isGenerating())
+    {
+        qDebug() << "fingerprinting cancelled" << currentSongPath;
+        fingerprintGenerator->cancel();
+        songInfo->clear();
+    }
+    setFingerprintControlsEnabled(true);
+}
+
+void SongDetail::setFingerprintControlsEnabled(bool enabled)
+{
+    identifyByFingerprintButton->setEnabled(enabled);
+    identifyByFingerprintAction->setEnabled(enabled);
+}
+
 void SongDetail::loadSong(const QString &songPath) // called when song is selected
 {
+    cancelFingerprinting(); // still running for the last song
     currentSongPath = songPath; //get songpath 
 
-    identifyByFingerprintButton->setEnabled(true);
-    identifyByFingerprintAction->setEnabled(true); // enable fingerprinting action
-
     TagLib::FileRef file(songPath.toUtf8().constData()); //get file reference for metadata
 
     if (!file.isNull() && file.tag()) // if fileref is valid, parse metadata
@@ -429,9 +465,6 @@ void SongDetail::fetchMetadata()
 {
     qDebug() << "fetching metadata from API...";
 
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-
-
     QString title = QUrl::toPercentEncoding(titleEdit->text());
     QString artist = QUrl::toPercentEncoding(artistEdit->text()); // for handling spaces & special chars
 
@@ -452,13 +485,10 @@ void SongDetail::fetchMetadata()
     QNetworkRequest metarequest(url);
     metarequest.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
 
-    // user agent header for identification
-    metarequest.setRawHeader("User-Agent", "lavender(university project) (n1076024@my.ntu.ac.uk)");
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(metarequest);
 
-    QNetworkReply *reply = manager->get(metarequest);
 
-
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]() 
     {
         qDebug() << "api request success!";
 
@@ -551,7 +581,7 @@ void SongDetail::fetchMetadata()
         else 
         {
             qDebug() << "request error:" << reply->errorString();
-            qDebug() << "http:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            qDebug() << "http:" << reply->httpStatus();
             qDebug() << "server response:" << reply->readAll();
             songInfo->setText("failed to fetch metadata: " + reply->errorString());
         }
@@ -599,17 +629,14 @@ void SongDetail::uploadAlbumArtwork()
 
 void SongDetail::fetchCoverArt(const QString &releaseGroupId) 
 {
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-
     QString apiUrl = QString("https://coverartarchive.org/release-group/%1/front").arg(releaseGroupId); //thanks to cover art archive
     qDebug() << apiUrl;
 
     QNetworkRequest request((QUrl(apiUrl)));
-    request.setRawHeader("User-Agent", "lavender(university project) (n1076024@my.ntu.ac.uk)");
 
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]() 
     {
         if (reply->error() == QNetworkReply::NoError)
         {
@@ -646,8 +673,6 @@ void SongDetail::fetchCoverArt(const QString &releaseGroupId)
 
 void SongDetail::fetchAlbumArt() 
 {
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-
     QString album = QUrl::toPercentEncoding(albumEdit->text());
     QString artist = QUrl::toPercentEncoding(artistEdit->text());
 
@@ -665,11 +690,10 @@ void SongDetail::fetchAlbumArt()
     QNetworkRequest request((QUrl(apiUrl)));
 
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    request.setRawHeader("User-Agent", "lavender(university project) (n1076024@my.ntu.ac.uk)");
 
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]() 
     {
         if (reply->error() == QNetworkReply::NoError) 
         {
@@ -710,17 +734,15 @@ void SongDetail::fetchAlbumArt()
 void SongDetail::fetchDetailedReleaseMetadata(const QString &releaseId) 
 {
 
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
     QString apiUrl = QString("https://musicbrainz.org/ws/2/release/%1?fmt=json&inc=recordings+artist-credits+genres+tags")
                          .arg(releaseId);
     
     QNetworkRequest request((QUrl(apiUrl)));
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    request.setRawHeader("User-Agent", "lavender(university project) (n1076024@my.ntu.ac.uk)");
     
-    QNetworkReply *reply = manager->get(request);
+    MusicBrainzReply *reply = MusicBrainzClient::instance().get(request);
     
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() 
+    connect(reply, &MusicBrainzReply::finished, this, [this, reply]() 
     {
         if (reply->error() == QNetworkReply::NoError) 
         {
@@ -820,49 +842,11 @@ void SongDetail::identifySongByFingerprint()
     
     qDebug() << currentSongPath;
     
-    // prompt user 
-    songInfo->setText("Generating audio fingerprint... this may take a moment!");
-    identifyByFingerprintButton->setEnabled(false);
-    identifyByFingerprintAction->setEnabled(false);
-    
-    // wait cursor 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    
-    // use timer to reset UI if fingerprinting takes too long
-    QTimer::singleShot(60000, this, [this]()
-    {
-        // If still processing after 60 seconds, reset UI
-        if (!identifyByFingerprintButton->isEnabled())
-        {
-            qDebug() << "finger print gen timed out";
-            songInfo->setText("fingerprint generation timed out.");
-
-            identifyByFingerprintButton->setEnabled(true);
-            identifyByFingerprintAction->setEnabled(true);
+    // prompt user, the decode runs on the thread pool so the page stays usable meanwhile
+    songInfo->setText("Generating audio fingerprint... 0%");
+    setFingerprintControlsEnabled(false);
 
-            QApplication::restoreOverrideCursor();
-        }
-    });
-    
-   
-    bool success = fingerprintGenerator->generateFingerprint(currentSongPath);
-    
-    if (success)
-    {
-        qDebug() << "fingerprint generated successfully, starting metadata lookup";
-        songInfo->setText("looking up song by audio fingerprint...");
-        fingerprintGenerator->lookupMetadata();
-    }
-    else 
-    {
-        qDebug() << "gen failed";
-        // no need for prompt 
-        
-        // Re-enable controls
-        identifyByFingerprintButton->setEnabled(true);
-        identifyByFingerprintAction->setEnabled(true);
-        QApplication::restoreOverrideCursor();
-    }
+    fingerprintGenerator->generateFingerprintAsync(currentSongPath); // fingerprintGenerated or error comes back
 }
 
 void SongDetail::handleFingerprintResult(const QJsonObject &metadata)
@@ -870,9 +854,7 @@ void SongDetail::handleFingerprintResult(const QJsonObject &metadata)
     qDebug() << "handling fingerprint result";
     
     // enable controls incase false
-    identifyByFingerprintButton->setEnabled(true);
-    identifyByFingerprintAction->setEnabled(true);
-    QApplication::restoreOverrideCursor();
+    setFingerprintControlsEnabled(true);
     
     // clear any prior results
     resultListWidget->clear();
@@ -26,6 +26,9 @@ public:
         return menuBar; 
     }
 
+protected:
+    void hideEvent(QHideEvent *event) override;
+
 signals:
     void backToMainMenu();
     void playSong(const QString &songPath);
@@ -42,6 +45,9 @@ private slots:
     void fetchDetailedReleaseMetadata(const QString &releaseId);
 
 private:
+    void cancelFingerprinting();
+    void setFingerprintControlsEnabled(bool enabled);
+
     AudioFingerprint *fingerprintGenerator;
 
     QMenuBar *menuBar;
@@ -0,0 +1,190 @@
+#include "thumbnailCache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QImageReader>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace
+{
+    const int sizes[] = {ThumbnailCache::Grid, ThumbnailCache::Album, ThumbnailCache::Player};
+
+    // every file is this header followed by the premultiplied argb rows as they sit in memory
+    struct EntryHeader
+    {
+        char magic[4];
+        quint32 width;
+        quint32 height;
+        quint32 bytesPerLine;
+    };
+
+    const char entryMagic[4] = {'L', 'V', 'T', '1'};
+
+    void unmapEntry(void *info)
+    {
+        delete static_cast<QFile *>(info); // closing the file drops the mapping
+    }
+}
+
+ThumbnailCache &ThumbnailCache::instance()
+{
+    static ThumbnailCache cache;
+    return cache;
+}
+
+ThumbnailCache::ThumbnailCache()
+{
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+}
+
+void ThumbnailCache::setCacheDirectory(const QString &dir)
+{
+    QMutexLocker locker(&dirMutex);
+    cacheDir = dir;
+}
+
+QString ThumbnailCache::cacheDirectory() const
+{
+    QMutexLocker locker(&dirMutex);
+    return cacheDir;
+}
+
+QString ThumbnailCache::findCoverArt(const QString &albumDir)
+{
+    // union of the names the menus used to look for on their own
+    static const QStringList albumArtFiles = {"Folder.jpg", "Front.jpg", "cover.jpg", "cover.png", "folder.jpg", "album.jpg", "artwork.jpg"};
+
+    for (const QString &fileName : albumArtFiles)
+    {
+        QString albumArtPath = albumDir + "/" + fileName;
+        if (QFileInfo::exists(albumArtPath))
+        {
+            return albumArtPath;
+        }
+    }
+
+    return QString();
+}
+
+QImage ThumbnailCache::thumbnail(const QString &albumDir, int size)
+{
+    QString coverPath = findCoverArt(albumDir);
+    if (coverPath.isEmpty())
+    {
+        return QImage();
+    }
+
+    // key changes with the file, so an edited cover just misses and gets regenerated
+    QFileInfo cover(coverPath);
+    QByteArray source = coverPath.toUtf8() + '|' + QByteArray::number(cover.lastModified().toMSecsSinceEpoch()) + '|' + QByteArray::number(cover.size());
+    QString key = QCryptographicHash::hash(source, QCryptographicHash::Sha1).toHex();
+
+    QImage image = mapEntry(entryPath(key, size));
+    if (!image.isNull())
+    {
+        return image;
+    }
+
+    if (!generate(coverPath, key))
+    {
+        return QImage();
+    }
+
+    return mapEntry(entryPath(key, size));
+}
+
+QString ThumbnailCache::entryPath(const QString &key, int size) const
+{
+    return QString("%1/%2/%3_%4.thumb").arg(cacheDirectory(), key.left(2), key).arg(size); // fanned out so no dir gets 20k entries
+}
+
+QImage ThumbnailCache::mapEntry(const QString &path) const
+{
+    QFile *file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < qint64(sizeof(EntryHeader)))
+    {
+        delete file;
+        return QImage();
+    }
+
+    uchar *data = file->map(0, file->size());
+    if (!data)
+    {
+        delete file;
+        return QImage();
+    }
+
+    const EntryHeader *header = reinterpret_cast<const EntryHeader *>(data);
+    if (memcmp(header->magic, entryMagic, 4) != 0 ||
+        file->size() < qint64(sizeof(EntryHeader)) + qint64(header->bytesPerLine) * header->height)
+    {
+        qWarning() << "corrupt thumbnail, regenerating:" << path;
+        delete file;
+        QFile::remove(path);
+        return QImage();
+    }
+
+    // image reads straight out of the mapping, the file goes when the last copy of the image does
+    const uchar *pixels = data + sizeof(EntryHeader); // const so any edit detaches instead of writing to the read only mapping
+    return QImage(pixels, header->width, header->height, header->bytesPerLine,
+                  QImage::Format_ARGB32_Premultiplied, unmapEntry, file);
+}
+
+// one decode of the source covers all three sizes
+bool ThumbnailCache::generate(const QString &coverPath, const QString &key)
+{
+    QImageReader reader(coverPath);
+    QSize sourceSize = reader.size();
+    if (sourceSize.isValid() && (sourceSize.width() > Player || sourceSize.height() > Player))
+    {
+        reader.setScaledSize(sourceSize.scaled(Player, Player, Qt::KeepAspectRatio)); // jpeg scales while decoding
+    }
+
+    QImage source = reader.read();
+    if (source.isNull())
+    {
+        qWarning() << "cover could not be decoded:" << coverPath << reader.errorString();
+        return false;
+    }
+    source = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    QDir().mkpath(QFileInfo(entryPath(key, Grid)).absolutePath());
+
+    for (int size : sizes)
+    {
+        QImage scaled = source;
+        if (source.width() > size || source.height() > size)
+        {
+            scaled = source.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+
+        EntryHeader header;
+        memcpy(header.magic, entryMagic, 4);
+        header.width = scaled.width();
+        header.height = scaled.height();
+        header.bytesPerLine = scaled.bytesPerLine();
+
+        QSaveFile file(entryPath(key, size)); // renamed into place, readers never see half a file
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "thumbnail cache not writable:" << file.fileName();
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(scaled.constBits()), scaled.sizeInBytes());
+
+        if (!file.commit())
+        {
+            qWarning() << "thumbnail write failed:" << file.fileName();
+            return false;
+        }
+    }
+
+    return true;
+}
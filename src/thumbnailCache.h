@@ -0,0 +1,39 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QString>
+#include <QImage>
+#include <QMutex>
+
+// album art thumbnails decoded once and kept on disk as raw pixels,
+// later visits (and launches) just map the file instead of decoding the jpeg again
+class ThumbnailCache
+{
+    public:
+        enum Size
+        {
+            Grid = 150,   // main menu tiles
+            Album = 200,  // album menu header
+            Player = 400  // playback view
+        };
+
+        static ThumbnailCache &instance();
+
+        QImage thumbnail(const QString &albumDir, int size); // null if the album has no art, safe from any thread
+
+        static QString findCoverArt(const QString &albumDir); // first cover file found in the dir, empty if none
+
+        void setCacheDirectory(const QString &dir);
+        QString cacheDirectory() const;
+
+    private:
+        ThumbnailCache();
+
+        QString entryPath(const QString &key, int size) const;
+        QImage mapEntry(const QString &path) const;
+        bool generate(const QString &coverPath, const QString &key);
+
+        mutable QMutex dirMutex;
+        QString cacheDir;
+    };
+#endif // THUMBNAILCACHE_H
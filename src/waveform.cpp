@@ -0,0 +1,437 @@
+#include "waveform.h"
+#include "audioDecoder.h"
+#include "dbManager.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <algorithm>
+#include <climits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    qint8 quantize(qint16 sample)
+    {
+        return qint8(sample >> 8);
+    }
+
+    Waveform::Peak merge(const Waveform::Peak &a, const Waveform::Peak &b)
+    {
+        Waveform::Peak peak;
+        peak.min = qMin(a.min, b.min);
+        peak.max = qMax(a.max, b.max);
+        return peak;
+    }
+}
+
+// --- min / max kernel --- //
+
+void Waveform::minMax(const qint16 *samples, int count, qint16 *min, qint16 *max)
+{
+    qint16 low = *min;
+    qint16 high = *max;
+    int i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    if (count >= 8)
+    {
+        __m128i low8 = _mm_set1_epi16(low);
+        __m128i high8 = _mm_set1_epi16(high);
+
+#if defined(__AVX2__)
+        // 16 samples a step, then the two halves folded into the sse registers for the rest
+        __m256i low16 = _mm256_set1_epi16(low);
+        __m256i high16 = _mm256_set1_epi16(high);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+            low16 = _mm256_min_epi16(low16, v);
+            high16 = _mm256_max_epi16(high16, v);
+        }
+        low8 = _mm_min_epi16(_mm256_castsi256_si128(low16), _mm256_extracti128_si256(low16, 1));
+        high8 = _mm_max_epi16(_mm256_castsi256_si128(high16), _mm256_extracti128_si256(high16, 1));
+#endif
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+            low8 = _mm_min_epi16(low8, v);
+            high8 = _mm_max_epi16(high8, v);
+        }
+
+        alignas(16) qint16 lows[8];
+        alignas(16) qint16 highs[8];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lows), low8);
+        _mm_store_si128(reinterpret_cast<__m128i *>(highs), high8);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            low = qMin(low, lows[lane]);
+            high = qMax(high, highs[lane]);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (count >= 8)
+    {
+        int16x8_t low8 = vdupq_n_s16(low);
+        int16x8_t high8 = vdupq_n_s16(high);
+        for (; i + 8 <= count; i += 8)
+        {
+            int16x8_t v = vld1q_s16(samples + i);
+            low8 = vminq_s16(low8, v);
+            high8 = vmaxq_s16(high8, v);
+        }
+        low = vminvq_s16(low8);
+        high = vmaxvq_s16(high8);
+    }
+#endif
+
+    // whatever is left, or everything without simd
+    for (; i < count; i++)
+    {
+        low = qMin(low, samples[i]);
+        high = qMax(high, samples[i]);
+    }
+
+    *min = low;
+    *max = high;
+}
+
+// --- builder --- //
+
+Waveform::Builder::Builder(int channels, int sampleRate, qint64 expectedFrames) : channels(qMax(1, channels)), sampleRate(sampleRate),
+                                                                                  framesPerPeak(minFramesPerPeak), inPeak(0), frames(0),
+                                                                                  low(SHRT_MAX), high(SHRT_MIN)
+{
+    // doubling keeps a fold lined up with the peaks already built if the guess was short
+    while (expectedFrames / framesPerPeak > maxPeaks)
+    {
+        framesPerPeak *= 2;
+    }
+    peaks.reserve(maxPeaks);
+}
+
+void Waveform::Builder::add(const qint16 *samples, int count)
+{
+    while (count > 0)
+    {
+        if (inPeak == 0 && peaks.size() == maxPeaks) // song is longer than it said, a new peak would go over
+        {
+            fold();
+        }
+
+        const int take = qMin(count, framesPerPeak - inPeak);
+        minMax(samples, take * channels, &low, &high);
+
+        samples += take * channels;
+        count -= take;
+        inPeak += take;
+        frames += take;
+
+        if (inPeak == framesPerPeak)
+        {
+            Peak peak;
+            peak.min = quantize(low);
+            peak.max = quantize(high);
+            peaks.append(peak);
+
+            inPeak = 0;
+            low = SHRT_MAX;
+            high = SHRT_MIN;
+        }
+    }
+}
+
+// pairs of peaks become one twice as long, maxPeaks is even so the peak being built carries on lined up
+void Waveform::Builder::fold()
+{
+    const int half = peaks.size() / 2;
+    for (int i = 0; i < half; i++)
+    {
+        peaks[i] = merge(peaks[2 * i], peaks[2 * i + 1]);
+    }
+    peaks.resize(half);
+    framesPerPeak *= 2;
+}
+
+Waveform Waveform::Builder::finish()
+{
+    if (inPeak > 0) // the last one is usually short
+    {
+        Peak peak;
+        peak.min = quantize(low);
+        peak.max = quantize(high);
+        peaks.append(peak);
+        inPeak = 0;
+    }
+
+    Waveform waveform;
+    if (peaks.isEmpty())
+    {
+        return waveform;
+    }
+
+    waveform.totalFrames = frames;
+    waveform.rate = sampleRate;
+    waveform.peakFrames = framesPerPeak;
+    waveform.buildLevels(peaks);
+    return waveform;
+}
+
+// --- waveform --- //
+
+Waveform::Waveform() : totalFrames(0), rate(0), peakFrames(0)
+{
+}
+
+void Waveform::buildLevels(QVector<Peak> base)
+{
+    levels.clear();
+    levels.append(std::move(base));
+
+    while (levels.last().size() > topLevelPeaks)
+    {
+        const QVector<Peak> &below = levels.last();
+        QVector<Peak> above((below.size() + 1) / 2);
+        for (int i = 0; i < above.size(); i++)
+        {
+            above[i] = 2 * i + 1 < below.size() ? merge(below[2 * i], below[2 * i + 1]) : below[2 * i];
+        }
+        levels.append(std::move(above));
+    }
+}
+
+bool Waveform::isNull() const
+{
+    return levels.isEmpty();
+}
+
+qint64 Waveform::frames() const
+{
+    return totalFrames;
+}
+
+int Waveform::sampleRate() const
+{
+    return rate;
+}
+
+qint64 Waveform::durationMs() const
+{
+    return rate > 0 ? totalFrames * 1000 / rate : 0;
+}
+
+int Waveform::framesPerPeak() const
+{
+    return peakFrames;
+}
+
+int Waveform::levelCount() const
+{
+    return levels.size();
+}
+
+const QVector<Waveform::Peak> &Waveform::level(int index) const
+{
+    return levels.at(index);
+}
+
+QVector<Waveform::Peak> Waveform::overview(int buckets) const
+{
+    QVector<Peak> result;
+    if (isNull() || buckets <= 0)
+    {
+        return result;
+    }
+
+    // coarsest level with at least a peak per bucket, so each bucket reads a couple of peaks at most
+    int chosen = 0;
+    for (int i = levels.size() - 1; i >= 0; i--)
+    {
+        if (levels[i].size() >= buckets)
+        {
+            chosen = i;
+            break;
+        }
+    }
+
+    const QVector<Peak> &peaks = levels[chosen];
+    const qint64 count = peaks.size();
+    result.resize(buckets);
+
+    for (int b = 0; b < buckets; b++)
+    {
+        qint64 first = b * count / buckets;
+        qint64 last = qMax(first + 1, (b + 1) * count / buckets); // song shorter than the widget, peaks repeat
+
+        Peak peak = peaks[first];
+        for (qint64 i = first + 1; i < last; i++)
+        {
+            peak = merge(peak, peaks[i]);
+        }
+        result[b] = peak;
+    }
+    return result;
+}
+
+// --- storage --- //
+
+QByteArray Waveform::pack() const
+{
+    if (isNull())
+    {
+        return QByteArray();
+    }
+
+    const QVector<Peak> &base = levels.first();
+    QByteArray raw(base.size() * 2, Qt::Uninitialized);
+    for (int i = 0; i < base.size(); i++)
+    {
+        raw[2 * i] = char(base[i].min);
+        raw[2 * i + 1] = char(base[i].max);
+    }
+    return qCompress(raw); // mostly quiet intros and repeated shapes, roughly halves it
+}
+
+bool Waveform::unpack(const QByteArray &packed, qint64 frames, int sampleRate, int framesPerPeak, Waveform *waveform)
+{
+    QByteArray raw = qUncompress(packed);
+    if (raw.isEmpty() || raw.size() % 2 != 0 || frames <= 0 || sampleRate <= 0 || framesPerPeak <= 0)
+    {
+        return false;
+    }
+
+    QVector<Peak> base(raw.size() / 2);
+    for (int i = 0; i < base.size(); i++)
+    {
+        base[i].min = qint8(raw[2 * i]);
+        base[i].max = qint8(raw[2 * i + 1]);
+    }
+
+    waveform->totalFrames = frames;
+    waveform->rate = sampleRate;
+    waveform->peakFrames = framesPerPeak;
+    waveform->buildLevels(std::move(base));
+    return true;
+}
+
+// every chunk goes straight from the decoder into the builder, nothing bigger than a chunk is ever held
+bool Waveform::fromFile(const QString &filePath, Waveform *waveform, QString *errorMessage, const std::atomic<bool> *cancel, qint64 *bytesRead)
+{
+    auto fail = [errorMessage](const QString &message)
+    {
+        if (errorMessage)
+        {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    if (!QFile::exists(filePath))
+    {
+        return fail("song does not exist!: " + filePath);
+    }
+
+    AudioDecoder decoder;
+    if (!decoder.open(filePath))
+    {
+        return fail("waveform failed!: " + decoder.errorString());
+    }
+
+    Builder builder(decoder.channels(), decoder.sampleRate(), qint64(decoder.duration() * decoder.sampleRate()));
+    bool decoded = decoder.read([&](const qint16 *samples, int frames)
+    {
+        if (cancel && cancel->load())
+        {
+            return false;
+        }
+        builder.add(samples, frames);
+        return true;
+    });
+
+    if (bytesRead)
+    {
+        *bytesRead = decoder.bytesRead();
+    }
+
+    if (cancel && cancel->load())
+    {
+        return fail("cancelled");
+    }
+    if (!decoded)
+    {
+        return fail("waveform failed!: " + decoder.errorString());
+    }
+
+    *waveform = builder.finish();
+    if (waveform->isNull())
+    {
+        return fail("waveform failed!: no audio");
+    }
+    return true;
+}
+
+bool Waveform::readCache(const QString &filePath, Waveform *waveform, qint64 *songId)
+{
+    QFileInfo info(filePath);
+    bool hit = false;
+
+    DbManager::instance().select("SELECT s.id, w.peaks, w.frames, w.sample_rate, w.frames_per_peak, w.file_size, w.file_mtime "
+                                 "FROM songs s LEFT JOIN waveforms w ON w.song_id = s.id AND w.status = 0 WHERE s.path = ? LIMIT 1",
+                                 {filePath}, [&](const QSqlQuery &query)
+    {
+        if (songId)
+        {
+            *songId = query.value(0).toLongLong();
+        }
+        if (query.value(1).isNull())
+        {
+            return;
+        }
+
+        bool sameStamp = query.value(5).toLongLong() == info.size() && query.value(6).toLongLong() == info.lastModified().toMSecsSinceEpoch();
+        hit = sameStamp && unpack(query.value(1).toByteArray(), query.value(2).toLongLong(), query.value(3).toInt(), query.value(4).toInt(), waveform);
+    });
+
+    return hit;
+}
+
+void Waveform::writeCache(qint64 songId, const QString &filePath, const Waveform &waveform)
+{
+    QFileInfo info(filePath);
+    QVariantList values = {songId, waveform.pack(), waveform.frames(), waveform.sampleRate(), waveform.framesPerPeak(),
+                           info.size(), info.lastModified().toMSecsSinceEpoch(), QDateTime::currentSecsSinceEpoch()};
+
+    DbManager::instance().post([values](QSqlDatabase &db)
+    {
+        QSqlQuery query(db);
+        if (!query.exec(tableSql)) // a library last scanned before the scanner made it
+        {
+            qWarning() << "waveform table failed:" << query.lastError().text();
+            return false;
+        }
+
+        query.prepare("INSERT OR REPLACE INTO waveforms (song_id, peaks, frames, sample_rate, frames_per_peak, file_size, file_mtime, status, error, created_at) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, 0, NULL, ?)");
+        for (const QVariant &value : values)
+        {
+            query.addBindValue(value);
+        }
+
+        if (!query.exec())
+        {
+            qWarning() << "waveform cache write failed:" << query.lastError().text();
+            return false;
+        }
+        return true;
+    });
+}
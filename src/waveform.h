@@ -0,0 +1,91 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+
+// min/max peak overview of a whole song for the playback seek bar. the base level has one peak per
+// framesPerPeak frames (all channels together), every level above it halves the one below, so drawing at
+// any width only ever touches about as many peaks as there are pixels. only the base level is stored
+// (waveforms table, compressed), the levels above are rebuilt on load since thats a few thousand peaks
+class Waveform
+{
+    public:
+        struct Peak
+        {
+            qint8 min = 0; // top 8 bits of the 16 bit samples, plenty for a few pixels of height
+            qint8 max = 0;
+        };
+
+        // feeds decoded pcm in as it comes, peaks are folded together if the song turns out longer than
+        // expectedFrames said, so the base level never goes over maxPeaks
+        class Builder
+        {
+            public:
+                Builder(int channels, int sampleRate, qint64 expectedFrames = 0);
+
+                void add(const qint16 *samples, int count); // count frames of interleaved pcm
+                Waveform finish();
+
+            private:
+                void fold();
+
+                int channels;
+                int sampleRate;
+                int framesPerPeak;
+                int inPeak; // frames already in the peak being built
+                qint64 frames;
+                qint16 low;
+                qint16 high;
+                QVector<Peak> peaks;
+            };
+
+        Waveform();
+
+        bool isNull() const;
+        qint64 frames() const;
+        int sampleRate() const;
+        qint64 durationMs() const;
+        int framesPerPeak() const;
+
+        int levelCount() const;
+        const QVector<Peak> &level(int index) const; // 0 is the finest
+
+        // exactly buckets peaks across the whole song, read off the coarsest level that still has enough
+        QVector<Peak> overview(int buckets) const;
+
+        // the base level as stored, frames/rate/framesPerPeak go in their own columns
+        QByteArray pack() const;
+        static bool unpack(const QByteArray &packed, qint64 frames, int sampleRate, int framesPerPeak, Waveform *waveform);
+
+        // decodes the whole file at its own rate, no signals, safe from any thread.
+        // cancel is checked between decoded chunks
+        static bool fromFile(const QString &filePath, Waveform *waveform, QString *errorMessage = nullptr,
+                             const std::atomic<bool> *cancel = nullptr, qint64 *bytesRead = nullptr);
+
+        // waveforms table, a row only counts while the file still has the size/mtime it was made from
+        static bool readCache(const QString &filePath, Waveform *waveform, qint64 *songId = nullptr);
+        static void writeCache(qint64 songId, const QString &filePath, const Waveform &waveform);
+
+        // folds count samples into *min / *max, which the caller seeds. sse2/avx2/neon where the build has them
+        static void minMax(const qint16 *samples, int count, qint16 *min, qint16 *max);
+
+        // status 0 = done, 1 = failed (error says why). peaks is pack(), size/mtime are the files stamp when it was made.
+        // in the header so the scanner can create it with the rest of the library schema without linking any of this
+        static constexpr const char *tableSql = "CREATE TABLE IF NOT EXISTS waveforms (song_id INTEGER PRIMARY KEY, peaks BLOB, frames INTEGER, sample_rate INTEGER, "
+                                                "frames_per_peak INTEGER, file_size INTEGER, file_mtime INTEGER, status INTEGER NOT NULL DEFAULT 0, error TEXT, created_at INTEGER)";
+        static const int maxPeaks = 4096;     // base level, ~8kb before compression
+        static const int minFramesPerPeak = 256;
+        static const int topLevelPeaks = 32;  // levels stop halving once they get this small
+
+    private:
+        void buildLevels(QVector<Peak> base);
+
+        qint64 totalFrames;
+        int rate;
+        int peakFrames;
+        QVector<QVector<Peak>> levels;
+    };
+#endif // WAVEFORM_H
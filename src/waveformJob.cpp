@@ -0,0 +1,54 @@
+#include "waveformJob.h"
+#include "waveform.h"
+
+WaveformJob::WaveformJob(QObject *parent) : LibraryJob(spec(), parent)
+{
+}
+
+void WaveformJob::createTable(sqlite3 *db)
+{
+    exec(db, Waveform::tableSql);
+}
+
+int WaveformJob::pendingCount(sqlite3 *db, bool retryFailed)
+{
+    return LibraryJob::pendingCount(spec(), db, retryFailed);
+}
+
+bool WaveformJob::run(const QString &dbPath, const JobOptions &options, Progress *result, const std::atomic<bool> *cancel)
+{
+    return LibraryJob::run(spec(), dbPath, options, result, cancel);
+}
+
+LibraryJob::Spec WaveformJob::spec()
+{
+    Spec spec;
+    spec.name = "waveform";
+    spec.table = "waveforms";
+    spec.columns = QStringList{"peaks", "frames", "sample_rate", "frames_per_peak"};
+    spec.createTables = &WaveformJob::createTable;
+
+    spec.process = [](const Song &song, const std::atomic<bool> *cancel)
+    {
+        Outcome outcome;
+        Waveform waveform;
+        outcome.ok = Waveform::fromFile(song.path, &waveform, &outcome.error, cancel, &outcome.bytesRead);
+        outcome.frames = waveform.frames();
+        if (outcome.ok)
+        {
+            const QByteArray peaks = waveform.pack(); // compressed here on the worker, not on the writer
+            const qint64 frames = waveform.frames();
+            const int sampleRate = waveform.sampleRate();
+            const int framesPerPeak = waveform.framesPerPeak();
+            outcome.bind = [peaks, frames, sampleRate, framesPerPeak](sqlite3_stmt *insert)
+            {
+                sqlite3_bind_blob(insert, 2, peaks.constData(), peaks.size(), SQLITE_TRANSIENT);
+                sqlite3_bind_int64(insert, 3, frames);
+                sqlite3_bind_int(insert, 4, sampleRate);
+                sqlite3_bind_int(insert, 5, framesPerPeak);
+            };
+        }
+        return outcome;
+    };
+    return spec;
+}
@@ -0,0 +1,22 @@
+#ifndef WAVEFORMJOB_H
+#define WAVEFORMJOB_H
+
+#include "libraryJob.h"
+
+// decodes every song in the library db in the background and keeps its Waveform peaks in the waveforms table,
+// so playback can draw the seek bar without decoding anything
+class WaveformJob : public LibraryJob
+{
+    Q_OBJECT
+
+    public:
+        explicit WaveformJob(QObject *parent = nullptr);
+
+        // blocks until every pending song is done or cancel goes true
+        static bool run(const QString &dbPath, const JobOptions &options = JobOptions(), Progress *result = nullptr, const std::atomic<bool> *cancel = nullptr);
+
+        static void createTable(sqlite3 *db);
+        static int pendingCount(sqlite3 *db, bool retryFailed = false);
+        static Spec spec();
+    };
+#endif // WAVEFORMJOB_H
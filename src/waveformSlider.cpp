@@ -0,0 +1,119 @@
+#include "waveformSlider.h"
+#include <QPainter>
+#include <QMouseEvent>
+#include <QStyle>
+
+WaveformSlider::WaveformSlider(QWidget *parent) : QSlider(Qt::Horizontal, parent)
+{
+}
+
+void WaveformSlider::setWaveform(const Waveform &newWaveform)
+{
+    waveform = newWaveform;
+    columns.clear();
+    updateGeometry();
+    update();
+}
+
+void WaveformSlider::clearWaveform()
+{
+    setWaveform(Waveform());
+}
+
+bool WaveformSlider::hasWaveform() const
+{
+    return !waveform.isNull();
+}
+
+QSize WaveformSlider::sizeHint() const
+{
+    QSize size = QSlider::sizeHint();
+    if (hasWaveform())
+    {
+        size.setHeight(qMax(size.height(), 48));
+    }
+    return size;
+}
+
+void WaveformSlider::resizeEvent(QResizeEvent *event)
+{
+    columns.clear(); // new width, new buckets
+    QSlider::resizeEvent(event);
+}
+
+void WaveformSlider::paintEvent(QPaintEvent *event)
+{
+    if (!hasWaveform())
+    {
+        QSlider::paintEvent(event);
+        return;
+    }
+
+    if (columns.size() != width())
+    {
+        columns = waveform.overview(width());
+    }
+
+    QPainter painter(this);
+    const int middle = height() / 2;
+    const double scale = (height() / 2 - 1) / 128.0;
+
+    // everything left of the playhead has been played
+    const int span = maximum() - minimum();
+    const int playhead = span > 0 ? int(qint64(sliderPosition() - minimum()) * (width() - 1) / span) : 0;
+
+    const QColor played = palette().color(QPalette::Highlight);
+    const QColor ahead = palette().color(QPalette::Mid);
+
+    for (int x = 0; x < columns.size(); x++)
+    {
+        painter.setPen(x < playhead ? played : ahead);
+        painter.drawLine(x, middle - int(columns[x].max * scale), x, middle - int(columns[x].min * scale));
+    }
+
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawLine(playhead, 0, playhead, height() - 1);
+}
+
+int WaveformSlider::valueAt(int x) const
+{
+    return QStyle::sliderValueFromPosition(minimum(), maximum(), x, width());
+}
+
+// the whole bar is the groove, so jump straight to where it was clicked instead of paging towards it
+void WaveformSlider::mousePressEvent(QMouseEvent *event)
+{
+    if (!hasWaveform() || event->button() != Qt::LeftButton)
+    {
+        QSlider::mousePressEvent(event);
+        return;
+    }
+
+    setSliderDown(true);
+    setSliderPosition(valueAt(event->position().toPoint().x())); // sliderMoved goes out while it is down
+    event->accept();
+}
+
+void WaveformSlider::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!hasWaveform() || !isSliderDown())
+    {
+        QSlider::mouseMoveEvent(event);
+        return;
+    }
+
+    setSliderPosition(valueAt(event->position().toPoint().x()));
+    event->accept();
+}
+
+void WaveformSlider::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!hasWaveform() || !isSliderDown())
+    {
+        QSlider::mouseReleaseEvent(event);
+        return;
+    }
+
+    setSliderDown(false);
+    event->accept();
+}
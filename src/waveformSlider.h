@@ -0,0 +1,38 @@
+#ifndef WAVEFORMSLIDER_H
+#define WAVEFORMSLIDER_H
+
+#include <QSlider>
+#include <QVector>
+#include "waveform.h"
+
+// the playback seek bar. with a waveform set it draws the song's min/max peaks, the played part in the accent
+// colour, and a click or drag anywhere on it seeks there. without one it is a plain QSlider.
+// the peaks for the current width are worked out once and kept, a repaint only draws lines
+class WaveformSlider : public QSlider
+{
+    Q_OBJECT
+
+public:
+    explicit WaveformSlider(QWidget *parent = nullptr);
+
+    void setWaveform(const Waveform &waveform);
+    void clearWaveform();
+    bool hasWaveform() const;
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+private:
+    int valueAt(int x) const;
+
+    Waveform waveform;
+    QVector<Waveform::Peak> columns; // one per pixel of width, empty until the next paint needs them
+};
+
+#endif // WAVEFORMSLIDER_H
@@ -0,0 +1,156 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "../src/libScan.h"
+
+class BenchmarkLavender : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void benchmark_scanWritePath();
+    void cleanupTestCase();
+
+private:
+    QTemporaryDir tempDir;
+    QString libraryPath;
+    int fileCount;
+
+    void createSyntheticLibrary(int files, int filesPerAlbum);
+    QJsonObject runScan(const QString& label, const LibScan::ScanOptions& options);
+    void writeResultsToJson(const QString& filename, const QJsonObject& data);
+};
+
+void BenchmarkLavender::initTestCase()
+{
+    QVERIFY(tempDir.isValid());
+
+    // LAVENDER_BENCH_FILES shrinks the tree for quick local runs
+    fileCount = qEnvironmentVariableIntValue("LAVENDER_BENCH_FILES");
+    if (fileCount <= 0) {
+        fileCount = 100000;
+    }
+
+    libraryPath = tempDir.path() + "/library";
+    QDir().mkpath(libraryPath);
+
+    QElapsedTimer timer;
+    timer.start();
+    createSyntheticLibrary(fileCount, 100);
+    qDebug() << "Synthetic library of" << fileCount << "files created in" << timer.elapsed() << "ms";
+}
+
+void BenchmarkLavender::createSyntheticLibrary(int files, int filesPerAlbum)
+{
+    // smallest valid wav taglib will open: riff header, fmt chunk and a 4 byte data chunk
+    QByteArray wav;
+    QDataStream stream(&wav, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    stream.writeRawData("RIFF", 4);
+    stream << quint32(36 + 4);
+    stream.writeRawData("WAVE", 4);
+    stream.writeRawData("fmt ", 4);
+    stream << quint32(16) << quint16(1) << quint16(2)   // pcm, stereo
+           << quint32(44100) << quint32(44100 * 4)      // sample rate, byte rate
+           << quint16(4) << quint16(16);                // block align, bits
+    stream.writeRawData("data", 4);
+    stream << quint32(4) << qint16(0) << qint16(0);
+
+    for (int i = 0; i < files; i++) {
+        QString albumDir = QString("%1/album_%2").arg(libraryPath).arg(i / filesPerAlbum, 5, 10, QChar('0'));
+        if (i % filesPerAlbum == 0) {
+            QDir().mkpath(albumDir);
+        }
+
+        QFile file(QString("%1/track_%2.wav").arg(albumDir).arg(i % filesPerAlbum, 3, 10, QChar('0')));
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(wav);
+        }
+    }
+}
+
+QJsonObject BenchmarkLavender::runScan(const QString& label, const LibScan::ScanOptions& options)
+{
+    QString dbPath = QString("%1/%2.db").arg(tempDir.path(), label);
+
+    LibScan::ScanStats stats;
+    bool success = LibScan::scanMusicLibrary(libraryPath, dbPath, options, &stats);
+
+    double rowsPerSec = stats.writeMs > 0 ? (stats.songsWritten + stats.albums) * 1000.0 / stats.writeMs : 0;
+
+    qDebug() << label << ":" << stats.songsWritten << "songs," << stats.albums << "albums,"
+             << "write" << stats.writeMs << "ms, parse" << stats.parseMs << "ms, total" << stats.elapsedMs << "ms,"
+             << rowsPerSec << "rows/sec";
+
+    QJsonObject result;
+    result["label"] = label;
+    result["success"] = success;
+    result["batch_size"] = options.batchSize;
+    result["tuned_pragmas"] = options.tunePragmas;
+    result["songs"] = stats.songsWritten;
+    result["albums"] = stats.albums;
+    result["write_ms"] = stats.writeMs;
+    result["parse_ms"] = stats.parseMs;
+    result["elapsed_ms"] = stats.elapsedMs;
+    result["rows_per_sec"] = rowsPerSec;
+    return result;
+}
+
+void BenchmarkLavender::benchmark_scanWritePath()
+{
+    // before: one statement per row in autocommit with the default rollback journal. not the scanner as it was,
+    // both runs reuse the same cached prepared statements, so this is only what batching and the pragmas buy
+    LibScan::ScanOptions before;
+    before.incremental = false;
+    before.batchSize = 1;
+    before.tunePragmas = false;
+
+    // after: batched transactions on a wal db
+    LibScan::ScanOptions after;
+    after.incremental = false;
+
+    QJsonObject beforeResult = runScan("autocommit", before);
+    QJsonObject afterResult = runScan("batched", after);
+
+    QVERIFY(beforeResult["success"].toBool());
+    QVERIFY(afterResult["success"].toBool());
+    QCOMPARE(afterResult["songs"].toInt(), beforeResult["songs"].toInt());
+
+    double speedup = beforeResult["rows_per_sec"].toDouble() > 0
+        ? afterResult["rows_per_sec"].toDouble() / beforeResult["rows_per_sec"].toDouble() : 0;
+    qDebug() << "Write path speedup:" << speedup << "x (batching + pragmas only, both runs use cached prepared statements)";
+
+    QJsonArray runs;
+    runs.append(beforeResult);
+    runs.append(afterResult);
+
+    QJsonObject resultData;
+    resultData["files"] = fileCount;
+    resultData["scan_write_path"] = runs;
+    resultData["speedup"] = speedup;
+    resultData["speedup_measures"] = "batching and pragmas only, the autocommit baseline also reuses cached prepared statements";
+    writeResultsToJson("benchmark_scan_write_path.json", resultData);
+}
+
+void BenchmarkLavender::writeResultsToJson(const QString& filename, const QJsonObject& data)
+{
+    QFile file(filename);
+    if (file.open(QIODevice::WriteOnly)) {
+        QJsonDocument doc(data);
+        file.write(doc.toJson());
+    }
+}
+
+void BenchmarkLavender::cleanupTestCase()
+{
+}
+
+QTEST_MAIN(BenchmarkLavender)
+#include "benchmark.moc"
@@ -6,7 +6,11 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QTemporaryDir>
+#include <QStandardPaths>
 #include "../src/audiofingerprint.h"
+#include "../src/acoustIdClient.h"
+#include "fakeAcoustIdServer.h"
 
 class BenchmarkAudioFingerprint : public QObject
 {
@@ -17,6 +21,7 @@ private slots:
     void benchmark_fingerprintGeneration();
     void benchmark_apiLookup();
     void benchmark_largeDataset();
+    void benchmark_batchedLookup();
     void cleanupTestCase();
 
 private:
@@ -33,12 +38,6 @@ void BenchmarkAudioFingerprint::initTestCase()
     qDebug() << "Initializing AudioFingerprint benchmark";
     fingerprinter = new AudioFingerprint(this);
     
-    // check if fpcalc is installed
-    QProcess checkProcess;
-    checkProcess.start("which", QStringList() << "fpcalc");
-    checkProcess.waitForFinished();
-    QVERIFY2(checkProcess.exitCode() == 0, "fpcalc is not installed, skipping benchmarks");
-
     // get test files
     testFiles = getTestFiles();
     if (testFiles.isEmpty()) {
@@ -102,8 +101,17 @@ void BenchmarkAudioFingerprint::benchmark_fingerprintGeneration()
         }
     }
     
+    // per file latency, the number to compare against the old fpcalc runs
+    qint64 totalMs = 0;
+    for (const QJsonValue &result : results) {
+        totalMs += result.toObject()["time_ms"].toInteger();
+    }
+    double meanMs = results.isEmpty() ? 0.0 : double(totalMs) / results.size();
+    qDebug() << "mean fingerprint time per file:" << meanMs << "ms";
+
     QJsonObject resultData;
     resultData["fingerprint_generation"] = results;
+    resultData["mean_ms_per_file"] = meanMs;
     writeResultsToJson("benchmark_fingerprint_generation.json", resultData);
 }
 
@@ -221,6 +229,68 @@ void BenchmarkAudioFingerprint::benchmark_largeDataset()
     qDebug() << "Average time per file:" << (processedFiles > 0 ? totalProcessingTime / processedFiles : 0) << "ms";
 }
 
+// offline against the local stand in server, at the real 3 req/s limit: what batching buys a library wide lookup
+void BenchmarkAudioFingerprint::benchmark_batchedLookup()
+{
+    QTemporaryDir cacheDir; // cold cache, every lookup goes out
+    QVERIFY(cacheDir.isValid());
+
+    FakeAcoustIdServer server;
+    server.latencyMs = 50; // roughly a round trip to acoustid
+
+    AcoustIdClient &client = AcoustIdClient::instance();
+    QUrl realServer = client.serverUrl();
+    client.setServerUrl(server.url());
+    client.setCacheDirectory(cacheDir.path());
+    client.setRateLimit(3);
+
+    const int lookups = 12;
+    QJsonArray results;
+
+    for (int batch : {1, 5, 20})
+    {
+        client.setBatchSize(batch);
+        server.reset();
+
+        QList<AcoustIdReply *> replies;
+        QList<QSharedPointer<QSignalSpy>> spies;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < lookups; i++)
+        {
+            replies.append(client.lookup(QString("bench-%1-%2").arg(batch).arg(i).toUtf8(), 200));
+            spies.append(QSharedPointer<QSignalSpy>::create(replies.last(), &AcoustIdReply::finished));
+        }
+        for (const QSharedPointer<QSignalSpy> &spy : spies)
+        {
+            QVERIFY(spy->count() > 0 || spy->wait(20000));
+        }
+        qint64 elapsed = timer.elapsed();
+        qDeleteAll(replies);
+
+        double perSecond = elapsed > 0 ? lookups * 1000.0 / elapsed : 0.0;
+        qDebug() << "batch size" << batch << ":" << lookups << "lookups in" << server.requests << "requests," << elapsed << "ms,"
+                 << perSecond << "lookups/s";
+
+        QJsonObject result;
+        result["batch_size"] = batch;
+        result["lookups"] = lookups;
+        result["requests"] = server.requests;
+        result["time_ms"] = elapsed;
+        result["lookups_per_second"] = perSecond;
+        results.append(result);
+    }
+
+    client.setBatchSize(20);
+    client.setServerUrl(realServer);
+    client.setCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/acoustid");
+
+    QJsonObject resultData;
+    resultData["batched_lookup"] = results;
+    writeResultsToJson("benchmark_batched_lookup.json", resultData);
+}
+
 void BenchmarkAudioFingerprint::cleanupTestCase()
 {
     delete fingerprinter;
@@ -0,0 +1,146 @@
+#ifndef FAKEACOUSTIDSERVER_H
+#define FAKEACOUSTIDSERVER_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QStringList>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+// stand in for api.acoustid.org/v2/lookup so lookups can be tested and timed offline.
+// takes the batched form POST, answers every fingerprint.N with one made up result whose id is the
+// fingerprint itself (so tests can check answers land on the right lookup), "unknown" gets no results
+class FakeAcoustIdServer : public QObject
+{
+    public:
+        FakeAcoustIdServer()
+        {
+            connect(&server, &QTcpServer::newConnection, this, [this]()
+            {
+                while (QTcpSocket *socket = server.nextPendingConnection())
+                {
+                    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { read(socket); });
+                    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+                }
+            });
+            server.listen(QHostAddress::LocalHost);
+            clock.start();
+        }
+
+        QUrl url() const
+        {
+            return QUrl(QString("http://127.0.0.1:%1/v2/lookup").arg(server.serverPort()));
+        }
+
+        void reset()
+        {
+            requests = 0;
+            lookups = 0;
+            batchSizes.clear();
+            arrivals.clear();
+            thresholds.clear();
+        }
+
+        int latencyMs = 0;          // how long the "server" thinks before answering
+        int requests = 0;
+        int lookups = 0;            // fingerprints across all requests
+        QList<int> batchSizes;
+        QList<qint64> arrivals;     // ms since the server started
+        QStringList thresholds;     // the threshold each request asked for, empty if it didnt
+        QElapsedTimer clock;
+
+    private:
+        void read(QTcpSocket *socket)
+        {
+            QByteArray &buffer = buffers[socket];
+            buffer += socket->readAll();
+
+            int end;
+            while ((end = buffer.indexOf("\r\n\r\n")) >= 0)
+            {
+                // wait for the whole form body before answering
+                QByteArray head = buffer.left(end).toLower();
+                int lengthAt = head.indexOf("content-length:");
+                int length = lengthAt < 0 ? 0 : head.mid(lengthAt + 15, head.indexOf("\r\n", lengthAt) - lengthAt - 15).trimmed().toInt();
+                if (buffer.size() < end + 4 + length)
+                {
+                    return;
+                }
+
+                QByteArray body = buffer.mid(end + 4, length);
+                buffer.remove(0, end + 4 + length);
+                answer(socket, body);
+            }
+        }
+
+        void answer(QTcpSocket *socket, const QByteArray &body)
+        {
+            QUrlQuery form(QString::fromUtf8(body));
+
+            QJsonArray fingerprints;
+            for (int i = 0; form.hasQueryItem(QString("fingerprint.%1").arg(i)); i++)
+            {
+                QString fingerprint = form.queryItemValue(QString("fingerprint.%1").arg(i), QUrl::FullyDecoded);
+
+                QJsonArray results;
+                if (fingerprint != "unknown")
+                {
+                    QJsonObject recording;
+                    recording["id"] = "recording-" + fingerprint;
+                    recording["title"] = fingerprint;
+
+                    QJsonObject result;
+                    result["id"] = fingerprint;
+                    result["score"] = 0.98;
+                    result["recordings"] = QJsonArray{recording};
+                    results.append(result);
+                }
+
+                QJsonObject entry;
+                entry["index"] = QString::number(i); // acoustid sends it back as a string
+                entry["results"] = results;
+                fingerprints.append(entry);
+            }
+
+            requests++;
+            lookups += fingerprints.size();
+            batchSizes.append(fingerprints.size());
+            arrivals.append(clock.elapsed());
+            thresholds.append(form.queryItemValue("threshold"));
+
+            QJsonObject response;
+            if (form.queryItemValue("client").isEmpty())
+            {
+                response["status"] = "error";
+                response["error"] = QJsonObject{{"code", 4}, {"message", "invalid API key"}};
+            }
+            else
+            {
+                response["status"] = "ok";
+                response["fingerprints"] = fingerprints;
+            }
+
+            QByteArray json = QJsonDocument(response).toJson(QJsonDocument::Compact);
+            QByteArray reply = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: " +
+                               QByteArray::number(json.size()) + "\r\n\r\n" + json;
+
+            QPointer<QTcpSocket> target(socket);
+            QTimer::singleShot(latencyMs, this, [target, reply]()
+            {
+                if (target)
+                {
+                    target->write(reply);
+                }
+            });
+        }
+
+        QTcpServer server;
+        QHash<QTcpSocket *, QByteArray> buffers;
+    };
+#endif // FAKEACOUSTIDSERVER_H
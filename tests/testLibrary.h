@@ -0,0 +1,139 @@
+#ifndef TESTLIBRARY_H
+#define TESTLIBRARY_H
+
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <functional>
+#include "../src/libScan.h"
+
+// what the library and audio tests share: wav files made from a sample function, and a music library in a
+// temp dir that gets scanned into its own db, which the test then reads through a named connection
+
+// 16 bit pcm wav, sample(frame, channel) for every sample. false if the file cant be written
+inline bool writeWav(const QString &path, int rate, int channels, qint64 frames, const std::function<qint16(qint64 frame, int channel)> &sample)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    const quint32 dataSize = quint32(frames * channels * 2);
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out.writeRawData("RIFF", 4);
+    out << quint32(36 + dataSize);
+    out.writeRawData("WAVEfmt ", 8);
+    out << quint32(16) << quint16(1) << quint16(channels) << quint32(rate) << quint32(rate * channels * 2) << quint16(channels * 2) << quint16(16);
+    out.writeRawData("data", 4);
+    out << dataSize;
+
+    for (qint64 frame = 0; frame < frames; frame++)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            out << sample(frame, channel);
+        }
+    }
+    return out.status() == QDataStream::Ok;
+}
+
+class TestLibrary
+{
+    public:
+        explicit TestLibrary(const QString &connection) : connection(connection)
+        {
+        }
+
+        ~TestLibrary()
+        {
+            if (QSqlDatabase::contains(connection))
+            {
+                QSqlDatabase::database(connection, false).close();
+                QSqlDatabase::removeDatabase(connection);
+            }
+        }
+
+        bool isValid() const
+        {
+            return dir.isValid() && QDir().mkpath(musicPath());
+        }
+
+        QString tempPath() const // outside the library, for files the scan shouldnt see
+        {
+            return dir.path();
+        }
+
+        QString dbPath() const
+        {
+            return dir.filePath("library.db");
+        }
+
+        QString musicPath() const
+        {
+            return dir.filePath("music");
+        }
+
+        QString path(const QString &relative) const // into the library, its folder is made if need be
+        {
+            const QString path = musicPath() + "/" + relative;
+            QDir().mkpath(QFileInfo(path).absolutePath());
+            return path;
+        }
+
+        // not audio at all, decoding it has to fail without stopping whatever reads it
+        bool addBroken(const QString &relative)
+        {
+            QFile broken(path(relative));
+            return broken.open(QIODevice::WriteOnly) && broken.write(QByteArray(4096, 'x')) == 4096;
+        }
+
+        // scans the library into the db, the first time also opens the test's connection to it
+        bool scan()
+        {
+            if (!LibScan::scanMusicLibrary(musicPath(), dbPath()))
+            {
+                return false;
+            }
+            if (QSqlDatabase::contains(connection))
+            {
+                return true;
+            }
+
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+            db.setDatabaseName(dbPath());
+            return db.open();
+        }
+
+        QSqlDatabase db() const
+        {
+            return QSqlDatabase::database(connection);
+        }
+
+        int rows(const QString &table, const QString &where = "1") const
+        {
+            QSqlQuery query(db());
+            if (!query.exec(QString("SELECT COUNT(*) FROM %1 WHERE %2").arg(table, where)) || !query.next())
+            {
+                return -1;
+            }
+            return query.value(0).toInt();
+        }
+
+        bool exec(const QString &sql) const
+        {
+            QSqlQuery query(db());
+            return query.exec(sql);
+        }
+
+    private:
+        QTemporaryDir dir;
+        QString connection;
+    };
+#endif // TESTLIBRARY_H
@@ -7,6 +7,7 @@
 #include <QFile>
 #include <QTemporaryDir>
 #include "../src/libScan.h"
+#include "../src/dbManager.h"
 
 class TestLibScan : public QObject
 {
@@ -22,6 +23,12 @@ private slots:
     void testScanNestedDirectories();
     void testRescanWithAddedFiles();
     void testNonAudioFilesIgnored();
+    void testParallelScanMatchesSerial();
+    void testRescanIsStable();
+    void testRescanRemovesDeletedFiles();
+    void testSyncDirectoriesAddsAndRemoves();
+    void testRecoIndexFollowsSongs();
+    void testMigratesTextSchema();
 
 private:
     LibScan* scanner;
@@ -30,6 +37,7 @@ private:
     
     void createTestAudioFile(const QString& path, bool valid = true);
     void verifyDatabaseTable(const QString& tableName, int expectedRowCount);
+    int tableRowCount(const QString& tableName);
 };
 
 void TestLibScan::initTestCase()
@@ -104,6 +112,23 @@ void TestLibScan::verifyDatabaseTable(const QString& tableName, int expectedRowC
     QCOMPARE(count, expectedRowCount);
 }
 
+int TestLibScan::tableRowCount(const QString& tableName)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "rowCount");
+    db.setDatabaseName(dbPath);
+    db.open();
+    QSqlQuery query(db);
+    query.exec("SELECT COUNT(*) FROM " + tableName);
+    query.next();
+    int count = query.value(0).toInt();
+    query.finish();
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("rowCount");
+
+    return count;
+}
+
 void TestLibScan::testDatabaseInitialization()
 {
     bool success = scanner->scanMusicLibrary(tempDir.path(), dbPath);
@@ -227,5 +252,212 @@ void TestLibScan::testNonAudioFilesIgnored()
     verifyDatabaseTable("songs", initialCount);
 }
 
+void TestLibScan::testParallelScanMatchesSerial()
+{
+    // same tree through one worker and through several, row counts should line up
+    QString serialDbPath = tempDir.path() + "/serial.db";
+    QString parallelDbPath = tempDir.path() + "/parallel.db";
+
+    LibScan::ScanOptions serialOptions;
+    serialOptions.threadCount = 1;
+
+    LibScan::ScanOptions parallelOptions;
+    parallelOptions.threadCount = 4;
+    parallelOptions.queueCapacity = 2; // force workers to wait on the writer
+
+    QVERIFY(LibScan::scanMusicLibrary(tempDir.path(), serialDbPath, serialOptions));
+    QVERIFY(LibScan::scanMusicLibrary(tempDir.path(), parallelDbPath, parallelOptions));
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "parallelCheck");
+    QStringList tables = {"albums", "songs"};
+
+    for (const QString &table : tables)
+    {
+        db.setDatabaseName(serialDbPath);
+        QVERIFY(db.open());
+        QSqlQuery serialQuery(db);
+        QVERIFY(serialQuery.exec("SELECT COUNT(*) FROM " + table));
+        QVERIFY(serialQuery.next());
+        int serialCount = serialQuery.value(0).toInt();
+        db.close();
+
+        db.setDatabaseName(parallelDbPath);
+        QVERIFY(db.open());
+        QSqlQuery parallelQuery(db);
+        QVERIFY(parallelQuery.exec("SELECT COUNT(*) FROM " + table));
+        QVERIFY(parallelQuery.next());
+        int parallelCount = parallelQuery.value(0).toInt();
+        db.close();
+
+        QCOMPARE(parallelCount, serialCount);
+    }
+
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("parallelCheck");
+}
+
+void TestLibScan::testRescanIsStable()
+{
+    // nothing changed on disk, a second pass must not add or drop rows
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+    int songs = tableRowCount("songs");
+    int albums = tableRowCount("albums");
+
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+    verifyDatabaseTable("songs", songs);
+    verifyDatabaseTable("albums", albums);
+}
+
+void TestLibScan::testRescanRemovesDeletedFiles()
+{
+    QDir dir(tempDir.path());
+    dir.mkdir("album3");
+    createTestAudioFile(tempDir.path() + "/album3/gone.mp3");
+
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+    int songs = tableRowCount("songs");
+    int albums = tableRowCount("albums");
+
+    // whatever album3 added has to disappear again once the dir is gone
+    QDir(tempDir.path() + "/album3").removeRecursively();
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+
+    QVERIFY(tableRowCount("songs") <= songs);
+    verifyDatabaseTable("albums", albums - 1);
+}
+
+void TestLibScan::testSyncDirectoriesAddsAndRemoves()
+{
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+    int albums = tableRowCount("albums");
+
+    // new dir only shows up through the root being dirty, like a watcher event on the parent
+    QDir(tempDir.path()).mkdir("album4");
+    createTestAudioFile(tempDir.path() + "/album4/new.mp3");
+
+    LibScan::LibraryChanges changes;
+    QVERIFY(LibScan::syncDirectories(tempDir.path(), dbPath, {tempDir.path(), tempDir.path() + "/album4"}, &changes));
+    QCOMPARE(changes.addedAlbums.size(), 1);
+    QCOMPARE(changes.addedAlbums.first().second, QFileInfo(tempDir.path() + "/album4").absoluteFilePath());
+    verifyDatabaseTable("albums", albums + 1);
+
+    QDir(tempDir.path() + "/album4").removeRecursively();
+
+    changes = LibScan::LibraryChanges();
+    QVERIFY(LibScan::syncDirectories(tempDir.path(), dbPath, {tempDir.path() + "/album4"}, &changes));
+    QCOMPARE(changes.removedAlbums.size(), 1);
+    verifyDatabaseTable("albums", albums);
+}
+
+void TestLibScan::testRecoIndexFollowsSongs()
+{
+    QDir dir(tempDir.path());
+    dir.mkdir("album4");
+    createTestAudioFile(tempDir.path() + "/album4/reco.mp3");
+
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+    verifyDatabaseTable("reco_meta", 1);
+
+    // every song has its terms and nothing points at a song that isnt there
+    QCOMPARE(tableRowCount("songs WHERE id NOT IN (SELECT song_id FROM reco_vectors)"), 0);
+    QCOMPARE(tableRowCount("reco_vectors WHERE song_id NOT IN (SELECT id FROM songs)"), 0);
+
+    QDir(tempDir.path() + "/album4").removeRecursively();
+    QVERIFY(scanner->scanMusicLibrary(tempDir.path(), dbPath));
+
+    QCOMPARE(tableRowCount("reco_vectors WHERE song_id NOT IN (SELECT id FROM songs)"), 0);
+    QCOMPARE(tableRowCount("reco_terms WHERE df <= 0"), 0);
+
+    // tags the removed songs were the last users of go with them
+    QCOMPARE(tableRowCount("artists WHERE id NOT IN (SELECT artist_id FROM songs WHERE artist_id IS NOT NULL)"), 0);
+    QCOMPARE(tableRowCount("genres WHERE id NOT IN (SELECT genre_id FROM songs WHERE genre_id IS NOT NULL)"), 0);
+}
+
+void TestLibScan::testMigratesTextSchema()
+{
+    // a db from before the dimension tables, tags as text on every row and no stamp columns yet
+    const QString oldDbPath = tempDir.path() + "/old_schema.db";
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "oldSchema");
+        db.setDatabaseName(oldDbPath);
+        QVERIFY(db.open());
+
+        QSqlQuery query(db);
+        QVERIFY(query.exec("CREATE TABLE albums (id INTEGER PRIMARY KEY, name TEXT, path TEXT)"));
+        QVERIFY(query.exec("CREATE TABLE songs (id INTEGER PRIMARY KEY, album_id INTEGER, name TEXT, artist TEXT, album TEXT, genre TEXT, path TEXT)"));
+        QVERIFY(query.exec("INSERT INTO albums (id, name, path) VALUES (1, 'opera', '/music/opera'), (2, 'kind', '/music/kind')"));
+        QVERIFY(query.exec("INSERT INTO songs (id, album_id, name, artist, album, genre, path) VALUES "
+                           "(10, 1, 'Bohemian Rhapsody', 'Queen', 'A Night at the Opera', 'Rock', '/music/opera/1.flac'),"
+                           "(11, 1, 'Love of My Life', 'Queen', 'A Night at the Opera', 'Rock', '/music/opera/2.flac'),"
+                           "(20, 2, 'So What', 'Miles Davis', 'Kind of Blue', 'Jazz', '/music/kind/1.flac'),"
+                           "(21, 2, 'untagged', NULL, NULL, NULL, '/music/kind/2.flac')"));
+        query.finish();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("oldSchema");
+
+    // opening it through the scanner migrates in place, no dirs so nothing on disk is looked at
+    QVERIFY(LibScan::syncDirectories(tempDir.path(), oldDbPath, QStringList()));
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "migrated");
+    db.setDatabaseName(oldDbPath);
+    QVERIFY(db.open());
+    {
+        QSqlQuery query(db);
+
+        QVERIFY(query.exec("SELECT MAX(version) FROM schema_version") && query.next());
+        QCOMPARE(query.value(0).toInt(), 2);
+
+        QStringList columns;
+        QVERIFY(query.exec("PRAGMA table_info(songs)"));
+        while (query.next())
+        {
+            columns.append(query.value(1).toString());
+        }
+        QVERIFY(columns.contains("artist_id") && columns.contains("genre_id") && columns.contains("file_inode"));
+        QVERIFY(!columns.contains("artist"));
+
+        QVERIFY(query.exec("SELECT (SELECT COUNT(*) FROM artists), (SELECT COUNT(*) FROM genres), (SELECT COUNT(*) FROM album_titles)") && query.next());
+        QCOMPARE(query.value(0).toInt(), 2); // repeated tags stored once
+        QCOMPARE(query.value(1).toInt(), 2);
+        QCOMPARE(query.value(2).toInt(), 2);
+
+        // same ids, same text once resolved, missing tags stay missing
+        QVERIFY(query.exec("SELECT id, name, artist, album, genre FROM song_details ORDER BY id"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toLongLong(), qint64(10));
+        QCOMPARE(query.value(2).toString(), QString("Queen"));
+        QCOMPARE(query.value(3).toString(), QString("A Night at the Opera"));
+        QVERIFY(query.next() && query.next());
+        QCOMPARE(query.value(0).toLongLong(), qint64(20));
+        QCOMPARE(query.value(4).toString(), QString("Jazz"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toLongLong(), qint64(21));
+        QVERIFY(query.value(2).isNull());
+
+        // search index was rebuilt over the view
+        QVERIFY(query.exec("SELECT COUNT(*) FROM songs_fts WHERE songs_fts MATCH 'queen'") && query.next());
+        QCOMPARE(query.value(0).toInt(), 2);
+
+        // hot lookups answered from the indexes alone
+        QVERIFY(query.exec("EXPLAIN QUERY PLAN SELECT artist_id, album_id FROM songs WHERE genre_id = 1") && query.next());
+        QVERIFY2(query.value(3).toString().contains("COVERING INDEX idx_songs_genre"), qPrintable(query.value(3).toString()));
+        QVERIFY(query.exec("EXPLAIN QUERY PLAN SELECT album_id FROM songs WHERE artist_id = 1") && query.next());
+        QVERIFY2(query.value(3).toString().contains("COVERING INDEX idx_songs_artist"), qPrintable(query.value(3).toString()));
+    }
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("migrated");
+
+    DbManager::instance().setDatabasePath(oldDbPath);
+    QCOMPARE(DbManager::instance().songsForArtist("Queen").size(), 2);
+    QCOMPARE(DbManager::instance().songsForGenre("Jazz").size(), 1);
+    QCOMPARE(DbManager::instance().song(11).artist, QString("Queen"));
+
+    // a second open leaves the migrated db alone
+    QVERIFY(LibScan::syncDirectories(tempDir.path(), oldDbPath, QStringList()));
+    QCOMPARE(DbManager::instance().songs().size(), 4);
+}
+
 QTEST_MAIN(TestLibScan)
-#include "test_libscan.moc"
\ No newline at end of file
+#include "test_libscan.moc"
@@ -0,0 +1,206 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include <QPixmap>
+#include <QImage>
+#include "../src/albumModel.h"
+#include "../src/thumbnailCache.h"
+#include "../src/dbManager.h"
+#include "testLibrary.h"
+
+// the main menu's model over a scanned temp library. covers come off the pool, so every check on a
+// decoration waits for the dataChanged that says it arrived
+class TestAlbumModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testRowsFromLibrary();
+    void testPlaceholderThenCover();
+    void testAlbumWithoutArt();
+    void testAddAndRemove();
+    void testRefreshPicksUpNewCover();
+
+private:
+    bool addAlbum(const QString &name, const QColor &cover);
+    bool writeCover(const QString &albumDir, const QColor &color);
+    int rowOf(const AlbumModel &model, const QString &albumPath);
+    QColor coverColour(const AlbumModel &model, int row);
+
+    TestLibrary library{"albummodel"};
+};
+
+bool TestAlbumModel::addAlbum(const QString &name, const QColor &cover)
+{
+    const bool written = writeWav(library.path(name + "/song.wav"), 8000, 1, 800, [](qint64, int) { return qint16(0); });
+    return written && (!cover.isValid() || writeCover(library.path(name), cover));
+}
+
+bool TestAlbumModel::writeCover(const QString &albumDir, const QColor &color)
+{
+    QImage image(300, 300, QImage::Format_RGB32);
+    image.fill(color);
+    return image.save(albumDir + "/cover.png");
+}
+
+int TestAlbumModel::rowOf(const AlbumModel &model, const QString &albumPath)
+{
+    for (int row = 0; row < model.rowCount(); row++)
+    {
+        if (model.data(model.index(row), AlbumModel::AlbumPathRole).toString() == albumPath)
+        {
+            return row;
+        }
+    }
+    return -1;
+}
+
+QColor TestAlbumModel::coverColour(const AlbumModel &model, int row)
+{
+    const QImage image = model.data(model.index(row), Qt::DecorationRole).value<QPixmap>().toImage();
+    return image.pixelColor(image.width() / 2, image.height() / 2);
+}
+
+void TestAlbumModel::initTestCase()
+{
+    QVERIFY(library.isValid());
+    QVERIFY(addAlbum("red", Qt::red));
+    QVERIFY(addAlbum("blue", Qt::blue));
+    QVERIFY(addAlbum("bare", QColor())); // no art at all
+    QVERIFY(library.scan());
+
+    ThumbnailCache::instance().setCacheDirectory(library.tempPath() + "/thumbnails");
+    DbManager::instance().setDatabasePath(library.dbPath());
+}
+
+void TestAlbumModel::testRowsFromLibrary()
+{
+    AlbumModel model;
+    QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+    model.setAlbums(DbManager::instance().albums());
+
+    QCOMPARE(reset.count(), 1);
+    QCOMPARE(model.rowCount(), 3);
+    QVERIFY(rowOf(model, library.path("red")) >= 0);
+    QVERIFY(rowOf(model, library.path("bare")) >= 0);
+    QCOMPARE(model.rowCount(model.index(0)), 0); // a list, rows have no children
+
+    const int row = rowOf(model, library.path("blue"));
+    QCOMPARE(model.data(model.index(row), AlbumModel::AlbumNameRole).toString(), QString("blue"));
+    QVERIFY(model.data(model.index(row), AlbumModel::AlbumIdRole).toLongLong() > 0);
+    QVERIFY(!model.data(model.index(model.rowCount()), Qt::DisplayRole).isValid());
+}
+
+void TestAlbumModel::testPlaceholderThenCover()
+{
+    AlbumModel model;
+    model.setAlbums(DbManager::instance().albums());
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+    const int row = rowOf(model, library.path("red"));
+    const QPixmap first = model.data(model.index(row), Qt::DecorationRole).value<QPixmap>();
+    QVERIFY(!first.isNull());
+    QVERIFY(first.toImage().pixelColor(first.width() / 2, first.height() / 2) != QColor(Qt::red)); // the placeholder
+
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(changed[0][0].value<QModelIndex>().row(), row);
+    QCOMPARE(changed[0][2].value<QList<int>>(), QList<int>{Qt::DecorationRole});
+
+    const QPixmap cover = model.data(model.index(row), Qt::DecorationRole).value<QPixmap>();
+    QCOMPARE(cover.size(), QSize(AlbumModel::coverSize, AlbumModel::coverSize));
+    QCOMPARE(coverColour(model, row), QColor(Qt::red));
+
+    // cached now, asking again doesnt queue another decode
+    model.data(model.index(row), Qt::DecorationRole);
+    QTest::qWait(100);
+    QCOMPARE(changed.count(), 1);
+}
+
+void TestAlbumModel::testAlbumWithoutArt()
+{
+    AlbumModel model;
+    model.setAlbums(DbManager::instance().albums());
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+    const int row = rowOf(model, library.path("bare"));
+    const QPixmap placeholder = model.data(model.index(row), Qt::DecorationRole).value<QPixmap>();
+    QTRY_COMPARE(changed.count(), 1);
+
+    // settles on the placeholder instead of asking the pool over and over
+    QCOMPARE(model.data(model.index(row), Qt::DecorationRole).value<QPixmap>().toImage(), placeholder.toImage());
+    QTest::qWait(100);
+    QCOMPARE(changed.count(), 1);
+}
+
+void TestAlbumModel::testAddAndRemove()
+{
+    AlbumModel model;
+    model.setAlbums(DbManager::instance().albums());
+    QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+    QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+
+    QVERIFY(addAlbum("green", Qt::green));
+    const QString green = library.path("green");
+    model.addAlbum("green", green);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(model.rowCount(), 4);
+    QCOMPARE(rowOf(model, green), 3);
+
+    model.addAlbum("green", green); // the watcher can report one twice
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(model.rowCount(), 4);
+
+    // rows after the removed one move up and still find their covers
+    const QString red = library.path("red");
+    const int redRow = rowOf(model, red);
+    model.removeAlbum(red);
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(removed[0][1].toInt(), redRow);
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(rowOf(model, red), -1);
+
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+    const int greenRow = rowOf(model, green);
+    QCOMPARE(greenRow, 2);
+    model.data(model.index(greenRow), Qt::DecorationRole);
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(changed[0][0].value<QModelIndex>().row(), greenRow);
+    QCOMPARE(coverColour(model, greenRow), QColor(Qt::green));
+
+    model.removeAlbum(red); // already gone
+    QCOMPARE(removed.count(), 1);
+}
+
+void TestAlbumModel::testRefreshPicksUpNewCover()
+{
+    AlbumModel model;
+    model.setAlbums(DbManager::instance().albums());
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+    const QString blue = library.path("blue");
+    const int row = rowOf(model, blue);
+    model.data(model.index(row), Qt::DecorationRole);
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(coverColour(model, row), QColor(Qt::blue));
+
+    // new art, new mtime and so a new thumbnail key
+    QVERIFY(writeCover(blue, Qt::yellow));
+    {
+        QFile cover(blue + "/cover.png");
+        QVERIFY(cover.open(QIODevice::ReadWrite));
+        QVERIFY(cover.setFileTime(QDateTime::currentDateTime().addSecs(60), QFileDevice::FileModificationTime));
+    }
+
+    model.refreshAlbum(blue);
+    QCOMPARE(changed.count(), 2); // straight away, so the view asks again
+    model.data(model.index(row), Qt::DecorationRole);
+    QTRY_COMPARE(changed.count(), 3);
+    QCOMPARE(coverColour(model, row), QColor(Qt::yellow));
+
+    model.refreshAlbum(library.path("missing")); // not a row, nothing to say
+    QCOMPARE(changed.count(), 3);
+}
+
+QTEST_MAIN(TestAlbumModel)
+#include "test_albummodel.moc"
@@ -0,0 +1,380 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include "../src/audioEngine.h"
+#include "../src/ringBuffer.h"
+#include "../src/audioDecoder.h"
+#include "testLibrary.h"
+
+// the engine on its null output, this test drives pull() the way QAudioSink would.
+// tracks are generated 16 bit stereo wavs where every frame has its own value, so any dropped,
+// repeated or padded frame shows up as a mismatch
+class TestAudioEngine : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testRingBuffer();
+    void testPlaysWholeTrack();
+    void testSeekIsSampleExact();
+    void testDecoderLimitAfterSeek();
+    void testNextTrackHasNoGap();
+    void testGainFollowsTrack();
+    void testUnderrunsCounted();
+    void testMissingFile();
+
+private:
+    static const int rate = 44100;
+    static const int chunkFrames = 441; // 10 ms pulls
+
+    static qint16 sampleAt(qint64 frame, int channel);
+    QString writeTrack(const QString &name, int frames, qint64 firstFrame);
+    AudioEngine::Options nullOptions(int bufferMs = 500);
+    QVector<qint16> drain(AudioEngine &engine, int maxFrames);
+    bool matches(const QVector<qint16> &samples, qint64 firstFrame);
+
+    QTemporaryDir dir;
+};
+
+qint16 TestAudioEngine::sampleAt(qint64 frame, int channel)
+{
+    qint16 value = qint16(frame % 32749 - 16374);
+    return channel == 0 ? value : qint16(-value);
+}
+
+QString TestAudioEngine::writeTrack(const QString &name, int frames, qint64 firstFrame)
+{
+    const QString path = dir.filePath(name);
+    const bool written = writeWav(path, rate, 2, frames, [firstFrame](qint64 frame, int channel)
+    {
+        return sampleAt(firstFrame + frame, channel);
+    });
+    return written ? path : QString();
+}
+
+AudioEngine::Options TestAudioEngine::nullOptions(int bufferMs)
+{
+    AudioEngine::Options options;
+    options.output = AudioEngine::Output::Null;
+    options.sampleRate = rate;
+    options.channels = 2;
+    options.bufferMs = bufferMs;
+    return options;
+}
+
+// pulls like an output would, but only once the decoder has a chunk ready (or is done), so nothing here
+// counts as an underrun. only the real audio pull() hands back is kept
+QVector<qint16> TestAudioEngine::drain(AudioEngine &engine, int maxFrames)
+{
+    QVector<qint16> collected;
+    qint16 chunk[chunkFrames * 2];
+
+    QElapsedTimer timer;
+    timer.start();
+    while (collected.size() / 2 < maxFrames && !engine.atEnd() && timer.elapsed() < 10000)
+    {
+        AudioEngine::Stats stats = engine.stats();
+        if (stats.bufferedFrames < chunkFrames && !stats.endDecoded)
+        {
+            QThread::msleep(1);
+            continue;
+        }
+
+        int got = engine.pull(chunk, qMin(chunkFrames, maxFrames - int(collected.size()) / 2));
+        for (int i = 0; i < got * 2; i++)
+        {
+            collected.append(chunk[i]);
+        }
+        engine.refresh();
+    }
+    return collected;
+}
+
+bool TestAudioEngine::matches(const QVector<qint16> &samples, qint64 firstFrame)
+{
+    for (int i = 0; i < samples.size(); i++)
+    {
+        if (samples[i] != sampleAt(firstFrame + i / 2, i % 2))
+        {
+            qWarning() << "first mismatch at frame" << firstFrame + i / 2;
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestAudioEngine::initTestCase()
+{
+    QVERIFY(dir.isValid());
+}
+
+void TestAudioEngine::testRingBuffer()
+{
+    RingBuffer<qint16> ring(1000);
+    QCOMPARE(ring.capacity(), size_t(1024));
+
+    // round after round so the copies wrap at every offset
+    qint16 in[300];
+    qint16 out[300];
+    for (int round = 0; round < 20; round++)
+    {
+        for (int i = 0; i < 300; i++)
+        {
+            in[i] = qint16(round * 300 + i);
+        }
+        QCOMPARE(ring.write(in, 300), size_t(300));
+        QCOMPARE(ring.readable(), size_t(300));
+        QCOMPARE(ring.read(out, 300), size_t(300));
+        QVERIFY(memcmp(in, out, sizeof(in)) == 0);
+    }
+
+    // full takes what fits, empty gives nothing
+    qint16 big[2000] = {};
+    QCOMPARE(ring.write(big, 2000), size_t(1024));
+    QCOMPARE(ring.writable(), size_t(0));
+    QCOMPARE(ring.write(in, 1), size_t(0));
+
+    size_t mark = ring.writePosition();
+    ring.skipTo(mark + 10); // past what was written, ignored
+    QCOMPARE(ring.readable(), size_t(1024));
+    ring.skipTo(mark);
+    QCOMPARE(ring.readable(), size_t(0));
+    QCOMPARE(ring.read(out, 10), size_t(0));
+}
+
+void TestAudioEngine::testPlaysWholeTrack()
+{
+    const int frames = rate * 3;
+    QString path = writeTrack("whole.wav", frames, 0);
+
+    AudioEngine engine(nullOptions());
+    QSignalSpy finished(&engine, &AudioEngine::finished);
+    QSignalSpy duration(&engine, &AudioEngine::durationChanged);
+
+    engine.open(path);
+    engine.play();
+
+    QVector<qint16> played = drain(engine, frames);
+    QCOMPARE(played.size(), frames * 2);
+    QVERIFY(matches(played, 0));
+
+    engine.refresh();
+    QVERIFY(engine.atEnd());
+    QCOMPARE(finished.size(), 1);
+    QVERIFY(!engine.isPlaying());
+    QVERIFY(!duration.isEmpty());
+    QVERIFY(qAbs(engine.duration() - 3000) <= 1);
+    QCOMPARE(engine.positionFrames(), qint64(frames));
+
+    AudioEngine::Stats stats = engine.stats();
+    QCOMPARE(stats.underruns, qint64(0));
+    QCOMPARE(stats.framesPlayed, qint64(frames));
+    QCOMPARE(stats.framesDecoded, qint64(frames));
+}
+
+void TestAudioEngine::testSeekIsSampleExact()
+{
+    const int frames = rate * 4;
+    QString path = writeTrack("seek.wav", frames, 0);
+
+    AudioEngine engine(nullOptions());
+    engine.open(path);
+    engine.seekFrame(54321);
+    engine.play();
+
+    QVector<qint16> played = drain(engine, 1000);
+    QCOMPARE(played.size(), 2000);
+    QVERIFY(matches(played, 54321));
+    QCOMPARE(engine.positionFrames(), qint64(54321 + 1000));
+
+    // while playing, nothing from before the seek may leak through
+    for (qint64 target : {qint64(101), qint64(frames - 500), qint64(rate * 2 + 7)})
+    {
+        engine.seekFrame(target);
+        QCOMPARE(engine.positionFrames(), target);
+
+        played = drain(engine, 400);
+        QCOMPARE(played.size(), 800);
+        QVERIFY(matches(played, target));
+    }
+
+    engine.seek(1000); // ms
+    played = drain(engine, 10);
+    QVERIFY(matches(played, rate));
+
+    QCOMPARE(engine.stats().underruns, qint64(0));
+}
+
+void TestAudioEngine::testDecoderLimitAfterSeek()
+{
+    // maxSeconds counts from where each read() starts, not from the top of the track
+    QString path = writeTrack("limit.wav", rate * 4, 0);
+
+    AudioDecoder decoder;
+    QVERIFY(decoder.open(path));
+    QVERIFY(decoder.seek(rate * 2));
+
+    QVector<qint16> collected;
+    AudioDecoder::Sink collect = [&](const qint16 *samples, int frames)
+    {
+        for (int i = 0; i < frames * 2; i++)
+        {
+            collected.append(samples[i]);
+        }
+        return true;
+    };
+
+    QVERIFY(decoder.read(collect, 0.5));
+    QCOMPARE(collected.size(), rate); // half a second, both channels
+    QVERIFY(matches(collected, rate * 2));
+    QCOMPARE(decoder.framesRead(), qint64(rate * 2 + rate / 2));
+
+    // and the next one carries on from there with its own limit
+    collected.clear();
+    QVERIFY(decoder.read(collect, 0.25));
+    QCOMPARE(collected.size(), rate / 2);
+    QVERIFY(matches(collected, rate * 2 + rate / 2));
+    QCOMPARE(decoder.framesRead(), qint64(rate * 2 + rate / 2 + rate / 4));
+}
+
+void TestAudioEngine::testNextTrackHasNoGap()
+{
+    // the second track carries on the first one's values, so a gapless join reads as one long track
+    const int first = 10000;
+    const int second = 8000;
+    QString a = writeTrack("a.wav", first, 0);
+    QString b = writeTrack("b.wav", second, first);
+
+    AudioEngine engine(nullOptions());
+    QSignalSpy trackChanged(&engine, &AudioEngine::trackChanged);
+    QSignalSpy finished(&engine, &AudioEngine::finished);
+
+    engine.open(a);
+    engine.setNext(b);
+    QCOMPARE(engine.nextPath(), b);
+    engine.play();
+
+    QVector<qint16> played = drain(engine, first + second);
+    QCOMPARE(played.size(), (first + second) * 2);
+    QVERIFY(matches(played, 0));
+
+    engine.refresh();
+    QCOMPARE(trackChanged.size(), 1);
+    QCOMPARE(trackChanged.first().first().toString(), b);
+    QCOMPARE(engine.currentPath(), b);
+    QCOMPARE(engine.positionFrames(), qint64(second));
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(engine.stats().underruns, qint64(0));
+
+    // changing the next after it was already decoded still ends up with the new one
+    QString c = writeTrack("c.wav", second, first);
+    engine.open(a);
+    engine.setNext(b);
+    engine.play();
+    played = drain(engine, 2000);
+    QVERIFY(matches(played, 0));
+
+    QTRY_VERIFY(engine.stats().endDecoded); // b is in the ring behind a by now
+    engine.setNext(c);
+    played += drain(engine, first + second);
+    QCOMPARE(played.size(), (first + second) * 2);
+    QVERIFY(matches(played, 0));
+    QCOMPARE(engine.currentPath(), c);
+}
+
+// each track plays at its own gain, switched on the first sample of the next one, not on the next refresh
+void TestAudioEngine::testGainFollowsTrack()
+{
+    const int first = 10000; // not a whole number of pulls, so the switch lands inside one
+    const int second = 8000;
+    QString a = writeTrack("gain-a.wav", first, 0);
+    QString b = writeTrack("gain-b.wav", second, first);
+
+    AudioEngine engine(nullOptions());
+    engine.open(a, 0.5f);
+    engine.setNext(b, 2.0f);
+    engine.play();
+
+    QVector<qint16> played = drain(engine, first + second);
+    QCOMPARE(played.size(), (first + second) * 2);
+    for (int i = 0; i < played.size(); i++)
+    {
+        const qint64 frame = i / 2;
+        const float scale = frame < first ? 0.5f : 2.0f;
+        const qint16 expected = qint16(qBound(-32768.0f, sampleAt(frame, i % 2) * scale, 32767.0f));
+        if (played[i] != expected)
+        {
+            QFAIL(qPrintable(QString("frame %1 played %2, expected %3").arg(frame).arg(played[i]).arg(expected)));
+        }
+    }
+
+    // changing the gain of what is already chained, and of what plays, both land
+    engine.open(a, 1.0f);
+    engine.setNext(b, 1.0f);
+    engine.play();
+    QTRY_VERIFY(engine.stats().endDecoded);
+    engine.setGain(0.5f);
+    engine.setNext(b, 0.25f);
+    QCOMPARE(engine.nextPath(), b); // same track, not decoded again
+
+    played = drain(engine, first + second);
+    QCOMPARE(played.size(), (first + second) * 2);
+    QCOMPARE(played[2], qint16(qBound(-32768.0f, sampleAt(1, 0) * 0.5f, 32767.0f)));
+    QCOMPARE(played.last(), qint16(qBound(-32768.0f, sampleAt(first + second - 1, 1) * 0.25f, 32767.0f)));
+}
+
+void TestAudioEngine::testUnderrunsCounted()
+{
+    QString path = writeTrack("underrun.wav", rate * 2, 0);
+
+    AudioEngine engine(nullOptions(100));
+    engine.open(path);
+    engine.play();
+
+    QVector<qint16> played = drain(engine, 100); // past the start, the ring refills behind it
+    QVERIFY(matches(played, 0));
+
+    AudioEngine::Stats stats = engine.stats();
+    QTRY_COMPARE((stats = engine.stats()).bufferedFrames, stats.capacityFrames);
+    QCOMPARE(stats.underruns, qint64(0));
+
+    // asking for more than the whole buffer in one go has to come up short
+    QVector<qint16> big((stats.capacityFrames + 1000) * 2);
+    int got = engine.pull(big.data(), stats.capacityFrames + 1000);
+    QVERIFY(got < stats.capacityFrames + 1000);
+
+    stats = engine.stats();
+    QCOMPARE(stats.underruns, qint64(1));
+    QCOMPARE(stats.silentFrames, qint64(stats.capacityFrames + 1000 - got));
+    QVERIFY(big[big.size() - 1] == 0);
+
+    // paused pulls are silence, not underruns
+    engine.pause();
+    QCOMPARE(engine.pull(big.data(), 100), 0);
+    QCOMPARE(engine.stats().underruns, qint64(1));
+}
+
+void TestAudioEngine::testMissingFile()
+{
+    AudioEngine engine(nullOptions());
+    QSignalSpy error(&engine, &AudioEngine::errorOccurred);
+    QSignalSpy finished(&engine, &AudioEngine::finished);
+
+    engine.open(dir.filePath("not-there.flac"));
+    engine.play();
+
+    QTRY_COMPARE(error.size(), 1);
+    QTRY_COMPARE(finished.size(), 1);
+    QVERIFY(engine.atEnd());
+
+    qint16 samples[200];
+    QCOMPARE(engine.pull(samples, 100), 0);
+    QCOMPARE(engine.stats().underruns, qint64(0));
+}
+
+QTEST_GUILESS_MAIN(TestAudioEngine)
+#include "test_audioengine.moc"
@@ -3,7 +3,10 @@
 #include <QFile>
 #include <QDir>
 #include <QElapsedTimer>
+#include <QTemporaryDir>
 #include "../src/audiofingerprint.h"
+#include "../src/acoustIdClient.h"
+#include "fakeAcoustIdServer.h"
 
 class TestAudioFingerprint : public QObject
 {
@@ -19,10 +22,18 @@ private slots:
     void testPerformance();
     void testMultipleFormats();
     void testDifferentQualities();
+    void testBatchedLookup();
+    void testLookupCache();
+    void testLookupRateLimit();
+    void testLookupMetadataOffline();
     void cleanupTestCase();
 
 private:
     AudioFingerprint* fingerprinter; // init
+    FakeAcoustIdServer acoustId;     // local stand in, only the offline lookup tests point the client at it
+    QTemporaryDir cacheDir;
+    QUrl realServer;
+    QList<AcoustIdReply *> lookupAll(const QList<QByteArray> &fingerprints);
     QString getTestFilePath(const QString& filename) const;
     QStringList setupTestFiles();
 };
@@ -31,13 +42,12 @@ void TestAudioFingerprint::initTestCase()
 {
     qDebug() << "Initializing AudioFingerprint test case";
     fingerprinter = new AudioFingerprint(this);
-    
-    // check if fpcalc is installed
-    QProcess checkProcess;
-    checkProcess.start("which", QStringList() << "fpcalc");
-    checkProcess.waitForFinished();
-    QVERIFY2(checkProcess.exitCode() == 0, "fpcalc is not installed, skipping tests");
 
+    // nothing from the test runs ends up in the users own acoustid cache
+    QVERIFY(cacheDir.isValid());
+    AcoustIdClient::instance().setCacheDirectory(cacheDir.path());
+    realServer = AcoustIdClient::instance().serverUrl();
+    
     // verify test directory exists
     QDir testDir("test_data");
     if (!testDir.exists()) {
@@ -350,6 +360,154 @@ void TestAudioFingerprint::testDifferentQualities()
     }
 }
 
+// queues every lookup in one go then waits them all out
+QList<AcoustIdReply *> TestAudioFingerprint::lookupAll(const QList<QByteArray> &fingerprints)
+{
+    QList<AcoustIdReply *> replies;
+    QList<QSharedPointer<QSignalSpy>> spies;
+    for (const QByteArray &fingerprint : fingerprints)
+    {
+        replies.append(AcoustIdClient::instance().lookup(fingerprint, 200));
+        spies.append(QSharedPointer<QSignalSpy>::create(replies.last(), &AcoustIdReply::finished));
+    }
+
+    for (const QSharedPointer<QSignalSpy> &spy : spies)
+    {
+        if (spy->count() == 0 && !spy->wait(10000))
+        {
+            qWarning() << "acoustid lookup never finished";
+        }
+    }
+    return replies;
+}
+
+void TestAudioFingerprint::testBatchedLookup()
+{
+    AcoustIdClient &client = AcoustIdClient::instance();
+    client.setServerUrl(acoustId.url());
+    client.setRateLimit(100);
+    client.setBatchSize(10);
+    acoustId.reset();
+
+    QList<QByteArray> fingerprints;
+    for (int i = 0; i < 45; i++)
+    {
+        fingerprints.append("batched-" + QByteArray::number(i));
+    }
+    fingerprints.append("unknown");
+    fingerprints.append("batched-3"); // asked twice, looked up once
+
+    QList<AcoustIdReply *> replies = lookupAll(fingerprints);
+
+    QCOMPARE(acoustId.requests, 5); // 46 distinct in tens
+    QCOMPARE(acoustId.lookups, 46);
+    QCOMPARE(acoustId.batchSizes.first(), 10);
+    QCOMPARE(acoustId.thresholds.count("0.35"), 5); // every request asks for the same minimum score
+
+    for (AcoustIdReply *reply : replies)
+    {
+        QCOMPARE(reply->error(), QNetworkReply::NoError);
+        QVERIFY(!reply->isFromCache());
+        if (reply->fingerprint() == "unknown")
+        {
+            QVERIFY(reply->results().isEmpty());
+        }
+        else
+        {
+            QCOMPARE(reply->results().size(), 1);
+            QCOMPARE(reply->results().first().toObject()["id"].toString(), QString::fromUtf8(reply->fingerprint())); // right answer for the right lookup
+        }
+        reply->deleteLater();
+    }
+
+    client.setServerUrl(realServer);
+}
+
+void TestAudioFingerprint::testLookupCache()
+{
+    AcoustIdClient &client = AcoustIdClient::instance();
+    client.setServerUrl(acoustId.url());
+    client.setRateLimit(100);
+    acoustId.reset();
+
+    // everything from testBatchedLookup is on disk now, unknown included
+    QList<AcoustIdReply *> replies = lookupAll({"batched-0", "batched-44", "unknown"});
+    QCOMPARE(acoustId.requests, 0);
+    for (AcoustIdReply *reply : replies)
+    {
+        QVERIFY(reply->isFromCache());
+        reply->deleteLater();
+    }
+    QCOMPARE(replies[1]->results().first().toObject()["id"].toString(), QString("batched-44"));
+
+    // same fingerprint, different duration is a different question
+    AcoustIdReply *other = client.lookup("batched-0", 201);
+    QSignalSpy done(other, &AcoustIdReply::finished);
+    QVERIFY(done.wait(10000));
+    QVERIFY(!other->isFromCache());
+    QCOMPARE(acoustId.requests, 1);
+    other->deleteLater();
+
+    client.setServerUrl(realServer);
+}
+
+void TestAudioFingerprint::testLookupRateLimit()
+{
+    AcoustIdClient &client = AcoustIdClient::instance();
+    client.setServerUrl(acoustId.url());
+    client.setRateLimit(3); // acoustids own limit
+    client.setBatchSize(1);
+    acoustId.reset();
+
+    QList<QByteArray> fingerprints;
+    for (int i = 0; i < 4; i++)
+    {
+        fingerprints.append("limited-" + QByteArray::number(i));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QList<AcoustIdReply *> replies = lookupAll(fingerprints);
+    qDebug() << "4 unbatched lookups at 3/s took" << timer.elapsed() << "ms";
+
+    QCOMPARE(acoustId.requests, 4);
+    for (int i = 1; i < acoustId.arrivals.size(); i++)
+    {
+        QVERIFY2(acoustId.arrivals[i] - acoustId.arrivals[i - 1] >= 300, "requests went out faster than 3 a second");
+    }
+    qDeleteAll(replies);
+
+    client.setBatchSize(20);
+    client.setServerUrl(realServer);
+}
+
+void TestAudioFingerprint::testLookupMetadataOffline()
+{
+    AcoustIdClient::instance().setServerUrl(acoustId.url());
+    AcoustIdClient::instance().setRateLimit(100);
+
+    fingerprinter->setFingerprint("offline-song");
+    fingerprinter->setDuration(180);
+
+    QSignalSpy metadataSpy(fingerprinter, &AudioFingerprint::metadataFound);
+    QSignalSpy errorSpy(fingerprinter, &AudioFingerprint::error);
+    fingerprinter->lookupMetadata();
+
+    QVERIFY(metadataSpy.wait(10000));
+    QCOMPARE(errorSpy.count(), 0);
+    QJsonArray results = metadataSpy.first().at(0).toJsonObject()["results"].toArray();
+    QCOMPARE(results.first().toObject()["id"].toString(), QString("offline-song"));
+
+    // nothing found comes out as the same error the single lookup gave
+    fingerprinter->setFingerprint("unknown");
+    fingerprinter->lookupMetadata();
+    QVERIFY(errorSpy.wait(10000));
+    QCOMPARE(errorSpy.first().at(0).toString(), QString("no results found"));
+
+    AcoustIdClient::instance().setServerUrl(realServer);
+    AcoustIdClient::instance().setRateLimit(3);
+}
+
 void TestAudioFingerprint::cleanupTestCase()
 {
     delete fingerprinter;
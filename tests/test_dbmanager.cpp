@@ -0,0 +1,143 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QThread>
+#include "../src/dbManager.h"
+
+class TestDbManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testWriteThenRead();
+    void testStatementIsCached();
+    void testReadsFromWorkerThread();
+    void testReadConnectionsAreQueryOnly();
+    void testReadersStartInWal();
+    void testFailedPrepareIsRemembered();
+    void testSelectInsideItsOwnRows();
+
+private:
+    QTemporaryDir tempDir;
+};
+
+void TestDbManager::initTestCase()
+{
+    QVERIFY(tempDir.isValid());
+    DbManager::instance().setDatabasePath(tempDir.path() + "/test_dbmanager.db");
+
+    QVERIFY(DbManager::instance().exec("CREATE TABLE albums (id INTEGER PRIMARY KEY, name TEXT, path TEXT)"));
+    QVERIFY(DbManager::instance().exec("CREATE TABLE songs (id INTEGER PRIMARY KEY, album_id INTEGER, name TEXT, artist TEXT, album TEXT, genre TEXT, path TEXT)"));
+
+    // the scanner's view resolves the tag ids, one straight over text columns is all the reads need here
+    QVERIFY(DbManager::instance().exec("CREATE VIEW song_details AS SELECT id, album_id, name, artist, album, genre, path FROM songs"));
+}
+
+void TestDbManager::testWriteThenRead()
+{
+    QVERIFY(DbManager::instance().exec("INSERT INTO albums (id, name, path) VALUES (?, ?, ?)", {1, "album", "/music/album"}));
+    QVERIFY(DbManager::instance().exec("INSERT INTO songs (id, album_id, name, artist, album, genre, path) VALUES (?, ?, ?, ?, ?, ?, ?)",
+                                       {7, 1, "song", "artist", "album", "rock", "/music/album/song.flac"}));
+
+    QCOMPARE(DbManager::instance().albums().size(), 1);
+
+    bool found = false;
+    SongRecord song = DbManager::instance().song(7, &found);
+    QVERIFY(found);
+    QCOMPARE(song.artist, QString("artist"));
+    QCOMPARE(song.albumId, qint64(1));
+
+    QCOMPARE(DbManager::instance().songsForAlbum(1).size(), 1);
+    QCOMPARE(DbManager::instance().songPath(7), QString("/music/album/song.flac"));
+
+    DbManager::instance().song(999, &found);
+    QVERIFY(!found);
+}
+
+void TestDbManager::testStatementIsCached()
+{
+    const QString sql = "SELECT path FROM songs WHERE id = ?";
+    QSqlQuery *first = DbManager::instance().cachedQuery(sql);
+    QVERIFY(first);
+    QCOMPARE(DbManager::instance().cachedQuery(sql), first);
+}
+
+void TestDbManager::testReadsFromWorkerThread()
+{
+    int workerAlbums = -1;
+    QSqlQuery *workerQuery = nullptr;
+    const QString sql = "SELECT id, name, path FROM albums";
+
+    QThread *worker = QThread::create([&]()
+    {
+        workerAlbums = DbManager::instance().albums().size();
+        workerQuery = DbManager::instance().cachedQuery(sql);
+    });
+    worker->start();
+    QVERIFY(worker->wait(5000));
+    delete worker;
+
+    QCOMPARE(workerAlbums, 1);
+    QVERIFY(workerQuery != DbManager::instance().cachedQuery(sql)); // own connection, own statements
+}
+
+void TestDbManager::testReadConnectionsAreQueryOnly()
+{
+    // writes have to go through the writer thread, a reader connection refuses them
+    QVERIFY(!DbManager::instance().select("DELETE FROM albums", {}, [](const QSqlQuery &) {}));
+    QCOMPARE(DbManager::instance().albums().size(), 1);
+}
+
+void TestDbManager::testReadersStartInWal()
+{
+    // a db nothing has written to yet, the first reader still switches it over
+    const QString path = DbManager::instance().databasePath();
+    DbManager::instance().setDatabasePath(tempDir.path() + "/fresh.db");
+
+    QString mode;
+    QVERIFY(DbManager::instance().select("PRAGMA journal_mode", {}, [&](const QSqlQuery &query)
+    {
+        mode = query.value(0).toString();
+    }));
+    QCOMPARE(mode, QString("wal"));
+
+    DbManager::instance().setDatabasePath(path);
+}
+
+void TestDbManager::testFailedPrepareIsRemembered()
+{
+    const QString sql = "SELECT value FROM later";
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("prepare failed"));
+    QVERIFY(!DbManager::instance().cachedQuery(sql));
+
+    // same schema, same answer, no second warning
+    QTest::failOnWarning(QRegularExpression("prepare failed"));
+    QVERIFY(!DbManager::instance().cachedQuery(sql));
+    QVERIFY(!DbManager::instance().select(sql, {}, [](const QSqlQuery &) {}));
+
+    // once the table is there it prepares
+    QVERIFY(DbManager::instance().exec("CREATE TABLE later (value INTEGER)"));
+    QVERIFY(DbManager::instance().cachedQuery(sql));
+}
+
+void TestDbManager::testSelectInsideItsOwnRows()
+{
+    QVERIFY(DbManager::instance().exec("INSERT INTO albums (id, name, path) VALUES (?, ?, ?)", {2, "other", "/music/other"}));
+
+    const QString sql = "SELECT id FROM albums ORDER BY id";
+    QList<qint64> outer;
+    int inner = 0;
+    QVERIFY(DbManager::instance().select(sql, {}, [&](const QSqlQuery &query)
+    {
+        outer.append(query.value(0).toLongLong());
+        QVERIFY(DbManager::instance().select(sql, {}, [&](const QSqlQuery &) { inner++; }));
+    }));
+
+    QCOMPARE(outer, QList<qint64>({1, 2})); // the inner select didnt reset the outer one
+    QCOMPARE(inner, 4);
+    QVERIFY(DbManager::instance().select(sql, {}, [](const QSqlQuery &) {})); // and the cached one is free again
+}
+
+QTEST_MAIN(TestDbManager)
+#include "test_dbmanager.moc"
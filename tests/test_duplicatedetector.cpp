@@ -0,0 +1,183 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QSet>
+#include "../src/duplicateDetector.h"
+
+class TestDuplicateDetector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testHammingDistance();
+    void testFindsReencodedCopies();
+    void testDifferentRecordingsStaySeparate();
+    void testDurationFilter();
+    void testLargeLibrary();
+
+private:
+    QVector<quint32> randomFingerprint(int frames);
+    QVector<quint32> reencode(const QVector<quint32> &original, double flipRate, int shift); // shift > 0 = copy starts later
+
+    QRandomGenerator random{20240611};
+};
+
+QVector<quint32> TestDuplicateDetector::randomFingerprint(int frames)
+{
+    QVector<quint32> fingerprint(frames);
+    for (quint32 &value : fingerprint)
+    {
+        value = random.generate();
+    }
+    return fingerprint;
+}
+
+QVector<quint32> TestDuplicateDetector::reencode(const QVector<quint32> &original, double flipRate, int shift)
+{
+    QVector<quint32> copy = shift > 0 ? randomFingerprint(shift) + original : original.mid(-shift);
+    for (quint32 &value : copy)
+    {
+        for (int bit = 0; bit < 32; bit++)
+        {
+            if (random.generateDouble() < flipRate)
+            {
+                value ^= 1u << bit;
+            }
+        }
+    }
+    return copy;
+}
+
+void TestDuplicateDetector::testHammingDistance()
+{
+    // every length so the simd body and the scalar tail both get hit
+    for (int count = 0; count < 40; count++)
+    {
+        QVector<quint32> a = randomFingerprint(count);
+        QVector<quint32> b = randomFingerprint(count);
+
+        qint64 expected = 0;
+        for (int i = 0; i < count; i++)
+        {
+            for (int bit = 0; bit < 32; bit++)
+            {
+                expected += ((a[i] ^ b[i]) >> bit) & 1;
+            }
+        }
+        QCOMPARE(DuplicateDetector::hammingDistance(a.constData(), b.constData(), count), expected);
+    }
+
+    QVector<quint32> same = randomFingerprint(16);
+    QCOMPARE(DuplicateDetector::bitErrorRate(same.constData(), same.constData(), same.size()), 0.0f);
+}
+
+void TestDuplicateDetector::testFindsReencodedCopies()
+{
+    DuplicateDetector detector;
+    QSet<QSet<qint64>> expected;
+    qint64 id = 1;
+
+    // five songs with two re-rips each, a few frames shifted either way
+    const int shifts[] = {0, 3, -2};
+    for (int song = 0; song < 5; song++)
+    {
+        QVector<quint32> original = randomFingerprint(300);
+        QSet<qint64> cluster;
+        for (int shift : shifts)
+        {
+            detector.add(id, shift == 0 ? original : reencode(original, 0.04, shift), 200);
+            cluster.insert(id++);
+        }
+        expected.insert(cluster);
+    }
+
+    for (int song = 0; song < 100; song++) // unrelated songs of the same length
+    {
+        detector.add(id++, randomFingerprint(300), 200);
+    }
+
+    DuplicateDetector::Stats stats;
+    QList<DuplicateDetector::Cluster> clusters = detector.findDuplicates(DuplicateDetector::Options(), &stats);
+
+    QCOMPARE(clusters.size(), 5);
+    QSet<QSet<qint64>> found;
+    for (const DuplicateDetector::Cluster &cluster : clusters)
+    {
+        found.insert(QSet<qint64>(cluster.songIds.begin(), cluster.songIds.end()));
+        QVERIFY(cluster.worstBitErrorRate < 0.15f);
+    }
+    QCOMPARE(found, expected);
+
+    // offsets come back as the shift between the two copies
+    for (const DuplicateDetector::Match &match : detector.findMatches())
+    {
+        int firstShift = shifts[(match.first - 1) % 3];
+        int secondShift = shifts[(match.second - 1) % 3];
+        QCOMPARE(match.offset, secondShift - firstShift);
+    }
+}
+
+void TestDuplicateDetector::testDifferentRecordingsStaySeparate()
+{
+    DuplicateDetector detector;
+    QVector<quint32> studio = randomFingerprint(300);
+    detector.add(1, studio, 180);
+    detector.add(2, reencode(studio, 0.35, 0), 180); // a live take shares shape, not bits
+
+    QVERIFY(detector.findDuplicates().isEmpty());
+}
+
+void TestDuplicateDetector::testDurationFilter()
+{
+    DuplicateDetector detector;
+    QVector<quint32> original = randomFingerprint(300);
+    detector.add(1, original, 180);
+    detector.add(2, reencode(original, 0.02, 0), 240); // same intro, much longer song (extended mix)
+
+    QVERIFY(detector.findDuplicates().isEmpty());
+
+    DuplicateDetector::Options options;
+    options.maxDurationDiff = 0;
+    QCOMPARE(detector.findDuplicates(options).size(), 1);
+}
+
+void TestDuplicateDetector::testLargeLibrary()
+{
+    const int count = 50000;
+    const int pairs = 100;
+
+    DuplicateDetector detector;
+    QList<QVector<quint32>> originals;
+    for (int i = 0; i < count; i++)
+    {
+        QVector<quint32> fingerprint = randomFingerprint(DuplicateDetector::storedFrames);
+        if (i < pairs)
+        {
+            originals.append(fingerprint);
+        }
+        detector.add(i + 1, fingerprint, 120 + i % 300);
+    }
+    for (int i = 0; i < pairs; i++)
+    {
+        detector.add(count + i + 1, reencode(originals[i], 0.03, i % 7 - 3), 120 + i % 300);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    DuplicateDetector::Stats stats;
+    QList<DuplicateDetector::Cluster> clusters = detector.findDuplicates(DuplicateDetector::Options(), &stats);
+    qDebug() << "duplicates over" << detector.size() << "songs took" << timer.elapsed() << "ms," << stats.postings << "postings,"
+             << stats.candidates << "candidates checked";
+
+    QCOMPARE(clusters.size(), pairs);
+    for (const DuplicateDetector::Cluster &cluster : clusters)
+    {
+        QCOMPARE(cluster.songIds.size(), 2);
+        QCOMPARE(cluster.songIds[1], cluster.songIds[0] + count);
+    }
+    QVERIFY(stats.candidates < qint64(pairs) * 10); // nowhere near all pairs
+}
+
+QTEST_MAIN(TestDuplicateDetector)
+#include "test_duplicatedetector.moc"
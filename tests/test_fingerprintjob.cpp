@@ -0,0 +1,319 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include <QThreadPool>
+#include <cmath>
+#include "../src/libScan.h"
+#include "../src/fingerprintJob.h"
+#include "../src/audiofingerprint.h"
+#include "../src/dbManager.h"
+#include "testLibrary.h"
+
+class TestFingerprintJob : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testFingerprintsWholeLibrary();
+    void testNothingLeftOnSecondRun();
+    void testResumesAfterInterruption();
+    void testChangedFilesAreRedone();
+    void testTouchedFileKeepsFingerprint();
+    void testGenerateUsesCache();
+    void testCacheBeforeJob();
+    void testGenerateAsync();
+    void testGenerateAsyncCancelled();
+    void testLongFileReadsOnlyPrefix();
+    void testCancelledBeforeStart();
+
+private:
+    bool writeTone(const QString &path, double frequency, int seconds);
+
+    TestLibrary library{"fingerprintjob"};
+    const int toneCount = 6;
+};
+
+// plain 16 bit stereo wav, different pitch per file so the fingerprints differ
+bool TestFingerprintJob::writeTone(const QString &path, double frequency, int seconds)
+{
+    const int rate = 22050;
+    return writeWav(path, rate, 2, qint64(rate) * seconds, [frequency](qint64 frame, int)
+    {
+        return qint16(8000 * std::sin(2 * M_PI * frequency * frame / rate) + 4000 * std::sin(2 * M_PI * frequency * 1.5 * frame / rate));
+    });
+}
+
+void TestFingerprintJob::initTestCase()
+{
+    QVERIFY(library.isValid());
+    for (int i = 0; i < toneCount; i++)
+    {
+        QString album = i % 2 ? "album two" : "album one";
+        QVERIFY(writeTone(library.path(QString("%1/tone%2.wav").arg(album).arg(i)), 220.0 + 110.0 * i, 12));
+    }
+    QVERIFY(library.addBroken("album two/broken.mp3")); // decoding it has to fail without stopping the job
+    QVERIFY(library.scan());
+}
+
+void TestFingerprintJob::testFingerprintsWholeLibrary()
+{
+    QAtomicInt reports = 0;
+
+    FingerprintJob::JobOptions options;
+    options.threadCount = 3;
+    options.maxInFlight = 2; // fewer slots than songs, the feeder has to wait on the writer
+    options.batchSize = 2;
+    options.progress = [&reports](const FingerprintJob::Progress &) { reports++; };
+
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), options, &result));
+
+    QCOMPARE(result.total, toneCount + 1);
+    QCOMPARE(result.done, toneCount + 1);
+    QCOMPARE(result.failed, 1);
+    QVERIFY(reports > 0); // the last one is always sent
+
+    QCOMPARE(library.rows("fingerprints"), toneCount + 1);
+    QCOMPARE(library.rows("fingerprints", "status = 0 AND fingerprint IS NOT NULL AND duration = 12"), toneCount);
+    QCOMPARE(library.rows("fingerprints", "status = 1 AND error IS NOT NULL"), 1);
+
+    QSqlQuery distinct(library.db());
+    QVERIFY(distinct.exec("SELECT COUNT(DISTINCT fingerprint) FROM fingerprints WHERE status = 0") && distinct.next());
+    QCOMPARE(distinct.value(0).toInt(), toneCount);
+}
+
+void TestFingerprintJob::testNothingLeftOnSecondRun()
+{
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result));
+    QCOMPARE(result.total, 0); // broken file isnt retried either
+
+    FingerprintJob::JobOptions retry;
+    retry.retryFailed = true;
+    QVERIFY(FingerprintJob::run(library.dbPath(), retry, &result));
+    QCOMPARE(result.total, 1);
+    QCOMPARE(result.failed, 1);
+}
+
+void TestFingerprintJob::testResumesAfterInterruption()
+{
+    // same as a job that got killed before its last batches were committed
+    QVERIFY(library.exec("DELETE FROM fingerprints WHERE song_id IN (SELECT song_id FROM fingerprints WHERE status = 0 ORDER BY song_id DESC LIMIT 3)"));
+    QCOMPARE(library.rows("fingerprints"), toneCount + 1 - 3);
+
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result));
+    QCOMPARE(result.total, 3);
+    QCOMPARE(result.done, 3);
+    QCOMPARE(library.rows("fingerprints"), toneCount + 1);
+}
+
+void TestFingerprintJob::testChangedFilesAreRedone()
+{
+    QString path = library.path("album one/tone0.wav");
+    QVERIFY(writeTone(path, 1000.0, 10));
+    QFile::setFileTime(path, QDateTime::currentDateTime().addSecs(60), QFileDevice::FileModificationTime);
+    QVERIFY(library.scan()); // picks up the new size/mtime
+
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result));
+    QCOMPARE(result.total, 1);
+    QCOMPARE(library.rows("fingerprints", "duration = 10"), 1);
+}
+
+void TestFingerprintJob::testTouchedFileKeepsFingerprint()
+{
+    QString path = library.path("album two/tone1.wav");
+    QFile::setFileTime(path, QDateTime::currentDateTime().addSecs(120), QFileDevice::FileModificationTime);
+    QVERIFY(library.scan());
+
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result));
+    QCOMPARE(result.total, 1);
+    QCOMPARE(result.reused, 1); // same bytes, nothing decoded
+    QCOMPARE(library.rows("fingerprints", "status = 0 AND raw IS NOT NULL AND content_hash IS NOT NULL"), toneCount);
+}
+
+void TestFingerprintJob::testGenerateUsesCache()
+{
+    DbManager::instance().setDatabasePath(library.dbPath());
+    auto flushWrites = []() { DbManager::instance().write([](QSqlDatabase &) { return true; }); };
+
+    QString path = library.path("album one/tone2.wav");
+    AudioFingerprint fingerprinter;
+
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(fingerprinter.isFromCache());
+    QCOMPARE(fingerprinter.getDuration(), 12);
+    QByteArray cached = fingerprinter.getFingerprint();
+
+    // touched without a rescan, the hash still matches
+    QFile::setFileTime(path, QDateTime::currentDateTime().addSecs(180), QFileDevice::FileModificationTime);
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(fingerprinter.isFromCache());
+    QCOMPARE(fingerprinter.getFingerprint(), cached);
+
+    // no row yet, decoded once then cached
+    QVERIFY(library.exec("DELETE FROM fingerprints WHERE song_id = (SELECT id FROM songs WHERE path LIKE '%tone2.wav')"));
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(!fingerprinter.isFromCache());
+    QCOMPARE(fingerprinter.getFingerprint(), cached);
+    flushWrites();
+
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(fingerprinter.isFromCache());
+
+    // rewritten with different audio, same everything else would be a stale hit
+    QVERIFY(writeTone(path, 3000.0, 12));
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(!fingerprinter.isFromCache());
+    QVERIFY(fingerprinter.getFingerprint() != cached);
+    flushWrites();
+
+    // not in the library, never cached
+    QString loose = library.tempPath() + "/loose.wav";
+    QVERIFY(QFile::copy(path, loose));
+    QVERIFY(fingerprinter.generateFingerprint(loose));
+    QVERIFY(!fingerprinter.isFromCache());
+    QVERIFY(fingerprinter.generateFingerprint(loose));
+    QVERIFY(!fingerprinter.isFromCache());
+}
+
+// a library no job has run on yet, and one whose fingerprints table is from before the cache columns
+void TestFingerprintJob::testCacheBeforeJob()
+{
+    TestLibrary fresh("fingerprintjob-fresh");
+    QVERIFY(fresh.isValid());
+    const QString path = fresh.path("album/first.wav");
+    QVERIFY(writeTone(path, 440.0, 12));
+
+    {
+        QSqlDatabase old = QSqlDatabase::addDatabase("QSQLITE", "fingerprintjob-old");
+        old.setDatabaseName(fresh.dbPath());
+        QVERIFY(old.open());
+        QSqlQuery query(old);
+        QVERIFY(query.exec("CREATE TABLE fingerprints (song_id INTEGER PRIMARY KEY, fingerprint TEXT, duration INTEGER, "
+                           "file_size INTEGER, file_mtime INTEGER, status INTEGER NOT NULL DEFAULT 0, error TEXT, created_at INTEGER)"));
+    }
+    QSqlDatabase::removeDatabase("fingerprintjob-old");
+
+    QVERIFY(fresh.scan());
+    QCOMPARE(fresh.rows("fingerprints", "raw IS NULL AND content_hash IS NULL"), 0); // -1 if the columns were missing
+
+    DbManager::instance().setDatabasePath(fresh.dbPath());
+    AudioFingerprint fingerprinter;
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(!fingerprinter.isFromCache());
+    DbManager::instance().write([](QSqlDatabase &) { return true; });
+
+    QVERIFY(fingerprinter.generateFingerprint(path));
+    QVERIFY(fingerprinter.isFromCache());
+    QCOMPARE(fresh.rows("fingerprints", "raw IS NOT NULL AND content_hash IS NOT NULL"), 1);
+
+    DbManager::instance().setDatabasePath(library.dbPath());
+}
+
+void TestFingerprintJob::testGenerateAsync()
+{
+    DbManager::instance().setDatabasePath(library.dbPath());
+    QVERIFY(library.exec("DELETE FROM fingerprints WHERE song_id = (SELECT id FROM songs WHERE path LIKE '%tone3.wav')"));
+
+    AudioFingerprint fingerprinter;
+    QSignalSpy progress(&fingerprinter, &AudioFingerprint::fingerprintProgress);
+    QSignalSpy generated(&fingerprinter, &AudioFingerprint::fingerprintGenerated);
+    QSignalSpy failed(&fingerprinter, &AudioFingerprint::error);
+
+    fingerprinter.generateFingerprintAsync(library.path("album two/tone3.wav"));
+    QVERIFY(fingerprinter.isGenerating());
+    QVERIFY(generated.wait(10000));
+
+    QVERIFY(!fingerprinter.isGenerating());
+    QVERIFY(!fingerprinter.isFromCache());
+    QVERIFY(!fingerprinter.getFingerprint().isEmpty());
+    QCOMPARE(fingerprinter.getDuration(), 12);
+    QVERIFY(progress.count() > 0);
+    QVERIFY(progress.last().at(0).toInt() <= 99);
+    QCOMPARE(failed.count(), 0);
+
+    fingerprinter.generateFingerprintAsync(library.tempPath() + "/missing.wav");
+    QVERIFY(failed.wait(10000));
+    QVERIFY(fingerprinter.getFingerprint().isEmpty());
+}
+
+void TestFingerprintJob::testGenerateAsyncCancelled()
+{
+    DbManager::instance().setDatabasePath(library.dbPath());
+    QVERIFY(library.exec("DELETE FROM fingerprints WHERE song_id = (SELECT id FROM songs WHERE path LIKE '%tone4.wav')"));
+    QString path = library.path("album one/tone4.wav");
+
+    AudioFingerprint fingerprinter;
+    QSignalSpy generated(&fingerprinter, &AudioFingerprint::fingerprintGenerated);
+    QSignalSpy failed(&fingerprinter, &AudioFingerprint::error);
+
+    fingerprinter.generateFingerprintAsync(path);
+    fingerprinter.cancel();
+    QVERIFY(!fingerprinter.isGenerating());
+
+    // nothing comes back from a cancelled run, not even the "cancelled" failure
+    QThreadPool::globalInstance()->waitForDone();
+    QCoreApplication::processEvents();
+    QCOMPARE(generated.count(), 0);
+    QCOMPARE(failed.count(), 0);
+
+    // the one started after a cancel is the one that answers
+    fingerprinter.generateFingerprintAsync(path);
+    fingerprinter.generateFingerprintAsync(path);
+    QVERIFY(generated.wait(10000));
+    QThreadPool::globalInstance()->waitForDone();
+    QCoreApplication::processEvents();
+    QCOMPARE(generated.count(), 1);
+
+    // owner gone mid decode (page closed), the worker must not touch it
+    AudioFingerprint *leaving = new AudioFingerprint;
+    leaving->generateFingerprintAsync(path);
+    delete leaving;
+    QThreadPool::globalInstance()->waitForDone();
+    QCoreApplication::processEvents();
+}
+
+void TestFingerprintJob::testLongFileReadsOnlyPrefix()
+{
+    // same audio for the first two minutes, one over three times as long as the other (stand in for a dj mix)
+    QString shortPath = library.tempPath() + "/prefix_short.wav";
+    QString longPath = library.tempPath() + "/prefix_long.wav";
+    QVERIFY(writeTone(shortPath, 440.0, 150));
+    QVERIFY(writeTone(longPath, 440.0, 480));
+
+    AudioFingerprint::FingerprintData shortData;
+    AudioFingerprint::FingerprintData longData;
+    QVERIFY(AudioFingerprint::fingerprintFile(shortPath, &shortData));
+    QVERIFY(AudioFingerprint::fingerprintFile(longPath, &longData));
+
+    QCOMPARE(longData.duration, 480); // from the header, not from decoding it all
+    QCOMPARE(longData.raw, shortData.raw);
+
+    // 120s of 22050hz stereo 16 bit plus a little io buffer slack, nowhere near the 85mb file
+    const qint64 prefixBytes = qint64(AudioFingerprint::fingerprintSeconds) * 22050 * 2 * 2;
+    qDebug() << "read" << longData.bytesRead << "of" << QFileInfo(longPath).size() << "bytes";
+    QVERIFY(longData.bytesRead < prefixBytes + 1024 * 1024);
+    QVERIFY(qAbs(longData.bytesRead - shortData.bytesRead) < 1024 * 1024);
+}
+
+void TestFingerprintJob::testCancelledBeforeStart()
+{
+    QVERIFY(library.exec("DELETE FROM fingerprints"));
+
+    std::atomic<bool> cancel(true);
+    FingerprintJob::Progress result;
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result, &cancel));
+    QCOMPARE(result.total, toneCount + 1);
+    QCOMPARE(result.done, 0);
+    QCOMPARE(library.rows("fingerprints"), 0); // next run picks all of it up
+
+    QVERIFY(FingerprintJob::run(library.dbPath(), FingerprintJob::JobOptions(), &result));
+    QCOMPARE(result.done, toneCount + 1);
+}
+
+QTEST_MAIN(TestFingerprintJob)
+#include "test_fingerprintjob.moc"
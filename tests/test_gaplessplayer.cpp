@@ -0,0 +1,180 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include "../src/gaplessPlayer.h"
+#include "../src/playQueue.h"
+#include "../src/audioEngine.h"
+#include "testLibrary.h"
+
+// the player on the native backend with the engine's null output, pulled here the way QAudioSink would.
+// every track carries on the previous one's sample values, so a queue played without a gap reads back as
+// one long track and any dropped, repeated or padded frame between them is a mismatch
+class TestGaplessPlayer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testQueuePlaysWithoutGap();
+    void testChangedNextIsFollowed();
+
+private:
+    static const int rate = 44100;
+    static const int chunkFrames = 441; // 10 ms pulls
+
+    static qint16 sampleAt(qint64 frame, int channel);
+    QString writeTrack(const QString &name, int frames, qint64 firstFrame);
+    AudioEngine::Options nullOptions();
+    QVector<qint16> drain(GaplessPlayer &player, int maxFrames);
+    bool matches(const QVector<qint16> &samples, qint64 firstFrame);
+
+    QTemporaryDir dir;
+};
+
+qint16 TestGaplessPlayer::sampleAt(qint64 frame, int channel)
+{
+    qint16 value = qint16(frame % 32749 - 16374);
+    return channel == 0 ? value : qint16(-value);
+}
+
+QString TestGaplessPlayer::writeTrack(const QString &name, int frames, qint64 firstFrame)
+{
+    const QString path = dir.filePath(name);
+    const bool written = writeWav(path, rate, 2, frames, [firstFrame](qint64 frame, int channel)
+    {
+        return sampleAt(firstFrame + frame, channel);
+    });
+    return written ? path : QString();
+}
+
+AudioEngine::Options TestGaplessPlayer::nullOptions()
+{
+    AudioEngine::Options options;
+    options.output = AudioEngine::Output::Null;
+    options.sampleRate = rate;
+    options.channels = 2;
+    return options;
+}
+
+// pulls while the player is playing, but only once the decoder has a chunk ready (or is done), so nothing
+// here is an underrun of the test's making. refresh() after each pull is what moves the player and queue on
+QVector<qint16> TestGaplessPlayer::drain(GaplessPlayer &player, int maxFrames)
+{
+    AudioEngine *engine = player.audioEngine();
+    QVector<qint16> collected;
+    qint16 chunk[chunkFrames * 2];
+
+    QElapsedTimer timer;
+    timer.start();
+    while (collected.size() / 2 < maxFrames && player.playbackState() == QMediaPlayer::PlayingState && timer.elapsed() < 10000)
+    {
+        AudioEngine::Stats stats = engine->stats();
+        if (stats.bufferedFrames < chunkFrames && !stats.endDecoded)
+        {
+            QThread::msleep(1);
+            continue;
+        }
+
+        int got = engine->pull(chunk, qMin(chunkFrames, maxFrames - int(collected.size()) / 2));
+        for (int i = 0; i < got * 2; i++)
+        {
+            collected.append(chunk[i]);
+        }
+        engine->refresh();
+    }
+    return collected;
+}
+
+bool TestGaplessPlayer::matches(const QVector<qint16> &samples, qint64 firstFrame)
+{
+    for (int i = 0; i < samples.size(); i++)
+    {
+        if (samples[i] != sampleAt(firstFrame + i / 2, i % 2))
+        {
+            qWarning() << "first mismatch at frame" << firstFrame + i / 2;
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestGaplessPlayer::initTestCase()
+{
+    QVERIFY(dir.isValid());
+}
+
+void TestGaplessPlayer::testQueuePlaysWithoutGap()
+{
+    // lengths that dont line up with the pulls, so the joins land inside one
+    const int lengths[] = {30000, 12345, 20000};
+    const int total = lengths[0] + lengths[1] + lengths[2];
+    QString a = writeTrack("a.wav", lengths[0], 0);
+    QString b = writeTrack("b.wav", lengths[1], lengths[0]);
+    QString c = writeTrack("c.wav", lengths[2], lengths[0] + lengths[1]);
+
+    PlayQueue queue;
+    GaplessPlayer player(&queue, GaplessPlayer::Backend::Native, nullptr, nullOptions());
+    QVERIFY(player.audioEngine());
+    QCOMPARE(player.lastHandoffUs(), qint64(-1));
+
+    QSignalSpy trackChanged(&player, &GaplessPlayer::trackChanged);
+    QSignalSpy finished(&player, &GaplessPlayer::queueFinished);
+
+    queue.setTracks({a, b, c});
+    QCOMPARE(player.currentPath(), a);
+    QVERIFY(player.nextReady()); // b is set up to follow before a starts
+    player.play();
+    QCOMPARE(player.playbackState(), QMediaPlayer::PlayingState);
+
+    QVector<qint16> played = drain(player, total);
+    QCOMPARE(played.size(), total * 2);
+    QVERIFY(matches(played, 0));
+
+    QCOMPARE(trackChanged.size(), 3);
+    QCOMPARE(trackChanged.at(1).first().toString(), b);
+    QCOMPARE(trackChanged.at(2).first().toString(), c);
+    QCOMPARE(queue.currentIndex(), 2);
+    QCOMPARE(player.currentPath(), c);
+
+    QCOMPARE(player.lastHandoffUs(), qint64(0)); // not a single silent sample at either join
+    QCOMPARE(player.audioEngine()->stats().lastGapFrames, qint64(0));
+    QCOMPARE(player.audioEngine()->stats().underruns, qint64(0));
+
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(player.playbackState(), QMediaPlayer::StoppedState);
+}
+
+// the queue changes while the old next is already decoded behind the current track, the new one plays instead
+void TestGaplessPlayer::testChangedNextIsFollowed()
+{
+    const int first = 30000;
+    const int second = 15000;
+    QString a = writeTrack("change-a.wav", first, 0);
+    QString b = writeTrack("change-b.wav", second, 0); // would show up as a mismatch if it played
+    QString c = writeTrack("change-c.wav", second, first);
+
+    PlayQueue queue;
+    GaplessPlayer player(&queue, GaplessPlayer::Backend::Native, nullptr, nullOptions());
+    QSignalSpy trackChanged(&player, &GaplessPlayer::trackChanged);
+
+    queue.setTracks({a, b});
+    player.play();
+    QVector<qint16> played = drain(player, first - 5000);
+    QTRY_VERIFY(player.audioEngine()->stats().endDecoded); // a is decoded to its end and b is in the ring behind it
+
+    queue.remove(1);
+    queue.append({c});
+    QTRY_VERIFY(player.nextReady());
+
+    played += drain(player, first + second - int(played.size()) / 2);
+    QCOMPARE(played.size(), (first + second) * 2);
+    QVERIFY(matches(played, 0));
+    QCOMPARE(trackChanged.last().first().toString(), c);
+    QCOMPARE(player.lastHandoffUs(), qint64(0));
+}
+
+QTEST_GUILESS_MAIN(TestGaplessPlayer)
+#include "test_gaplessplayer.moc"
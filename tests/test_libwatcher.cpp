@@ -0,0 +1,188 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include <QElapsedTimer>
+#include "../src/libWatcher.h"
+#include "testLibrary.h"
+
+// the watcher on a scanned temp library. the timings are shrunk from the defaults so the run stays short,
+// the checks are the same: nothing syncs while events keep coming inside the quiet period, max wait
+// cuts a steady stream short, and every sync reports what it did through the album signals
+class TestLibWatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testAlbumAdded();
+    void testDebounce();
+    void testMaxWait();
+    void testNewDirIsWatched();
+    void testAlbumRemoved();
+    void testOverflowResync();
+
+private:
+    bool addSong(const QString &relative);
+    static bool reported(const QSignalSpy &spy, int pathArg, const QString &path);
+
+    TestLibrary library{"libwatcher"};
+    LibWatcher watcher; // after the library so it stops before the temp dir goes
+};
+
+bool TestLibWatcher::addSong(const QString &relative)
+{
+    return writeWav(library.path(relative), 8000, 1, 800, [](qint64, int) { return qint16(0); });
+}
+
+bool TestLibWatcher::reported(const QSignalSpy &spy, int pathArg, const QString &path)
+{
+    for (const QList<QVariant> &arguments : spy)
+    {
+        if (arguments.at(pathArg).toString() == path)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TestLibWatcher::initTestCase()
+{
+    QVERIFY(library.isValid());
+    QVERIFY(addSong("one/song.wav"));
+    QVERIFY(library.scan());
+
+    QCOMPARE(watcher.debounceMs, 750);
+    QCOMPARE(watcher.maxWaitMs, 5000);
+    watcher.debounceMs = 400;
+    watcher.maxWaitMs = 1200;
+
+    QVERIFY(!watcher.isWatching());
+    QVERIFY(watcher.start(library.musicPath(), library.dbPath()));
+    QVERIFY(watcher.isWatching());
+}
+
+void TestLibWatcher::testAlbumAdded()
+{
+    QSignalSpy added(&watcher, &LibWatcher::albumAdded);
+
+    QVERIFY(addSong("two/song.wav"));
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added[0][0].toString(), QString("two"));
+    QCOMPARE(added[0][1].toString(), library.path("two"));
+    QCOMPARE(library.rows("albums", QString("path = '%1'").arg(library.path("two"))), 1);
+}
+
+void TestLibWatcher::testDebounce()
+{
+    QSignalSpy updated(&watcher, &LibWatcher::albumUpdated);
+
+    // a song every 100 ms keeps restarting the quiet period, shorter than max wait so that doesnt kick in
+    for (int i = 0; i < 8; i++)
+    {
+        QVERIFY(addSong(QString("one/extra%1.wav").arg(i)));
+        QTest::qWait(100);
+        QCOMPARE(updated.count(), 0);
+    }
+
+    QElapsedTimer quiet;
+    quiet.start();
+    QTRY_COMPARE(updated.count(), 1);
+    QVERIFY(quiet.elapsed() >= watcher.debounceMs - 100); // the last wait above already counts toward it
+    QCOMPARE(updated[0][0].toString(), library.path("one"));
+    QCOMPARE(library.rows("songs", "path LIKE '%/one/%'"), 9); // one sync picked up the whole batch
+}
+
+void TestLibWatcher::testMaxWait()
+{
+    QSignalSpy updated(&watcher, &LibWatcher::albumUpdated);
+
+    // the stream never goes quiet, a sync has to happen anyway once max wait is up
+    QElapsedTimer streaming;
+    streaming.start();
+    int written = 0;
+    while (updated.isEmpty() && streaming.elapsed() < 4000)
+    {
+        QVERIFY(addSong(QString("one/stream%1.wav").arg(written++)));
+        QTest::qWait(100);
+    }
+
+    QCOMPARE(updated.count(), 1);
+    QVERIFY(streaming.elapsed() >= watcher.maxWaitMs);
+    QVERIFY(streaming.elapsed() < 4000);
+
+    // whatever came in during that sync goes in the next one
+    QTRY_VERIFY(library.rows("songs", "path LIKE '%/one/stream%'") == written);
+}
+
+void TestLibWatcher::testNewDirIsWatched()
+{
+    QSignalSpy added(&watcher, &LibWatcher::albumAdded);
+    QSignalSpy updated(&watcher, &LibWatcher::albumUpdated);
+    const QString fresh = library.musicPath() + "/fresh";
+
+    QVERIFY(QDir().mkpath(fresh));
+    QTRY_VERIFY(reported(added, 1, fresh)); // empty, but still an album row
+
+    // only the new dir's own watch sees this, the root doesnt get events for files a level down
+    QVERIFY(addSong("fresh/song.wav"));
+    QTRY_VERIFY(reported(updated, 0, fresh));
+    QCOMPARE(library.rows("songs", "path LIKE '%/fresh/%'"), 1);
+}
+
+void TestLibWatcher::testAlbumRemoved()
+{
+    QSignalSpy removed(&watcher, &LibWatcher::albumRemoved);
+    const QString two = library.path("two");
+
+    QVERIFY(QDir(two).removeRecursively());
+    QTRY_VERIFY(reported(removed, 0, two));
+    QCOMPARE(library.rows("albums", QString("path = '%1'").arg(two)), 0);
+    QCOMPARE(library.rows("songs", "path LIKE '%/two/%'"), 0);
+}
+
+void TestLibWatcher::testOverflowResync()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("inotify only");
+#else
+    QFile limitFile("/proc/sys/fs/inotify/max_queued_events");
+    if (!limitFile.open(QIODevice::ReadOnly))
+    {
+        QSKIP("inotify queue limit not readable");
+    }
+    const int limit = limitFile.readAll().trimmed().toInt();
+    if (limit <= 0 || limit > 65536)
+    {
+        QSKIP("inotify queue too long to overflow in a test");
+    }
+
+    QSignalSpy added(&watcher, &LibWatcher::albumAdded);
+    QSignalSpy updated(&watcher, &LibWatcher::albumUpdated);
+    QTest::ignoreMessage(QtWarningMsg, "inotify queue overflowed, resyncing library");
+
+    // the event loop doesnt run in here, so the kernel queue fills up. create, close write and delete
+    // are three events a file
+    const QString one = library.path("one");
+    for (int i = 0; i < limit / 2; i++)
+    {
+        QFile file(one + QString("/flood%1.tmp").arg(i));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+        QVERIFY(file.remove());
+    }
+
+    // the root's event for this is dropped, only the resync can find it
+    QVERIFY(addSong("late/song.wav"));
+    const QString late = library.path("late");
+    QTRY_VERIFY(reported(added, 1, late));
+
+    // and it got a watch on the way
+    QVERIFY(addSong("late/second.wav"));
+    QTRY_VERIFY(reported(updated, 0, late));
+    QCOMPARE(library.rows("songs", "path LIKE '%/late/%'"), 2);
+#endif
+}
+
+QTEST_GUILESS_MAIN(TestLibWatcher)
+#include "test_libwatcher.moc"
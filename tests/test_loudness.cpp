@@ -0,0 +1,283 @@
+#include <QtTest/QtTest>
+#include <cmath>
+#include "../src/loudness.h"
+#include "../src/loudnessJob.h"
+#include "../src/libScan.h"
+#include "../src/dbManager.h"
+#include "testLibrary.h"
+
+class TestLoudness : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testReferenceSine();
+    void testSilenceIsGated();
+    void testLoudnessRange();
+    void testTruePeak();
+    void testCombine();
+    void testPackRoundTrip();
+    void testGainDb();
+    void testAnalyseFile();
+    void testLibraryJob();
+
+private:
+    struct Segment
+    {
+        double seconds;
+        double levelDb; // sine amplitude in dBFS, below -200 is silence
+    };
+
+    static QVector<qint16> sine(int rate, int channels, const QList<Segment> &segments, double frequency = 1000, double phase = 0);
+    static Loudness::Result measure(int rate, int channels, const QVector<qint16> &samples);
+    bool writeSine(const QString &path, const QList<Segment> &segments);
+    double albumValue(const QString &albumDir, const QString &column);
+
+    TestLibrary library{"loudness"};
+    const int rate = 44100;
+};
+
+QVector<qint16> TestLoudness::sine(int rate, int channels, const QList<Segment> &segments, double frequency, double phase)
+{
+    QVector<qint16> samples;
+    qint64 frame = 0;
+    for (const Segment &segment : segments)
+    {
+        const double amplitude = segment.levelDb < -200 ? 0 : 32767 * std::pow(10.0, segment.levelDb / 20);
+        const qint64 frames = qint64(segment.seconds * rate);
+        for (qint64 i = 0; i < frames; i++, frame++)
+        {
+            const qint16 sample = qint16(std::lround(amplitude * std::sin(2 * M_PI * frequency * frame / rate + phase)));
+            for (int c = 0; c < channels; c++)
+            {
+                samples.append(sample);
+            }
+        }
+    }
+    return samples;
+}
+
+// fed in odd sized chunks so sub blocks never line up with them
+Loudness::Result TestLoudness::measure(int rate, int channels, const QVector<qint16> &samples)
+{
+    Loudness::Analyzer analyzer(channels, rate);
+    const int frames = samples.size() / channels;
+    for (int done = 0; done < frames; done += 1237)
+    {
+        analyzer.add(samples.constData() + qint64(done) * channels, qMin(1237, frames - done));
+    }
+    return analyzer.finish();
+}
+
+// 16 bit stereo 1kHz sine
+bool TestLoudness::writeSine(const QString &path, const QList<Segment> &segments)
+{
+    const QVector<qint16> samples = sine(rate, 2, segments);
+    return writeWav(path, rate, 2, samples.size() / 2, [&samples](qint64 frame, int channel)
+    {
+        return samples[frame * 2 + channel];
+    });
+}
+
+double TestLoudness::albumValue(const QString &albumDir, const QString &column)
+{
+    QSqlQuery query(library.db());
+    query.prepare(QString("SELECT a.%1 FROM album_loudness a JOIN albums b ON b.id = a.album_id WHERE b.path = ?").arg(column));
+    query.addBindValue(library.musicPath() + "/" + albumDir);
+    if (!query.exec() || !query.next())
+    {
+        return qQNaN();
+    }
+    return query.value(0).toDouble();
+}
+
+void TestLoudness::initTestCase()
+{
+    // one quiet album with a quieter and a louder song, one loud single
+    QVERIFY(library.isValid());
+    QVERIFY(writeSine(library.path("quiet/song0.wav"), {{8, -33}}));
+    QVERIFY(writeSine(library.path("quiet/song1.wav"), {{8, -23}}));
+    QVERIFY(writeSine(library.path("loud/song0.wav"), {{6, -6}}));
+    QVERIFY(library.addBroken("loud/broken.mp3")); // has to fail without stopping the job
+    QVERIFY(library.scan());
+}
+
+void TestLoudness::testReferenceSine()
+{
+    // EBU Tech 3341: a stereo 1kHz sine at -23 dBFS reads -23 LUFS, +-0.1
+    for (int sampleRate : {44100, 48000, 96000})
+    {
+        Loudness::Result result = measure(sampleRate, 2, sine(sampleRate, 2, {{20, -23}}));
+        QVERIFY2(std::abs(result.integrated + 23) < 0.1, qPrintable(QString("%1 Hz: %2 LUFS").arg(sampleRate).arg(result.integrated)));
+        QVERIFY(result.range < 0.1);
+        QVERIFY(std::abs(result.truePeak + 23) < 0.2);
+        QCOMPARE(result.frames, qint64(20) * sampleRate);
+    }
+
+    // mono counts as one channel, 3 dB under the same sine in stereo
+    Loudness::Result mono = measure(48000, 1, sine(48000, 1, {{20, -23}}));
+    QVERIFY(std::abs(mono.integrated + 26) < 0.1);
+}
+
+void TestLoudness::testSilenceIsGated()
+{
+    // the absolute gate drops the silence, the relative one the quiet stretch
+    Loudness::Result result = measure(48000, 2, sine(48000, 2, {{10, -23}, {10, -300}, {10, -23}, {5, -60}}));
+    QVERIFY2(std::abs(result.integrated + 23) < 0.1, qPrintable(QString::number(result.integrated)));
+
+    Loudness::Result silence = measure(48000, 2, sine(48000, 2, {{5, -300}}));
+    QCOMPARE(silence.integrated, Loudness::silenceLufs);
+    QCOMPARE(silence.range, 0.0);
+    QCOMPARE(Loudness::gainDb(silence.integrated, silence.truePeak), 0.0);
+}
+
+void TestLoudness::testLoudnessRange()
+{
+    // EBU Tech 3342 case 1 and 2: 20s at one level, 20s 10 (or 5) dB lower
+    Loudness::Result ten = measure(48000, 2, sine(48000, 2, {{20, -20}, {20, -30}}));
+    QVERIFY2(std::abs(ten.range - 10) < 1, qPrintable(QString::number(ten.range)));
+
+    Loudness::Result five = measure(48000, 2, sine(48000, 2, {{20, -20}, {20, -25}}));
+    QVERIFY2(std::abs(five.range - 5) < 1, qPrintable(QString::number(five.range)));
+}
+
+void TestLoudness::testTruePeak()
+{
+    // fs/4 at 45 degrees, every sample lands 3 dB under the real peak
+    const QVector<qint16> samples = sine(48000, 2, {{2, -6}}, 12000, M_PI / 4);
+    qint16 samplePeak = 0;
+    for (qint16 sample : samples)
+    {
+        samplePeak = qMax<qint16>(samplePeak, qAbs(sample));
+    }
+    const double samplePeakDb = 20 * std::log10(samplePeak / 32768.0);
+
+    Loudness::Result result = measure(48000, 2, samples);
+    QVERIFY2(std::abs(result.truePeak + 6) < 0.3, qPrintable(QString::number(result.truePeak)));
+    QVERIFY(result.truePeak > samplePeakDb + 2);
+}
+
+void TestLoudness::testCombine()
+{
+    // an album from its songs' histograms reads the same as the songs back to back
+    const QVector<qint16> first = sine(48000, 2, {{10, -20}});
+    const QVector<qint16> second = sine(48000, 2, {{15, -28}});
+
+    QList<Loudness::Result> tracks{measure(48000, 2, first), measure(48000, 2, second)};
+    Loudness::Result album = Loudness::combine(tracks);
+    Loudness::Result whole = measure(48000, 2, first + second);
+
+    QVERIFY2(std::abs(album.integrated - whole.integrated) < 0.05, qPrintable(QString("%1 vs %2").arg(album.integrated).arg(whole.integrated)));
+    QVERIFY(std::abs(album.range - whole.range) < 0.5);
+    QCOMPARE(album.truePeak, qMax(tracks[0].truePeak, tracks[1].truePeak));
+    QCOMPARE(album.frames, tracks[0].frames + tracks[1].frames);
+
+    QCOMPARE(Loudness::combine({}).integrated, Loudness::silenceLufs);
+}
+
+void TestLoudness::testPackRoundTrip()
+{
+    Loudness::Result result = measure(44100, 2, sine(44100, 2, {{10, -20}, {10, -35}}));
+    QCOMPARE(result.blocks.size(), int(Loudness::histogramBins));
+
+    const QVector<quint32> blocks = Loudness::unpackHistogram(Loudness::packHistogram(result.blocks));
+    QCOMPARE(blocks, result.blocks);
+    QCOMPARE(Loudness::integratedFrom(blocks), result.integrated);
+    QCOMPARE(Loudness::rangeFrom(Loudness::unpackHistogram(Loudness::packHistogram(result.shortTerm))), result.range);
+
+    QVERIFY(Loudness::unpackHistogram(QByteArray("not compressed")).isEmpty());
+}
+
+void TestLoudness::testGainDb()
+{
+    QCOMPARE(Loudness::gainDb(-23, -10), 5.0);  // up to the reference
+    QCOMPARE(Loudness::gainDb(-8, -0.5), -10.0); // down to it
+    QCOMPARE(Loudness::gainDb(-23, -3), 2.0);   // held back by the true peak ceiling
+    QCOMPARE(Loudness::gainDb(Loudness::silenceLufs, Loudness::silencePeak), 0.0);
+}
+
+void TestLoudness::testAnalyseFile()
+{
+    const QString path = library.tempPath() + "/sine.wav";
+    QVERIFY(writeSine(path, {{10, -23}}));
+
+    Loudness::Result result;
+    QString error;
+    qint64 bytesRead = 0;
+    QVERIFY2(Loudness::analyseFile(path, &result, &error, nullptr, &bytesRead), qPrintable(error));
+    QVERIFY(std::abs(result.integrated + 23) < 0.1);
+    QCOMPARE(result.frames, qint64(10) * rate);
+    QVERIFY(bytesRead >= result.frames * 4);
+
+    std::atomic<bool> cancel(true);
+    QVERIFY(!Loudness::analyseFile(path, &result, &error, &cancel));
+    QVERIFY(!Loudness::analyseFile(library.tempPath() + "/missing.wav", &result, &error));
+}
+
+void TestLoudness::testLibraryJob()
+{
+    // the scan made both tables, before the job a song just plays at unity without the lookup failing
+    QCOMPARE(library.rows("loudness"), 0);
+    QCOMPARE(library.rows("album_loudness"), 0);
+    DbManager::instance().setDatabasePath(library.dbPath());
+    QTest::failOnWarning(QRegularExpression("prepare failed|query failed"));
+    QCOMPARE(Loudness::gainFor(library.path("quiet/song0.wav"), Loudness::GainMode::Track), 1.0f);
+
+    LoudnessJob::JobOptions options;
+    options.threadCount = 2;
+    options.maxInFlight = 2;
+    options.batchSize = 2;
+
+    LoudnessJob::Progress result;
+    QVERIFY(LoudnessJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, 4);
+    QCOMPARE(result.done, 4);
+    QCOMPARE(result.failed, 1);
+    QCOMPARE(result.followUps, 2);
+
+    QCOMPARE(library.rows("loudness"), 4);
+    QCOMPARE(library.rows("loudness", "status = 0 AND blocks IS NOT NULL AND short_term IS NOT NULL"), 3);
+    QCOMPARE(library.rows("loudness", "status = 1 AND error IS NOT NULL"), 1);
+    QCOMPARE(library.rows("album_loudness"), 2);
+
+    // equal length songs 10 dB apart, the album sits at their average energy
+    const double quietAlbum = 10 * std::log10((std::pow(10.0, -3.3) + std::pow(10.0, -2.3)) / 2);
+    QVERIFY(std::abs(albumValue("quiet", "integrated") - quietAlbum) < 0.1);
+    QCOMPARE(albumValue("quiet", "songs"), 2.0);
+    QCOMPARE(albumValue("loud", "songs"), 1.0);
+
+    // nothing changed, nothing to do
+    QVERIFY(LoudnessJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, 0);
+    QCOMPARE(result.followUps, 0);
+
+    // playback's lookup, track and album gain out of the same rows
+    DbManager::instance().setDatabasePath(library.dbPath());
+    const QString quiet = library.path("quiet/song0.wav");
+    auto db = [](float gain)
+    {
+        return 20 * std::log10(double(gain));
+    };
+
+    QVERIFY(std::abs(db(Loudness::gainFor(quiet, Loudness::GainMode::Track)) - 15) < 0.1);
+    QVERIFY(std::abs(db(Loudness::gainFor(quiet, Loudness::GainMode::Album)) - (-18 - quietAlbum)) < 0.1);
+    QCOMPARE(Loudness::gainFor(quiet, Loudness::GainMode::Off), 1.0f);
+    QVERIFY(std::abs(db(Loudness::gainFor(library.path("loud/song0.wav"), Loudness::GainMode::Track)) - (-12)) < 0.1);
+    QCOMPARE(Loudness::gainFor(library.path("loud/broken.mp3"), Loudness::GainMode::Track), 1.0f);
+    QCOMPARE(Loudness::gainFor(library.tempPath() + "/not-in-library.wav", Loudness::GainMode::Album), 1.0f);
+
+    // a song leaves the album, the album is recombined from the one left without decoding anything
+    QVERIFY(QFile::remove(quiet));
+    QVERIFY(library.scan());
+    QVERIFY(LoudnessJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, 0);
+    QCOMPARE(result.followUps, 1);
+    QCOMPARE(library.rows("loudness"), 3);
+    QCOMPARE(albumValue("quiet", "songs"), 1.0);
+    QVERIFY(std::abs(albumValue("quiet", "integrated") + 23) < 0.1);
+}
+
+QTEST_GUILESS_MAIN(TestLoudness)
+#include "test_loudness.moc"
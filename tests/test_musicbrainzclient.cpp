@@ -0,0 +1,174 @@
+#include <QtTest/QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include "../src/musicBrainzClient.h"
+
+// bare bones http server, answers every GET with the path it was asked for
+class FakeServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    FakeServer()
+    {
+        connect(&server, &QTcpServer::newConnection, this, [this]()
+        {
+            while (QTcpSocket *socket = server.nextPendingConnection())
+            {
+                connections++;
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { answer(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+        server.listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url(const QString &path) const
+    {
+        return QUrl(QString("http://127.0.0.1:%1%2").arg(server.serverPort()).arg(path));
+    }
+
+    int requests = 0;
+    int connections = 0;
+    QList<qint64> arrivals; // ms on the test clock
+    QElapsedTimer clock;
+
+private:
+    void answer(QTcpSocket *socket)
+    {
+        buffers[socket] += socket->readAll();
+        QByteArray &buffer = buffers[socket];
+
+        int end;
+        while ((end = buffer.indexOf("\r\n\r\n")) >= 0)
+        {
+            QByteArray head = buffer.left(end);
+            buffer.remove(0, end + 4);
+
+            requests++;
+            arrivals.append(clock.elapsed());
+
+            QByteArray path = head.split(' ').value(1);
+            QByteArray body = "{\"path\":\"" + path + "\"}";
+            socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: " +
+                          QByteArray::number(body.size()) + "\r\n\r\n" + body);
+        }
+    }
+
+    QTcpServer server;
+    QHash<QTcpSocket *, QByteArray> buffers;
+};
+
+class TestMusicBrainzClient : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testDuplicatesShareOneRequest();
+    void testCacheAnswersRepeats();
+    void testRateLimitSpacesRequests();
+
+private:
+    static bool waitFor(QSignalSpy &finished);
+
+    QTemporaryDir cacheDir;
+    FakeServer server;
+};
+
+void TestMusicBrainzClient::initTestCase()
+{
+    QVERIFY(cacheDir.isValid());
+    MusicBrainzClient::instance().setCacheDirectory(cacheDir.path());
+    server.clock.start();
+}
+
+// finished is always queued, so a spy made right after get() can't miss it
+bool TestMusicBrainzClient::waitFor(QSignalSpy &finished)
+{
+    return finished.count() > 0 || finished.wait(5000);
+}
+
+void TestMusicBrainzClient::testDuplicatesShareOneRequest()
+{
+    MusicBrainzClient::instance().setRateLimit("127.0.0.1", 100, 10);
+    int before = server.requests;
+
+    MusicBrainzReply *first = MusicBrainzClient::instance().get(server.url("/shared"));
+    MusicBrainzReply *second = MusicBrainzClient::instance().get(server.url("/shared"));
+    QSignalSpy firstDone(first, &MusicBrainzReply::finished);
+    QSignalSpy secondDone(second, &MusicBrainzReply::finished);
+
+    QVERIFY(waitFor(firstDone));
+    QVERIFY(waitFor(secondDone));
+
+    QCOMPARE(first->error(), QNetworkReply::NoError);
+    QCOMPARE(first->readAll(), QByteArray("{\"path\":\"/shared\"}"));
+    QCOMPARE(second->readAll(), first->readAll());
+    QCOMPARE(server.requests - before, 1);
+
+    first->deleteLater();
+    second->deleteLater();
+}
+
+void TestMusicBrainzClient::testCacheAnswersRepeats()
+{
+    MusicBrainzClient::instance().setRateLimit("127.0.0.1", 100, 10);
+
+    MusicBrainzReply *fresh = MusicBrainzClient::instance().get(server.url("/cached"));
+    QSignalSpy freshDone(fresh, &MusicBrainzReply::finished);
+    QVERIFY(waitFor(freshDone));
+    QVERIFY(!fresh->isFromCache());
+    int afterFirst = server.requests;
+
+    MusicBrainzReply *repeat = MusicBrainzClient::instance().get(server.url("/cached"));
+    QSignalSpy repeatDone(repeat, &MusicBrainzReply::finished);
+    QVERIFY(waitFor(repeatDone));
+    QVERIFY(repeat->isFromCache());
+    QCOMPARE(repeat->readAll(), fresh->readAll());
+    QCOMPARE(server.requests, afterFirst);
+
+    fresh->deleteLater();
+    repeat->deleteLater();
+}
+
+void TestMusicBrainzClient::testRateLimitSpacesRequests()
+{
+    MusicBrainzClient::instance().setRateLimit("127.0.0.1", 10, 1); // one every 100ms
+    int before = server.requests;
+    int connectionsBefore = server.connections;
+
+    QList<MusicBrainzReply *> replies;
+    QList<QSharedPointer<QSignalSpy>> spies;
+    for (int i = 0; i < 4; i++)
+    {
+        replies.append(MusicBrainzClient::instance().get(server.url(QString("/limited/%1").arg(i))));
+        spies.append(QSharedPointer<QSignalSpy>::create(replies.last(), &MusicBrainzReply::finished));
+    }
+
+    QElapsedTimer loopCheck;
+    loopCheck.start();
+    QCoreApplication::processEvents(); // get() must hand straight back, the waiting happens on timers
+    QVERIFY(loopCheck.elapsed() < 50);
+
+    for (int i = 0; i < replies.size(); i++)
+    {
+        QVERIFY(waitFor(*spies[i]));
+        QCOMPARE(replies[i]->error(), QNetworkReply::NoError);
+        replies[i]->deleteLater();
+    }
+
+    QCOMPARE(server.requests - before, 4);
+    for (int i = before + 1; i < server.arrivals.size(); i++)
+    {
+        QVERIFY2(server.arrivals[i] - server.arrivals[i - 1] >= 80, "requests went out faster than the limit");
+    }
+
+    QVERIFY(server.connections - connectionsBefore <= 1); // kept alive between them
+}
+
+QTEST_MAIN(TestMusicBrainzClient)
+#include "test_musicbrainzclient.moc"
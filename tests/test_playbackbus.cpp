@@ -0,0 +1,191 @@
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include "../src/playbackBus.h"
+
+class TestPlaybackBus : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCoalesces();
+    void testFrameLimit();
+    void testNothingWhenNothingChanges();
+    void testOneSubscriptionPerListener();
+    void testPositionStep();
+};
+
+// a thousand position reports in one go come out as one snapshot with the last of them
+void TestPlaybackBus::testCoalesces()
+{
+    PlaybackBus bus;
+    QObject listener;
+
+    QList<PlaybackBus::State> states;
+    QList<PlaybackBus::Changes> changes;
+    bus.subscribe(&listener, [&](const PlaybackBus::State &state, PlaybackBus::Changes changed)
+    {
+        states.append(state);
+        changes.append(changed);
+    });
+    QCOMPARE(states.size(), 1); // the current state straight away
+    QCOMPARE(changes.first(), PlaybackBus::Changes(PlaybackBus::Everything));
+
+    bus.setTrack("/music/a.flac", "a");
+    bus.setDuration(180000);
+    bus.setPlaybackState(QMediaPlayer::PlayingState);
+    for (int position = 1; position <= 1000; position++)
+    {
+        bus.setPosition(position);
+    }
+    QCOMPARE(states.size(), 1); // nothing until the event loop runs
+
+    QTRY_COMPARE(states.size(), 2);
+    QCOMPARE(bus.publishCount(), qint64(1));
+    QCOMPARE(states.last().path, QString("/music/a.flac"));
+    QCOMPARE(states.last().title, QString("a"));
+    QCOMPARE(states.last().duration, qint64(180000));
+    QCOMPARE(states.last().position, qint64(1000));
+    QCOMPARE(states.last().playbackState, QMediaPlayer::PlayingState);
+    QCOMPARE(changes.last(), PlaybackBus::Changes(PlaybackBus::Everything));
+
+    // only what changed is flagged
+    bus.setPosition(2000);
+    QTRY_COMPARE(states.size(), 3);
+    QCOMPARE(changes.last(), PlaybackBus::Changes(PlaybackBus::Position));
+}
+
+// a player reporting every millisecond still only gets through about once a frame
+void TestPlaybackBus::testFrameLimit()
+{
+    const int fps = 20;
+    PlaybackBus bus(nullptr, fps);
+    QObject listener;
+    int calls = 0;
+    bus.subscribe(&listener, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+    {
+        calls++;
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 position = 0;
+    while (timer.elapsed() < 500)
+    {
+        bus.setPosition(++position);
+        QTest::qWait(1);
+    }
+    QTest::qWait(1000 / fps * 2); // let the last frame out
+
+    QVERIFY(bus.publishCount() >= 5);
+    QVERIFY2(bus.publishCount() <= 500 * fps / 1000 + 2, qPrintable(QString::number(bus.publishCount())));
+    QCOMPARE(calls, int(bus.publishCount()) + 1);
+    QCOMPARE(bus.state().position, position);
+}
+
+// paused or stopped nothing moves, and nothing is sent or even scheduled
+void TestPlaybackBus::testNothingWhenNothingChanges()
+{
+    PlaybackBus bus;
+    QObject listener;
+    int calls = 0;
+    bus.subscribe(&listener, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+    {
+        calls++;
+    });
+
+    bus.setPosition(5000);
+    QTRY_COMPARE(calls, 2);
+
+    for (int i = 0; i < 100; i++)
+    {
+        bus.setPosition(5000);
+        bus.setPlaybackState(QMediaPlayer::StoppedState);
+        bus.setTrack(QString(), QString());
+    }
+    QTest::qWait(100);
+    QCOMPARE(calls, 2);
+    QCOMPARE(bus.publishCount(), qint64(1));
+}
+
+void TestPlaybackBus::testOneSubscriptionPerListener()
+{
+    PlaybackBus bus;
+    int first = 0;
+    int second = 0;
+
+    {
+        QObject listener;
+        bus.subscribe(&listener, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+        {
+            first++;
+        });
+        bus.subscribe(&listener, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+        {
+            second++;
+        });
+        QCOMPARE(bus.subscriberCount(), 1);
+        QVERIFY(bus.isSubscribed(&listener));
+
+        bus.setPosition(100);
+        QTRY_COMPARE(second, 2);
+        QCOMPARE(first, 1); // the replaced callback never hears about it
+
+        bus.unsubscribe(&listener);
+        QCOMPARE(bus.subscriberCount(), 0);
+        bus.setPosition(200);
+        QTest::qWait(100);
+        QCOMPARE(second, 2);
+
+        bus.subscribe(&listener, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+        {
+            second++;
+        });
+        QCOMPARE(bus.subscriberCount(), 1);
+    }
+
+    // gone with the listener, nothing left to call into a dead object
+    QCOMPARE(bus.subscriberCount(), 0);
+    bus.setPosition(300);
+    QTest::qWait(100);
+    QCOMPARE(second, 3);
+}
+
+void TestPlaybackBus::testPositionStep()
+{
+    PlaybackBus bus;
+    QObject seconds;
+    QObject frames;
+    QList<qint64> secondPositions;
+    int frameCalls = 0;
+
+    bus.subscribe(&seconds, [&](const PlaybackBus::State &state, PlaybackBus::Changes changes)
+    {
+        if (changes & PlaybackBus::Position)
+        {
+            secondPositions.append(state.position);
+        }
+    }, 1000);
+    bus.subscribe(&frames, [&](const PlaybackBus::State &, PlaybackBus::Changes)
+    {
+        frameCalls++;
+    });
+
+    for (qint64 position : {300, 700, 999, 1000, 1500, 2100})
+    {
+        bus.setPosition(position);
+        QTRY_COMPARE(bus.state().position, position);
+        QTest::qWait(60); // a frame each
+    }
+
+    QCOMPARE(frameCalls, 7);
+    QCOMPARE(secondPositions, QList<qint64>({0, 1000, 2100}));
+
+    // something other than position still gets through without a new second
+    int before = secondPositions.size();
+    bus.setDuration(90000);
+    QTRY_COMPARE(bus.publishCount(), qint64(7));
+    QCOMPARE(secondPositions.size(), before);
+}
+
+QTEST_MAIN(TestPlaybackBus)
+#include "test_playbackbus.moc"
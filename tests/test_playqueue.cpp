@@ -0,0 +1,143 @@
+#include <QtTest/QtTest>
+#include <QSignalSpy>
+#include "../src/playQueue.h"
+
+class TestPlayQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSetTracks();
+    void testAdvanceAndPrevious();
+    void testAppendAndPlayNext();
+    void testRemove();
+    void testSignalsOnlyForChanges();
+};
+
+void TestPlayQueue::testSetTracks()
+{
+    PlayQueue queue;
+    QCOMPARE(queue.currentIndex(), -1);
+    QVERIFY(queue.current().isEmpty());
+
+    QSignalSpy current(&queue, &PlayQueue::currentChanged);
+    QSignalSpy next(&queue, &PlayQueue::nextChanged);
+
+    queue.setTracks({"a", "b", "c"}, 1);
+    QCOMPARE(queue.current(), QString("b"));
+    QCOMPARE(queue.next(), QString("c"));
+    QCOMPARE(current.size(), 1);
+    QCOMPARE(current.first().first().toString(), QString("b"));
+    QCOMPARE(next.size(), 1);
+
+    // picking the same song again has to restart it
+    queue.setTracks({"b"});
+    QCOMPARE(current.size(), 2);
+    QVERIFY(queue.next().isEmpty());
+
+    queue.setTracks({"a"}, 5); // out of range clamps
+    QCOMPARE(queue.current(), QString("a"));
+
+    queue.clear();
+    QCOMPARE(queue.currentIndex(), -1);
+    QVERIFY(current.last().first().toString().isEmpty());
+}
+
+void TestPlayQueue::testAdvanceAndPrevious()
+{
+    PlayQueue queue;
+    QVERIFY(!queue.advance());
+    QVERIFY(!queue.previous());
+
+    queue.setTracks({"a", "b"});
+    QVERIFY(!queue.previous());
+    QVERIFY(queue.advance());
+    QCOMPARE(queue.current(), QString("b"));
+    QVERIFY(queue.next().isEmpty());
+
+    QVERIFY(!queue.advance()); // the last track stays current
+    QCOMPARE(queue.current(), QString("b"));
+
+    QVERIFY(queue.previous());
+    QCOMPARE(queue.current(), QString("a"));
+}
+
+void TestPlayQueue::testAppendAndPlayNext()
+{
+    PlayQueue queue;
+    QSignalSpy current(&queue, &PlayQueue::currentChanged);
+
+    queue.append({"a"}); // empty queue starts on what was added
+    QCOMPARE(queue.current(), QString("a"));
+    QCOMPARE(current.size(), 1);
+
+    queue.append({"d", "e"});
+    queue.playNext({"b", "c"});
+    QCOMPARE(queue.tracks(), QStringList({"a", "b", "c", "d", "e"}));
+    QCOMPARE(queue.next(), QString("b"));
+    QCOMPARE(current.size(), 1); // still on a the whole time
+
+    queue.jumpTo(3);
+    queue.playNext({"x"});
+    QCOMPARE(queue.tracks(), QStringList({"a", "b", "c", "d", "x", "e"}));
+
+    queue.append(QStringList());
+    QCOMPARE(queue.size(), 6);
+}
+
+void TestPlayQueue::testRemove()
+{
+    PlayQueue queue;
+    queue.setTracks({"a", "b", "c", "d"}, 2);
+    QSignalSpy current(&queue, &PlayQueue::currentChanged);
+    QSignalSpy next(&queue, &PlayQueue::nextChanged);
+
+    queue.remove(0); // before current, index shifts but the song doesnt change
+    QCOMPARE(queue.current(), QString("c"));
+    QCOMPARE(queue.currentIndex(), 1);
+    QCOMPARE(current.size(), 0);
+
+    queue.remove(2); // the queued next song
+    QVERIFY(queue.next().isEmpty());
+    QCOMPARE(next.size(), 1);
+
+    queue.remove(1); // current and last, falls back to the one before
+    QCOMPARE(queue.current(), QString("b"));
+    QCOMPARE(current.size(), 1);
+
+    queue.remove(0);
+    QVERIFY(queue.isEmpty());
+    QCOMPARE(queue.currentIndex(), -1);
+    QCOMPARE(current.size(), 2);
+    QVERIFY(current.last().first().toString().isEmpty());
+
+    queue.remove(0); // nothing left, nothing happens
+    QCOMPARE(current.size(), 2);
+}
+
+// the player reloads on currentChanged and rewarms on nextChanged, neither should fire for nothing
+void TestPlayQueue::testSignalsOnlyForChanges()
+{
+    PlayQueue queue;
+    queue.setTracks({"a", "b", "c"});
+
+    QSignalSpy current(&queue, &PlayQueue::currentChanged);
+    QSignalSpy next(&queue, &PlayQueue::nextChanged);
+    QSignalSpy changed(&queue, &PlayQueue::queueChanged);
+
+    queue.append({"d"});
+    QCOMPARE(current.size(), 0);
+    QCOMPARE(next.size(), 0);
+    QCOMPARE(changed.size(), 1);
+
+    queue.jumpTo(0);
+    QCOMPARE(current.size(), 0);
+
+    queue.advance();
+    QCOMPARE(current.size(), 1);
+    QCOMPARE(next.size(), 1);
+    QCOMPARE(next.last().first().toString(), QString("c"));
+}
+
+QTEST_MAIN(TestPlayQueue)
+#include "test_playqueue.moc"
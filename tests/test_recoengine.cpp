@@ -0,0 +1,139 @@
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <cmath>
+#include "../src/recoEngine.h"
+
+class TestRecoEngine : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testTokenize();
+    void testIdfMatchesSklearn();
+    void testRanking();
+    void testArtistRecommendations();
+    void testUnknownSong();
+    void testLargeLibrary();
+
+private:
+    static SongRecord makeSong(qint64 id, const QString &name, const QString &artist, const QString &genre, const QString &album);
+};
+
+SongRecord TestRecoEngine::makeSong(qint64 id, const QString &name, const QString &artist, const QString &genre, const QString &album)
+{
+    SongRecord song;
+    song.id = id;
+    song.name = name;
+    song.artist = artist;
+    song.genre = genre;
+    song.album = album;
+    return song;
+}
+
+void TestRecoEngine::testTokenize()
+{
+    // lowercased, single chars and stop words dropped, punctuation splits
+    QCOMPARE(RecoEngine::tokenize("The Dark Side of the Moon"), QStringList({"dark", "moon"}));
+    QCOMPARE(RecoEngine::tokenize("AC/DC - Hells_Bells (1980) a"), QStringList({"ac", "dc", "hells_bells", "1980"}));
+    QCOMPARE(RecoEngine::tokenize("Björk"), QStringList({"björk"}));
+}
+
+void TestRecoEngine::testIdfMatchesSklearn()
+{
+    RecoEngine engine;
+    engine.build({makeSong(1, "alpha", "band", "rock", "record"),
+                  makeSong(2, "beta", "band", "rock", "record"),
+                  makeSong(3, "gamma", "other", "jazz", "tape")});
+
+    // idf = ln((1 + n) / (1 + df)) + 1
+    QVERIFY(std::abs(engine.idf("band") - float(std::log(4.0 / 3.0) + 1)) < 1e-6);
+    QVERIFY(std::abs(engine.idf("gamma") - float(std::log(4.0 / 2.0) + 1)) < 1e-6);
+    QCOMPARE(engine.idf("missing"), 0.0f);
+}
+
+void TestRecoEngine::testRanking()
+{
+    RecoEngine engine;
+    engine.build({makeSong(1, "intro", "band", "rock", "first record"),
+                  makeSong(2, "outro", "band", "rock", "first record"),
+                  makeSong(3, "ballad", "band", "rock", "second record"),
+                  makeSong(4, "tune", "someone", "jazz", "tape"),
+                  makeSong(5, "song", "nobody", "pop", "single")});
+
+    RecoEngine::Results results;
+    QVERIFY(engine.recommend(1, &results, 5, 3));
+    QCOMPARE(results.songs.size(), 3);
+
+    // same album beats same artist, nothing shared scores zero, the query song never shows up
+    QCOMPARE(results.songs[0].id, qint64(2));
+    QCOMPARE(results.songs[1].id, qint64(3));
+    QCOMPARE(results.songs[2].id, qint64(4)); // zero score, padded in library order
+    QVERIFY(results.songs[0].score > results.songs[1].score);
+    QCOMPARE(results.songs[2].score, 0.0f);
+
+    for (const RecoEngine::SongRecommendation &song : results.songs)
+    {
+        QVERIFY(song.id != 1);
+    }
+}
+
+void TestRecoEngine::testArtistRecommendations()
+{
+    RecoEngine engine;
+    engine.build({makeSong(1, "a1", "band", "rock", "x"),
+                  makeSong(2, "b1", "other", "jazz", "y"),
+                  makeSong(3, "c1", "third", "rock", "z"),
+                  makeSong(4, "c2", "third", "rock", "z")});
+
+    RecoEngine::Results results;
+    QVERIFY(engine.recommend(1, &results));
+    QCOMPARE(results.artists.size(), 1); // only same genre artists when there are any
+    QCOMPARE(results.artists[0].artist, QString("third"));
+
+    QVERIFY(engine.recommend(2, &results));
+    QCOMPARE(results.artists.size(), 2); // no other jazz artists, falls back to everyone
+    QCOMPARE(results.artists[0].artist, QString("band"));
+    QCOMPARE(results.artists[1].artist, QString("third"));
+}
+
+void TestRecoEngine::testUnknownSong()
+{
+    RecoEngine engine;
+    RecoEngine::Results results;
+    QVERIFY(!engine.recommend(1, &results));
+
+    engine.build({makeSong(1, "only", "band", "rock", "x")});
+    QVERIFY(!engine.recommend(42, &results));
+    QVERIFY(engine.recommend(1, &results));
+    QVERIFY(results.songs.isEmpty());
+}
+
+void TestRecoEngine::testLargeLibrary()
+{
+    // big enough that the old n x n matrix would have been ~10GB
+    const int count = 50000;
+    QList<SongRecord> library;
+    library.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        library.append(makeSong(i + 1, QString("track%1").arg(i), QString("artist%1").arg(i % 2000),
+                                QString("genre%1").arg(i % 40), QString("album%1").arg(i % 5000)));
+    }
+
+    RecoEngine engine;
+    engine.build(library);
+    QCOMPARE(engine.songCount(), count);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    RecoEngine::Results results;
+    QVERIFY(engine.recommend(1, &results));
+    qDebug() << "query over" << count << "songs took" << timer.elapsed() << "ms";
+
+    QCOMPARE(results.songs.size(), 10);
+    QCOMPARE(results.songs[0].album, QString("album0")); // shares album, artist and genre
+}
+
+QTEST_MAIN(TestRecoEngine)
+#include "test_recoengine.moc"
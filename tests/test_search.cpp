@@ -0,0 +1,300 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <sqlite3.h>
+#include <algorithm>
+#include "../src/libScan.h"
+#include "../src/searchIndex.h"
+#include "../src/dbManager.h"
+
+class TestSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testMatchExpression();
+    void testPrefixAsYouType();
+    void testTitleOutranksGenre();
+    void testAlbumsAndArtists();
+    void testDiacritics();
+    void testIndexFollowsWrites();
+    void testBackfillsOldDatabase();
+    void testLargeLibraryLatency();
+
+private:
+    void exec(const QString &sql);
+    qint64 addAlbum(const QString &name);
+    qint64 tagId(const char *table, const QString &name);
+    void addSong(qint64 albumId, const QString &name, const QString &artist, const QString &album, const QString &genre);
+    QStringList titles(const QString &text);
+
+    QTemporaryDir tempDir;
+    QString dbPath;
+    QString libraryPath;
+    sqlite3 *db = nullptr;
+    int songCount = 0;
+    QHash<QByteArray, QHash<QString, qint64>> tagIds;
+};
+
+void TestSearch::exec(const QString &sql)
+{
+    char *errMsg = nullptr;
+    int rc = sqlite3_exec(db, sql.toUtf8().constData(), nullptr, nullptr, &errMsg);
+    QVERIFY2(rc == SQLITE_OK, errMsg);
+}
+
+qint64 TestSearch::addAlbum(const QString &name)
+{
+    exec(QString("INSERT INTO albums (name, path) VALUES ('%1', '%2/%1')").arg(name, libraryPath));
+    return sqlite3_last_insert_rowid(db);
+}
+
+// same as the scanner, tags go in their own table once and songs point at them
+qint64 TestSearch::tagId(const char *table, const QString &name)
+{
+    QHash<QString, qint64> &ids = tagIds[table];
+    if (ids.contains(name))
+    {
+        return ids.value(name);
+    }
+
+    sqlite3_stmt *stmt;
+    const QByteArray sql = QString("INSERT INTO %1 (name) VALUES (?)").arg(table).toUtf8();
+    const QByteArray value = name.toUtf8();
+    if (sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, value.constData(), value.size(), SQLITE_TRANSIENT);
+    bool inserted = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+
+    qint64 id = inserted ? sqlite3_last_insert_rowid(db) : 0;
+    ids.insert(name, id);
+    return id;
+}
+
+void TestSearch::addSong(qint64 albumId, const QString &name, const QString &artist, const QString &album, const QString &genre)
+{
+    const qint64 ids[] = {tagId("artists", artist), tagId("album_titles", album), tagId("genres", genre)};
+
+    sqlite3_stmt *stmt;
+    QCOMPARE(sqlite3_prepare_v2(db, "INSERT INTO songs (album_id, name, artist_id, album_title_id, genre_id, path) VALUES (?, ?, ?, ?, ?, ?)", -1, &stmt, nullptr), SQLITE_OK);
+
+    QByteArray title = name.toUtf8();
+    QByteArray path = QString("%1/%2/%3.flac").arg(libraryPath, album).arg(songCount++).toUtf8();
+    sqlite3_bind_int64(stmt, 1, albumId);
+    sqlite3_bind_text(stmt, 2, title.constData(), title.size(), SQLITE_TRANSIENT);
+    for (int i = 0; i < 3; i++)
+    {
+        sqlite3_bind_int64(stmt, i + 3, ids[i]);
+    }
+    sqlite3_bind_text(stmt, 6, path.constData(), path.size(), SQLITE_TRANSIENT);
+    QCOMPARE(sqlite3_step(stmt), SQLITE_DONE);
+    sqlite3_finalize(stmt);
+}
+
+QStringList TestSearch::titles(const QString &text)
+{
+    QStringList names;
+    for (const SongRecord &song : SearchIndex::searchSongs(text))
+    {
+        names.append(song.name);
+    }
+    return names;
+}
+
+void TestSearch::initTestCase()
+{
+    QVERIFY(tempDir.isValid());
+    dbPath = tempDir.path() + "/library.db";
+    libraryPath = tempDir.path() + "/music";
+    QVERIFY(QDir().mkpath(libraryPath));
+
+    QVERIFY(LibScan::scanMusicLibrary(libraryPath, dbPath)); // empty library, just the schema
+    QCOMPARE(sqlite3_open(dbPath.toUtf8().constData(), &db), SQLITE_OK);
+    QVERIFY(LibScan::tableExists(db, "songs_fts"));
+
+    DbManager::instance().setDatabasePath(dbPath);
+
+    qint64 opera = addAlbum("A Night at the Opera");
+    addSong(opera, "Bohemian Rhapsody", "Queen", "A Night at the Opera", "Rock");
+    addSong(opera, "Love of My Life", "Queen", "A Night at the Opera", "Rock");
+
+    qint64 game = addAlbum("The Game");
+    addSong(game, "Another One Bites the Dust", "Queen", "The Game", "Rock");
+
+    qint64 kind = addAlbum("Kind of Blue");
+    addSong(kind, "So What", "Miles Davis", "Kind of Blue", "Jazz");
+    addSong(kind, "Blue in Green", "Miles Davis", "Kind of Blue", "Jazz");
+
+    qint64 jazz = addAlbum("Jazz");
+    addSong(jazz, "Mustapha", "Queen", "Jazz", "Rock");
+
+    qint64 lemonade = addAlbum("Lemonade");
+    addSong(lemonade, "Formation", "Beyoncé", "Lemonade", "R&B");
+}
+
+void TestSearch::cleanupTestCase()
+{
+    sqlite3_close(db);
+}
+
+void TestSearch::testMatchExpression()
+{
+    QCOMPARE(SearchIndex::matchExpression("bohemian rh"), QString("\"bohemian\" \"rh\"*"));
+    QCOMPARE(SearchIndex::matchExpression("queen", "artist"), QString("artist : \"queen\"*"));
+    QCOMPARE(SearchIndex::matchExpression("q"), QString("\"q\"")); // too short to be a prefix yet
+
+    // fts5 syntax typed by the user is just more words, never an error
+    QCOMPARE(SearchIndex::matchExpression("AND (\"x* OR"), QString("\"AND\" \"x\" \"OR\"*"));
+    QVERIFY(SearchIndex::matchExpression("  -*\"() ").isEmpty());
+    QVERIFY(SearchIndex::searchSongs("\"*(").isEmpty());
+}
+
+void TestSearch::testPrefixAsYouType()
+{
+    QCOMPARE(titles("bo"), QStringList({"Bohemian Rhapsody"}));
+    QCOMPARE(titles("bohemian rh"), QStringList({"Bohemian Rhapsody"}));
+    QCOMPARE(titles("rhapsody bohemian"), QStringList({"Bohemian Rhapsody"})); // word order doesnt matter
+    QVERIFY(titles("bohemian x").isEmpty());                                  // every word has to match
+    QCOMPARE(titles("QUEEN DUST"), QStringList({"Another One Bites the Dust"}));
+}
+
+void TestSearch::testTitleOutranksGenre()
+{
+    // "Jazz" is Queens album and Miles Davis's genre, the album tag counts for more than the genre
+    QStringList hits = titles("jazz");
+    QCOMPARE(hits.size(), 3);
+    QCOMPARE(hits.first(), QString("Mustapha"));
+
+    // a title match beats an album match
+    hits = titles("blue");
+    QCOMPARE(hits.first(), QString("Blue in Green"));
+    QCOMPARE(hits.size(), 2);
+}
+
+void TestSearch::testAlbumsAndArtists()
+{
+    QList<AlbumRecord> albums = SearchIndex::searchAlbums("opera");
+    QCOMPARE(albums.size(), 1);
+    QCOMPARE(albums.first().name, QString("A Night at the Opera"));
+    QCOMPARE(albums.first().path, libraryPath + "/A Night at the Opera");
+
+    QVERIFY(SearchIndex::searchAlbums("bohemian").isEmpty()); // only the album tag counts for albums
+
+    QList<SearchIndex::ArtistHit> artists = SearchIndex::searchArtists("que");
+    QCOMPARE(artists.size(), 1);
+    QCOMPARE(artists.first().name, QString("Queen"));
+    QCOMPARE(artists.first().songs, 4);
+
+    SearchIndex::Results results = SearchIndex::search("miles");
+    QCOMPARE(results.songs.size(), 2);
+    QCOMPARE(results.artists.size(), 1);
+    QVERIFY(results.albums.isEmpty());
+}
+
+void TestSearch::testDiacritics()
+{
+    QCOMPARE(titles("beyonce"), QStringList({"Formation"}));
+    QCOMPARE(titles("BEYONCÉ"), QStringList({"Formation"}));
+}
+
+void TestSearch::testIndexFollowsWrites()
+{
+    exec("UPDATE songs SET name = 'Bicycle Race' WHERE name = 'Mustapha'");
+    QCOMPARE(titles("bicycle"), QStringList({"Bicycle Race"}));
+    QVERIFY(titles("mustapha").isEmpty());
+
+    // moves (what a rescan does when a folder is renamed) leave the index alone and still resolve
+    exec("UPDATE songs SET path = path || '.moved' WHERE name = 'Bicycle Race'");
+    QVERIFY(SearchIndex::searchSongs("bicycle").first().path.endsWith(".moved"));
+
+    exec("DELETE FROM songs WHERE name = 'Bicycle Race'");
+    QVERIFY(titles("bicycle").isEmpty());
+
+    exec("INSERT INTO songs_fts (songs_fts) VALUES ('integrity-check')"); // index still agrees with songs
+}
+
+void TestSearch::testBackfillsOldDatabase()
+{
+    // a db from before the index, songs already in it
+    exec("DROP TRIGGER songs_fts_insert; DROP TRIGGER songs_fts_delete; DROP TRIGGER songs_fts_update; DROP TABLE songs_fts;");
+    addSong(addAlbum("News of the World"), "We Will Rock You", "Queen", "News of the World", "Rock");
+
+    // the watcher's sync runs the same schema setup, and with no dirs it leaves the fake rows alone
+    QVERIFY(LibScan::syncDirectories(libraryPath, dbPath, QStringList()));
+    QVERIFY(LibScan::tableExists(db, "songs_fts"));
+    QCOMPARE(titles("we will"), QStringList({"We Will Rock You"}));
+    QCOMPARE(titles("bohemian"), QStringList({"Bohemian Rhapsody"}));
+}
+
+void TestSearch::testLargeLibraryLatency()
+{
+    const int songs = qEnvironmentVariableIntValue("LAVENDER_SEARCH_SONGS") > 0 ? qEnvironmentVariableIntValue("LAVENDER_SEARCH_SONGS") : 500000;
+    const QStringList words = {"love", "night", "blue", "dream", "fire", "heart", "rain", "summer", "city", "light",
+                               "dance", "river", "shadow", "gold", "midnight", "road", "storm", "angel", "echo", "wild",
+                               "ocean", "silver", "ghost", "paradise", "thunder", "velvet", "crystal", "highway", "sugar", "winter"};
+    const QStringList genres = {"Rock", "Jazz", "Pop", "Electronic", "Hip Hop", "Classical", "Folk", "Metal"};
+
+    QRandomGenerator random(500);
+    auto phrase = [&](int count)
+    {
+        QStringList picked;
+        for (int i = 0; i < count; i++)
+        {
+            picked.append(words[random.bounded(words.size())]);
+        }
+        picked.append(QString::number(random.bounded(100000))); // keeps titles mostly distinct
+        return picked.join(' ');
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    exec("BEGIN");
+    for (int i = 0; i < songs; i += 12)
+    {
+        QString album = phrase(2);
+        qint64 albumId = addAlbum(album);
+        QString artist = phrase(1);
+        for (int track = 0; track < 12 && i + track < songs; track++)
+        {
+            addSong(albumId, phrase(3), artist, album, genres[random.bounded(genres.size())]);
+        }
+    }
+    exec("COMMIT");
+    exec("INSERT INTO songs_fts (songs_fts) VALUES ('optimize')"); // what the scanner does after a big scan
+    qDebug() << "indexed" << songs << "songs in" << timer.elapsed() << "ms";
+
+    const QStringList queries = {"mid", "midnight", "midnight th", "blue dr", "velvet ghost", "sum", "ocean storm an",
+                                 "highway 12", "crystal", "wild heart", "ech", "paradise sugar winter"};
+    QList<qint64> times;
+    for (int round = 0; round < 3; round++)
+    {
+        for (const QString &query : queries)
+        {
+            SearchIndex::Results results = SearchIndex::search(query);
+            times.append(results.elapsedUs);
+            if (round == 0)
+            {
+                QVERIFY2(!results.songs.isEmpty(), qPrintable(query));
+            }
+        }
+    }
+
+    std::sort(times.begin(), times.end());
+    qint64 median = times[times.size() / 2];
+    qint64 worst = times.last();
+    qDebug() << "search over" << songs << "songs: median" << median / 1000.0 << "ms, worst" << worst / 1000.0 << "ms";
+
+#ifdef QT_NO_DEBUG
+    QVERIFY2(median < 10000, "search slower than 10ms");
+#endif
+}
+
+QTEST_MAIN(TestSearch)
+#include "test_search.moc"
@@ -0,0 +1,205 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QDirIterator>
+#include <QImage>
+#include "../src/thumbnailCache.h"
+
+// the on disk cover cache: one decode makes all three sizes, later calls map the file, and the key is the
+// cover's path + mtime + size so an edited cover misses instead of showing the old art
+class TestThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testGeneratesEverySize();
+    void testSecondCallDoesntDecode();
+    void testCorruptEntryIsRegenerated();
+    void testTouchedCoverMisses();
+    void testNoArt();
+
+private:
+    bool writeCover(const QString &albumDir, const QColor &color, int size = 300);
+    QStringList entries() const;
+    QString entry(int size) const; // the one entry of that size, empty unless there is exactly one
+
+    QTemporaryDir tempDir;
+    QString albumDir;
+};
+
+bool TestThumbnailCache::writeCover(const QString &dir, const QColor &color, int size)
+{
+    QImage image(size, size, QImage::Format_RGB32);
+    image.fill(color);
+    return image.save(dir + "/cover.png");
+}
+
+QStringList TestThumbnailCache::entries() const
+{
+    QStringList found;
+    QDirIterator it(ThumbnailCache::instance().cacheDirectory(), {"*.thumb"}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        found.append(it.next());
+    }
+    return found;
+}
+
+QString TestThumbnailCache::entry(int size) const
+{
+    const QStringList sized = entries().filter(QString("_%1.thumb").arg(size));
+    return sized.size() == 1 ? sized.first() : QString();
+}
+
+void TestThumbnailCache::initTestCase()
+{
+    QVERIFY(tempDir.isValid());
+    albumDir = tempDir.filePath("album");
+    QVERIFY(QDir().mkpath(albumDir));
+    QVERIFY(writeCover(albumDir, Qt::red));
+
+    ThumbnailCache::instance().setCacheDirectory(tempDir.filePath("thumbnails"));
+}
+
+void TestThumbnailCache::testGeneratesEverySize()
+{
+    QCOMPARE(ThumbnailCache::findCoverArt(albumDir), albumDir + "/cover.png");
+    QVERIFY(entries().isEmpty());
+
+    QImage grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.size(), QSize(150, 150));
+    QCOMPARE(grid.pixelColor(75, 75), QColor(Qt::red));
+
+    // one decode wrote all three, the player size isnt blown up past the source
+    QCOMPARE(entries().size(), 3);
+    QCOMPARE(ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Album).size(), QSize(200, 200));
+    QCOMPARE(ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Player).size(), QSize(300, 300));
+    QCOMPARE(entries().size(), 3);
+
+    QFile file(entry(ThumbnailCache::Grid));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.read(4), QByteArray("LVT1"));
+}
+
+void TestThumbnailCache::testSecondCallDoesntDecode()
+{
+    // same path, size and mtime but bytes that wont decode: only a hit can still come back with the image
+    const QString cover = albumDir + "/cover.png";
+    const QFileInfo before(cover);
+    const QDateTime mtime = before.lastModified();
+    QByteArray original;
+    {
+        QFile file(cover);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        original = file.readAll();
+        file.seek(0);
+        file.write(QByteArray(original.size(), 'x'));
+    }
+    QFile touched(cover);
+    QVERIFY(touched.open(QIODevice::ReadWrite));
+    QVERIFY(touched.setFileTime(mtime, QFileDevice::FileModificationTime));
+    touched.close();
+    QCOMPARE(QFileInfo(cover).size(), before.size());
+
+    const QDateTime written = QFileInfo(entry(ThumbnailCache::Grid)).lastModified();
+    QImage grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.pixelColor(75, 75), QColor(Qt::red));
+    QCOMPARE(QFileInfo(entry(ThumbnailCache::Grid)).lastModified(), written);
+
+    // put the real cover back under the same key for the tests after this
+    QFile restore(cover);
+    QVERIFY(restore.open(QIODevice::WriteOnly));
+    restore.write(original);
+    QVERIFY(restore.flush()); // or closing would write it after the mtime is set
+    QVERIFY(restore.setFileTime(mtime, QFileDevice::FileModificationTime));
+}
+
+void TestThumbnailCache::testCorruptEntryIsRegenerated()
+{
+    const QString path = entry(ThumbnailCache::Grid);
+    QVERIFY(!path.isEmpty());
+
+    // wrong magic
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        file.write("JUNK");
+    }
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("corrupt thumbnail"));
+    QImage grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.pixelColor(75, 75), QColor(Qt::red));
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.read(4), QByteArray("LVT1"));
+    }
+
+    // right magic, rows cut short
+    grid = QImage(); // lets go of the mapping before the file shrinks under it
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.resize(file.size() / 2));
+    }
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("corrupt thumbnail"));
+    grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.size(), QSize(150, 150));
+    QCOMPARE(QFileInfo(path).size(), qint64(16 + 150 * 150 * 4));
+    QCOMPARE(entries().size(), 3);
+}
+
+void TestThumbnailCache::testTouchedCoverMisses()
+{
+    const QString cover = albumDir + "/cover.png";
+    const QStringList old = entries();
+    const QDateTime later = QDateTime::currentDateTime().addSecs(60); // differs even on filesystems with coarse timestamps
+
+    QVERIFY(writeCover(albumDir, Qt::blue));
+    {
+        QFile file(cover);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(later, QFileDevice::FileModificationTime));
+    }
+
+    QImage grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.pixelColor(75, 75), QColor(Qt::blue));
+    QCOMPARE(entries().size(), 6); // a new key, the old entries are just no longer asked for
+    for (const QString &path : old)
+    {
+        QVERIFY(entries().contains(path));
+    }
+
+    // a different file size on the same mtime is a different key too
+    QVERIFY(writeCover(albumDir, Qt::green, 320));
+    {
+        QFile file(cover);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(later, QFileDevice::FileModificationTime));
+    }
+    grid = ThumbnailCache::instance().thumbnail(albumDir, ThumbnailCache::Grid);
+    QCOMPARE(grid.pixelColor(75, 75), QColor(Qt::green));
+    QCOMPARE(entries().size(), 9);
+}
+
+void TestThumbnailCache::testNoArt()
+{
+    const QString bare = tempDir.filePath("bare");
+    QVERIFY(QDir().mkpath(bare));
+    QVERIFY(ThumbnailCache::findCoverArt(bare).isEmpty());
+    QVERIFY(ThumbnailCache::instance().thumbnail(bare, ThumbnailCache::Grid).isNull());
+
+    // there but not an image, nothing cached for it
+    QFile broken(bare + "/cover.jpg");
+    QVERIFY(broken.open(QIODevice::WriteOnly));
+    broken.write(QByteArray(1024, 'x'));
+    broken.close();
+
+    const int before = entries().size();
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("cover could not be decoded"));
+    QVERIFY(ThumbnailCache::instance().thumbnail(bare, ThumbnailCache::Grid).isNull());
+    QCOMPARE(entries().size(), before);
+}
+
+QTEST_GUILESS_MAIN(TestThumbnailCache)
+#include "test_thumbnailcache.moc"
@@ -0,0 +1,366 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include <climits>
+#include "../src/waveform.h"
+#include "../src/waveformJob.h"
+#include "../src/libScan.h"
+#include "../src/dbManager.h"
+#include "testLibrary.h"
+
+class TestWaveform : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testMinMaxMatchesScalar();
+    void testPeaksFollowSamples();
+    void testFoldsWhenLongerThanExpected();
+    void testPyramid();
+    void testPackRoundTrip();
+    void testFromFile();
+    void testLibraryJob();
+    void testCacheBeforeJob();
+
+private:
+    static qint16 sampleAt(qint64 frame);
+    static Waveform::Peak expectedPeak(qint64 first, qint64 last);
+    bool writeSquare(const QString &path, int frames, int quietFrames);
+
+    TestLibrary library{"waveform"};
+    const int rate = 22050;
+    const int songCount = 4;
+};
+
+// jumps around enough that every peak has its own min and max
+qint16 TestWaveform::sampleAt(qint64 frame)
+{
+    return qint16((frame * 7919) % 65536 - 32768) / qint16(1 + (frame / 5000) % 4);
+}
+
+Waveform::Peak TestWaveform::expectedPeak(qint64 first, qint64 last)
+{
+    qint16 low = SHRT_MAX;
+    qint16 high = SHRT_MIN;
+    for (qint64 i = first; i < last; i++)
+    {
+        low = qMin(low, sampleAt(i));
+        high = qMax(high, sampleAt(i));
+    }
+
+    Waveform::Peak peak;
+    peak.min = qint8(low >> 8);
+    peak.max = qint8(high >> 8);
+    return peak;
+}
+
+// 16 bit stereo, quiet for the first quietFrames then a loud square wave
+bool TestWaveform::writeSquare(const QString &path, int frames, int quietFrames)
+{
+    return writeWav(path, rate, 2, frames, [quietFrames](qint64 frame, int)
+    {
+        return qint16(frame < quietFrames ? 0 : ((frame / 50) % 2 ? 20000 : -20000));
+    });
+}
+
+void TestWaveform::initTestCase()
+{
+    QVERIFY(library.isValid());
+    for (int i = 0; i < songCount; i++)
+    {
+        QVERIFY(writeSquare(library.path(QString("album/song%1.wav").arg(i)), rate * (3 + i), rate));
+    }
+    QVERIFY(library.addBroken("album/broken.mp3")); // has to fail without stopping the job
+    QVERIFY(library.scan());
+}
+
+void TestWaveform::testMinMaxMatchesScalar()
+{
+    // every length and start offset around the vector widths, so each tail and unaligned load gets hit
+    QVector<qint16> samples(200);
+    for (qint16 &sample : samples)
+    {
+        sample = qint16(QRandomGenerator::global()->bounded(65536) - 32768);
+    }
+
+    for (int offset = 0; offset < 17; offset++)
+    {
+        for (int count = 0; count < 100; count++)
+        {
+            qint16 low = 100;
+            qint16 high = -100;
+            Waveform::minMax(samples.constData() + offset, count, &low, &high);
+
+            qint16 expectedLow = 100;
+            qint16 expectedHigh = -100;
+            for (int i = 0; i < count; i++)
+            {
+                expectedLow = qMin(expectedLow, samples[offset + i]);
+                expectedHigh = qMax(expectedHigh, samples[offset + i]);
+            }
+            QCOMPARE(low, expectedLow);
+            QCOMPARE(high, expectedHigh);
+        }
+    }
+
+    // the extremes survive too
+    qint16 edges[20] = {};
+    edges[13] = SHRT_MIN;
+    edges[18] = SHRT_MAX;
+    qint16 low = 0;
+    qint16 high = 0;
+    Waveform::minMax(edges, 20, &low, &high);
+    QCOMPARE(low, qint16(SHRT_MIN));
+    QCOMPARE(high, qint16(SHRT_MAX));
+}
+
+void TestWaveform::testPeaksFollowSamples()
+{
+    const qint64 frames = 300000;
+    Waveform::Builder builder(1, rate, frames);
+
+    // chunks that dont line up with the peaks
+    QVector<qint16> chunk(999);
+    for (qint64 done = 0; done < frames; done += chunk.size())
+    {
+        int count = int(qMin<qint64>(chunk.size(), frames - done));
+        for (int i = 0; i < count; i++)
+        {
+            chunk[i] = sampleAt(done + i);
+        }
+        builder.add(chunk.constData(), count);
+    }
+
+    Waveform waveform = builder.finish();
+    QVERIFY(!waveform.isNull());
+    QCOMPARE(waveform.frames(), frames);
+    QCOMPARE(waveform.framesPerPeak(), int(Waveform::minFramesPerPeak));
+
+    const QVector<Waveform::Peak> &base = waveform.level(0);
+    QCOMPARE(base.size(), int((frames + Waveform::minFramesPerPeak - 1) / Waveform::minFramesPerPeak));
+    for (int i = 0; i < base.size(); i++)
+    {
+        Waveform::Peak expected = expectedPeak(qint64(i) * Waveform::minFramesPerPeak, qMin(frames, qint64(i + 1) * Waveform::minFramesPerPeak));
+        QCOMPARE(base[i].min, expected.min);
+        QCOMPARE(base[i].max, expected.max);
+    }
+}
+
+void TestWaveform::testFoldsWhenLongerThanExpected()
+{
+    // no duration from the container, three times what fits at the finest resolution
+    const qint64 frames = qint64(Waveform::maxPeaks) * Waveform::minFramesPerPeak * 3;
+    Waveform::Builder builder(1, rate);
+
+    QVector<qint16> chunk(4096);
+    for (qint64 done = 0; done < frames; done += chunk.size())
+    {
+        for (int i = 0; i < chunk.size(); i++)
+        {
+            chunk[i] = sampleAt(done + i);
+        }
+        builder.add(chunk.constData(), chunk.size());
+    }
+
+    Waveform waveform = builder.finish();
+    const int framesPerPeak = Waveform::minFramesPerPeak * 4;
+    QCOMPARE(waveform.framesPerPeak(), framesPerPeak);
+    QCOMPARE(waveform.level(0).size(), int(frames / framesPerPeak));
+    QVERIFY(waveform.level(0).size() <= Waveform::maxPeaks);
+
+    // folded peaks still cover exactly their own stretch
+    const QVector<Waveform::Peak> &base = waveform.level(0);
+    for (int i = 0; i < base.size(); i += 97)
+    {
+        Waveform::Peak expected = expectedPeak(qint64(i) * framesPerPeak, qint64(i + 1) * framesPerPeak);
+        QCOMPARE(base[i].min, expected.min);
+        QCOMPARE(base[i].max, expected.max);
+    }
+}
+
+void TestWaveform::testPyramid()
+{
+    const qint64 frames = 1000000;
+    Waveform::Builder builder(1, rate, frames);
+    QVector<qint16> samples(frames);
+    for (qint64 i = 0; i < frames; i++)
+    {
+        samples[i] = sampleAt(i);
+    }
+    builder.add(samples.constData(), int(frames));
+    Waveform waveform = builder.finish();
+
+    QVERIFY(waveform.levelCount() > 1);
+    for (int i = 1; i < waveform.levelCount(); i++)
+    {
+        QCOMPARE(waveform.level(i).size(), (waveform.level(i - 1).size() + 1) / 2);
+    }
+    QVERIFY(waveform.level(waveform.levelCount() - 1).size() <= Waveform::topLevelPeaks);
+
+    Waveform::Peak whole = expectedPeak(0, frames);
+    QVector<Waveform::Peak> one = waveform.overview(1);
+    QCOMPARE(one.size(), 1);
+    QCOMPARE(one[0].min, whole.min);
+    QCOMPARE(one[0].max, whole.max);
+
+    // any width, every bucket is its own slice of the song
+    for (int width : {7, 300, 1001, 5000})
+    {
+        QVector<Waveform::Peak> buckets = waveform.overview(width);
+        QCOMPARE(buckets.size(), width);
+
+        qint8 low = 127;
+        qint8 high = -128;
+        for (const Waveform::Peak &peak : buckets)
+        {
+            QVERIFY(peak.min <= peak.max);
+            low = qMin(low, peak.min);
+            high = qMax(high, peak.max);
+        }
+        QCOMPARE(low, whole.min);
+        QCOMPARE(high, whole.max);
+    }
+
+    QVERIFY(Waveform().overview(100).isEmpty());
+}
+
+void TestWaveform::testPackRoundTrip()
+{
+    const qint64 frames = 500000;
+    Waveform::Builder builder(1, rate, frames);
+    QVector<qint16> samples(frames);
+    for (qint64 i = 0; i < frames; i++)
+    {
+        samples[i] = sampleAt(i);
+    }
+    builder.add(samples.constData(), int(frames));
+    Waveform waveform = builder.finish();
+
+    QByteArray packed = waveform.pack();
+    QVERIFY(!packed.isEmpty());
+
+    Waveform loaded;
+    QVERIFY(Waveform::unpack(packed, waveform.frames(), waveform.sampleRate(), waveform.framesPerPeak(), &loaded));
+    QCOMPARE(loaded.frames(), waveform.frames());
+    QCOMPARE(loaded.durationMs(), waveform.durationMs());
+    QCOMPARE(loaded.levelCount(), waveform.levelCount());
+    for (int level = 0; level < waveform.levelCount(); level++)
+    {
+        QCOMPARE(loaded.level(level).size(), waveform.level(level).size());
+        for (int i = 0; i < waveform.level(level).size(); i++)
+        {
+            QCOMPARE(loaded.level(level)[i].min, waveform.level(level)[i].min);
+            QCOMPARE(loaded.level(level)[i].max, waveform.level(level)[i].max);
+        }
+    }
+
+    Waveform broken;
+    QVERIFY(!Waveform::unpack(QByteArray("not compressed"), frames, rate, 256, &broken));
+    QVERIFY(broken.isNull());
+}
+
+void TestWaveform::testFromFile()
+{
+    const int frames = rate * 4;
+    const QString path = library.tempPath() + "/quiet-then-loud.wav";
+    QVERIFY(writeSquare(path, frames, frames / 2));
+
+    Waveform waveform;
+    QString error;
+    qint64 bytesRead = 0;
+    QVERIFY2(Waveform::fromFile(path, &waveform, &error, nullptr, &bytesRead), qPrintable(error));
+    QCOMPARE(waveform.frames(), qint64(frames));
+    QCOMPARE(waveform.sampleRate(), rate);
+    QCOMPARE(waveform.durationMs(), qint64(4000));
+    QVERIFY(bytesRead >= frames * 4);
+
+    // the first tenth is all inside the quiet half, the last all inside the loud one
+    QVector<Waveform::Peak> tenths = waveform.overview(10);
+    QCOMPARE(tenths[0].min, qint8(0));
+    QCOMPARE(tenths[0].max, qint8(0));
+    QCOMPARE(tenths[9].min, qint8(-20000 >> 8));
+    QCOMPARE(tenths[9].max, qint8(20000 >> 8));
+
+    // cancelled before it starts, nothing comes back
+    std::atomic<bool> cancel(true);
+    Waveform cancelled;
+    QVERIFY(!Waveform::fromFile(path, &cancelled, &error, &cancel));
+    QVERIFY(cancelled.isNull());
+
+    QVERIFY(!Waveform::fromFile(library.tempPath() + "/missing.wav", &cancelled, &error));
+}
+
+void TestWaveform::testLibraryJob()
+{
+    WaveformJob::JobOptions options;
+    options.threadCount = 2;
+    options.maxInFlight = 2;
+    options.batchSize = 2;
+
+    WaveformJob::Progress result;
+    QVERIFY(WaveformJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, songCount + 1);
+    QCOMPARE(result.done, songCount + 1);
+    QCOMPARE(result.failed, 1);
+    QVERIFY(result.framesDecoded > 0);
+
+    QCOMPARE(library.rows("waveforms"), songCount + 1);
+    QCOMPARE(library.rows("waveforms", "status = 0 AND peaks IS NOT NULL"), songCount);
+    QCOMPARE(library.rows("waveforms", "status = 1 AND error IS NOT NULL"), 1);
+
+    // nothing changed, nothing to do
+    QVERIFY(WaveformJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, 0);
+
+    // playback's lookup sees what the job stored
+    DbManager::instance().setDatabasePath(library.dbPath());
+    const QString path = library.path("album/song1.wav");
+
+    Waveform cached;
+    qint64 songId = 0;
+    QVERIFY(Waveform::readCache(path, &cached, &songId));
+    QVERIFY(songId > 0);
+    QCOMPARE(cached.frames(), qint64(rate * 4));
+
+    Waveform decoded;
+    QVERIFY(Waveform::fromFile(path, &decoded));
+    QCOMPARE(cached.level(0).size(), decoded.level(0).size());
+
+    // a touched file doesnt match its row any more, and the next run picks it up once the scan has the new stamp
+    QFile::setFileTime(path, QDateTime::currentDateTime().addSecs(60), QFileDevice::FileModificationTime);
+    QVERIFY(!Waveform::readCache(path, &cached));
+
+    QVERIFY(library.scan());
+    QVERIFY(WaveformJob::run(library.dbPath(), options, &result));
+    QCOMPARE(result.total, 1);
+    QVERIFY(Waveform::readCache(path, &cached));
+}
+
+// a library no job has run on yet, what playback sees the first time a song is played
+void TestWaveform::testCacheBeforeJob()
+{
+    TestLibrary fresh("waveform-fresh");
+    QVERIFY(fresh.isValid());
+    const QString path = fresh.path("album/first.wav");
+    QVERIFY(writeSquare(path, rate * 2, 0));
+    QVERIFY(fresh.scan());
+    QCOMPARE(fresh.rows("waveforms"), 0); // made by the scan, not by a job
+
+    DbManager::instance().setDatabasePath(fresh.dbPath());
+    Waveform cached;
+    qint64 songId = 0;
+    QVERIFY(!Waveform::readCache(path, &cached, &songId));
+    QVERIFY(songId > 0);
+
+    Waveform decoded;
+    QVERIFY(Waveform::fromFile(path, &decoded));
+    Waveform::writeCache(songId, path, decoded);
+    QVERIFY(DbManager::instance().write([](QSqlDatabase &) { return true; })); // queued behind the post
+
+    QVERIFY(Waveform::readCache(path, &cached));
+    QCOMPARE(cached.frames(), decoded.frames());
+}
+
+QTEST_GUILESS_MAIN(TestWaveform)
+#include "test_waveform.moc"